@@ -9,10 +9,48 @@
 #include "streams.h"
 #include "validation.h"
 
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
 namespace block_bench {
 #include "bench/data/block413567.raw.h"
 }
 
+// Count the heap allocations of the whole program, so that the benches below
+// can report those made to deserialize one block.
+static std::atomic<uint64_t> nAllocations{0};
+static std::atomic<uint64_t> nAllocatedBytes{0};
+
+void *operator new(size_t nSize) {
+    nAllocations.fetch_add(1, std::memory_order_relaxed);
+    nAllocatedBytes.fetch_add(nSize, std::memory_order_relaxed);
+    if (void *p = std::malloc(nSize)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+// Print, as a comment line of the output, the allocations made by one call to
+// read, which deserializes a block from the stream.
+template <typename Read>
+static void ReportAllocations(const char *pszName, CDataStream &stream,
+                              Read read) {
+    CBlock block;
+    uint64_t nAllocationsBefore = nAllocations;
+    uint64_t nBytesBefore = nAllocatedBytes;
+    read(stream, block);
+    std::cout << "# " << pszName << " allocations per block: "
+              << nAllocations - nAllocationsBefore << ", bytes: "
+              << nAllocatedBytes - nBytesBefore << "\n";
+    assert(stream.Rewind(sizeof(block_bench::block413567)));
+}
+
 // These are the two major time-sinks which happen after we have fully received
 // a block off the wire, but before we can relay the block on to peers using
 // compact block relay.
@@ -30,6 +68,31 @@ static void DeserializeBlockTest(benchmark::State &state) {
         stream >> block;
         assert(stream.Rewind(sizeof(block_bench::block413567)));
     }
+
+    ReportAllocations("DeserializeBlockTest", stream,
+                      [](CDataStream &s, CBlock &block) { s >> block; });
+}
+
+// Same as above, but reading the block in place from the stream buffer, the way
+// blocks received from the network are, so transactions are hashed over the
+// bytes they were read from instead of being serialized again.
+static void DeserializeBlockInPlaceTest(benchmark::State &state) {
+    CDataStream stream((const char *)block_bench::block413567,
+                       (const char *)&block_bench::block413567[sizeof(
+                           block_bench::block413567)],
+                       SER_NETWORK, PROTOCOL_VERSION);
+    char a;
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        stream.ReadInPlace(block);
+        assert(stream.Rewind(sizeof(block_bench::block413567)));
+    }
+
+    ReportAllocations(
+        "DeserializeBlockInPlaceTest", stream,
+        [](CDataStream &s, CBlock &block) { s.ReadInPlace(block); });
 }
 
 static void DeserializeAndCheckBlockTest(benchmark::State &state) {
@@ -54,4 +117,5 @@ static void DeserializeAndCheckBlockTest(benchmark::State &state) {
 }
 
 BENCHMARK(DeserializeBlockTest);
+BENCHMARK(DeserializeBlockInPlaceTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
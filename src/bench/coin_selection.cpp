@@ -4,8 +4,14 @@
 
 #include "bench.h"
 #include "chainparams.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "utilmoneystr.h"
 #include "wallet/wallet.h"
 
+#include <cmath>
+#include <iostream>
+#include <memory>
 #include <set>
 
 static void addCoin(const Amount nValue, const CWallet &wallet,
@@ -34,6 +40,7 @@ static void addCoin(const Amount nValue, const CWallet &wallet,
 // either for measurements."
 // (https://github.com/bitcoin/bitcoin/issues/7883#issuecomment-224807484)
 static void CoinSelection(benchmark::State &state) {
+    SelectParams(CBaseChainParams::REGTEST);
     const CWallet wallet(Params());
     std::vector<COutput> vCoins;
     LOCK(wallet.cs_wallet);
@@ -62,3 +69,83 @@ static void CoinSelection(benchmark::State &state) {
 }
 
 BENCHMARK(CoinSelection);
+
+// Number of outputs of each transaction of the generated pools of coins.
+static const size_t POOL_OUTPUTS_PER_TX = 1000;
+
+// Fill vCoins with nCoins confirmed coins of values spread evenly on a log
+// scale between 0.0001 and 0.1 BCH, as in a wallet which has received many
+// small payments. The same pool is generated for each size.
+static void CreateCoinPool(const CWallet &wallet, size_t nCoins,
+                           std::vector<std::unique_ptr<CWalletTx>> &vWtx,
+                           std::vector<COutput> &vCoins) {
+    FastRandomContext rand(true);
+    for (size_t i = 0; i < nCoins; i += POOL_OUTPUTS_PER_TX) {
+        CMutableTransaction tx;
+        tx.nLockTime = vWtx.size();
+        const size_t nOutputs = std::min(POOL_OUTPUTS_PER_TX, nCoins - i);
+        for (size_t j = 0; j < nOutputs; j++) {
+            double dExponent = 4 + 3 * (rand.rand32() / 4294967296.0);
+            tx.vout.emplace_back(Amount(int64_t(std::pow(10, dExponent))),
+                                 CScript());
+        }
+
+        vWtx.emplace_back(
+            new CWalletTx(&wallet, MakeTransactionRef(std::move(tx))));
+        for (size_t j = 0; j < nOutputs; j++) {
+            vCoins.emplace_back(vWtx.back().get(), j, 6 * 24,
+                                true /* spendable */, true /* solvable */,
+                                true /* safe */);
+        }
+    }
+}
+
+// Select 0.5 BCH out of a pool of nCoins small coins, allowing the excess
+// CreateTransaction allows to avoid change. The number of inputs selected is
+// reported after the timings.
+static void CoinSelectionPool(benchmark::State &state, const char *name,
+                              size_t nCoins) {
+    SelectParams(CBaseChainParams::REGTEST);
+    const CWallet wallet(Params());
+    std::vector<std::unique_ptr<CWalletTx>> vWtx;
+    std::vector<COutput> vCoins;
+    CreateCoinPool(wallet, nCoins, vWtx, vCoins);
+    const Amount nMaxExcess =
+        CTxOut(Amount(0), GetScriptForDestination(CKeyID()))
+            .GetDustThreshold(dustRelayFee) -
+        Amount(1);
+    LOCK(wallet.cs_wallet);
+
+    std::set<std::pair<const CWalletTx *, unsigned int>> setCoinsRet;
+    Amount nValueRet;
+    while (state.KeepRunning()) {
+        bool success =
+            wallet.SelectCoinsMinConf(COIN / 2, 1, 6, 0, vCoins, setCoinsRet,
+                                      nValueRet, nMaxExcess);
+        assert(success);
+    }
+
+    std::cout << "#" << name << " inputs," << setCoinsRet.size() << ","
+              << FormatMoney(nValueRet) << "\n";
+}
+
+static void CoinSelection1k(benchmark::State &state) {
+    CoinSelectionPool(state, "CoinSelection1k", 1000);
+}
+
+static void CoinSelection10k(benchmark::State &state) {
+    CoinSelectionPool(state, "CoinSelection10k", 10000);
+}
+
+static void CoinSelection100k(benchmark::State &state) {
+    CoinSelectionPool(state, "CoinSelection100k", 100000);
+}
+
+static void CoinSelection1M(benchmark::State &state) {
+    CoinSelectionPool(state, "CoinSelection1M", 1000000);
+}
+
+BENCHMARK(CoinSelection1k);
+BENCHMARK(CoinSelection10k);
+BENCHMARK(CoinSelection100k);
+BENCHMARK(CoinSelection1M);
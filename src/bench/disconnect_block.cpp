@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "undo.h"
+#include "validation.h"
+
+#include <cassert>
+#include <vector>
+
+static const int REORG_DEPTH = 100;
+static const int TXS_PER_BLOCK = 200;
+
+/**
+ * A chain of REORG_DEPTH blocks, each made of transactions with two inputs
+ * and two outputs, connected on top of a set of initial coins, along with the
+ * serialized undo data of every block.
+ */
+struct ReorgSetup {
+    CCoinsView coinsDummy;
+    CCoinsViewCache tip;
+    std::vector<CBlock> vBlocks;
+    std::vector<CBlockIndex> vIndex;
+    std::vector<std::vector<char>> vUndo;
+
+    ReorgSetup() : tip(&coinsDummy), vIndex(REORG_DEPTH) {
+        // Initial coins, spent by the first block.
+        std::vector<COutPoint> vAvailable;
+        CMutableTransaction funding;
+        funding.vin.resize(1);
+        funding.vout.resize(2 * TXS_PER_BLOCK);
+        for (auto &txout : funding.vout) {
+            txout.nValue = Amount(1000);
+            txout.scriptPubKey = CScript() << OP_TRUE;
+        }
+        const CTransaction fundingTx(funding);
+        AddCoins(tip, fundingTx, 1);
+        for (uint32_t i = 0; i < funding.vout.size(); i++) {
+            vAvailable.emplace_back(fundingTx.GetId(), i);
+        }
+
+        for (int nHeight = 2; nHeight < REORG_DEPTH + 2; nHeight++) {
+            CBlock block;
+            CMutableTransaction coinbase;
+            coinbase.vin.resize(1);
+            coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+            coinbase.vout.resize(1);
+            coinbase.vout[0].nValue = Amount(50);
+            coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+            block.vtx.push_back(MakeTransactionRef(coinbase));
+
+            CBlockUndo blockundo;
+            std::vector<COutPoint> vNext;
+            for (int i = 0; i < TXS_PER_BLOCK; i++) {
+                CMutableTransaction tx;
+                tx.vin.resize(2);
+                tx.vin[0].prevout = vAvailable[2 * i];
+                tx.vin[1].prevout = vAvailable[2 * i + 1];
+                tx.vout.resize(2);
+                for (auto &txout : tx.vout) {
+                    txout.nValue = Amount(1000);
+                    txout.scriptPubKey = CScript() << OP_TRUE;
+                }
+                const CTransaction txConst(tx);
+                blockundo.vtxundo.push_back(CTxUndo());
+                UpdateCoins(tip, txConst, blockundo.vtxundo.back(), nHeight);
+                vNext.emplace_back(txConst.GetId(), 0);
+                vNext.emplace_back(txConst.GetId(), 1);
+                block.vtx.push_back(MakeTransactionRef(txConst));
+            }
+            AddCoins(tip, *block.vtx[0], nHeight);
+            vAvailable.swap(vNext);
+
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ss << blockundo;
+            vUndo.emplace_back(ss.begin(), ss.end());
+            vIndex[vBlocks.size()].nHeight = nHeight;
+            vBlocks.push_back(std::move(block));
+        }
+    }
+};
+
+// Disconnect REORG_DEPTH blocks, streaming the spent coins from the serialized
+// undo data straight into the view.
+static void DisconnectBlocksStreaming(benchmark::State &state) {
+    ReorgSetup setup;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&setup.tip);
+        for (int i = REORG_DEPTH - 1; i >= 0; i--) {
+            CDataStream ss(setup.vUndo[i].data(),
+                           setup.vUndo[i].data() + setup.vUndo[i].size(),
+                           SER_DISK, CLIENT_VERSION);
+            DisconnectResult res =
+                ApplyBlockUndo(ss, setup.vBlocks[i], &setup.vIndex[i], view);
+            assert(res == DISCONNECT_OK);
+        }
+    }
+}
+
+// Same as above, but deserializing the whole CBlockUndo first, as was done
+// before undo data was streamed.
+static void DisconnectBlocksMaterialized(benchmark::State &state) {
+    ReorgSetup setup;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&setup.tip);
+        for (int i = REORG_DEPTH - 1; i >= 0; i--) {
+            CDataStream ss(setup.vUndo[i].data(),
+                           setup.vUndo[i].data() + setup.vUndo[i].size(),
+                           SER_DISK, CLIENT_VERSION);
+            CBlockUndo blockundo;
+            ss >> blockundo;
+            DisconnectResult res = ApplyBlockUndo(blockundo, setup.vBlocks[i],
+                                                  &setup.vIndex[i], view);
+            assert(res == DISCONNECT_OK);
+        }
+    }
+}
+
+BENCHMARK(DisconnectBlocksStreaming);
+BENCHMARK(DisconnectBlocksMaterialized);
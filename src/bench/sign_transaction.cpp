@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "keystore.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+// Number of inputs of the transaction signed.
+static const size_t SIGN_BENCH_INPUTS = 1000;
+
+// Build a transaction spending SIGN_BENCH_INPUTS pay-to-pubkey-hash outputs
+// of the key in keystore.
+static CMutableTransaction SetupTransaction(CBasicKeyStore &keystore,
+                                            std::vector<CTxOut> &vSpent) {
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKeyPubKey(key, key.GetPubKey());
+    const CScript scriptPubKey =
+        GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction mtx;
+    for (size_t i = 0; i < SIGN_BENCH_INPUTS; i++) {
+        mtx.vin.emplace_back(COutPoint(uint256(), i));
+        vSpent.emplace_back(Amount(1000), scriptPubKey);
+    }
+    mtx.vout.emplace_back(Amount(1000 * SIGN_BENCH_INPUTS), scriptPubKey);
+    return mtx;
+}
+
+// Sign all the inputs, the way signrawtransaction and the wallet do.
+static void SignTransaction(benchmark::State &state) {
+    // Each signature is checked once produced.
+    ECCVerifyHandle verifyHandle;
+    CBasicKeyStore keystore;
+    std::vector<CTxOut> vSpent;
+    const CTransaction tx(SetupTransaction(keystore, vSpent));
+
+    while (state.KeepRunning()) {
+        std::vector<SignatureData> vSigData;
+        ProduceSignatures(keystore, tx, PrecomputedTransactionData(tx), vSpent,
+                          SigHashType().withForkId(), vSigData);
+    }
+}
+
+// Sign the same inputs one at a time, for comparison.
+static void SignTransactionInputs(benchmark::State &state) {
+    ECCVerifyHandle verifyHandle;
+    CBasicKeyStore keystore;
+    std::vector<CTxOut> vSpent;
+    CMutableTransaction mtx = SetupTransaction(keystore, vSpent);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < mtx.vin.size(); i++) {
+            SignSignature(keystore, vSpent[i].scriptPubKey, mtx, i,
+                          vSpent[i].nValue, SigHashType().withForkId());
+        }
+    }
+}
+
+BENCHMARK(SignTransaction);
+BENCHMARK(SignTransactionInputs);
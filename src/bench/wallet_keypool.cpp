@@ -0,0 +1,29 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "pubkey.h"
+#include "wallet/wallet.h"
+
+// Number of keys added to the keypool at each run.
+static const unsigned int KEYPOOL_BENCH_KEYS = 1000;
+
+// Fill the keypool of a new HD wallet, the way keypoolrefill does. Each key is
+// derived from the chain key, checked and added to the wallet.
+static void WalletKeypoolTopUp(benchmark::State &state) {
+    SelectParams(CBaseChainParams::REGTEST);
+    // New keys are checked against their public key.
+    ECCVerifyHandle verifyHandle;
+
+    while (state.KeepRunning()) {
+        CWallet wallet(Params());
+        LOCK(wallet.cs_wallet);
+        wallet.SetHDMasterKey(wallet.GenerateNewHDMasterKey());
+        wallet.TopUpKeyPool(KEYPOOL_BENCH_KEYS);
+    }
+}
+
+BENCHMARK(WalletKeypoolTopUp);
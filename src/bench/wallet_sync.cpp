@@ -0,0 +1,54 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "key.h"
+#include "streams.h"
+#include "validation.h"
+#include "wallet/wallet.h"
+
+namespace block_bench {
+#include "bench/data/block413567.raw.h"
+}
+
+// Number of keys in the wallet, as with a default keypool and some history.
+static const int WALLET_SYNC_KEYS = 1000;
+
+// Sync a full block none of whose transactions involve the wallet, the way
+// every connected block is. Each output of each transaction is checked with
+// IsMine.
+static void WalletSyncBlock(benchmark::State &state) {
+    SelectParams(CBaseChainParams::MAIN);
+
+    CDataStream stream((const char *)block_bench::block413567,
+                       (const char *)&block_bench::block413567[sizeof(
+                           block_bench::block413567)],
+                       SER_NETWORK, PROTOCOL_VERSION);
+    auto pblock = std::make_shared<CBlock>();
+    stream >> *pblock;
+
+    const uint256 hashBlock = pblock->GetHash();
+    CBlockIndex index;
+    index.phashBlock = &hashBlock;
+
+    CWallet wallet(Params());
+    {
+        LOCK(wallet.cs_wallet);
+        for (int i = 0; i < WALLET_SYNC_KEYS; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            wallet.LoadKey(key, key.GetPubKey());
+        }
+    }
+
+    const std::vector<CTransactionRef> noConflicts;
+    while (state.KeepRunning()) {
+        wallet.BlockConnected(pblock, &index, noConflicts);
+    }
+}
+
+BENCHMARK(WalletSyncBlock);
@@ -0,0 +1,228 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+#include <ios>
+#include <limits>
+
+/**
+ * Map a uniformly distributed 64-bit value into [0, n), as (x * n) >> 64,
+ * which is cheaper than a modulo.
+ */
+static uint64_t MapIntoRange(uint64_t x, uint64_t n) {
+#ifdef __SIZEOF_INT128__
+    return (static_cast<unsigned __int128>(x) *
+            static_cast<unsigned __int128>(n)) >>
+           64;
+#else
+    // Multiply the 32-bit halves and keep the high 64 bits of the product.
+    const uint64_t xHi = x >> 32, xLo = x & 0xFFFFFFFF;
+    const uint64_t nHi = n >> 32, nLo = n & 0xFFFFFFFF;
+    const uint64_t hh = xHi * nHi, hl = xHi * nLo;
+    const uint64_t lh = xLo * nHi, ll = xLo * nLo;
+    const uint64_t mid = (ll >> 32) + (hl & 0xFFFFFFFF) + (lh & 0xFFFFFFFF);
+    return hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+#endif
+}
+
+template <typename OStream>
+static void GolombRiceEncode(BitStreamWriter<OStream> &bitwriter, uint8_t nP,
+                             uint64_t x) {
+    // The quotient is written in unary, as that many 1 bits followed by a 0.
+    uint64_t q = x >> nP;
+    while (q > 0) {
+        int nBits = q <= 64 ? int(q) : 64;
+        bitwriter.Write(~uint64_t(0), nBits);
+        q -= nBits;
+    }
+    bitwriter.Write(0, 1);
+
+    // The remainder is written as is, on nP bits.
+    bitwriter.Write(x, nP);
+}
+
+template <typename IStream>
+static uint64_t GolombRiceDecode(BitStreamReader<IStream> &bitreader,
+                                 uint8_t nP) {
+    uint64_t q = 0;
+    while (bitreader.Read(1) == 1) {
+        q++;
+    }
+
+    uint64_t r = bitreader.Read(nP);
+    return (q << nP) + r;
+}
+
+GCSFilter::GCSFilter(const Params &paramsIn)
+    : params(paramsIn), nN(0), nF(0), vchEncoded(1, 0) {}
+
+GCSFilter::GCSFilter(const Params &paramsIn, std::vector<uint8_t> vchEncodedIn)
+    : params(paramsIn), vchEncoded(std::move(vchEncodedIn)) {
+    CSpanReader stream(SER_NETWORK, PROTOCOL_VERSION, vchEncoded.data(),
+                       vchEncoded.data() + vchEncoded.size());
+
+    uint64_t nNRead = ReadCompactSize(stream);
+    if (nNRead > std::numeric_limits<uint32_t>::max()) {
+        throw std::ios_base::failure("N must be less than 2^32");
+    }
+    nN = uint32_t(nNRead);
+    nF = uint64_t(nN) * params.nM;
+
+    // Decode all the values, so that a malformed filter is rejected here
+    // rather than when it is matched.
+    BitStreamReader<CSpanReader> bitreader(stream);
+    for (uint32_t i = 0; i < nN; i++) {
+        GolombRiceDecode(bitreader, params.nP);
+    }
+    if (!stream.empty()) {
+        throw std::ios_base::failure("encoded filter contains excess data");
+    }
+}
+
+GCSFilter::GCSFilter(const Params &paramsIn, const ElementSet &elements)
+    : params(paramsIn) {
+    if (elements.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::invalid_argument("N must be less than 2^32");
+    }
+    nN = uint32_t(elements.size());
+    nF = uint64_t(nN) * params.nM;
+
+    CVectorWriter stream(SER_NETWORK, PROTOCOL_VERSION, vchEncoded, 0);
+    WriteCompactSize(stream, nN);
+    if (elements.empty()) {
+        return;
+    }
+
+    BitStreamWriter<CVectorWriter> bitwriter(stream);
+    uint64_t nLastValue = 0;
+    for (uint64_t nValue : BuildHashedSet(elements)) {
+        GolombRiceEncode(bitwriter, params.nP, nValue - nLastValue);
+        nLastValue = nValue;
+    }
+    bitwriter.Flush();
+}
+
+uint64_t GCSFilter::HashToRange(const Element &element) const {
+    uint64_t nHash = CSipHasher(params.nSipHashK0, params.nSipHashK1)
+                         .Write(element.data(), element.size())
+                         .Finalize();
+    return MapIntoRange(nHash, nF);
+}
+
+std::vector<uint64_t>
+GCSFilter::BuildHashedSet(const ElementSet &elements) const {
+    std::vector<uint64_t> vHashed;
+    vHashed.reserve(elements.size());
+    for (const Element &element : elements) {
+        vHashed.push_back(HashToRange(element));
+    }
+    std::sort(vHashed.begin(), vHashed.end());
+    return vHashed;
+}
+
+bool GCSFilter::MatchInternal(const uint64_t *pelements,
+                              size_t nElements) const {
+    CSpanReader stream(SER_NETWORK, PROTOCOL_VERSION, vchEncoded.data(),
+                       vchEncoded.data() + vchEncoded.size());
+    // N was checked when the filter was built or decoded.
+    ReadCompactSize(stream);
+    BitStreamReader<CSpanReader> bitreader(stream);
+
+    // Walk the values of the filter and the sorted elements side by side.
+    uint64_t nValue = 0;
+    size_t j = 0;
+    for (uint32_t i = 0; i < nN; i++) {
+        nValue += GolombRiceDecode(bitreader, params.nP);
+        while (true) {
+            if (j == nElements) {
+                return false;
+            }
+            if (pelements[j] == nValue) {
+                return true;
+            }
+            if (pelements[j] > nValue) {
+                break;
+            }
+            j++;
+        }
+    }
+
+    return false;
+}
+
+bool GCSFilter::Match(const Element &element) const {
+    if (nN == 0) {
+        return false;
+    }
+    uint64_t nQuery = HashToRange(element);
+    return MatchInternal(&nQuery, 1);
+}
+
+bool GCSFilter::MatchAny(const ElementSet &elements) const {
+    if (nN == 0 || elements.empty()) {
+        return false;
+    }
+    const std::vector<uint64_t> vQueries = BuildHashedSet(elements);
+    return MatchInternal(vQueries.data(), vQueries.size());
+}
+
+GCSFilter::Params BlockFilter::ParamsForBlock(const uint256 &hashBlock) {
+    // The SipHash key is the first 16 bytes of the block hash.
+    return GCSFilter::Params(ReadLE64(hashBlock.begin()),
+                             ReadLE64(hashBlock.begin() + 8), BASIC_FILTER_P,
+                             BASIC_FILTER_M);
+}
+
+BlockFilter::BlockFilter(const uint256 &hashBlockIn,
+                         std::vector<uint8_t> vchFilter)
+    : hashBlock(hashBlockIn),
+      filter(ParamsForBlock(hashBlock), std::move(vchFilter)) {}
+
+BlockFilter::BlockFilter(const CBlock &block, const CBlockUndo &blockundo)
+    : hashBlock(block.GetHash()) {
+    GCSFilter::ElementSet elements;
+
+    for (const CTransactionRef &tx : block.vtx) {
+        for (const CTxOut &txout : tx->vout) {
+            const CScript &script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN) {
+                continue;
+            }
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+
+    for (const CTxUndo &txundo : blockundo.vtxundo) {
+        for (const Coin &coin : txundo.vprevout) {
+            const CScript &script = coin.GetTxOut().scriptPubKey;
+            if (script.empty()) {
+                continue;
+            }
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+
+    filter = GCSFilter(ParamsForBlock(hashBlock), elements);
+}
+
+uint256 BlockFilter::GetHash() const {
+    const std::vector<uint8_t> &vchEncoded = GetEncodedFilter();
+    return Hash(vchEncoded.begin(), vchEncoded.end());
+}
+
+uint256 BlockFilter::ComputeHeader(const uint256 &hashPrevHeader) const {
+    const uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), hashPrevHeader.begin(),
+                hashPrevHeader.end());
+}
@@ -0,0 +1,122 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * Golomb-coded set: a compact probabilistic set of byte vectors, as specified
+ * by BIP 158. Elements are hashed with SipHash into the range [0, N * M), and
+ * the sorted differences between the hashes are Golomb-Rice coded with
+ * parameter P. Matching an element that is not in the set has a false
+ * positive rate of about 1 / M.
+ */
+class GCSFilter {
+public:
+    typedef std::vector<uint8_t> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params {
+        uint64_t nSipHashK0;
+        uint64_t nSipHashK1;
+        uint8_t nP;
+        uint32_t nM;
+
+        Params(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0,
+               uint8_t nPIn = 0, uint32_t nMIn = 1)
+            : nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn),
+              nM(nMIn) {}
+    };
+
+    explicit GCSFilter(const Params &paramsIn = Params());
+    /** Decode a filter, throws std::ios_base::failure if it is malformed. */
+    GCSFilter(const Params &paramsIn, std::vector<uint8_t> vchEncodedIn);
+    GCSFilter(const Params &paramsIn, const ElementSet &elements);
+
+    uint32_t GetN() const { return nN; }
+    const Params &GetParams() const { return params; }
+    const std::vector<uint8_t> &GetEncoded() const { return vchEncoded; }
+
+    /** Whether the element may be in the set. */
+    bool Match(const Element &element) const;
+    /**
+     * Whether any of the elements may be in the set. This is much faster than
+     * matching them one at a time.
+     */
+    bool MatchAny(const ElementSet &elements) const;
+
+private:
+    Params params;
+    uint32_t nN;
+    //! Range the elements are hashed into, N * M.
+    uint64_t nF;
+    std::vector<uint8_t> vchEncoded;
+
+    uint64_t HashToRange(const Element &element) const;
+    std::vector<uint64_t> BuildHashedSet(const ElementSet &elements) const;
+    /** Whether any of the sorted hashes is in the set. */
+    bool MatchInternal(const uint64_t *pelements, size_t nElements) const;
+};
+
+//! BIP 158 parameters of the basic filter.
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+/**
+ * Basic block filter of BIP 158: the set of the scriptPubKeys of the outputs
+ * a block creates, but OP_RETURN ones, and of the outputs it spends. It is
+ * keyed on the block hash, so the undo data of the block is needed to build
+ * it.
+ */
+class BlockFilter {
+public:
+    BlockFilter() {}
+    BlockFilter(const uint256 &hashBlockIn, std::vector<uint8_t> vchFilter);
+    BlockFilter(const CBlock &block, const CBlockUndo &blockundo);
+
+    const uint256 &GetBlockHash() const { return hashBlock; }
+    const GCSFilter &GetFilter() const { return filter; }
+    const std::vector<uint8_t> &GetEncodedFilter() const {
+        return filter.GetEncoded();
+    }
+
+    /** Hash of the encoded filter. */
+    uint256 GetHash() const;
+    /** Header of the filter, committing to the headers of the previous ones. */
+    uint256 ComputeHeader(const uint256 &hashPrevHeader) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(hashBlock);
+        if (ser_action.ForRead()) {
+            std::vector<uint8_t> vchEncoded;
+            READWRITE(vchEncoded);
+            filter =
+                GCSFilter(ParamsForBlock(hashBlock), std::move(vchEncoded));
+        } else {
+            std::vector<uint8_t> vchEncoded = filter.GetEncoded();
+            READWRITE(vchEncoded);
+        }
+    }
+
+private:
+    uint256 hashBlock;
+    GCSFilter filter;
+
+    static GCSFilter::Params ParamsForBlock(const uint256 &hashBlock);
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -0,0 +1,57 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockresponsecache.h"
+
+CBlockResponseCache::CBlockResponseCache(size_t nMaxBlocksIn)
+    : nMaxBlocks(nMaxBlocksIn) {}
+
+CBlockResponseCache::Payload
+CBlockResponseCache::Get(const uint256 &hash, const std::string &strCommand) {
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it == mapBlocks.end()) {
+        return nullptr;
+    }
+
+    auto itPayload = it->second->mapPayloads.find(strCommand);
+    if (itPayload == it->second->mapPayloads.end()) {
+        return nullptr;
+    }
+
+    listBlocks.splice(listBlocks.begin(), listBlocks, it->second);
+    return itPayload->second;
+}
+
+void CBlockResponseCache::Put(const uint256 &hash,
+                              const std::string &strCommand, Payload payload) {
+    if (nMaxBlocks == 0) {
+        return;
+    }
+
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it != mapBlocks.end()) {
+        listBlocks.splice(listBlocks.begin(), listBlocks, it->second);
+    } else {
+        if (listBlocks.size() >= nMaxBlocks) {
+            mapBlocks.erase(listBlocks.back().hash);
+            listBlocks.pop_back();
+        }
+        listBlocks.push_front(Entry{hash, {}});
+        it = mapBlocks.emplace(hash, listBlocks.begin()).first;
+    }
+    it->second->mapPayloads[strCommand] = std::move(payload);
+}
+
+size_t CBlockResponseCache::GetBlockCount() const {
+    LOCK(cs);
+    return listBlocks.size();
+}
+
+void CBlockResponseCache::Clear() {
+    LOCK(cs);
+    mapBlocks.clear();
+    listBlocks.clear();
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKRESPONSECACHE_H
+#define BITCOIN_BLOCKRESPONSECACHE_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Serialized payloads of the messages sent for the most recent blocks (full
+ * block, compact block, header), keyed by block hash and message type and
+ * shared by all peers. A block requested by many peers at once, as happens
+ * right after it was found, is then read and serialized only once.
+ *
+ * Blocks are evicted least recently used first, with all their payloads.
+ */
+class CBlockResponseCache {
+public:
+    typedef std::shared_ptr<const std::vector<uint8_t>> Payload;
+
+    explicit CBlockResponseCache(size_t nMaxBlocksIn);
+
+    /** Return the payload of the strCommand message for block hash, if
+     * cached, or nullptr. */
+    Payload Get(const uint256 &hash, const std::string &strCommand);
+
+    void Put(const uint256 &hash, const std::string &strCommand,
+             Payload payload);
+
+    size_t GetBlockCount() const;
+    void Clear();
+
+private:
+    struct Entry {
+        uint256 hash;
+        std::map<std::string, Payload> mapPayloads;
+    };
+
+    mutable CCriticalSection cs;
+    const size_t nMaxBlocks;
+    //! Most recently used first.
+    std::list<Entry> listBlocks;
+    std::map<uint256, std::list<Entry>::iterator> mapBlocks;
+};
+
+#endif // BITCOIN_BLOCKRESPONSECACHE_H
@@ -13,6 +13,20 @@
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return false;
 }
+size_t CCoinsView::GetCoins(const std::vector<COutPoint> &vOutPoints,
+                            std::vector<Coin> &vCoins,
+                            std::vector<bool> &found) const {
+    vCoins.assign(vOutPoints.size(), Coin());
+    found.assign(vOutPoints.size(), false);
+    size_t nFound = 0;
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        if (GetCoin(vOutPoints[i], vCoins[i])) {
+            found[i] = true;
+            nFound++;
+        }
+    }
+    return nFound;
+}
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const {
     return false;
 }
@@ -181,6 +195,20 @@ bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     return it != cacheCoins.end();
 }
 
+void CCoinsViewCache::AddFetchedCoin(const COutPoint &outpoint, Coin &&coin) {
+    std::pair<CCoinsMap::iterator, bool> inserted = cacheCoins.emplace(
+        std::piecewise_construct, std::forward_as_tuple(outpoint),
+        std::forward_as_tuple(std::move(coin)));
+    if (!inserted.second) {
+        return;
+    }
+    if (inserted.first->second.coin.IsSpent()) {
+        // Same as in FetchCoin.
+        inserted.first->second.flags = CCoinsCacheEntry::FRESH;
+    }
+    cachedCoinsUsage += inserted.first->second.coin.DynamicMemoryUsage();
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const {
     if (hashBlock.IsNull()) {
         hashBlock = base->GetBestBlock();
@@ -141,6 +141,16 @@ public:
     //! Retrieve the Coin (unspent transaction output) for a given outpoint.
     virtual bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
 
+    //! Retrieve the Coins for several outpoints at once. vCoins[i] and
+    //! found[i] are set for vOutPoints[i]. Returns the number of coins found.
+    virtual size_t GetCoins(const std::vector<COutPoint> &vOutPoints,
+                            std::vector<Coin> &vCoins,
+                            std::vector<bool> &found) const;
+
+    //! Whether GetCoin and GetCoins may be called from several threads at
+    //! once.
+    virtual bool SupportsConcurrentReads() const { return false; }
+
     //! Just check whether we have data for a given outpoint.
     //! This may (but cannot always) return true for spent outputs.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
@@ -181,6 +191,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
+    CCoinsView *GetBackend() const { return base; }
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
@@ -218,6 +229,14 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Add a coin which was looked up in the backing view outside of this
+     * cache, for instance ahead of time by another thread, as if it had been
+     * fetched by it. Does nothing if the cache already has an entry for this
+     * outpoint, as that entry takes precedence over the backing view.
+     */
+    void AddFetchedCoin(const COutPoint &outpoint, Coin &&coin);
+
     /**
      * Return a reference to a Coin in the cache, or a pruned one if not found.
      * This is more efficient than GetCoin. Modifications to other cache entries
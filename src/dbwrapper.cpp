@@ -5,11 +5,13 @@
 #include "dbwrapper.h"
 
 #include "random.h"
+#include "trace.h"
 #include "util.h"
 
 #include <boost/filesystem.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -79,9 +81,21 @@ static leveldb::Options GetOptions(size_t nCacheSize) {
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
     // up to two write buffers may be held in memory simultaneously
     options.write_buffer_size = nCacheSize / 4;
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_size =
+        std::max<int64_t>(
+            1, gArgs.GetArg("-dbblocksize", DEFAULT_DB_BLOCK_SIZE)) *
+        1024;
+    // The bloom filter lets point lookups of missing keys, such as the inputs
+    // of new transactions in the coin database, skip most table files.
+    int64_t nBloomBits = gArgs.GetArg("-dbbloombits", DEFAULT_DB_BLOOM_BITS);
+    options.filter_policy =
+        nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(nBloomBits) : nullptr;
+    options.compression =
+        gArgs.GetBoolArg("-dbcompression", DEFAULT_DB_COMPRESSION)
+            ? leveldb::kSnappyCompression
+            : leveldb::kNoCompression;
+    options.max_open_files = std::max<int64_t>(
+        16, gArgs.GetArg("-dbmaxopenfiles", DEFAULT_DB_MAX_OPEN_FILES));
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 ||
         (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -93,7 +107,8 @@ static leveldb::Options GetOptions(size_t nCacheSize) {
 }
 
 CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory,
-                       bool fWipe, bool obfuscate) {
+                       bool fWipe, bool obfuscate)
+    : name(path.string()) {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
@@ -146,6 +161,12 @@ CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory,
 }
 
 CDBWrapper::~CDBWrapper() {
+    if (readLatency.GetCount() || writeLatency.GetCount()) {
+        LogPrint(BCLog::LEVELDB, "Read latency of %s: %s\n", name,
+                 readLatency.ToString());
+        LogPrint(BCLog::LEVELDB, "Write latency of %s: %s\n", name,
+                 writeLatency.ToString());
+    }
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -159,12 +180,28 @@ CDBWrapper::~CDBWrapper() {
 }
 
 bool CDBWrapper::WriteBatch(CDBBatch &batch, bool fSync) {
+    TRACE_SPAN("leveldb", name);
+    int64_t nStart = dbwrapper_private::GetLatencyTimeMicros();
     leveldb::Status status =
         pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    writeLatency.Add(dbwrapper_private::GetLatencyTimeMicros() - nStart);
     dbwrapper_private::HandleError(status);
     return true;
 }
 
+bool CDBWrapper::ReadRaw(const leveldb::Slice &slKey,
+                         std::string &strValue) const {
+    int64_t nStart = dbwrapper_private::GetLatencyTimeMicros();
+    leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+    readLatency.Add(dbwrapper_private::GetLatencyTimeMicros() - nStart);
+    if (!status.ok()) {
+        if (status.IsNotFound()) return false;
+        LogPrintf("LevelDB read failure: %s\n", status.ToString());
+        dbwrapper_private::HandleError(status);
+    }
+    return true;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy past
@@ -189,6 +226,44 @@ bool CDBWrapper::IsEmpty() {
     return !(it->Valid());
 }
 
+CDBLatencyHistogram::CDBLatencyHistogram() : nTotalMicros(0) {
+    for (auto &bucket : vBuckets) {
+        bucket = 0;
+    }
+}
+
+void CDBLatencyHistogram::Add(int64_t nMicros) {
+    int i = 0;
+    while (i < NUM_BUCKETS - 1 && nMicros >= (int64_t(1) << i)) {
+        i++;
+    }
+    vBuckets[i].fetch_add(1, std::memory_order_relaxed);
+    nTotalMicros.fetch_add(std::max<int64_t>(0, nMicros),
+                           std::memory_order_relaxed);
+}
+
+uint64_t CDBLatencyHistogram::GetCount() const {
+    uint64_t nCount = 0;
+    for (const auto &bucket : vBuckets) {
+        nCount += bucket;
+    }
+    return nCount;
+}
+
+std::string CDBLatencyHistogram::ToString() const {
+    uint64_t nCount = GetCount();
+    std::string str = strprintf(
+        "count=%u avg=%.2fus", nCount,
+        nCount ? double(nTotalMicros) / nCount : 0.0);
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        if (vBuckets[i]) {
+            str += strprintf(" <%dus:%u", int64_t(1) << i,
+                             uint64_t(vBuckets[i]));
+        }
+    }
+    return str;
+}
+
 CDBIterator::~CDBIterator() {
     delete piter;
 }
@@ -224,4 +299,10 @@ void HandleError(const leveldb::Status &status) {
 const std::vector<uint8_t> &GetObfuscateKey(const CDBWrapper &w) {
     return w.obfuscate_key;
 }
+
+int64_t GetLatencyTimeMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
 }; // namespace dbwrapper_private
@@ -16,9 +16,23 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+//! -dbmaxopenfiles default
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+//! -dbblocksize default, in KiB (LevelDB's own default)
+static const int DEFAULT_DB_BLOCK_SIZE = 4;
+//! -dbbloombits default, bits per key of the bloom filter (0 to disable)
+static const int DEFAULT_DB_BLOOM_BITS = 10;
+//! -dbcompression default
+static const bool DEFAULT_DB_COMPRESSION = false;
+
 class dbwrapper_error : public std::runtime_error {
 public:
     dbwrapper_error(const std::string &msg) : std::runtime_error(msg) {}
@@ -42,8 +56,39 @@ void HandleError(const leveldb::Status &status);
  * specific database.
  */
 const std::vector<uint8_t> &GetObfuscateKey(const CDBWrapper &w);
+
+/**
+ * Monotonic clock used to time database operations, in microseconds.
+ */
+int64_t GetLatencyTimeMicros();
 }; // namespace dbwrapper_private
 
+/**
+ * Histogram of operation latencies in power-of-two microsecond buckets: bucket
+ * 0 counts operations under 1us, and bucket i those in [2^(i-1), 2^i) us. The
+ * last bucket also holds everything slower. Updates are lock-free, so that
+ * const reads on any thread can record into it.
+ */
+class CDBLatencyHistogram {
+public:
+    static const int NUM_BUCKETS = 24;
+
+    CDBLatencyHistogram();
+
+    void Add(int64_t nMicros);
+
+    uint64_t GetCount() const;
+    uint64_t GetBucket(int i) const { return vBuckets[i]; }
+    int64_t GetTotalMicros() const { return nTotalMicros; }
+
+    /** One line summary, listing the non-empty buckets by upper bound. */
+    std::string ToString() const;
+
+private:
+    std::atomic<uint64_t> vBuckets[NUM_BUCKETS];
+    std::atomic<int64_t> nTotalMicros;
+};
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch {
     friend class CDBWrapper;
@@ -208,6 +253,29 @@ private:
 
     std::vector<uint8_t> CreateObfuscateKey() const;
 
+    //! human readable name of the database, used in log messages
+    std::string name;
+
+    //! latency of point reads (including each key of a MultiRead) and writes
+    mutable CDBLatencyHistogram readLatency;
+    CDBLatencyHistogram writeLatency;
+
+    //! Timed point lookup. Returns false if the key was not found.
+    bool ReadRaw(const leveldb::Slice &slKey, std::string &strValue) const;
+
+    template <typename V>
+    bool DeserializeValue(const char *pbegin, const char *pend,
+                          V &value) const {
+        try {
+            CDataStream ssValue(pbegin, pend, SER_DISK, CLIENT_VERSION);
+            ssValue.Xor(obfuscate_key);
+            ssValue >> value;
+        } catch (const std::exception &) {
+            return false;
+        }
+        return true;
+    }
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will
@@ -230,22 +298,118 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
-        if (!status.ok()) {
-            if (status.IsNotFound()) return false;
-            LogPrintf("LevelDB read failure: %s\n", status.ToString());
-            dbwrapper_private::HandleError(status);
-        }
-        try {
-            CDataStream ssValue(strValue.data(),
-                                strValue.data() + strValue.size(), SER_DISK,
-                                CLIENT_VERSION);
-            ssValue.Xor(obfuscate_key);
-            ssValue >> value;
-        } catch (const std::exception &) {
+        if (!ReadRaw(slKey, strValue)) {
             return false;
         }
-        return true;
+        return DeserializeValue(strValue.data(),
+                                strValue.data() + strValue.size(), value);
+    }
+
+    /**
+     * Read the values of several keys at once. The keys are looked up in
+     * sorted order through a single iterator, so that neighbouring keys share
+     * the table blocks that were already loaded rather than walking the levels
+     * again for each of them.
+     *
+     * @param[in]  keys    Keys to look up, in any order.
+     * @param[out] values  Resized to keys.size(); values[i] is set for keys[i]
+     *                     if it was found.
+     * @param[out] found   Resized to keys.size(); whether keys[i] was found
+     *                     and its value could be deserialized.
+     * @return the number of keys found.
+     */
+    template <typename K, typename V>
+    size_t MultiRead(const std::vector<K> &keys, std::vector<V> &values,
+                     std::vector<bool> &found) const {
+        values.assign(keys.size(), V());
+        found.assign(keys.size(), false);
+
+        std::vector<std::string> vKeys(keys.size());
+        std::vector<size_t> vOrder(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+            ssKey << keys[i];
+            vKeys[i].assign(ssKey.data(), ssKey.size());
+            vOrder[i] = i;
+        }
+        std::sort(vOrder.begin(), vOrder.end(), [&vKeys](size_t a, size_t b) {
+            return vKeys[a] < vKeys[b];
+        });
+
+        size_t nFound = 0;
+        std::unique_ptr<leveldb::Iterator> piter(
+            pdb->NewIterator(readoptions));
+        for (const size_t i : vOrder) {
+            int64_t nStart = dbwrapper_private::GetLatencyTimeMicros();
+            const leveldb::Slice slKey(vKeys[i]);
+            // Only seek when the iterator is not already there, e.g. for
+            // duplicate keys.
+            if (!piter->Valid() || piter->key().compare(slKey) < 0) {
+                piter->Seek(slKey);
+            }
+            readLatency.Add(dbwrapper_private::GetLatencyTimeMicros() -
+                            nStart);
+            if (!piter->Valid()) {
+                dbwrapper_private::HandleError(piter->status());
+                // Every key left is past the end of the database.
+                break;
+            }
+            if (piter->key() != slKey) {
+                continue;
+            }
+            const leveldb::Slice slValue = piter->value();
+            if (DeserializeValue(slValue.data(),
+                                 slValue.data() + slValue.size(), values[i])) {
+                found[i] = true;
+                nFound++;
+            }
+        }
+        return nFound;
+    }
+
+    /**
+     * Call fn(key, value) for every entry whose serialized key starts with
+     * the serialization of prefix, in key order, until fn returns false.
+     * Entries that cannot be deserialized as K and V are skipped.
+     *
+     * @return the number of entries passed to fn.
+     */
+    template <typename K, typename V, typename P, typename F>
+    size_t ForEachPrefix(const P &prefix, F fn) const {
+        CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+        ssPrefix.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssPrefix << prefix;
+        const leveldb::Slice slPrefix(ssPrefix.data(), ssPrefix.size());
+
+        size_t nCount = 0;
+        std::unique_ptr<leveldb::Iterator> piter(
+            pdb->NewIterator(iteroptions));
+        for (piter->Seek(slPrefix);
+             piter->Valid() && piter->key().starts_with(slPrefix);
+             piter->Next()) {
+            K key;
+            V value;
+            const leveldb::Slice slKey = piter->key();
+            const leveldb::Slice slValue = piter->value();
+            try {
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(),
+                                  SER_DISK, CLIENT_VERSION);
+                ssKey >> key;
+            } catch (const std::exception &) {
+                continue;
+            }
+            if (!DeserializeValue(slValue.data(),
+                                  slValue.data() + slValue.size(), value)) {
+                continue;
+            }
+            nCount++;
+            if (!fn(key, value)) {
+                break;
+            }
+        }
+        dbwrapper_private::HandleError(piter->status());
+        return nCount;
     }
 
     template <typename K, typename V>
@@ -262,13 +426,7 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
-        if (!status.ok()) {
-            if (status.IsNotFound()) return false;
-            LogPrintf("LevelDB read failure: %s\n", status.ToString());
-            dbwrapper_private::HandleError(status);
-        }
-        return true;
+        return ReadRaw(slKey, strValue);
     }
 
     template <typename K> bool Erase(const K &key, bool fSync = false) {
@@ -296,6 +454,9 @@ public:
      */
     bool IsEmpty();
 
+    const CDBLatencyHistogram &GetReadLatency() const { return readLatency; }
+    const CDBLatencyHistogram &GetWriteLatency() const { return writeLatency; }
+
     template <typename K>
     size_t EstimateSize(const K &key_begin, const K &key_end) const {
         CDataStream ssKey1(SER_DISK, CLIENT_VERSION),
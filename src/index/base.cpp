@@ -0,0 +1,244 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/base.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <functional>
+
+static const char DB_BEST_BLOCK = 'B';
+
+//! Interval between sync progress log lines, in seconds.
+static const int64_t SYNC_LOG_INTERVAL = 30;
+
+BaseIndex::DB::DB(const fs::path &path, size_t nCacheSize, bool fMemory,
+                  bool fWipe)
+    : CDBWrapper(path, nCacheSize, fMemory, fWipe) {}
+
+bool BaseIndex::DB::ReadBestBlock(uint256 &hashBlock) const {
+    return Read(DB_BEST_BLOCK, hashBlock);
+}
+
+bool BaseIndex::DB::WriteBestBlock(const uint256 &hashBlock) {
+    return Write(DB_BEST_BLOCK, hashBlock);
+}
+
+void BaseIndex::DB::WriteBestBlock(CDBBatch &batch,
+                                   const uint256 &hashBlock) const {
+    batch.Write(DB_BEST_BLOCK, hashBlock);
+}
+
+BaseIndex::BaseIndex(const Config &configIn)
+    : fSynced(false), pindexBest(nullptr), fInterrupted(false),
+      config(configIn) {}
+
+BaseIndex::~BaseIndex() {
+    Stop();
+}
+
+bool BaseIndex::AppendBlock(const CBlock &block, const CBlockIndex *pindex) {
+    if (!WriteBlock(block, pindex)) {
+        return false;
+    }
+
+    pindexBest = pindex;
+    return true;
+}
+
+bool BaseIndex::RewindBlock(const CBlockIndex *pindex) {
+    // The entries of the disconnected block are kept: they are still valid
+    // should the block be connected again.
+    if (!GetDB().WriteBestBlock(pindex->pprev->GetBlockHash())) {
+        return error("%s: failed to rewind %s to %s", __func__, GetName(),
+                     pindex->pprev->GetBlockHash().ToString());
+    }
+
+    pindexBest = pindex->pprev;
+    return true;
+}
+
+/**
+ * Return the next block to index after pindex, or nullptr if pindex is the
+ * active tip. A pindex that was reorged out resumes from the fork point.
+ */
+static const CBlockIndex *NextSyncBlock(const CBlockIndex *pindex) {
+    AssertLockHeld(cs_main);
+
+    if (!pindex) {
+        return chainActive.Genesis();
+    }
+
+    const CBlockIndex *pindexNext = chainActive.Next(pindex);
+    if (pindexNext || chainActive.Contains(pindex)) {
+        return pindexNext;
+    }
+
+    return chainActive.Next(chainActive.FindFork(pindex));
+}
+
+void BaseIndex::ThreadSync() {
+    const CBlockIndex *pindex = pindexBest;
+    int64_t nLastLog = 0;
+    while (!fSynced) {
+        if (fInterrupted) {
+            return;
+        }
+
+        {
+            LOCK(cs_main);
+            const CBlockIndex *pindexNext = NextSyncBlock(pindex);
+            if (!pindexNext) {
+                // Blocks connected from now on are queued by BlockConnected.
+                fSynced = true;
+                break;
+            }
+            pindex = pindexNext;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, config)) {
+            error("%s: failed to read block %s from disk", __func__,
+                  pindex->GetBlockHash().ToString());
+            return;
+        }
+
+        if (!AppendBlock(block, pindex)) {
+            return;
+        }
+
+        int64_t nNow = GetTime();
+        if (nNow - nLastLog >= SYNC_LOG_INTERVAL) {
+            LogPrintf("Syncing %s with block chain from height %d\n",
+                      GetName(), pindex->nHeight);
+            nLastLog = nNow;
+        }
+    }
+
+    LogPrintf("%s is enabled at height %d\n", GetName(),
+              pindex ? pindex->nHeight : -1);
+
+    while (true) {
+        QueueEntry entry;
+        {
+            std::unique_lock<std::mutex> lock(cs_queue);
+            condQueue.wait(lock,
+                           [this] { return fInterrupted || !queue.empty(); });
+            if (fInterrupted) {
+                return;
+            }
+            entry = queue.front();
+        }
+
+        bool fWritten = entry.pblock ? AppendBlock(*entry.pblock, entry.pindex)
+                                     : RewindBlock(entry.pindex);
+
+        {
+            std::lock_guard<std::mutex> lock(cs_queue);
+            if (fWritten) {
+                queue.pop_front();
+            } else {
+                // Do not leave BlockUntilSyncedToCurrentChain waiting forever.
+                fInterrupted = true;
+            }
+        }
+        condQueue.notify_all();
+
+        if (!fWritten) {
+            return;
+        }
+    }
+}
+
+void BaseIndex::BlockConnected(
+    const std::shared_ptr<const CBlock> &block, const CBlockIndex *pindex,
+    const std::vector<CTransactionRef> &txnConflicted) {
+    if (!fSynced) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cs_queue);
+        queue.push_back({block, pindex});
+    }
+    condQueue.notify_all();
+}
+
+void BaseIndex::BlockDisconnected(const std::shared_ptr<const CBlock> &block) {
+    if (!fSynced) {
+        return;
+    }
+
+    const CBlockIndex *pindex;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(block->GetHash());
+        if (it == mapBlockIndex.end() || !it->second->pprev) {
+            return;
+        }
+        pindex = it->second;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cs_queue);
+        queue.push_back({nullptr, pindex});
+    }
+    condQueue.notify_all();
+}
+
+bool BaseIndex::BlockUntilSyncedToCurrentChain() {
+    AssertLockNotHeld(cs_main);
+
+    if (!fSynced) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(cs_queue);
+    condQueue.wait(lock, [this] { return fInterrupted || queue.empty(); });
+    return !fInterrupted;
+}
+
+bool BaseIndex::Start() {
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (GetDB().ReadBestBlock(hashBest)) {
+            BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+            if (it == mapBlockIndex.end()) {
+                return error("%s: best block of %s not found. Your database "
+                             "may be corrupted. Please restart with -reindex.",
+                             __func__, GetName());
+            }
+            pindexBest = it->second;
+        }
+    }
+
+    RegisterValidationInterface(this);
+
+    threadSync = std::thread(
+        &TraceThread<std::function<void()>>, GetName(),
+        std::function<void()>(std::bind(&BaseIndex::ThreadSync, this)));
+    return true;
+}
+
+void BaseIndex::Interrupt() {
+    {
+        std::lock_guard<std::mutex> lock(cs_queue);
+        fInterrupted = true;
+    }
+    condQueue.notify_all();
+}
+
+void BaseIndex::Stop() {
+    UnregisterValidationInterface(this);
+    Interrupt();
+
+    if (threadSync.joinable()) {
+        threadSync.join();
+    }
+}
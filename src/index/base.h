@@ -0,0 +1,118 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BASE_H
+#define BITCOIN_INDEX_BASE_H
+
+#include "dbwrapper.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class CBlock;
+class CBlockIndex;
+class Config;
+
+/**
+ * Base class for the indexes that live in their own database and are
+ * decoupled from block validation: an index builds itself in the background
+ * from the block files, then follows the chain through validation
+ * notifications, which are queued and processed on its own thread. Derived
+ * classes only write the entries of a block and look them up.
+ */
+class BaseIndex : public CValidationInterface {
+protected:
+    /** Access to the database of an index, which records its best block. */
+    class DB : public CDBWrapper {
+    public:
+        DB(const fs::path &path, size_t nCacheSize, bool fMemory = false,
+           bool fWipe = false);
+
+        bool ReadBestBlock(uint256 &hashBlock) const;
+        bool WriteBestBlock(const uint256 &hashBlock);
+        //! Mark a block as the best indexed one as part of batch.
+        void WriteBestBlock(CDBBatch &batch, const uint256 &hashBlock) const;
+    };
+
+private:
+    /** A connected or disconnected block waiting to be processed. */
+    struct QueueEntry {
+        //! The connected block, or null if pindex was disconnected.
+        std::shared_ptr<const CBlock> pblock;
+        const CBlockIndex *pindex;
+    };
+
+    /**
+     * Whether the index has caught up with the active chain. Blocks connected
+     * before that are picked up by the initial sync, and blocks connected or
+     * disconnected afterwards are queued.
+     */
+    std::atomic<bool> fSynced;
+    /** The last block which has been written to the index. */
+    std::atomic<const CBlockIndex *> pindexBest;
+
+    std::mutex cs_queue;
+    std::condition_variable condQueue;
+    /** Blocks waiting to be processed, oldest first. */
+    std::deque<QueueEntry> queue;
+    std::atomic<bool> fInterrupted;
+
+    std::thread threadSync;
+
+    /**
+     * Build the index from the block files up to the active tip, then process
+     * the queued blocks as they are connected and disconnected.
+     */
+    void ThreadSync();
+    bool AppendBlock(const CBlock &block, const CBlockIndex *pindex);
+    bool RewindBlock(const CBlockIndex *pindex);
+
+protected:
+    const Config &config;
+
+    void BlockConnected(const std::shared_ptr<const CBlock> &block,
+                        const CBlockIndex *pindex,
+                        const std::vector<CTransactionRef> &txnConflicted)
+        override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock> &block) override;
+
+    /**
+     * Write the entries of a block and mark it as the best indexed one,
+     * atomically. Entries of disconnected blocks are kept.
+     */
+    virtual bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) = 0;
+
+    virtual DB &GetDB() const = 0;
+
+    /** Name of the index, for its thread and log messages. */
+    virtual const char *GetName() const = 0;
+
+public:
+    explicit BaseIndex(const Config &configIn);
+    /** Derived classes must call Stop, as the sync thread uses them. */
+    virtual ~BaseIndex();
+
+    bool IsSynced() const { return fSynced; }
+
+    /**
+     * Wait until all the blocks connected so far have been written. Returns
+     * false immediately if the initial sync is still in progress. Must not be
+     * called with cs_main held.
+     */
+    bool BlockUntilSyncedToCurrentChain();
+
+    /** Load the best indexed block, register for notifications and start the
+     * sync thread. */
+    bool Start();
+    void Interrupt();
+    /** Unregister from notifications and join the sync thread. */
+    void Stop();
+};
+
+#endif // BITCOIN_INDEX_BASE_H
@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/blockfilterindex.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+static const char DB_FILTER = 'f';
+
+std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+BlockFilterIndex::DB::DB(size_t nCacheSize, bool fMemory, bool fWipe)
+    : BaseIndex::DB(GetDataDir() / "indexes" / "blockfilter" / "basic",
+                    nCacheSize, fMemory, fWipe) {}
+
+bool BlockFilterIndex::DB::ReadFilter(const uint256 &hashBlock,
+                                      BlockFilter &filter,
+                                      uint256 &hashHeader) const {
+    std::pair<BlockFilter, uint256> value;
+    try {
+        if (!Read(std::make_pair(DB_FILTER, hashBlock), value)) {
+            return false;
+        }
+    } catch (const std::exception &e) {
+        return error("%s: invalid filter for block %s: %s", __func__,
+                     hashBlock.ToString(), e.what());
+    }
+    filter = std::move(value.first);
+    hashHeader = value.second;
+    return true;
+}
+
+bool BlockFilterIndex::DB::WriteFilter(const BlockFilter &filter,
+                                       const uint256 &hashHeader) {
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_FILTER, filter.GetBlockHash()),
+                std::make_pair(filter, hashHeader));
+    WriteBestBlock(batch, filter.GetBlockHash());
+    return WriteBatch(batch);
+}
+
+BlockFilterIndex::BlockFilterIndex(const Config &configIn, size_t nCacheSize,
+                                   bool fMemory, bool fWipe)
+    : BaseIndex(configIn), db(new DB(nCacheSize, fMemory, fWipe)) {}
+
+BlockFilterIndex::~BlockFilterIndex() {
+    Stop();
+}
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex *pindex,
+                                    BlockFilter &filter) const {
+    uint256 hashHeader;
+    return db->ReadFilter(pindex->GetBlockHash(), filter, hashHeader);
+}
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex *pindex,
+                                    BlockFilter &filter,
+                                    uint256 &hashHeader) const {
+    return db->ReadFilter(pindex->GetBlockHash(), filter, hashHeader);
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock &block,
+                                  const CBlockIndex *pindex) {
+    // The genesis block has no undo data, as its outputs are not spendable.
+    CBlockUndo blockundo;
+    uint256 hashPrevHeader;
+    if (pindex->pprev) {
+        if (!UndoReadFromDisk(blockundo, pindex->GetUndoPos(),
+                              pindex->pprev->GetBlockHash())) {
+            return error("%s: failed to read undo data of block %s", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+        BlockFilter filterPrev;
+        if (!db->ReadFilter(pindex->pprev->GetBlockHash(), filterPrev,
+                            hashPrevHeader)) {
+            return error("%s: filter of block %s not found", __func__,
+                         pindex->pprev->GetBlockHash().ToString());
+        }
+    }
+
+    const BlockFilter filter(block, blockundo);
+    if (!db->WriteFilter(filter, filter.ComputeHeader(hashPrevHeader))) {
+        return error("%s: failed to write the filter of block %s", __func__,
+                     pindex->GetBlockHash().ToString());
+    }
+
+    return true;
+}
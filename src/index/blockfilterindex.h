@@ -0,0 +1,59 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKFILTERINDEX_H
+#define BITCOIN_INDEX_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "index/base.h"
+
+#include <memory>
+
+/**
+ * BlockFilterIndex keeps the basic BIP 158 filter of every block of the active
+ * chain, along with its filter header. Like TxIndex, it lives in its own
+ * database (indexes/blockfilter/basic/), builds itself in the background from
+ * the block and undo files, and then follows the chain through validation
+ * notifications, including disconnected blocks.
+ */
+class BlockFilterIndex final : public BaseIndex {
+private:
+    /** Access to the block filter database (indexes/blockfilter/basic/) */
+    class DB : public BaseIndex::DB {
+    public:
+        DB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+        bool ReadFilter(const uint256 &hashBlock, BlockFilter &filter,
+                        uint256 &hashHeader) const;
+        //! Write the filter of a block and mark that block as the best indexed
+        //! one, atomically.
+        bool WriteFilter(const BlockFilter &filter, const uint256 &hashHeader);
+    };
+
+    const std::unique_ptr<DB> db;
+
+protected:
+    bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
+    BaseIndex::DB &GetDB() const override { return *db; }
+    const char *GetName() const override { return "blockfilterindex"; }
+
+public:
+    BlockFilterIndex(const Config &configIn, size_t nCacheSize,
+                     bool fMemory = false, bool fWipe = false);
+    ~BlockFilterIndex();
+
+    /**
+     * Look up the filter of a block. Filters of blocks that have been
+     * disconnected are kept, as they do not depend on the chain.
+     */
+    bool LookupFilter(const CBlockIndex *pindex, BlockFilter &filter) const;
+    /** Look up both the filter and its header, reading the record once. */
+    bool LookupFilter(const CBlockIndex *pindex, BlockFilter &filter,
+                      uint256 &hashHeader) const;
+};
+
+/** The global block filter index. May be null. */
+extern std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+#endif // BITCOIN_INDEX_BLOCKFILTERINDEX_H
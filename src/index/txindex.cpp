@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/txindex.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "util.h"
+
+static const char DB_TXINDEX = 't';
+
+std::unique_ptr<TxIndex> g_txindex;
+
+TxIndex::DB::DB(size_t nCacheSize, bool fMemory, bool fWipe)
+    : BaseIndex::DB(GetDataDir() / "indexes" / "txindex", nCacheSize, fMemory,
+                    fWipe) {}
+
+bool TxIndex::DB::ReadTxPos(const uint256 &txid, CDiskTxPos &pos) const {
+    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+}
+
+bool TxIndex::DB::WriteBlock(
+    const std::vector<std::pair<uint256, CDiskTxPos>> &vPos,
+    const uint256 &hashBlock) {
+    CDBBatch batch(*this);
+    for (const auto &entry : vPos) {
+        batch.Write(std::make_pair(DB_TXINDEX, entry.first), entry.second);
+    }
+    WriteBestBlock(batch, hashBlock);
+    return WriteBatch(batch);
+}
+
+TxIndex::TxIndex(const Config &configIn, size_t nCacheSize, bool fMemory,
+                 bool fWipe)
+    : BaseIndex(configIn), db(new DB(nCacheSize, fMemory, fWipe)) {}
+
+TxIndex::~TxIndex() {
+    Stop();
+}
+
+bool TxIndex::FindTx(const TxId &txid, CDiskTxPos &pos) const {
+    return db->ReadTxPos(txid, pos);
+}
+
+bool TxIndex::WriteBlock(const CBlock &block, const CBlockIndex *pindex) {
+    CDiskTxPos pos(pindex->GetBlockPos(),
+                   GetSizeOfCompactSize(block.vtx.size()));
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    vPos.reserve(block.vtx.size());
+    for (const auto &tx : block.vtx) {
+        vPos.push_back(std::make_pair(tx->GetId(), pos));
+        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+
+    if (!db->WriteBlock(vPos, pindex->GetBlockHash())) {
+        return error("%s: failed to write block %s to the transaction index",
+                     __func__, pindex->GetBlockHash().ToString());
+    }
+
+    return true;
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_TXINDEX_H
+#define BITCOIN_INDEX_TXINDEX_H
+
+#include "index/base.h"
+#include "primitives/transaction.h"
+#include "txdb.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * TxIndex is used to look up transactions included in the blockchain by txid.
+ * It lives in its own database (indexes/txindex/) and is decoupled from block
+ * validation: it follows the chain through validation notifications and writes
+ * on its own thread. When first enabled, it builds itself in the background
+ * from the block files, so it can be turned on or off without a reindex.
+ */
+class TxIndex final : public BaseIndex {
+private:
+    /** Access to the txindex database (indexes/txindex/) */
+    class DB : public BaseIndex::DB {
+    public:
+        DB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+        bool ReadTxPos(const uint256 &txid, CDiskTxPos &pos) const;
+        //! Write the positions of a block's transactions and mark that block
+        //! as the best indexed one, atomically.
+        bool WriteBlock(const std::vector<std::pair<uint256, CDiskTxPos>> &vPos,
+                        const uint256 &hashBlock);
+    };
+
+    const std::unique_ptr<DB> db;
+
+protected:
+    bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
+    BaseIndex::DB &GetDB() const override { return *db; }
+    const char *GetName() const override { return "txindex"; }
+
+public:
+    TxIndex(const Config &configIn, size_t nCacheSize, bool fMemory = false,
+            bool fWipe = false);
+    ~TxIndex();
+
+    /** Look up the on-disk position of a transaction by its txid. */
+    bool FindTx(const TxId &txid, CDiskTxPos &pos) const;
+};
+
+/** The global transaction index, used in GetTransaction. May be null. */
+extern std::unique_ptr<TxIndex> g_txindex;
+
+#endif // BITCOIN_INDEX_TXINDEX_H
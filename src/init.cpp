@@ -20,7 +20,10 @@
 #include "fs.h"
 #include "httprpc.h"
 #include "httpserver.h"
+#include "index/blockfilterindex.h"
+#include "index/txindex.h"
 #include "key.h"
+#include "metrics.h"
 #include "miner.h"
 #include "net.h"
 #include "net_processing.h"
@@ -32,8 +35,10 @@
 #include "script/scriptcache.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "sync.h"
 #include "timedata.h"
 #include "torcontrol.h"
+#include "trace.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -70,6 +75,7 @@
 bool fFeeEstimatesInitialized = false;
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
+static const bool DEFAULT_METRICS_ENABLE = false;
 static const bool DEFAULT_DISABLE_SAFEMODE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 
@@ -158,6 +164,23 @@ public:
             abort();
         }
     }
+    size_t GetCoins(const std::vector<COutPoint> &vOutPoints,
+                    std::vector<Coin> &vCoins,
+                    std::vector<bool> &found) const override {
+        try {
+            return base->GetCoins(vOutPoints, vCoins, found);
+        } catch (const std::runtime_error &e) {
+            uiInterface.ThreadSafeMessageBox(
+                _("Error reading from database, shutting down."), "",
+                CClientUIInterface::MSG_ERROR);
+            LogPrintf("Error reading from database: %s\n", e.what());
+            // See GetCoin.
+            abort();
+        }
+    }
+    bool SupportsConcurrentReads() const override {
+        return base->SupportsConcurrentReads();
+    }
     // Writes do not need similar protection, as failure to write is handled by
     // the caller.
 };
@@ -173,6 +196,8 @@ void Interrupt(boost::thread_group &threadGroup) {
     InterruptREST();
     InterruptTorControl();
     if (g_connman) g_connman->Interrupt();
+    if (g_txindex) g_txindex->Interrupt();
+    if (g_blockfilterindex) g_blockfilterindex->Interrupt();
     threadGroup.interrupt_all();
 }
 
@@ -191,6 +216,7 @@ void Shutdown() {
 
     StopHTTPRPC();
     StopREST();
+    StopMetrics();
     StopRPC();
     StopHTTPServer();
 #ifdef ENABLE_WALLET
@@ -202,6 +228,14 @@ void Shutdown() {
     UnregisterValidationInterface(peerLogic.get());
     peerLogic.reset();
     g_connman.reset();
+    if (g_txindex) {
+        g_txindex->Stop();
+        g_txindex.reset();
+    }
+    if (g_blockfilterindex) {
+        g_blockfilterindex->Stop();
+        g_blockfilterindex.reset();
+    }
 
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
@@ -267,6 +301,7 @@ void Shutdown() {
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
+    GetLogger().StopAsyncWriter();
 }
 
 /**
@@ -371,6 +406,27 @@ std::string HelpMessage(HelpMessageMode mode) {
         strprintf(
             _("Set database cache size in megabytes (%d to %d, default: %d)"),
             nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    if (showDebug) {
+        strUsage += HelpMessageOpt(
+            "-dbblocksize=<n>",
+            strprintf("Size of the LevelDB table blocks in KiB (default: %d)",
+                      DEFAULT_DB_BLOCK_SIZE));
+        strUsage += HelpMessageOpt(
+            "-dbbloombits=<n>",
+            strprintf("Bits per key of the LevelDB bloom filters, 0 to "
+                      "disable them (default: %d)",
+                      DEFAULT_DB_BLOOM_BITS));
+        strUsage += HelpMessageOpt(
+            "-dbcompression",
+            strprintf("Compress LevelDB tables with snappy, if available "
+                      "(default: %u)",
+                      DEFAULT_DB_COMPRESSION));
+        strUsage += HelpMessageOpt(
+            "-dbmaxopenfiles=<n>",
+            strprintf("Maximum number of files each LevelDB database keeps "
+                      "open (minimum: 16, default: %d)",
+                      DEFAULT_DB_MAX_OPEN_FILES));
+    }
     if (showDebug) {
         strUsage += HelpMessageOpt(
             "-feefilter", strprintf("Tell other nodes to filter invs to us by "
@@ -424,6 +480,12 @@ std::string HelpMessage(HelpMessageMode mode) {
         "-pid=<file>",
         strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt(
+        "-prefetchthreads=<n>",
+        strprintf(_("Set the number of threads reading the coins spent by "
+                    "blocks ahead of their connection (0 to %d, 0 = read "
+                    "them when connecting, default: %d)"),
+                  MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
     strUsage += HelpMessageOpt(
         "-prune=<n>",
         strprintf(
@@ -431,7 +493,8 @@ std::string HelpMessage(HelpMessageMode mode) {
               "old blocks. This allows the pruneblockchain RPC to be called to "
               "delete specific blocks, and enables automatic pruning of old "
               "blocks if a target size in MiB is provided. This mode is "
-              "incompatible with -txindex and -rescan. "
+              "incompatible with -txindex, -spentindex, -blockfilterindex and "
+              "-rescan. "
               "Warning: Reverting this setting requires re-downloading the "
               "entire blockchain. "
               "(default: 0 = disable pruning blocks, 1 = allow manual pruning "
@@ -444,6 +507,18 @@ std::string HelpMessage(HelpMessageMode mode) {
     strUsage +=
         HelpMessageOpt("-reindex", _("Rebuild chain state and block index from "
                                      "the blk*.dat files on disk"));
+    strUsage += HelpMessageOpt(
+        "-blockfilterindex",
+        strprintf(_("Maintain an index of the BIP 158 basic filters of the "
+                    "blocks, used by the getblockfilter rpc call and to speed "
+                    "up wallet rescans. The index is built in the background "
+                    "and can be enabled at any time (default: %d)"),
+                  DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt(
+        "-spentindex",
+        strprintf(_("Maintain an index of spent outputs, used by the "
+                    "getspentinfo rpc call (default: %d)"),
+                  DEFAULT_SPENTINDEX));
 #ifndef WIN32
     strUsage += HelpMessageOpt(
         "-sysperms",
@@ -451,9 +526,11 @@ std::string HelpMessage(HelpMessageMode mode) {
           "077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt(
-        "-txindex", strprintf(_("Maintain a full transaction index, used by "
-                                "the getrawtransaction rpc call (default: %d)"),
-                              DEFAULT_TXINDEX));
+        "-txindex",
+        strprintf(_("Maintain a full transaction index, used by the "
+                    "getrawtransaction rpc call. The index is built in the "
+                    "background and can be enabled at any time (default: %d)"),
+                  DEFAULT_TXINDEX));
     strUsage += HelpMessageOpt(
         "-usecashaddr", _("Use Cash Address for destination encoding instead "
                           "of base58 (activate by default on Jan, 14)"));
@@ -657,6 +734,12 @@ std::string HelpMessage(HelpMessageMode mode) {
         strUsage += HelpMessageOpt(
             "-testsafemode",
             strprintf("Force safe mode (default: %d)", DEFAULT_TESTSAFEMODE));
+        strUsage += HelpMessageOpt(
+            "-tracing",
+            strprintf("Record the time spent in block validation, message "
+                      "processing, database writes and RPC calls, to be "
+                      "written with the dumptrace RPC (default: %d)",
+                      DEFAULT_TRACING));
         strUsage +=
             HelpMessageOpt("-dropmessagestest=<n>",
                            "Randomly drop 1 of every <n> network messages");
@@ -729,6 +812,23 @@ std::string HelpMessage(HelpMessageMode mode) {
             strprintf(
                 "Add microsecond precision to debug timestamps (default: %d)",
                 DEFAULT_LOGTIMEMICROS));
+        strUsage += HelpMessageOpt(
+            "-logbuffersize=<n>",
+            strprintf("Number of messages buffered for the thread writing "
+                      "debug.log, 0 to write them from the logging thread. "
+                      "Buffered messages are lost on a crash or a failed "
+                      "assertion (default: %d)",
+                      DEFAULT_LOGBUFFERSIZE));
+        strUsage += HelpMessageOpt(
+            "-logflushinterval=<n>",
+            strprintf("Write buffered log messages to debug.log at least "
+                      "every <n> milliseconds (default: %d)",
+                      DEFAULT_LOGFLUSHINTERVAL));
+        strUsage += HelpMessageOpt(
+            "-lockstats",
+            strprintf("Record lock contention statistics, reported by the "
+                      "getlockstats RPC (default: %d)",
+                      DEFAULT_LOCKSTATS));
         strUsage += HelpMessageOpt(
             "-mocktime=<n>",
             "Replace actual time with <n> seconds since epoch (default: 0)");
@@ -850,6 +950,11 @@ std::string HelpMessage(HelpMessageMode mode) {
     strUsage += HelpMessageOpt(
         "-rest", strprintf(_("Accept public REST requests (default: %d)"),
                            DEFAULT_REST_ENABLE));
+    strUsage += HelpMessageOpt(
+        "-metrics",
+        strprintf(_("Accept public requests for node metrics in the "
+                    "Prometheus text format at /metrics (default: %d)"),
+                  DEFAULT_METRICS_ENABLE));
     strUsage += HelpMessageOpt(
         "-rpcbind=<addr>",
         _("Bind to given address to listen for JSON-RPC connections. Use "
@@ -1121,6 +1226,10 @@ static bool AppInitServers(Config &config, boost::thread_group &threadGroup) {
     if (!StartHTTPRPC()) return false;
     if (gArgs.GetBoolArg("-rest", DEFAULT_REST_ENABLE) && !StartREST())
         return false;
+    if (gArgs.GetBoolArg("-metrics", DEFAULT_METRICS_ENABLE) &&
+        !StartMetrics()) {
+        return false;
+    }
     if (!StartHTTPServer()) return false;
     return true;
 }
@@ -1233,6 +1342,8 @@ void InitLogging() {
         gArgs.GetBoolArg("-logtimemicros", DEFAULT_LOGTIMEMICROS);
 
     fLogIPs = gArgs.GetBoolArg("-logips", DEFAULT_LOGIPS);
+    fLockStats = gArgs.GetBoolArg("-lockstats", DEFAULT_LOCKSTATS);
+    fTracing = gArgs.GetBoolArg("-tracing", DEFAULT_TRACING);
 
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("%s version %s\n", CLIENT_NAME, FormatFullVersion());
@@ -1328,6 +1439,12 @@ bool AppInitParameterInteraction(Config &config) {
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+            return InitError(
+                _("Prune mode is incompatible with -spentindex."));
+        if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(
+                _("Prune mode is incompatible with -blockfilterindex."));
     }
 
     // if space reserved for high priority transactions is misconfigured
@@ -1486,6 +1603,11 @@ bool AppInitParameterInteraction(Config &config) {
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nPrefetchThreads = std::max<int>(
+        0, std::min<int>(gArgs.GetArg("-prefetchthreads",
+                                      DEFAULT_PREFETCH_THREADS),
+                         MAX_PREFETCH_THREADS));
+
     // Configure excessive block size.
     const uint64_t nProposedExcessiveBlockSize =
         gArgs.GetArg("-excessiveblocksize", DEFAULT_MAX_BLOCK_SIZE);
@@ -1701,6 +1823,14 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
 
     if (logger.fPrintToDebugLog) {
         logger.OpenDebugLog();
+
+        int nLogBufferSize =
+            gArgs.GetArg("-logbuffersize", DEFAULT_LOGBUFFERSIZE);
+        if (nLogBufferSize > 0) {
+            logger.StartAsyncWriter(
+                nLogBufferSize,
+                gArgs.GetArg("-logflushinterval", DEFAULT_LOGFLUSHINTERVAL));
+        }
     }
 
     if (!logger.fLogTimestamps) {
@@ -1727,6 +1857,11 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
         }
     }
 
+    LogPrintf("Using %u threads for input prefetching\n", nPrefetchThreads);
+    for (int i = 0; i < nPrefetchThreads; i++) {
+        threadGroup.create_thread(&ThreadInputPrefetch);
+    }
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop =
         boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1935,12 +2070,25 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
     // total cache cannot be greater than nMaxDbcache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20);
     int64_t nBlockTreeDBCache = nTotalCache / 8;
-    nBlockTreeDBCache = std::min(nBlockTreeDBCache,
-                                 (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)
-                                      ? nMaxBlockDBAndTxIndexCache
-                                      : nMaxBlockDBCache)
-                                     << 20);
+    nBlockTreeDBCache = std::min(
+        nBlockTreeDBCache,
+        (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)
+             ? nMaxBlockDBAndSpentIndexCache
+             : nMaxBlockDBCache)
+            << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nTxIndexCache =
+        std::min(nTotalCache / 8,
+                 gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)
+                     ? nMaxTxIndexCache << 20
+                     : 0);
+    nTotalCache -= nTxIndexCache;
+    int64_t nFilterIndexCache =
+        std::min(nTotalCache / 8,
+                 gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)
+                     ? nMaxFilterIndexCache << 20
+                     : 0);
+    nTotalCache -= nFilterIndexCache;
     // use 25%-50% of the remainder for disk cache
     int64_t nCoinDBCache =
         std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23));
@@ -1954,6 +2102,14 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n",
               nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        LogPrintf("* Using %.1fMiB for transaction index database\n",
+                  nTxIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        LogPrintf("* Using %.1fMiB for block filter index database\n",
+                  nFilterIndexCache * (1.0 / 1024 / 1024));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n",
               nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of "
@@ -2019,10 +2175,12 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
                     break;
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using "
-                                     "-reindex-chainstate to change -txindex");
+                // Check for changed -spentindex state
+                if (fSpentIndex !=
+                    gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                    strLoadError =
+                        _("You need to rebuild the database using "
+                          "-reindex-chainstate to change -spentindex");
                     break;
                 }
 
@@ -2134,6 +2292,23 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    // The transaction and block filter indexes build themselves in the
+    // background from the block files, so they can be enabled at any time
+    // without a reindex.
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        g_txindex.reset(new TxIndex(config, nTxIndexCache, false, fReindex));
+        if (!g_txindex->Start()) {
+            return InitError(_("Error loading the transaction index"));
+        }
+    }
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        g_blockfilterindex.reset(new BlockFilterIndex(
+            config, nFilterIndexCache, false, fReindex));
+        if (!g_blockfilterindex->Start()) {
+            return InitError(_("Error loading the block filter index"));
+        }
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK,
                          CLIENT_VERSION);
@@ -8,6 +8,10 @@
 #include "util.h"
 #include "utiltime.h"
 
+#include <atomic>
+#include <chrono>
+#include <exception>
+
 bool fLogIPs = DEFAULT_LOGIPS;
 
 /**
@@ -32,6 +36,80 @@ static int FileWriteStr(const std::string &str, FILE *fp) {
     return fwrite(str.data(), 1, str.size(), fp);
 }
 
+//! debug.log is unbuffered, queued messages are written in chunks of about
+//! this many bytes.
+static const size_t LOG_WRITE_BATCH_SIZE = 1 << 16;
+
+BCLog::MessageQueue::MessageQueue(size_t nCapacity)
+    : mask([nCapacity] {
+          size_t n = 1;
+          while (n < nCapacity) {
+              n <<= 1;
+          }
+          return n - 1;
+      }()) {
+    cells.reset(new Cell[mask + 1]);
+    for (size_t i = 0; i <= mask; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool BCLog::MessageQueue::Push(std::string &&msg) {
+    size_t pos = nPushPos.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0) {
+            // The cell is free, claim it.
+            if (nPushPos.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The cell still holds a message from the previous lap.
+            return false;
+        } else {
+            pos = nPushPos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->msg = std::move(msg);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool BCLog::MessageQueue::Pop(std::string &msg) {
+    size_t pos = nPopPos.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+        if (diff == 0) {
+            if (nPopPos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = nPopPos.load(std::memory_order_relaxed);
+        }
+    }
+    msg = std::move(cell->msg);
+    cell->msg.clear();
+    // Free the cell for the producer of the next lap.
+    cell->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+}
+
+size_t BCLog::MessageQueue::Size() const {
+    size_t nPush = nPushPos.load(std::memory_order_relaxed);
+    size_t nPop = nPopPos.load(std::memory_order_relaxed);
+    return nPush > nPop ? nPush - nPop : 0;
+}
+
 void BCLog::Logger::OpenDebugLog() {
     std::lock_guard<std::mutex> scoped_lock(mutexDebugLog);
 
@@ -111,23 +189,29 @@ std::string ListLogCategories() {
 }
 
 BCLog::Logger::~Logger() {
+    StopAsyncWriter();
     if (fileout) {
         fclose(fileout);
     }
 }
 
+std::string BCLog::Logger::LogTimestampPrefix() const {
+    if (!fLogTimestamps) return "";
+
+    int64_t nTimeMicros = GetLogTimeMicros();
+    std::string strStamp =
+        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeMicros / 1000000);
+    if (fLogTimeMicros) strStamp += strprintf(".%06d", nTimeMicros % 1000000);
+    return strStamp + ' ';
+}
+
 std::string BCLog::Logger::LogTimestampStr(const std::string &str) {
     std::string strStamped;
 
     if (!fLogTimestamps) return str;
 
     if (fStartedNewLine) {
-        int64_t nTimeMicros = GetLogTimeMicros();
-        strStamped =
-            DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeMicros / 1000000);
-        if (fLogTimeMicros)
-            strStamped += strprintf(".%06d", nTimeMicros % 1000000);
-        strStamped += ' ' + str;
+        strStamped = LogTimestampPrefix() + str;
     } else
         strStamped = str;
 
@@ -139,6 +223,20 @@ std::string BCLog::Logger::LogTimestampStr(const std::string &str) {
     return strStamped;
 }
 
+int BCLog::Logger::WriteDebugLog(const std::string &str) {
+    // Reopen the log file, if requested.
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        fs::path pathDebug = GetDataDir() / "debug.log";
+        if (fsbridge::freopen(pathDebug, "a", fileout) != nullptr) {
+            // unbuffered.
+            setbuf(fileout, nullptr);
+        }
+    }
+
+    return FileWriteStr(str, fileout);
+}
+
 int BCLog::Logger::LogPrintStr(const std::string &str) {
     // Returns total number of characters written.
     int ret = 0;
@@ -149,6 +247,25 @@ int BCLog::Logger::LogPrintStr(const std::string &str) {
         // Print to console.
         ret = fwrite(strTimestamped.data(), 1, strTimestamped.size(), stdout);
         fflush(stdout);
+    } else if (fPrintToDebugLog && fAsync) {
+        // Leave the write to the writer thread, waking it up early if the
+        // queue is filling up.
+        ret = strTimestamped.length();
+        if (!queue->Push(std::move(strTimestamped))) {
+            nDroppedMessages++;
+            ret = 0;
+        }
+        // Pairs with the fence in StopAsyncWriter: either it drains this
+        // message, or the writer is seen stopped here.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!fAsync) {
+            // The writer stopped meanwhile, and nothing may be left to write
+            // this message, so write it now.
+            std::lock_guard<std::mutex> scoped_lock(mutexDebugLog);
+            DrainQueue();
+        } else if (queue->Size() >= queue->Capacity() / 2) {
+            condWriter.notify_one();
+        }
     } else if (fPrintToDebugLog) {
         std::lock_guard<std::mutex> scoped_lock(mutexDebugLog);
 
@@ -157,22 +274,120 @@ int BCLog::Logger::LogPrintStr(const std::string &str) {
             ret = strTimestamped.length();
             vMsgsBeforeOpenLog.push_back(strTimestamped);
         } else {
-            // Reopen the log file, if requested.
-            if (fReopenDebugLog) {
-                fReopenDebugLog = false;
-                fs::path pathDebug = GetDataDir() / "debug.log";
-                if (fsbridge::freopen(pathDebug, "a", fileout) != nullptr) {
-                    // unbuffered.
-                    setbuf(fileout, nullptr);
-                }
-            }
-
-            ret = FileWriteStr(strTimestamped, fileout);
+            // Keep the order of messages queued before the writer stopped.
+            DrainQueue();
+            ret = WriteDebugLog(strTimestamped);
         }
     }
     return ret;
 }
 
+void BCLog::Logger::DrainQueue() {
+    if (!queue) {
+        return;
+    }
+
+    std::string strBatch;
+    std::string str;
+    while (queue->Pop(str)) {
+        strBatch += str;
+        if (strBatch.size() >= LOG_WRITE_BATCH_SIZE) {
+            WriteDebugLog(strBatch);
+            strBatch.clear();
+        }
+    }
+
+    uint64_t nDropped = nDroppedMessages;
+    if (nDropped != nDroppedLogged) {
+        strBatch += LogTimestampPrefix() +
+                    strprintf("%u log messages were dropped, the log writer "
+                              "fell behind\n",
+                              nDropped - nDroppedLogged);
+        nDroppedLogged = nDropped;
+    }
+
+    if (!strBatch.empty()) {
+        WriteDebugLog(strBatch);
+    }
+}
+
+void BCLog::Logger::Flush(bool fWait) {
+    std::unique_lock<std::mutex> lock(mutexDebugLog, std::defer_lock);
+    if (fWait) {
+        lock.lock();
+    } else if (!lock.try_lock()) {
+        return;
+    }
+
+    if (fileout) {
+        DrainQueue();
+    }
+}
+
+void BCLog::Logger::ThreadWriter() {
+    RenameThread("bitcoin-logger");
+    std::unique_lock<std::mutex> lock(mutexWriter);
+    while (!fStopWriter) {
+        condWriter.wait_for(lock, std::chrono::milliseconds(nFlushIntervalMs));
+        lock.unlock();
+        Flush();
+        lock.lock();
+    }
+}
+
+static std::terminate_handler prevTerminateHandler = nullptr;
+
+/** Do not lose the last messages before an uncaught exception. */
+static void FlushLogAndTerminate() {
+    GetLogger().Flush(false);
+    if (prevTerminateHandler) {
+        prevTerminateHandler();
+    }
+    std::abort();
+}
+
+void BCLog::Logger::StartAsyncWriter(size_t nBufferSize,
+                                     int64_t nFlushIntervalMsIn) {
+    std::lock_guard<std::mutex> scoped_lock(mutexDebugLog);
+    if (fAsync || fileout == nullptr) {
+        return;
+    }
+
+    // A previous queue is kept, a late message may still be pushed to it.
+    if (!queue) {
+        queue.reset(new MessageQueue(nBufferSize));
+    }
+    nFlushIntervalMs = std::max<int64_t>(1, nFlushIntervalMsIn);
+    fStopWriter = false;
+    fAsync = true;
+    threadWriter = std::thread(&BCLog::Logger::ThreadWriter, this);
+
+    if (!prevTerminateHandler) {
+        prevTerminateHandler = std::set_terminate(FlushLogAndTerminate);
+    }
+}
+
+void BCLog::Logger::StopAsyncWriter() {
+    if (!threadWriter.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutexWriter);
+        fStopWriter = true;
+    }
+    condWriter.notify_one();
+    threadWriter.join();
+
+    // Messages logged from now on are written directly, after whatever the
+    // writer thread did not get to. Those queued by threads which have not
+    // seen fAsync change yet are written by these threads.
+    std::lock_guard<std::mutex> scoped_lock(mutexDebugLog);
+    fAsync = false;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    DrainQueue();
+}
+
 void BCLog::Logger::ShrinkDebugFile() {
     // Amount of debug.log to save at end when shrinking (must fit in memory)
     constexpr size_t RECENT_DEBUG_HISTORY_SIZE = 10 * 1000000;
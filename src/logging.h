@@ -8,14 +8,22 @@
 #define BITCOIN_LOGGING_H
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+//! Number of messages queued for the debug.log writer thread, 0 to write
+//! them from the logging thread.
+static const int DEFAULT_LOGBUFFERSIZE = 16384;
+//! Longest time a queued message waits before it is written, in milliseconds.
+static const int DEFAULT_LOGFLUSHINTERVAL = 100;
 
 extern bool fLogIPs;
 
@@ -47,12 +55,59 @@ enum LogFlags : uint32_t {
     ALL = ~uint32_t(0),
 };
 
+/**
+ * Bounded lock-free queue of log messages, for any number of producers.
+ * Every cell carries a sequence number telling whether it is free for the
+ * producer, or filled for the consumer, at a given queue position.
+ */
+class MessageQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        std::string msg;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    const size_t mask;
+    std::atomic<size_t> nPushPos{0};
+    std::atomic<size_t> nPopPos{0};
+
+public:
+    /** nCapacity is rounded up to a power of two. */
+    explicit MessageQueue(size_t nCapacity);
+
+    /** Queue a message, or return false if the queue is full. */
+    bool Push(std::string &&msg);
+    /** Take the oldest message, or return false if the queue is empty. */
+    bool Pop(std::string &msg);
+
+    size_t Capacity() const { return mask + 1; }
+    /** Approximate number of queued messages. */
+    size_t Size() const;
+};
+
 class Logger {
 private:
     FILE *fileout = nullptr;
     std::mutex mutexDebugLog;
     std::list<std::string> vMsgsBeforeOpenLog;
 
+    /**
+     * Messages for debug.log are queued when the writer thread is running,
+     * and written in batches by that thread.
+     */
+    std::unique_ptr<MessageQueue> queue;
+    std::atomic<bool> fAsync{false};
+    std::atomic<uint64_t> nDroppedMessages{0};
+    //! Dropped messages already noted in debug.log, guarded by mutexDebugLog.
+    uint64_t nDroppedLogged = 0;
+
+    std::thread threadWriter;
+    std::mutex mutexWriter;
+    std::condition_variable condWriter;
+    bool fStopWriter = false;
+    int64_t nFlushIntervalMs = DEFAULT_LOGFLUSHINTERVAL;
+
     /**
      * fStartedNewLine is a state variable that will suppress printing of the
      * timestamp when multiple calls are made that don't end in a newline.
@@ -65,8 +120,15 @@ private:
      */
     std::atomic<uint32_t> logCategories{0};
 
+    std::string LogTimestampPrefix() const;
     std::string LogTimestampStr(const std::string &str);
 
+    /** Write to debug.log, reopening it if requested. */
+    int WriteDebugLog(const std::string &str);
+    /** Write all queued messages. */
+    void DrainQueue();
+    void ThreadWriter();
+
 public:
     bool fPrintToConsole = false;
     bool fPrintToDebugLog = true;
@@ -84,6 +146,24 @@ public:
     void OpenDebugLog();
     void ShrinkDebugFile();
 
+    /**
+     * Start writing debug.log from a background thread, buffering up to
+     * nBufferSize messages. Messages logged while the buffer is full are
+     * dropped and counted. Buffered messages are written when the process
+     * terminates on an uncaught exception, but are lost if it is killed by a
+     * signal or calls abort(), as a failed assert does.
+     */
+    void StartAsyncWriter(size_t nBufferSize, int64_t nFlushIntervalMsIn);
+    /** Stop the writer thread, after writing all queued messages. */
+    void StopAsyncWriter();
+    /**
+     * Write all queued messages and flush debug.log. Unless fWait is set,
+     * give up if another thread is writing, so that this is safe to call
+     * when the process is about to die.
+     */
+    void Flush(bool fWait = true);
+    uint64_t GetDroppedMessages() const { return nDroppedMessages; }
+
     void EnableCategory(LogFlags category);
     void DisableCategory(LogFlags category);
 
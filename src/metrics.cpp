@@ -0,0 +1,188 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "metrics.h"
+
+#include "httpserver.h"
+#include "net.h"
+#include "protocol.h"
+#include "rpc/protocol.h"
+#include "tinyformat.h"
+#include "txmempool.h"
+#include "validation.h"
+
+#include <algorithm>
+
+//! Bucket bounds of the block connection time histogram, in microseconds.
+static const std::vector<int64_t> BLOCK_CONNECT_TIME_BOUNDS = {
+    1000,    2500,    5000,    10000,    25000,    50000,    100000,
+    250000,  500000,  1000000, 2500000,  5000000,  10000000, 30000000,
+    60000000};
+
+MetricsHistogram::MetricsHistogram(std::vector<int64_t> vBoundsIn)
+    : vBounds(std::move(vBoundsIn)), vBuckets(vBounds.size() + 1) {
+    for (auto &bucket : vBuckets) {
+        bucket = 0;
+    }
+}
+
+void MetricsHistogram::Observe(int64_t nMicros) {
+    size_t i = std::lower_bound(vBounds.begin(), vBounds.end(), nMicros) -
+               vBounds.begin();
+    vBuckets[i].fetch_add(1, std::memory_order_relaxed);
+    nSumMicros.fetch_add(std::max<int64_t>(nMicros, 0),
+                         std::memory_order_relaxed);
+}
+
+void MetricsHistogram::Format(std::string &strOut, const std::string &strName,
+                              const std::string &strHelp) const {
+    strOut += strprintf("# HELP %s %s\n# TYPE %s histogram\n", strName,
+                        strHelp, strName);
+    // Buckets are cumulative. The count is derived from them, so that it is
+    // consistent with the +Inf bucket while observations come in.
+    uint64_t nCumulative = 0;
+    for (size_t i = 0; i < vBuckets.size(); i++) {
+        nCumulative += vBuckets[i].load(std::memory_order_relaxed);
+        std::string strBound =
+            i < vBounds.size() ? strprintf("%g", vBounds[i] / 1e6) : "+Inf";
+        strOut += strprintf("%s_bucket{le=\"%s\"} %u\n", strName, strBound,
+                            nCumulative);
+    }
+    strOut += strprintf("%s_sum %g\n", strName,
+                        nSumMicros.load(std::memory_order_relaxed) / 1e6);
+    strOut += strprintf("%s_count %u\n", strName, nCumulative);
+}
+
+MetricsCounterMap::MetricsCounterMap(const std::vector<std::string> &vKeys,
+                                     const std::string &strOtherKeyIn)
+    : strOtherKey(strOtherKeyIn) {
+    for (const std::string &strKey : vKeys) {
+        counters[strKey] = 0;
+    }
+    counters[strOtherKey] = 0;
+}
+
+void MetricsCounterMap::Add(const std::string &strKey, uint64_t n) {
+    auto it = counters.find(strKey);
+    if (it == counters.end()) {
+        it = counters.find(strOtherKey);
+    }
+    it->second.fetch_add(n, std::memory_order_relaxed);
+}
+
+std::map<std::string, uint64_t> MetricsCounterMap::Get() const {
+    std::map<std::string, uint64_t> result;
+    for (const auto &entry : counters) {
+        result[entry.first] = entry.second.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+Metrics::Metrics()
+    : blockConnectTime(BLOCK_CONNECT_TIME_BOUNDS),
+      recvBytesPerMsgCmd(getAllNetMessageTypes(), NET_MESSAGE_COMMAND_OTHER),
+      sendBytesPerMsgCmd(getAllNetMessageTypes(), NET_MESSAGE_COMMAND_OTHER) {}
+
+Metrics &GetMetrics() {
+    // Constructed on first use, as it depends on the list of message types.
+    static Metrics metrics;
+    return metrics;
+}
+
+static void FormatGauge(std::string &strOut, const std::string &strName,
+                        const std::string &strHelp, double value) {
+    strOut += strprintf("# HELP %s %s\n# TYPE %s gauge\n%s %g\n", strName,
+                        strHelp, strName, strName, value);
+}
+
+static void FormatCounter(std::string &strOut, const std::string &strName,
+                          const std::string &strHelp, uint64_t value) {
+    strOut += strprintf("# HELP %s %s\n# TYPE %s counter\n%s %u\n", strName,
+                        strHelp, strName, strName, value);
+}
+
+static void FormatCounterMap(std::string &strOut, const std::string &strName,
+                             const std::string &strHelp,
+                             const std::string &strLabel,
+                             const MetricsCounterMap &counters) {
+    strOut += strprintf("# HELP %s %s\n# TYPE %s counter\n", strName, strHelp,
+                        strName);
+    for (const auto &entry : counters.Get()) {
+        strOut += strprintf("%s{%s=\"%s\"} %u\n", strName, strLabel,
+                            entry.first, entry.second);
+    }
+}
+
+std::string FormatMetrics() {
+    Metrics &metrics = GetMetrics();
+    std::string strOut;
+
+    FormatGauge(strOut, "bitcoin_blocks", "Height of the active chain tip.",
+                metrics.nBlockHeight);
+    metrics.blockConnectTime.Format(
+        strOut, "bitcoin_block_connect_seconds",
+        "Time taken to connect a block to the active chain tip.");
+
+    FormatGauge(strOut, "bitcoin_mempool_transactions",
+                "Number of transactions in the mempool.", mempool.size());
+    FormatGauge(strOut, "bitcoin_mempool_size_bytes",
+                "Serialized size of the transactions in the mempool.",
+                mempool.GetTotalTxSize());
+    FormatGauge(strOut, "bitcoin_mempool_usage_bytes",
+                "Memory used by the mempool.", mempool.DynamicMemoryUsage());
+    FormatGauge(strOut, "bitcoin_coins_cache_usage_bytes",
+                "Memory used by the coins cache.", metrics.nCoinsCacheBytes);
+
+    uint64_t nHits = metrics.nScriptCacheHits;
+    uint64_t nMisses = metrics.nScriptCacheMisses;
+    FormatCounter(strOut, "bitcoin_script_cache_hits_total",
+                  "Transactions whose scripts were found in the script "
+                  "execution cache.",
+                  nHits);
+    FormatCounter(strOut, "bitcoin_script_cache_misses_total",
+                  "Transactions whose scripts had to be executed.", nMisses);
+    FormatGauge(strOut, "bitcoin_script_cache_hit_ratio",
+                "Ratio of script execution cache lookups that hit.",
+                nHits + nMisses ? double(nHits) / (nHits + nMisses) : 0.0);
+
+    if (g_connman) {
+        strOut += "# HELP bitcoin_peers Number of connected peers.\n"
+                  "# TYPE bitcoin_peers gauge\n";
+        strOut += strprintf(
+            "bitcoin_peers{direction=\"inbound\"} %u\n",
+            g_connman->GetNodeCount(CConnman::CONNECTIONS_IN));
+        strOut += strprintf(
+            "bitcoin_peers{direction=\"outbound\"} %u\n",
+            g_connman->GetNodeCount(CConnman::CONNECTIONS_OUT));
+    }
+    FormatCounterMap(strOut, "bitcoin_net_received_bytes_total",
+                     "Bytes received from peers per message type.", "command",
+                     metrics.recvBytesPerMsgCmd);
+    FormatCounterMap(strOut, "bitcoin_net_sent_bytes_total",
+                     "Bytes sent to peers per message type.", "command",
+                     metrics.sendBytesPerMsgCmd);
+
+    return strOut;
+}
+
+static bool HTTPReq_Metrics(Config &config, HTTPRequest *req,
+                            const std::string &) {
+    if (req->GetRequestMethod() != HTTPRequest::GET) {
+        req->WriteReply(HTTP_BAD_METHOD, "Only GET requests are supported\n");
+        return false;
+    }
+
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, FormatMetrics());
+    return true;
+}
+
+bool StartMetrics() {
+    RegisterHTTPHandler("/metrics", true, HTTPReq_Metrics);
+    return true;
+}
+
+void StopMetrics() {
+    UnregisterHTTPHandler("/metrics", true);
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_METRICS_H
+#define BITCOIN_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Histogram of durations in microseconds, with fixed bucket bounds. Updates
+ * are lock free.
+ */
+class MetricsHistogram {
+private:
+    const std::vector<int64_t> vBounds;
+    std::vector<std::atomic<uint64_t>> vBuckets;
+    std::atomic<uint64_t> nSumMicros{0};
+
+public:
+    /** vBoundsIn are the inclusive upper bounds of the buckets, ascending. */
+    explicit MetricsHistogram(std::vector<int64_t> vBoundsIn);
+
+    void Observe(int64_t nMicros);
+
+    /** Write the histogram, in seconds, in the Prometheus text format. */
+    void Format(std::string &strOut, const std::string &strName,
+                const std::string &strHelp) const;
+};
+
+/**
+ * Counters for a set of keys fixed at construction, so that they can be
+ * updated without a lock. Unknown keys are counted under strOtherKey.
+ */
+class MetricsCounterMap {
+private:
+    std::map<std::string, std::atomic<uint64_t>> counters;
+    const std::string strOtherKey;
+
+public:
+    MetricsCounterMap(const std::vector<std::string> &vKeys,
+                      const std::string &strOtherKeyIn);
+
+    void Add(const std::string &strKey, uint64_t n);
+    std::map<std::string, uint64_t> Get() const;
+};
+
+/**
+ * Node statistics maintained as the node runs, to be served by /metrics
+ * without taking cs_main.
+ */
+struct Metrics {
+    //! Time taken by ConnectTip.
+    MetricsHistogram blockConnectTime;
+    std::atomic<int> nBlockHeight{-1};
+    //! Memory used by the coins cache, updated whenever the state is flushed.
+    std::atomic<uint64_t> nCoinsCacheBytes{0};
+    std::atomic<uint64_t> nScriptCacheHits{0};
+    std::atomic<uint64_t> nScriptCacheMisses{0};
+    //! Bytes received and sent per message type, headers included.
+    MetricsCounterMap recvBytesPerMsgCmd;
+    MetricsCounterMap sendBytesPerMsgCmd;
+
+    Metrics();
+};
+
+Metrics &GetMetrics();
+
+/** Render all metrics in the Prometheus text exposition format. */
+std::string FormatMetrics();
+
+/** Start serving /metrics on the HTTP server. */
+bool StartMetrics();
+/** Stop serving /metrics. */
+void StopMetrics();
+
+#endif // BITCOIN_METRICS_H
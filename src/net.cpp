@@ -17,6 +17,7 @@
 #include "crypto/common.h"
 #include "crypto/sha256.h"
 #include "hash.h"
+#include "metrics.h"
 #include "netbase.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
@@ -27,6 +28,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -61,7 +63,7 @@
 #endif
 #endif
 
-static const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
+const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL;
@@ -669,6 +671,8 @@ void CNode::copyStats(CNodeStats &stats) {
         stats.mapRecvBytesPerMsgCmd = mapRecvBytesPerMsgCmd;
         stats.nRecvBytes = nRecvBytes;
     }
+    stats.nSendCalls = nSendCalls;
+    stats.nRecvCalls = nRecvCalls;
     stats.fWhitelisted = fWhitelisted;
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -716,6 +720,7 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
         if (vRecvMsg.empty() || vRecvMsg.back().complete()) {
             vRecvMsg.push_back(CNetMessage(Params().NetMagic(), SER_NETWORK,
                                            INIT_PROTO_VERSION));
+            vRecvMsg.back().vRecv.SetBuffer(recvBufferPool.Get());
         }
 
         CNetMessage &msg = vRecvMsg.back();
@@ -753,6 +758,8 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
 
             assert(i != mapRecvBytesPerMsgCmd.end());
             i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+            GetMetrics().recvBytesPerMsgCmd.Add(
+                i->first, msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE);
 
             msg.nTime = nTimeMicros;
             complete = true;
@@ -825,14 +832,11 @@ int CNetMessage::readData(const char *pch, uint32_t nBytes) {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message
-        // size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
-
+    // Append rather than resize and copy, so the buffer is not zero filled
+    // first. It grows with the data actually received, not with the size
+    // announced in the header.
     hasher.Write((const uint8_t *)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -846,14 +850,24 @@ const uint256 &CNetMessage::GetMessageHash() const {
     return data_hash;
 }
 
+#ifndef WIN32
+//! Maximum number of buffers gathered in a single sendmsg call.
+#ifdef IOV_MAX
+static const size_t MAX_SEND_IOV = IOV_MAX;
+#else
+static const size_t MAX_SEND_IOV = 16;
+#endif
+#endif
+
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode *pnode) const {
     AssertLockHeld(pnode->cs_vSend);
     size_t nSentSize = 0;
     size_t nMsgCount = 0;
 
-    for (const auto &data : pnode->vSendMsg) {
-        assert(data.size() > pnode->nSendOffset);
+    while (nMsgCount < pnode->vSendMsg.size()) {
+        assert(pnode->vSendMsg[nMsgCount].size() > pnode->nSendOffset);
+        size_t nPending = 0;
         int nBytes = 0;
 
         {
@@ -862,11 +876,36 @@ size_t CConnman::SocketSendData(CNode *pnode) const {
                 break;
             }
 
+#ifdef WIN32
+            const auto &data = pnode->vSendMsg[nMsgCount];
+            nPending = data.size() - pnode->nSendOffset;
             nBytes = send(pnode->hSocket,
                           reinterpret_cast<const char *>(data.data()) +
                               pnode->nSendOffset,
-                          data.size() - pnode->nSendOffset,
-                          MSG_NOSIGNAL | MSG_DONTWAIT);
+                          nPending, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Gather as many pending buffers as possible, so that a burst of
+            // small messages, and their headers, is sent in a single call.
+            struct iovec iov[MAX_SEND_IOV];
+            size_t nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (size_t i = nMsgCount;
+                 i < pnode->vSendMsg.size() && nIov < MAX_SEND_IOV; i++) {
+                const auto &data = pnode->vSendMsg[i];
+                iov[nIov].iov_base =
+                    const_cast<uint8_t *>(data.data()) + nOffset;
+                iov[nIov].iov_len = data.size() - nOffset;
+                nPending += iov[nIov].iov_len;
+                nIov++;
+                nOffset = 0;
+            }
+
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+            pnode->nSendCalls++;
         }
 
         if (nBytes == 0) {
@@ -889,19 +928,35 @@ size_t CConnman::SocketSendData(CNode *pnode) const {
         assert(nBytes > 0);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size()) {
-            // could not send full message; stop sending more
-            break;
-        }
 
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
+        // Walk the buffers that were sent; the last one may only have been
+        // sent in part.
+        size_t nRemaining = nBytes;
+        while (nRemaining > 0) {
+            const auto &data = pnode->vSendMsg[nMsgCount];
+            size_t nLeft = data.size() - pnode->nSendOffset;
+            if (nRemaining < nLeft) {
+                pnode->nSendOffset += nRemaining;
+                break;
+            }
+
+            nRemaining -= nLeft;
+            pnode->nSendOffset = 0;
+            pnode->nSendSize -= data.size();
+            nMsgCount++;
+        }
         pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
+
+        if (size_t(nBytes) != nPending) {
+            // could not send everything; stop sending more
+            break;
+        }
     }
 
+    for (size_t i = 0; i < nMsgCount; i++) {
+        pnode->sendBufferPool.Put(std::move(pnode->vSendMsg[i].owned));
+    }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(),
                           pnode->vSendMsg.begin() + nMsgCount);
 
@@ -1413,6 +1468,7 @@ void CConnman::ThreadSocketHandler() {
                     }
                     nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf),
                                   MSG_DONTWAIT);
+                    pnode->nRecvCalls++;
                 }
                 if (nBytes > 0) {
                     bool notify = false;
@@ -2824,6 +2880,8 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
     nLastRecv = 0;
     nSendBytes = 0;
     nRecvBytes = 0;
+    nSendCalls = 0;
+    nRecvCalls = 0;
     nTimeOffset = 0;
     addrName = addrNameIn == "" ? addr.ToStringIPPort() : addrNameIn;
     nVersion = 0;
@@ -2933,14 +2991,17 @@ bool CConnman::NodeFullyConnected(const CNode *pnode) {
 }
 
 void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
-    size_t nMessageSize = msg.data.size();
+    const std::vector<uint8_t> &payload =
+        msg.sharedData ? *msg.sharedData : msg.data;
+    size_t nMessageSize = payload.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",
              SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
+    GetMetrics().sendBytesPerMsgCmd.Add(msg.command, nTotalSize);
 
     std::vector<uint8_t> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    uint256 hash = Hash(payload.data(), payload.data() + nMessageSize);
     CMessageHeader hdr(config->GetChainParams().NetMagic(), msg.command.c_str(),
                        nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
@@ -2959,9 +3020,13 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
         if (pnode->nSendSize > nSendBufferMaxSize) {
             pnode->fPauseSend = true;
         }
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize) {
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.emplace_back(std::move(serializedHeader));
+        if (nMessageSize == 0) {
+            pnode->sendBufferPool.Put(std::move(msg.data));
+        } else if (msg.sharedData) {
+            pnode->vSendMsg.emplace_back(std::move(msg.sharedData));
+        } else {
+            pnode->vSendMsg.emplace_back(std::move(msg.data));
         }
 
         // If write queue empty, attempt "optimistic write"
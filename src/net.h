@@ -94,6 +94,14 @@ static const size_t DEFAULT_MAXSENDBUFFER = 1 * 1000;
 
 static const ServiceFlags REQUIRED_SERVICES = ServiceFlags(NODE_NETWORK);
 
+/** Maximum number of buffers kept around per peer, for each direction */
+static const size_t MAX_POOLED_NET_BUFFERS = 8;
+/** Buffers with a larger capacity are released rather than kept around */
+static const size_t MAX_POOLED_NET_BUFFER_SIZE = 32 * 1024;
+/** Buffers with a smaller capacity, such as those of message headers, are
+ * cheap to allocate and are released rather than taking a place in the pool */
+static const size_t MIN_POOLED_NET_BUFFER_SIZE = 1024;
+
 // Default 24-hour ban.
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;
@@ -111,6 +119,48 @@ class CTransaction;
 class CNodeStats;
 class CClientUIInterface;
 
+/**
+ * A few message buffers kept around after their message was processed or
+ * sent, so their capacity is reused by the next messages rather than freed
+ * and allocated again.
+ */
+template <typename Buffer> class CNetBufferPool {
+public:
+    /** Take an empty buffer, with some capacity if one was pooled. */
+    Buffer Get() {
+        LOCK(cs);
+        if (vBuffers.empty()) {
+            return Buffer();
+        }
+        Buffer buffer = std::move(vBuffers.back());
+        vBuffers.pop_back();
+        return buffer;
+    }
+
+    /** Give a buffer back. Small and large buffers are released, as are the
+     * ones that do not fit in the pool. */
+    void Put(Buffer &&buffer) {
+        if (buffer.capacity() < MIN_POOLED_NET_BUFFER_SIZE ||
+            buffer.capacity() > MAX_POOLED_NET_BUFFER_SIZE) {
+            return;
+        }
+        buffer.clear();
+        LOCK(cs);
+        if (vBuffers.size() < MAX_POOLED_NET_BUFFERS) {
+            vBuffers.push_back(std::move(buffer));
+        }
+    }
+
+    size_t size() const {
+        LOCK(cs);
+        return vBuffers.size();
+    }
+
+private:
+    mutable CCriticalSection cs;
+    std::vector<Buffer> vBuffers;
+};
+
 struct CSerializedNetMsg {
     CSerializedNetMsg() = default;
     CSerializedNetMsg(CSerializedNetMsg &&) = default;
@@ -120,9 +170,31 @@ struct CSerializedNetMsg {
     CSerializedNetMsg &operator=(const CSerializedNetMsg &) = delete;
 
     std::vector<uint8_t> data;
+    //! A payload shared with other messages, sent instead of data when set.
+    std::shared_ptr<const std::vector<uint8_t>> sharedData;
     std::string command;
 };
 
+/**
+ * A buffer in the send queue of a peer: either owned, and recycled once sent,
+ * or shared with the messages queued for other peers.
+ */
+struct CNetSendBuffer {
+    explicit CNetSendBuffer(std::vector<uint8_t> &&ownedIn)
+        : owned(std::move(ownedIn)) {}
+    explicit CNetSendBuffer(
+        std::shared_ptr<const std::vector<uint8_t>> &&sharedIn)
+        : shared(std::move(sharedIn)) {}
+
+    const uint8_t *data() const {
+        return shared ? shared->data() : owned.data();
+    }
+    size_t size() const { return shared ? shared->size() : owned.size(); }
+
+    std::vector<uint8_t> owned;
+    std::shared_ptr<const std::vector<uint8_t>> shared;
+};
+
 class CConnman {
 public:
     enum NumConnections {
@@ -492,6 +564,9 @@ extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 // Command, total bytes
 typedef std::map<std::string, uint64_t> mapMsgCmdSize;
 
+/** Key under which bytes of unknown message types are counted. */
+extern const std::string NET_MESSAGE_COMMAND_OTHER;
+
 class CNodeStats {
 public:
     NodeId nodeid;
@@ -511,6 +586,8 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    uint64_t nSendCalls;
+    uint64_t nRecvCalls;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -586,7 +663,9 @@ public:
     // Offset inside the first vSendMsg already sent.
     size_t nSendOffset;
     uint64_t nSendBytes;
-    std::deque<std::vector<uint8_t>> vSendMsg;
+    std::deque<CNetSendBuffer> vSendMsg;
+    // Buffers of sent messages, reused to serialize the next ones.
+    CNetBufferPool<std::vector<uint8_t>> sendBufferPool;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -594,11 +673,16 @@ public:
     CCriticalSection cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
+    // Buffers of processed messages, reused to receive the next ones.
+    CNetBufferPool<CSerializeData> recvBufferPool;
 
     CCriticalSection cs_sendProcessing;
 
     std::deque<CInv> vRecvGetData;
     uint64_t nRecvBytes;
+    // Number of send and receive system calls made on the socket.
+    std::atomic<uint64_t> nSendCalls;
+    std::atomic<uint64_t> nRecvCalls;
     std::atomic<int> nRecvVersion;
 
     std::atomic<int64_t> nLastSend;
@@ -8,6 +8,7 @@
 #include "addrman.h"
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "blockresponsecache.h"
 #include "chainparams.h"
 #include "config.h"
 #include "consensus/validation.h"
@@ -23,6 +24,7 @@
 #include "primitives/transaction.h"
 #include "random.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txmempool.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -909,6 +911,26 @@ static std::shared_ptr<const CBlockHeaderAndShortTxIDs>
     most_recent_compact_block;
 static uint256 most_recent_block_hash;
 
+static CBlockResponseCache blockResponseCache(BLOCK_RESPONSE_CACHE_BLOCKS);
+
+//! Serialize the payload of a block message, to be shared by all peers.
+template <typename T>
+static CBlockResponseCache::Payload
+MakeBlockResponse(const CNetMsgMaker &msgMaker, const std::string &strCommand,
+                  const T &obj) {
+    return std::make_shared<const std::vector<uint8_t>>(
+        msgMaker.Make(strCommand, obj).data);
+}
+
+static void PushBlockResponse(CConnman &connman, CNode *pnode,
+                              const std::string &strCommand,
+                              const CBlockResponseCache::Payload &payload) {
+    CSerializedNetMsg msg;
+    msg.command = strCommand;
+    msg.sharedData = payload;
+    connman.PushMessage(pnode, std::move(msg));
+}
+
 void PeerLogicValidation::NewPoWValidBlock(
     const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
@@ -932,9 +954,12 @@ void PeerLogicValidation::NewPoWValidBlock(
         most_recent_compact_block = pcmpctblock;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker,
+    const CBlockResponseCache::Payload cmpctPayload =
+        MakeBlockResponse(msgMaker, NetMsgType::CMPCTBLOCK, *pcmpctblock);
+    blockResponseCache.Put(hashBlock, NetMsgType::CMPCTBLOCK, cmpctPayload);
+
+    connman->ForEachNode([this, &cmpctPayload, pindex,
                           &hashBlock](CNode *pnode) {
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect) {
             return;
         }
@@ -948,8 +973,8 @@ void PeerLogicValidation::NewPoWValidBlock(
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n",
                      "PeerLogicValidation::NewPoWValidBlock",
                      hashBlock.ToString(), pnode->id);
-            connman->PushMessage(
-                pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            PushBlockResponse(*connman, pnode, NetMsgType::CMPCTBLOCK,
+                              cmpctPayload);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1118,13 +1143,45 @@ static void RelayAddress(const CAddress &addr, bool fReachable,
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+static void PushMerkleBlock(CConnman &connman, CNode *pfrom,
+                            const CNetMsgMaker &msgMaker, const CBlock &block) {
+    bool sendMerkleBlock = false;
+    CMerkleBlock merkleBlock;
+    {
+        LOCK(pfrom->cs_filter);
+        if (pfrom->pfilter) {
+            sendMerkleBlock = true;
+            merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+        }
+    }
+    if (!sendMerkleBlock) {
+        // no response
+        return;
+    }
+
+    connman.PushMessage(pfrom,
+                        msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+    // CMerkleBlock just contains hashes, so also push any transactions in the
+    // block the client did not see. This avoids hurting performance by
+    // pointlessly requiring a round-trip. Note that there is currently no way
+    // for a node to request any single transactions we didn't send here - they
+    // must either disconnect and retry or request the full block. Thus, the
+    // protocol spec specified allows for us to provide duplicate txn here,
+    // however we MUST always provide at least what the remote peer needs.
+    typedef std::pair<unsigned int, uint256> PairType;
+    for (PairType &pair : merkleBlock.vMatchedTxn) {
+        connman.PushMessage(
+            pfrom, msgMaker.Make(NetMsgType::TX, *block.vtx[pair.first]));
+    }
+}
+
 static void ProcessGetData(const Config &config, CNode *pfrom,
                            const Consensus::Params &consensusParams,
                            CConnman &connman,
                            const std::atomic<bool> &interruptMsgProc) {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    const CNetMsgMaker msgMaker(pfrom);
     LOCK(cs_main);
 
     while (it != pfrom->vRecvGetData.end()) {
@@ -1213,76 +1270,64 @@ static void ProcessGetData(const Config &config, CNode *pfrom,
                 // Pruned nodes may have deleted the block, so check whether
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus.hasData())) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, config)) {
-                        assert(!"cannot load block from disk");
+                    // If a peer is asking for old blocks, we're almost
+                    // guaranteed they won't have a useful mempool to match
+                    // against a compact block, and we don't feel like
+                    // constructing the object for them, so instead we respond
+                    // with the full, non-compact block.
+                    std::string strCommand;
+                    if (inv.type == MSG_BLOCK) {
+                        strCommand = NetMsgType::BLOCK;
+                    } else if (inv.type == MSG_CMPCT_BLOCK) {
+                        strCommand =
+                            CanDirectFetch(consensusParams) &&
+                                    mi->second->nHeight >=
+                                        chainActive.Height() -
+                                            MAX_CMPCTBLOCK_DEPTH
+                                ? NetMsgType::CMPCTBLOCK
+                                : NetMsgType::BLOCK;
                     }
 
-                    if (inv.type == MSG_BLOCK) {
-                        connman.PushMessage(
-                            pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
-                    } else if (inv.type == MSG_FILTERED_BLOCK) {
-                        bool sendMerkleBlock = false;
-                        CMerkleBlock merkleBlock;
-                        {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter) {
-                                sendMerkleBlock = true;
-                                merkleBlock =
-                                    CMerkleBlock(block, *pfrom->pfilter);
-                            }
-                        }
-                        if (sendMerkleBlock) {
-                            connman.PushMessage(
-                                pfrom,
-                                msgMaker.Make(NetMsgType::MERKLEBLOCK,
-                                              merkleBlock));
-                            // CMerkleBlock just contains hashes, so also push
-                            // any transactions in the block the client did not
-                            // see. This avoids hurting performance by
-                            // pointlessly requiring a round-trip. Note that
-                            // there is currently no way for a node to request
-                            // any single transactions we didn't send here -
-                            // they must either disconnect and retry or request
-                            // the full block. Thus, the protocol spec specified
-                            // allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the
-                            // remote peer needs.
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            for (PairType &pair : merkleBlock.vMatchedTxn) {
-                                connman.PushMessage(
-                                    pfrom,
-                                    msgMaker.Make(NetMsgType::TX,
-                                                  *block.vtx[pair.first]));
-                            }
+                    // Block and compact block messages are the same for every
+                    // peer, so they are served from the cache when possible.
+                    CBlockResponseCache::Payload payload;
+                    if (!strCommand.empty()) {
+                        payload = blockResponseCache.Get(inv.hash, strCommand);
+                    }
+
+                    if (!payload) {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second, config)) {
+                            assert(!"cannot load block from disk");
                         }
-                        // else
-                        // no response
-                    } else if (inv.type == MSG_CMPCT_BLOCK) {
-                        // If a peer is asking for old blocks, we're almost
-                        // guaranteed they won't have a useful mempool to match
-                        // against a compact block, and we don't feel like
-                        // constructing the object for them, so instead we
-                        // respond with the full, non-compact block.
-                        int nSendFlags = 0;
-                        if (CanDirectFetch(consensusParams) &&
-                            mi->second->nHeight >=
-                                chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(block);
-                            connman.PushMessage(
-                                pfrom,
-                                msgMaker.Make(nSendFlags,
-                                              NetMsgType::CMPCTBLOCK,
-                                              cmpctblock));
+
+                        if (strCommand == NetMsgType::BLOCK) {
+                            payload = MakeBlockResponse(msgMaker, strCommand,
+                                                        block);
+                        } else if (strCommand == NetMsgType::CMPCTBLOCK) {
+                            payload = MakeBlockResponse(
+                                msgMaker, strCommand,
+                                CBlockHeaderAndShortTxIDs(block));
                         } else {
-                            connman.PushMessage(pfrom,
-                                                msgMaker.Make(nSendFlags,
-                                                              NetMsgType::BLOCK,
-                                                              block));
+                            PushMerkleBlock(connman, pfrom, msgMaker, block);
+                        }
+
+                        // Only cache blocks near the tip, so that peers
+                        // catching up do not evict them.
+                        if (payload &&
+                            mi->second->nHeight +
+                                    int(BLOCK_RESPONSE_CACHE_BLOCKS) >
+                                chainActive.Height()) {
+                            blockResponseCache.Put(inv.hash, strCommand,
+                                                   payload);
                         }
                     }
 
+                    if (payload) {
+                        PushBlockResponse(connman, pfrom, strCommand, payload);
+                    }
+
                     // Trigger the peer node to send a getblocks request for the
                     // next batch of inventory.
                     if (inv.hash == pfrom->hashContinue) {
@@ -1368,7 +1413,7 @@ inline static void SendBlockTransactions(const CBlock &block,
         resp.txn[i] = block.vtx[req.indices[i]];
     }
     LOCK(cs_main);
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    const CNetMsgMaker msgMaker(pfrom);
     int nSendFlags = 0;
     connman.PushMessage(pfrom,
                         msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
@@ -1379,6 +1424,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                            int64_t nTimeReceived,
                            const CChainParams &chainparams, CConnman &connman,
                            const std::atomic<bool> &interruptMsgProc) {
+    TRACE_SPAN("net", strCommand);
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n",
              SanitizeString(strCommand), vRecv.size(), pfrom->id);
     if (gArgs.IsArgSet("-dropmessagestest") &&
@@ -1624,7 +1670,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
     }
 
     // At this point, the outgoing message serialization version can't change.
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    const CNetMsgMaker msgMaker(pfrom);
 
     if (strCommand == NetMsgType::VERACK) {
         pfrom->SetRecvVersion(
@@ -2040,7 +2086,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         std::deque<COutPoint> vWorkQueue;
         std::vector<uint256> vEraseQueue;
         CTransactionRef ptx;
-        vRecv >> ptx;
+        vRecv.ReadInPlace(ptx);
         const CTransaction &tx = *ptx;
 
         CInv inv(MSG_TX, tx.GetId());
@@ -2239,7 +2285,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
     // Ignore blocks received while importing
     else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) {
         CBlockHeaderAndShortTxIDs cmpctblock;
-        vRecv >> cmpctblock;
+        vRecv.ReadInPlace(cmpctblock);
 
         {
             LOCK(cs_main);
@@ -2485,7 +2531,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
              !fReindex) // Ignore blocks received while importing
     {
         BlockTransactions resp;
-        vRecv >> resp;
+        vRecv.ReadInPlace(resp);
 
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
         bool fBlockRead = false;
@@ -2765,7 +2811,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
              !fReindex) // Ignore blocks received while importing
     {
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-        vRecv >> *pblock;
+        vRecv.ReadInPlace(*pblock);
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n",
                  pblock->GetHash().ToString(), pfrom->id);
@@ -3175,6 +3221,8 @@ bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
                   SanitizeString(strCommand), nMessageSize, pfrom->id);
     }
 
+    pfrom->recvBufferPool.Put(vRecv.ReleaseBuffer());
+
     LOCK(cs_main);
     SendRejectsAndCheckIfBanned(pfrom, connman);
 
@@ -3207,7 +3255,7 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
 
     // If we get here, the outgoing message serialization version is set and
     // can't change.
-    const CNetMsgMaker msgMaker(pto->GetSendVersion());
+    const CNetMsgMaker msgMaker(pto);
 
     //
     // Message: ping
@@ -3417,31 +3465,33 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                          "%s sending header-and-ids %s to peer=%d\n", __func__,
                          vHeaders.front().GetHash().ToString(), pto->id);
 
-                int nSendFlags = 0;
-
-                bool fGotBlockFromCache = false;
-                {
-                    LOCK(cs_most_recent_block);
-                    if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                        CBlockHeaderAndShortTxIDs cmpctblock(
-                            *most_recent_block);
-                        connman.PushMessage(
-                            pto,
-                            msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                          cmpctblock));
-                        fGotBlockFromCache = true;
+                const uint256 hashBest = pBestIndex->GetBlockHash();
+                CBlockResponseCache::Payload payload =
+                    blockResponseCache.Get(hashBest, NetMsgType::CMPCTBLOCK);
+                if (!payload) {
+                    std::shared_ptr<const CBlock> pblock;
+                    {
+                        LOCK(cs_most_recent_block);
+                        if (most_recent_block_hash == hashBest) {
+                            pblock = most_recent_block;
+                        }
                     }
+                    if (!pblock) {
+                        std::shared_ptr<CBlock> pblockRead =
+                            std::make_shared<CBlock>();
+                        bool ret =
+                            ReadBlockFromDisk(*pblockRead, pBestIndex, config);
+                        assert(ret);
+                        pblock = pblockRead;
+                    }
+                    payload = MakeBlockResponse(
+                        msgMaker, NetMsgType::CMPCTBLOCK,
+                        CBlockHeaderAndShortTxIDs(*pblock));
+                    blockResponseCache.Put(hashBest, NetMsgType::CMPCTBLOCK,
+                                           payload);
                 }
-                if (!fGotBlockFromCache) {
-                    CBlock block;
-                    bool ret = ReadBlockFromDisk(block, pBestIndex, config);
-                    assert(ret);
-                    CBlockHeaderAndShortTxIDs cmpctblock(block);
-                    connman.PushMessage(pto,
-                                        msgMaker.Make(nSendFlags,
-                                                      NetMsgType::CMPCTBLOCK,
-                                                      cmpctblock));
-                }
+                PushBlockResponse(connman, pto, NetMsgType::CMPCTBLOCK,
+                                  payload);
                 state.pindexBestHeaderSent = pBestIndex;
             } else if (state.fPreferHeaders) {
                 if (vHeaders.size() > 1) {
@@ -3450,13 +3500,26 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                              __func__, vHeaders.size(),
                              vHeaders.front().GetHash().ToString(),
                              vHeaders.back().GetHash().ToString(), pto->id);
+                    connman.PushMessage(
+                        pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
                 } else {
                     LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n",
                              __func__, vHeaders.front().GetHash().ToString(),
                              pto->id);
+                    // A new block is announced with the same single header
+                    // to every peer.
+                    const uint256 hash = vHeaders.front().GetHash();
+                    CBlockResponseCache::Payload payload =
+                        blockResponseCache.Get(hash, NetMsgType::HEADERS);
+                    if (!payload) {
+                        payload = MakeBlockResponse(
+                            msgMaker, NetMsgType::HEADERS, vHeaders);
+                        blockResponseCache.Put(hash, NetMsgType::HEADERS,
+                                               payload);
+                    }
+                    PushBlockResponse(connman, pto, NetMsgType::HEADERS,
+                                      payload);
                 }
-                connman.PushMessage(
-                    pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
                 state.pindexBestHeaderSent = pBestIndex;
             } else {
                 fRevertToInv = true;
@@ -21,6 +21,9 @@ static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** Default number of orphan+recently-replaced txn to keep around for block
  * reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Number of recent blocks whose serialized messages are kept to be served to
+ * all peers */
+static const size_t BLOCK_RESPONSE_CACHE_BLOCKS = 4;
 
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals &nodeSignals);
@@ -11,12 +11,22 @@
 
 class CNetMsgMaker {
 public:
-    CNetMsgMaker(int nVersionIn) : nVersion(nVersionIn) {}
+    CNetMsgMaker(int nVersionIn) : nVersion(nVersionIn), pnode(nullptr) {}
+
+    /**
+     * Make messages for pnodeIn at its send version, serialized into buffers
+     * recycled from the messages it sent.
+     */
+    explicit CNetMsgMaker(CNode *pnodeIn)
+        : nVersion(pnodeIn->GetSendVersion()), pnode(pnodeIn) {}
 
     template <typename... Args>
     CSerializedNetMsg Make(int nFlags, std::string sCommand,
                            Args &&... args) const {
         CSerializedNetMsg msg;
+        if (pnode) {
+            msg.data = pnode->sendBufferPool.Get();
+        }
         msg.command = std::move(sCommand);
         CVectorWriter{SER_NETWORK, nFlags | nVersion, msg.data, 0,
                       std::forward<Args>(args)...};
@@ -30,6 +40,7 @@ public:
 
 private:
     const int nVersion;
+    CNode *const pnode;
 };
 
 #endif // BITCOIN_NETMESSAGEMAKER_H
@@ -6,6 +6,7 @@
 #include "primitives/transaction.h"
 
 #include "hash.h"
+#include "streams.h"
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 
@@ -69,6 +70,22 @@ CTransaction::CTransaction(const CMutableTransaction &tx)
 CTransaction::CTransaction(CMutableTransaction &&tx)
     : nVersion(tx.nVersion), vin(std::move(tx.vin)), vout(std::move(tx.vout)),
       nLockTime(tx.nLockTime), hash(ComputeHash()) {}
+CTransaction::CTransaction(std::pair<CMutableTransaction, uint256> &&txAndHash)
+    : nVersion(txAndHash.first.nVersion), vin(std::move(txAndHash.first.vin)),
+      vout(std::move(txAndHash.first.vout)),
+      nLockTime(txAndHash.first.nLockTime), hash(txAndHash.second) {}
+
+static std::pair<CMutableTransaction, uint256>
+UnserializeAndHash(CSpanReader &s) {
+    const uint8_t *pbegin = s.Cursor();
+    CMutableTransaction tx(deserialize, s);
+    // The serialization used for hashing is the same as the one on the wire.
+    uint256 hash = Hash(pbegin, s.Cursor());
+    return std::make_pair(std::move(tx), hash);
+}
+
+CTransaction::CTransaction(deserialize_type, CSpanReader &s)
+    : CTransaction(UnserializeAndHash(s)) {}
 
 Amount CTransaction::GetValueOut() const {
     Amount nValueOut(0);
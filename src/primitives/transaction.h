@@ -213,6 +213,7 @@ public:
 };
 
 class CMutableTransaction;
+class CSpanReader;
 
 /**
  * Basic transaction serialization format:
@@ -273,6 +274,9 @@ private:
 
     uint256 ComputeHash() const;
 
+    /** Take a transaction whose hash was computed by the caller. */
+    explicit CTransaction(std::pair<CMutableTransaction, uint256> &&txAndHash);
+
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
     CTransaction();
@@ -294,6 +298,12 @@ public:
     CTransaction(deserialize_type, Stream &s)
         : CTransaction(CMutableTransaction(deserialize, s)) {}
 
+    /**
+     * Deserialize in place from a byte range, hashing the bytes that were
+     * read rather than serializing the transaction again.
+     */
+    CTransaction(deserialize_type, CSpanReader &s);
+
     bool IsNull() const { return vin.empty() && vout.empty(); }
 
     const TxId GetId() const { return TxId(hash); }
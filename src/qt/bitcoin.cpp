@@ -541,6 +541,8 @@ void BitcoinApplication::handleRunawayException(const QString &message) {
         BitcoinGUI::tr("A fatal error occurred. Bitcoin can no longer continue "
                        "safely and will quit.") +
             QString("\n\n") + message);
+    // Write the queued log messages, the writer thread is not stopped.
+    GetLogger().Flush(false);
     ::exit(EXIT_FAILURE);
 }
 
@@ -103,7 +103,9 @@ void WalletTests::walletTests() {
     }
     {
         LOCK(cs_main);
-        wallet.ScanForWalletTransactions(chainActive.Genesis(), true);
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        wallet.ScanForWalletTransactions(chainActive.Genesis(), reserver, true);
     }
     wallet.SetBroadcastTransactions(true);
 
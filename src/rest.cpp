@@ -14,6 +14,7 @@
 #include "rpc/tojson.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
 #include "validation.h"
@@ -667,6 +668,81 @@ static bool rest_getutxos(Config &config, HTTPRequest *req,
     return true;
 }
 
+static bool rest_spentinfo(Config &config, HTTPRequest *req,
+                           const std::string &strURIPart) {
+    if (!CheckWarmup(req)) {
+        return false;
+    }
+
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    // The outpoint is given as txid-n.
+    const std::string::size_type sep = param.find('-');
+    if (sep == std::string::npos) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+    }
+
+    const std::string strTxid = param.substr(0, sep);
+    int32_t nOutput;
+    uint256 txid;
+    if (!ParseInt32(param.substr(sep + 1), &nOutput) || nOutput < 0 ||
+        !ParseHashStr(strTxid, txid)) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+    }
+
+    if (!fSpentIndex) {
+        return RESTERR(req, HTTP_NOT_FOUND,
+                       "Spent index not enabled, use -spentindex");
+    }
+
+    CSpentIndexValue value;
+    if (!GetSpentInfo(COutPoint(txid, uint32_t(nOutput)), value)) {
+        return RESTERR(req, HTTP_NOT_FOUND, param + " not found");
+    }
+
+    CDataStream ssSpent(SER_NETWORK, PROTOCOL_VERSION);
+    ssSpent << value;
+
+    switch (rf) {
+        case RF_BINARY: {
+            std::string binarySpent = ssSpent.str();
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, binarySpent);
+            return true;
+        }
+
+        case RF_HEX: {
+            std::string strHex =
+                HexStr(ssSpent.begin(), ssSpent.end()) + "\n";
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, strHex);
+            return true;
+        }
+
+        case RF_JSON: {
+            UniValue objSpent(UniValue::VOBJ);
+            objSpent.push_back(Pair("txid", value.txid.GetHex()));
+            objSpent.push_back(Pair("index", int64_t(value.nInput)));
+            objSpent.push_back(Pair("height", value.nHeight));
+            std::string strJSON = objSpent.write() + "\n";
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, strJSON);
+            return true;
+        }
+
+        default: {
+            return RESTERR(req, HTTP_NOT_FOUND,
+                           "output format not found (available: " +
+                               AvailableDataFormatsString() + ")");
+        }
+    }
+
+    // not reached
+    // continue to process further HTTP reqs on this cxn
+    return true;
+}
+
 static const struct {
     const char *prefix;
     bool (*handler)(Config &config, HTTPRequest *req,
@@ -680,6 +756,7 @@ static const struct {
     {"/rest/mempool/contents", rest_mempool_contents},
     {"/rest/headers/", rest_headers},
     {"/rest/getutxos", rest_getutxos},
+    {"/rest/spentinfo/", rest_spentinfo},
 };
 
 bool StartREST() {
@@ -13,12 +13,14 @@
 #include "config.h"
 #include "consensus/validation.h"
 #include "hash.h"
+#include "index/blockfilterindex.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
 #include "rpc/tojson.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -1120,6 +1122,113 @@ UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
     return ret;
 }
 
+UniValue getspentinfo(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 2) {
+        throw std::runtime_error(
+            "getspentinfo \"txid\" n\n"
+            "\nReturns the input that spent a transaction output in the "
+            "active chain.\n"
+            "Requires the spent index to be enabled with -spentindex.\n"
+            "\nArguments:\n"
+            "1. \"txid\"             (string, required) The transaction id\n"
+            "2. \"n\"                (numeric, required) vout number\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"hash\",    (string) The spending transaction id\n"
+            "  \"index\" : n,         (numeric) The spending input index\n"
+            "  \"height\" : n         (numeric) The height of the block "
+            "containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "\"txid\" 1") +
+            HelpExampleRpc("getspentinfo", "\"txid\", 1"));
+    }
+
+    if (!fSpentIndex) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Spent index not enabled, use -spentindex");
+    }
+
+    uint256 hash = ParseHashV(request.params[0], "txid");
+    int n = request.params[1].get_int();
+    if (n < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Invalid parameter, vout must be positive");
+    }
+
+    COutPoint out(hash, n);
+    CSpentIndexValue value;
+    if (!GetSpentInfo(out, value)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                           "Unable to get spent info");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("txid", value.txid.GetHex()));
+    ret.push_back(Pair("index", int64_t(value.nInput)));
+    ret.push_back(Pair("height", value.nHeight));
+    return ret;
+}
+
+UniValue getblockfilter(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\"\n"
+            "\nReturns the BIP 158 basic filter of a block, and its filter "
+            "header.\n"
+            "Requires the block filter index to be enabled with "
+            "-blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"        (string, required) The block hash\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",   (string) The hex-encoded filter\n"
+            "  \"header\" : \"hash\"   (string) The filter header, committing "
+            "to the filters of the previous blocks\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec3"
+                                             "7b049d214adbda81d7e2a3dd146f6ed09"
+                                             "\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec3"
+                                             "7b049d214adbda81d7e2a3dd146f6ed09"
+                                             "\""));
+    }
+
+    if (!g_blockfilterindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filter index not enabled, "
+                                           "use -blockfilterindex");
+    }
+
+    uint256 hash = ParseHashV(request.params[0], "blockhash");
+
+    const CBlockIndex *pblockindex;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        pblockindex = it->second;
+    }
+
+    BlockFilter filter;
+    uint256 hashHeader;
+    if (!g_blockfilterindex->LookupFilter(pblockindex, filter, hashHeader)) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           g_blockfilterindex->IsSynced()
+                               ? "Filter not found"
+                               : "Filter not found, the block filter index "
+                                 "is still being built");
+    }
+
+    const std::vector<uint8_t> &vchFilter = filter.GetEncodedFilter();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(vchFilter.begin(), vchFilter.end())));
+    ret.push_back(Pair("header", hashHeader.GetHex()));
+    return ret;
+}
+
 UniValue verifychain(const Config &config, const JSONRPCRequest &request) {
     int nCheckLevel = gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL);
     int nCheckDepth = gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS);
@@ -1672,6 +1781,7 @@ static const ContextFreeRPCCommand commands[] = {
     { "blockchain",         "getblock",               getblock,               true,  {"blockhash","verbose"} },
     { "blockchain",         "getblockhash",           getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         getblockheader,         true,  {"blockhash","verbose"} },
+    { "blockchain",         "getblockfilter",         getblockfilter,         true,  {"blockhash"} },
     { "blockchain",         "getchaintips",           getchaintips,           true,  {} },
     { "blockchain",         "getdifficulty",          getdifficulty,          true,  {} },
     { "blockchain",         "getmempoolancestors",    getmempoolancestors,    true,  {"txid","verbose"} },
@@ -1681,6 +1791,7 @@ static const ContextFreeRPCCommand commands[] = {
     { "blockchain",         "getrawmempool",          getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               gettxout,               true,  {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "getspentinfo",           getspentinfo,           true,  {"txid","n"} },
     { "blockchain",         "pruneblockchain",        pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            verifychain,            true,  {"checklevel","nblocks"} },
     { "blockchain",         "preciousblock",          preciousblock,          true,  {"blockhash"} },
@@ -89,6 +89,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"fundrawtransaction", 1, "options"},
     {"gettxout", 1, "n"},
     {"gettxout", 2, "include_mempool"},
+    {"getspentinfo", 1, "n"},
     {"gettxoutproof", 0, "txids"},
     {"lockunspent", 0, "unlock"},
     {"lockunspent", 1, "transactions"},
@@ -109,6 +110,9 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"setban", 2, "bantime"},
     {"setban", 3, "absolute"},
     {"setnetworkactive", 0, "state"},
+    {"setlockstats", 0, "enabled"},
+    {"settracing", 0, "enabled"},
+    {"dumptrace", 1, "clear"},
     {"getmempoolancestors", 1, "verbose"},
     {"getmempooldescendants", 1, "verbose"},
     {"disconnectnode", 1, "nodeid"},
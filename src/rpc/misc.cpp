@@ -13,7 +13,9 @@
 #include "netbase.h"
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
+#include "sync.h"
 #include "timedata.h"
+#include "trace.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #include "validation.h"
@@ -25,6 +27,7 @@
 
 #include <univalue.h>
 
+#include <algorithm>
 #include <cstdint>
 
 /**
@@ -614,6 +617,152 @@ static UniValue getmemoryinfo(const Config &config,
     return obj;
 }
 
+static UniValue getlockstats(const Config &config,
+                             const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            "getlockstats\n"
+            "Returns lock contention statistics of every LOCK site, sorted by "
+            "total time spent waiting for the lock, then by time spent "
+            "holding it. Statistics are only recorded while enabled, see "
+            "setlockstats and -lockstats.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lock\": \"name\",         (string) The locked "
+            "expression\n"
+            "    \"location\": \"file:line\",  (string) Where the lock is "
+            "taken\n"
+            "    \"acquisitions\": n,        (numeric) Number of times the "
+            "lock was taken\n"
+            "    \"contended\": n,           (numeric) Number of times it was "
+            "held by another thread\n"
+            "    \"total_wait_us\": n,       (numeric) Total time waited for "
+            "the lock, in microseconds\n"
+            "    \"max_wait_us\": n,         (numeric) Longest wait, in "
+            "microseconds\n"
+            "    \"total_hold_us\": n,       (numeric) Total time the lock "
+            "was held, in microseconds\n"
+            "    \"max_hold_us\": n          (numeric) Longest hold, in "
+            "microseconds\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getlockstats", "") +
+            HelpExampleRpc("getlockstats", ""));
+    }
+
+    std::vector<LockSiteStats> vStats = GetLockStats();
+    std::sort(vStats.begin(), vStats.end(),
+              [](const LockSiteStats &a, const LockSiteStats &b) {
+                  if (a.nWaitNanos != b.nWaitNanos) {
+                      return a.nWaitNanos > b.nWaitNanos;
+                  }
+                  return a.nHoldNanos > b.nHoldNanos;
+              });
+
+    UniValue result(UniValue::VARR);
+    for (const LockSiteStats &stats : vStats) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lock", stats.strName));
+        obj.push_back(
+            Pair("location", strprintf("%s:%d", stats.strFile, stats.nLine)));
+        obj.push_back(Pair("acquisitions", stats.nAcquisitions));
+        obj.push_back(Pair("contended", stats.nContended));
+        obj.push_back(Pair("total_wait_us", stats.nWaitNanos / 1000));
+        obj.push_back(Pair("max_wait_us", stats.nMaxWaitNanos / 1000));
+        obj.push_back(Pair("total_hold_us", stats.nHoldNanos / 1000));
+        obj.push_back(Pair("max_hold_us", stats.nMaxHoldNanos / 1000));
+        result.push_back(obj);
+    }
+    return result;
+}
+
+static UniValue setlockstats(const Config &config,
+                             const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "setlockstats enabled\n"
+            "Start or stop recording the lock contention statistics returned "
+            "by getlockstats. Statistics already recorded are kept.\n"
+            "\nArguments:\n"
+            "1. enabled      (boolean, required) Whether to record statistics\n"
+            "\nExamples:\n" +
+            HelpExampleCli("setlockstats", "true") +
+            HelpExampleRpc("setlockstats", "true"));
+    }
+
+    fLockStats = request.params[0].get_bool();
+    return NullUniValue;
+}
+
+static UniValue settracing(const Config &config,
+                           const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "settracing enabled\n"
+            "Start or stop recording the time spent in block validation, "
+            "message processing, database writes and RPC calls. Recorded "
+            "spans are written with dumptrace.\n"
+            "\nArguments:\n"
+            "1. enabled      (boolean, required) Whether to record spans\n"
+            "\nExamples:\n" +
+            HelpExampleCli("settracing", "true") +
+            HelpExampleRpc("settracing", "true"));
+    }
+
+    fTracing = request.params[0].get_bool();
+    return NullUniValue;
+}
+
+static UniValue dumptrace(const Config &config,
+                          const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "dumptrace \"filename\" ( clear )\n"
+            "Write the spans recorded while tracing is enabled (see "
+            "settracing and -tracing) to a server-side file, in the Chrome "
+            "trace event format. The file can be loaded in chrome://tracing "
+            "or Perfetto. This does not allow overwriting existing files.\n"
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The filename with path "
+            "(either absolute or relative to bitcoind)\n"
+            "2. clear         (boolean, optional, default=true) Discard the "
+            "written spans\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filename\": \"xxxx\",  (string) The filename with full "
+            "absolute path\n"
+            "  \"spans\": n           (numeric) Number of spans written\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptrace", "\"trace.json\"") +
+            HelpExampleRpc("dumptrace", "\"trace.json\""));
+    }
+
+    fs::path filepath = fs::absolute(request.params[0].get_str());
+    if (fs::exists(filepath)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           filepath.string() + " already exists. If you are "
+                                               "sure this is what you want, "
+                                               "move it out of the way first");
+    }
+
+    bool fClear = request.params.size() < 2 || request.params[1].get_bool();
+    size_t nSpans = 0;
+    if (!DumpTrace(filepath, fClear, nSpans)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Cannot write trace file " + filepath.string());
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("filename", filepath.string()));
+    obj.push_back(Pair("spans", uint64_t(nSpans)));
+    return obj;
+}
+
 static UniValue echo(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp) {
         throw std::runtime_error(
@@ -634,6 +783,10 @@ static const ContextFreeRPCCommand commands[] = {
     //  ------------------- ------------------------  ----------------------  ----------
     { "control",            "getinfo",                getinfo,                true,  {} }, /* uses wallet if enabled */
     { "control",            "getmemoryinfo",          getmemoryinfo,          true,  {} },
+    { "control",            "getlockstats",           getlockstats,           true,  {} },
+    { "control",            "setlockstats",           setlockstats,           true,  {"enabled"} },
+    { "control",            "settracing",             settracing,             true,  {"enabled"} },
+    { "control",            "dumptrace",              dumptrace,              true,  {"filename","clear"} },
     { "util",               "validateaddress",        validateaddress,        true,  {"address"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         createmultisig,         true,  {"nrequired","keys"} },
     { "util",               "verifymessage",          verifymessage,          true,  {"address","signature","message"} },
@@ -90,6 +90,10 @@ static UniValue getpeerinfo(const Config &config,
             "    \"bytessent\": n,            (numeric) The total bytes sent\n"
             "    \"bytesrecv\": n,            (numeric) The total bytes "
             "received\n"
+            "    \"sendcalls\": n,            (numeric) The number of send "
+            "system calls\n"
+            "    \"recvcalls\": n,            (numeric) The number of receive "
+            "system calls\n"
             "    \"conntime\": ttt,           (numeric) The connection time in "
             "seconds since epoch (Jan 1 1970 GMT)\n"
             "    \"timeoffset\": ttt,         (numeric) The time offset in "
@@ -166,6 +170,8 @@ static UniValue getpeerinfo(const Config &config,
         obj.push_back(Pair("lastrecv", stats.nLastRecv));
         obj.push_back(Pair("bytessent", stats.nSendBytes));
         obj.push_back(Pair("bytesrecv", stats.nRecvBytes));
+        obj.push_back(Pair("sendcalls", stats.nSendCalls));
+        obj.push_back(Pair("recvcalls", stats.nRecvCalls));
         obj.push_back(Pair("conntime", stats.nTimeConnected));
         obj.push_back(Pair("timeoffset", stats.nTimeOffset));
         if (stats.dPingTime > 0.0) {
@@ -10,6 +10,7 @@
 #include "consensus/validation.h"
 #include "core_io.h"
 #include "dstencode.h"
+#include "index/txindex.h"
 #include "init.h"
 #include "keystore.h"
 #include "merkleblock.h"
@@ -109,6 +110,8 @@ void TxToJSON(const Config &config, const CTransaction &tx,
     entry.push_back(Pair("vout", vout));
 
     if (!hashBlock.IsNull()) {
+        LOCK(cs_main);
+
         entry.push_back(Pair("blockhash", hashBlock.GetHex()));
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second) {
@@ -212,8 +215,6 @@ static UniValue getrawtransaction(const Config &config,
             HelpExampleRpc("getrawtransaction", "\"mytxid\", true"));
     }
 
-    LOCK(cs_main);
-
     TxId txid = TxId(ParseHashV(request.params[0], "parameter 1"));
 
     // Accept either a bool (true) or a num (>=1) to indicate verbose output.
@@ -237,12 +238,19 @@ static UniValue getrawtransaction(const Config &config,
     CTransactionRef tx;
     uint256 hashBlock;
     if (!GetTransaction(config, txid, tx, hashBlock, true)) {
-        throw JSONRPCError(
-            RPC_INVALID_ADDRESS_OR_KEY,
-            std::string(fTxIndex ? "No such mempool or blockchain transaction"
-                                 : "No such mempool transaction. Use -txindex "
-                                   "to enable blockchain transaction queries") +
-                ". Use gettransaction for wallet transactions.");
+        std::string errmsg;
+        if (!g_txindex) {
+            errmsg = "No such mempool transaction. Use -txindex to enable "
+                     "blockchain transaction queries";
+        } else if (!g_txindex->IsSynced()) {
+            errmsg = "No such mempool or blockchain transaction. Blockchain "
+                     "transactions are still in the process of being indexed";
+        } else {
+            errmsg = "No such mempool or blockchain transaction";
+        }
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                           errmsg +
+                               ". Use gettransaction for wallet transactions.");
     }
 
     std::string strHex = EncodeHexTx(*tx, RPCSerializationFlags());
@@ -308,17 +316,17 @@ static UniValue gettxoutproof(const Config &config,
         oneTxId = txid;
     }
 
-    LOCK(cs_main);
-
     CBlockIndex *pblockindex = nullptr;
 
     uint256 hashBlock;
     if (request.params.size() > 1) {
+        LOCK(cs_main);
         hashBlock = uint256S(request.params[1].get_str());
         if (!mapBlockIndex.count(hashBlock))
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
         pblockindex = mapBlockIndex[hashBlock];
     } else {
+        LOCK(cs_main);
         // Loop through txids and try to find which block they're in. Exit loop
         // once a block is found.
         for (const auto &txid : setTxIds) {
@@ -330,14 +338,19 @@ static UniValue gettxoutproof(const Config &config,
         }
     }
 
-    if (pblockindex == nullptr) {
-        CTransactionRef tx;
-        if (!GetTransaction(config, oneTxId, tx, hashBlock, false) ||
-            hashBlock.IsNull()) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
-                               "Transaction not yet in block");
-        }
+    // GetTransaction waits for the transaction index, so it is called before
+    // taking cs_main.
+    CTransactionRef tx;
+    if (pblockindex == nullptr &&
+        (!GetTransaction(config, oneTxId, tx, hashBlock, false) ||
+         hashBlock.IsNull())) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                           "Transaction not yet in block");
+    }
+
+    LOCK(cs_main);
 
+    if (pblockindex == nullptr) {
         if (!mapBlockIndex.count(hashBlock)) {
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Transaction index corrupt");
         }
@@ -1028,7 +1041,24 @@ static UniValue signrawtransaction(const Config &config,
     // Use CTransaction for the constant parts of the transaction to avoid
     // rehashing.
     const CTransaction txConst(mergedTx);
+    const PrecomputedTransactionData txdata(txConst);
+
+    // Only sign inputs whose coin is known, and SIGHASH_SINGLE ones if there's
+    // a corresponding output:
+    std::vector<CTxOut> vSpent(mergedTx.vin.size());
+    for (size_t i = 0; i < mergedTx.vin.size(); i++) {
+        const Coin &coin = view.AccessCoin(mergedTx.vin[i].prevout);
+        if (!coin.IsSpent() &&
+            ((sigHashType.getBaseType() != BaseSigHashType::SINGLE) ||
+             (i < mergedTx.vout.size()))) {
+            vSpent[i] = coin.GetTxOut();
+        }
+    }
+
     // Sign what we can:
+    std::vector<SignatureData> vSigData;
+    ProduceSignatures(keystore, txConst, txdata, vSpent, sigHashType, vSigData);
+
     for (size_t i = 0; i < mergedTx.vin.size(); i++) {
         CTxIn &txin = mergedTx.vin[i];
         const Coin &coin = view.AccessCoin(txin.prevout);
@@ -1039,32 +1069,22 @@ static UniValue signrawtransaction(const Config &config,
 
         const CScript &prevPubKey = coin.GetTxOut().scriptPubKey;
         const Amount amount = coin.GetTxOut().nValue;
+        const TransactionSignatureChecker checker(&txConst, i, amount, txdata);
 
-        SignatureData sigdata;
-        // Only sign SIGHASH_SINGLE if there's a corresponding output:
-        if ((sigHashType.getBaseType() != BaseSigHashType::SINGLE) ||
-            (i < mergedTx.vout.size())) {
-            ProduceSignature(MutableTransactionSignatureCreator(
-                                 &keystore, &mergedTx, i, amount, sigHashType),
-                             prevPubKey, sigdata);
-        }
-
+        SignatureData &sigdata = vSigData[i];
         // ... and merge in other signatures:
         for (const CMutableTransaction &txv : txVariants) {
             if (txv.vin.size() > i) {
-                sigdata = CombineSignatures(
-                    prevPubKey,
-                    TransactionSignatureChecker(&txConst, i, amount), sigdata,
-                    DataFromTransaction(txv, i));
+                sigdata = CombineSignatures(prevPubKey, checker, sigdata,
+                                            DataFromTransaction(txv, i));
             }
         }
 
         UpdateTransaction(mergedTx, i, sigdata);
 
         ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(
-                txin.scriptSig, prevPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
-                TransactionSignatureChecker(&txConst, i, amount), &serror)) {
+        if (!VerifyScript(txin.scriptSig, prevPubKey,
+                          STANDARD_SCRIPT_VERIFY_FLAGS, checker, &serror)) {
             TxInErrorToJSON(txin, vErrors, ScriptErrorString(serror));
         }
     }
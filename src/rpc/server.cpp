@@ -11,6 +11,7 @@
 #include "init.h"
 #include "random.h"
 #include "sync.h"
+#include "trace.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -529,6 +530,7 @@ UniValue CRPCTable::execute(Config &config,
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    TRACE_SPAN("rpc", request.strMethod);
     try {
         // Execute, convert arguments to array if necessary
         if (request.params.isObject()) {
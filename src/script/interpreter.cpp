@@ -8,6 +8,7 @@
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
+#include "hash.h"
 #include "primitives/transaction.h"
 #include "pubkey.h"
 #include "script/script.h"
@@ -251,35 +252,40 @@ static bool CheckPubKeyEncoding(const valtype &vchPubKey, uint32_t flags,
     return true;
 }
 
-static bool CheckMinimalPush(const valtype &data, opcodetype opcode) {
-    if (data.size() == 0) {
+static bool CheckMinimalPush(const uint8_t *data, size_t size,
+                             opcodetype opcode) {
+    if (size == 0) {
         // Could have used OP_0.
         return opcode == OP_0;
     }
-    if (data.size() == 1 && data[0] >= 1 && data[0] <= 16) {
+    if (size == 1 && data[0] >= 1 && data[0] <= 16) {
         // Could have used OP_1 .. OP_16.
         return opcode == OP_1 + (data[0] - 1);
     }
-    if (data.size() == 1 && data[0] == 0x81) {
+    if (size == 1 && data[0] == 0x81) {
         // Could have used OP_1NEGATE.
         return opcode == OP_1NEGATE;
     }
-    if (data.size() <= 75) {
+    if (size <= 75) {
         // Could have used a direct push (opcode indicating number of bytes
         // pushed + those bytes).
-        return opcode == data.size();
+        return opcode == size;
     }
-    if (data.size() <= 255) {
+    if (size <= 255) {
         // Could have used OP_PUSHDATA.
         return opcode == OP_PUSHDATA1;
     }
-    if (data.size() <= 65535) {
+    if (size <= 65535) {
         // Could have used OP_PUSHDATA2.
         return opcode == OP_PUSHDATA2;
     }
     return true;
 }
 
+static bool CheckMinimalPush(const valtype &data, opcodetype opcode) {
+    return CheckMinimalPush(data.data(), data.size(), opcode);
+}
+
 static bool IsOpcodeDisabled(opcodetype opcode, uint32_t flags) {
     switch (opcode) {
         case OP_INVERT:
@@ -1727,9 +1733,9 @@ bool TransactionSignatureChecker::CheckSequence(
     return true;
 }
 
-bool VerifyScript(const CScript &scriptSig, const CScript &scriptPubKey,
-                  uint32_t flags, const BaseSignatureChecker &checker,
-                  ScriptError *serror) {
+bool VerifyScriptGeneric(const CScript &scriptSig, const CScript &scriptPubKey,
+                         uint32_t flags, const BaseSignatureChecker &checker,
+                         ScriptError *serror) {
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
 
     // If FORKID is enabled, we also ensure strict encoding.
@@ -1807,3 +1813,291 @@ bool VerifyScript(const CScript &scriptSig, const CScript &scriptPubKey,
 
     return set_success(serror);
 }
+
+/**
+ * Fast paths for the standard script templates that make up most of the
+ * inputs we verify. They produce the same result and error as the generic
+ * interpreter, but work on the data pushed by scriptSig in place instead of
+ * building a stack. Each of them returns false, without side effects, when the
+ * scripts are not in the exact shape it handles, and the generic interpreter
+ * must be used instead.
+ */
+namespace {
+
+/** Data pushed by a script, pointing into the script itself. */
+struct ScriptPush {
+    const uint8_t *data;
+    size_t size;
+
+    valtype ToVector() const { return valtype(data, data + size); }
+};
+
+} // namespace
+
+//! At most 16 keys can be used with OP_1 .. OP_16 as the key count.
+static const int MAX_FAST_MULTISIG_KEYS = 16;
+//! The dummy element, the signatures and the redeem script.
+static const size_t MAX_FAST_MULTISIG_PUSHES = MAX_FAST_MULTISIG_KEYS + 2;
+
+static bool GetScriptPush(const CScript &script, CScript::const_iterator &pc,
+                          uint32_t flags, ScriptPush &push) {
+    const CScript::const_iterator pstart = pc;
+    opcodetype opcode;
+    if (!script.GetOp(pc, opcode) || opcode > OP_PUSHDATA4) {
+        return false;
+    }
+
+    size_t nHeaderSize = 1;
+    if (opcode == OP_PUSHDATA1) {
+        nHeaderSize = 2;
+    } else if (opcode == OP_PUSHDATA2) {
+        nHeaderSize = 3;
+    } else if (opcode == OP_PUSHDATA4) {
+        nHeaderSize = 5;
+    }
+    push.data = script.data() + (pstart - script.begin()) + nHeaderSize;
+    push.size = (pc - pstart) - nHeaderSize;
+
+    // Anything EvalScript would reject is left to it.
+    if (push.size > MAX_SCRIPT_ELEMENT_SIZE) {
+        return false;
+    }
+    return !(flags & SCRIPT_VERIFY_MINIMALDATA) ||
+           CheckMinimalPush(push.data, push.size, opcode);
+}
+
+/**
+ * Split a script made of data pushes only into the data it pushes. Fails if
+ * the script contains anything else or more than nMaxPushes pushes.
+ */
+static bool GetScriptPushes(const CScript &script, uint32_t flags,
+                            ScriptPush *pushes, size_t nMaxPushes,
+                            size_t &nPushes) {
+    if (script.size() > MAX_SCRIPT_SIZE) {
+        return false;
+    }
+    nPushes = 0;
+    CScript::const_iterator pc = script.begin();
+    while (pc < script.end()) {
+        if (nPushes == nMaxPushes ||
+            !GetScriptPush(script, pc, flags, pushes[nPushes++])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool MatchesHash160(const ScriptPush &push, const uint8_t *hash) {
+    uint160 hashPush;
+    CHash160().Write(push.data, push.size).Finalize(hashPush.begin());
+    return memcmp(hashPush.begin(), hash, hashPush.size()) == 0;
+}
+
+static bool VerifySuccess(uint32_t flags, ScriptError *serror) {
+    // Mirrors the CLEANSTACK sanity check of the generic path. Both templates
+    // leave exactly one element on the stack.
+    assert(!(flags & SCRIPT_VERIFY_CLEANSTACK) || (flags & SCRIPT_VERIFY_P2SH));
+    return set_success(serror);
+}
+
+/**
+ * <sig> <pubkey> spending DUP HASH160 <hash> EQUALVERIFY CHECKSIG.
+ */
+static bool VerifyPayToPubKeyHash(const CScript &scriptSig,
+                                  const CScript &scriptPubKey, uint32_t flags,
+                                  const BaseSignatureChecker &checker,
+                                  ScriptError *serror, bool &fValid) {
+    if (scriptPubKey.size() != 25 || scriptPubKey[0] != OP_DUP ||
+        scriptPubKey[1] != OP_HASH160 || scriptPubKey[2] != 20 ||
+        scriptPubKey[23] != OP_EQUALVERIFY || scriptPubKey[24] != OP_CHECKSIG) {
+        return false;
+    }
+    ScriptPush pushes[2];
+    size_t nPushes;
+    if (!GetScriptPushes(scriptSig, flags, pushes, 2, nPushes) ||
+        nPushes != 2) {
+        return false;
+    }
+
+    if (!MatchesHash160(pushes[1], &scriptPubKey[3])) {
+        fValid = set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+        return true;
+    }
+
+    const valtype vchSig = pushes[0].ToVector();
+    const valtype vchPubKey = pushes[1].ToVector();
+    if (!CheckSignatureEncoding(vchSig, flags, serror) ||
+        !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
+        // serror is set
+        fValid = false;
+        return true;
+    }
+
+    CScript scriptCode(scriptPubKey);
+    CleanupScriptCode(scriptCode, vchSig, flags);
+    if (!checker.CheckSig(vchSig, vchPubKey, scriptCode, flags)) {
+        if ((flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size()) {
+            fValid = set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+        } else {
+            fValid = set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+        }
+        return true;
+    }
+
+    fValid = VerifySuccess(flags, serror);
+    return true;
+}
+
+/**
+ * OP_0 <sig> ... <redeemscript> spending HASH160 <hash> EQUAL, where the
+ * redeem script is <m> <pubkey> ... <n> CHECKMULTISIG.
+ */
+static bool VerifyPayToScriptHashMultisig(const CScript &scriptSig,
+                                          const CScript &scriptPubKey,
+                                          uint32_t flags,
+                                          const BaseSignatureChecker &checker,
+                                          ScriptError *serror, bool &fValid) {
+    if (!(flags & SCRIPT_VERIFY_P2SH) || !scriptPubKey.IsPayToScriptHash()) {
+        return false;
+    }
+    ScriptPush pushes[MAX_FAST_MULTISIG_PUSHES];
+    size_t nPushes;
+    if (!GetScriptPushes(scriptSig, flags, pushes, MAX_FAST_MULTISIG_PUSHES,
+                         nPushes) ||
+        nPushes < 3) {
+        return false;
+    }
+
+    const ScriptPush &redeem = pushes[nPushes - 1];
+    const CScript redeemScript(redeem.data, redeem.data + redeem.size);
+    CScript::const_iterator pc = redeemScript.begin();
+    opcodetype opcode;
+    if (!redeemScript.GetOp(pc, opcode) || opcode < OP_1 || opcode > OP_16) {
+        return false;
+    }
+    const int nSigsRequired = CScript::DecodeOP_N(opcode);
+
+    ScriptPush keys[MAX_FAST_MULTISIG_KEYS];
+    int nKeys = 0;
+    while (true) {
+        CScript::const_iterator pcKey = pc;
+        if (!redeemScript.GetOp(pc, opcode)) {
+            return false;
+        }
+        if (opcode > OP_PUSHDATA4) {
+            break;
+        }
+        pc = pcKey;
+        if (nKeys == MAX_FAST_MULTISIG_KEYS ||
+            !GetScriptPush(redeemScript, pc, flags, keys[nKeys++])) {
+            return false;
+        }
+    }
+    if (opcode < OP_1 || opcode > OP_16 ||
+        CScript::DecodeOP_N(opcode) != nKeys || nSigsRequired > nKeys ||
+        !redeemScript.GetOp(pc, opcode) || opcode != OP_CHECKMULTISIG ||
+        pc != redeemScript.end()) {
+        return false;
+    }
+    // Extra or missing stack elements are left to the generic path.
+    if (nPushes != size_t(nSigsRequired) + 2) {
+        return false;
+    }
+
+    if (!MatchesHash160(redeem, &scriptPubKey[2])) {
+        fValid = set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+        return true;
+    }
+
+    const ScriptPush &dummy = pushes[0];
+    valtype vchSigs[MAX_FAST_MULTISIG_KEYS];
+    for (int k = 0; k < nSigsRequired; k++) {
+        vchSigs[k] = pushes[k + 1].ToVector();
+    }
+
+    // Remove signatures for pre-fork scripts, last one first as the generic
+    // path does.
+    CScript scriptCode(redeemScript);
+    for (int k = nSigsRequired - 1; k >= 0; k--) {
+        CleanupScriptCode(scriptCode, vchSigs[k], flags);
+    }
+
+    // Signatures and keys are matched starting from the last ones, in the same
+    // order as OP_CHECKMULTISIG does, which is observable through encoding
+    // errors.
+    int isig = nSigsRequired - 1;
+    int ikey = nKeys - 1;
+    int nSigsCount = nSigsRequired;
+    int nKeysCount = nKeys;
+    bool fSuccess = true;
+    valtype vchPubKey;
+    while (fSuccess && nSigsCount > 0) {
+        const valtype &vchSig = vchSigs[isig];
+        vchPubKey.assign(keys[ikey].data, keys[ikey].data + keys[ikey].size);
+        if (!CheckSignatureEncoding(vchSig, flags, serror) ||
+            !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
+            // serror is set
+            fValid = false;
+            return true;
+        }
+
+        if (checker.CheckSig(vchSig, vchPubKey, scriptCode, flags)) {
+            isig--;
+            nSigsCount--;
+        }
+        ikey--;
+        nKeysCount--;
+
+        if (nSigsCount > nKeysCount) {
+            fSuccess = false;
+        }
+    }
+
+    if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL)) {
+        for (int k = 0; k < nSigsRequired; k++) {
+            if (vchSigs[k].size()) {
+                fValid = set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+                return true;
+            }
+        }
+    }
+    if ((flags & SCRIPT_VERIFY_NULLDUMMY) && dummy.size) {
+        fValid = set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
+        return true;
+    }
+    if (!fSuccess) {
+        fValid = set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+        return true;
+    }
+
+    fValid = VerifySuccess(flags, serror);
+    return true;
+}
+
+bool VerifyScript(const CScript &scriptSig, const CScript &scriptPubKey,
+                  uint32_t flags, const BaseSignatureChecker &checker,
+                  ScriptError *serror) {
+    // If FORKID is enabled, we also ensure strict encoding.
+    uint32_t fastFlags = flags;
+    if (fastFlags & SCRIPT_ENABLE_SIGHASH_FORKID) {
+        fastFlags |= SCRIPT_VERIFY_STRICTENC;
+    }
+
+    // The templates only contain pushes in scriptSig, so SIGPUSHONLY always
+    // holds for them.
+    bool fValid;
+    try {
+        if (VerifyPayToPubKeyHash(scriptSig, scriptPubKey, fastFlags, checker,
+                                  serror, fValid) ||
+            VerifyPayToScriptHashMultisig(scriptSig, scriptPubKey, fastFlags,
+                                          checker, serror, fValid)) {
+            return fValid;
+        }
+    } catch (...) {
+        // The generic interpreter reports any exception this way as well.
+        return set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
+    }
+
+    return VerifyScriptGeneric(scriptSig, scriptPubKey, flags, checker,
+                               serror);
+}
@@ -180,4 +180,13 @@ bool VerifyScript(const CScript &scriptSig, const CScript &scriptPubKey,
                   uint32_t flags, const BaseSignatureChecker &checker,
                   ScriptError *serror = nullptr);
 
+/**
+ * Same as VerifyScript, but always runs the generic interpreter, even for the
+ * standard templates VerifyScript verifies without it. Only exposed so that
+ * both can be checked to agree.
+ */
+bool VerifyScriptGeneric(const CScript &scriptSig, const CScript &scriptPubKey,
+                         uint32_t flags, const BaseSignatureChecker &checker,
+                         ScriptError *serror = nullptr);
+
 #endif // BITCOIN_SCRIPT_INTERPRETER_H
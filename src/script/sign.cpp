@@ -11,15 +11,22 @@
 #include "primitives/transaction.h"
 #include "script/standard.h"
 #include "uint256.h"
+#include "util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 typedef std::vector<uint8_t> valtype;
 
 TransactionSignatureCreator::TransactionSignatureCreator(
     const CKeyStore *keystoreIn, const CTransaction *txToIn, unsigned int nInIn,
-    const Amount amountIn, SigHashType sigHashTypeIn)
+    const Amount amountIn, SigHashType sigHashTypeIn,
+    const PrecomputedTransactionData *txdataIn)
     : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn),
-      amount(amountIn), sigHashType(sigHashTypeIn),
-      checker(txTo, nIn, amountIn) {}
+      amount(amountIn), sigHashType(sigHashTypeIn), txdata(txdataIn),
+      checker(txdata ? TransactionSignatureChecker(txTo, nIn, amountIn, *txdata)
+                     : TransactionSignatureChecker(txTo, nIn, amountIn)) {}
 
 bool TransactionSignatureCreator::CreateSig(std::vector<uint8_t> &vchSig,
                                             const CKeyID &address,
@@ -29,7 +36,8 @@ bool TransactionSignatureCreator::CreateSig(std::vector<uint8_t> &vchSig,
         return false;
     }
 
-    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, sigHashType, amount);
+    uint256 hash =
+        SignatureHash(scriptCode, *txTo, nIn, sigHashType, amount, txdata);
     if (!key.Sign(hash, vchSig)) {
         return false;
     }
@@ -167,6 +175,49 @@ bool ProduceSignature(const BaseSignatureCreator &creator,
                         STANDARD_SCRIPT_VERIFY_FLAGS, creator.Checker());
 }
 
+bool ProduceSignatures(const CKeyStore &keystore, const CTransaction &txTo,
+                       const PrecomputedTransactionData &txdata,
+                       const std::vector<CTxOut> &vSpent,
+                       SigHashType sigHashType,
+                       std::vector<SignatureData> &vSigDataRet) {
+    assert(vSpent.size() == txTo.vin.size());
+    vSigDataRet.assign(txTo.vin.size(), SignatureData());
+
+    // Signatures are deterministic, and each thread writes only to the slots
+    // of the inputs it takes, so the result does not depend on the threads.
+    std::atomic<size_t> nNext(0);
+    std::atomic<bool> fSolved(true);
+    auto sign = [&]() {
+        for (size_t i = nNext++; i < vSpent.size(); i = nNext++) {
+            if (vSpent[i].IsNull()) {
+                continue;
+            }
+
+            if (!ProduceSignature(
+                    TransactionSignatureCreator(&keystore, &txTo, i,
+                                                vSpent[i].nValue, sigHashType,
+                                                &txdata),
+                    vSpent[i].scriptPubKey, vSigDataRet[i])) {
+                fSolved = false;
+            }
+        }
+    };
+
+    int nThreads = std::max(
+        1, std::min<int>(std::min(GetNumCores(), MAX_SIGNING_THREADS),
+                         vSpent.size()));
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++) {
+        threads.emplace_back(sign);
+    }
+    sign();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    return fSolved;
+}
+
 SignatureData DataFromTransaction(const CMutableTransaction &tx,
                                   unsigned int nIn) {
     SignatureData data;
@@ -9,11 +9,18 @@
 #include "script/interpreter.h"
 #include "script/sighashtype.h"
 
+#include <vector>
+
+//! Maximum number of threads signing the inputs of a transaction
+static const int MAX_SIGNING_THREADS = 8;
+
 class CKeyID;
 class CKeyStore;
 class CMutableTransaction;
 class CScript;
 class CTransaction;
+class CTxOut;
+struct PrecomputedTransactionData;
 
 /** Virtual base class for signature creators. */
 class BaseSignatureCreator {
@@ -37,13 +44,15 @@ class TransactionSignatureCreator : public BaseSignatureCreator {
     unsigned int nIn;
     Amount amount;
     SigHashType sigHashType;
+    const PrecomputedTransactionData *txdata;
     const TransactionSignatureChecker checker;
 
 public:
-    TransactionSignatureCreator(const CKeyStore *keystoreIn,
-                                const CTransaction *txToIn, unsigned int nInIn,
-                                const Amount amountIn,
-                                SigHashType sigHashTypeIn = SigHashType());
+    TransactionSignatureCreator(
+        const CKeyStore *keystoreIn, const CTransaction *txToIn,
+        unsigned int nInIn, const Amount amountIn,
+        SigHashType sigHashTypeIn = SigHashType(),
+        const PrecomputedTransactionData *txdataIn = nullptr);
     const BaseSignatureChecker &Checker() const override { return checker; }
     bool CreateSig(std::vector<uint8_t> &vchSig, const CKeyID &keyid,
                    const CScript &scriptCode) const override;
@@ -83,6 +92,19 @@ struct SignatureData {
 bool ProduceSignature(const BaseSignatureCreator &creator,
                       const CScript &scriptPubKey, SignatureData &sigdata);
 
+/**
+ * Produce the script signatures of all the inputs of a transaction, spreading
+ * them across several threads which share txdata. vSpent holds the output
+ * spent by each input; inputs spending a null output are not signed. The
+ * signature data is returned in input order, whichever thread produced it.
+ * Returns false if any of the inputs signed could not be completely satisfied.
+ */
+bool ProduceSignatures(const CKeyStore &keystore, const CTransaction &txTo,
+                       const PrecomputedTransactionData &txdata,
+                       const std::vector<CTxOut> &vSpent,
+                       SigHashType sigHashType,
+                       std::vector<SignatureData> &vSigDataRet);
+
 /** Produce a script signature for a transaction. */
 bool SignSignature(const CKeyStore &keystore, const CScript &fromPubKey,
                    CMutableTransaction &txTo, unsigned int nIn,
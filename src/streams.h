@@ -18,6 +18,7 @@
 #include <limits>
 #include <map>
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
@@ -120,6 +121,136 @@ private:
     size_t nPos;
 };
 
+/**
+ * Minimal stream for reading from an existing byte range, without copying it.
+ *
+ * Deserializers can take the range they consumed from Cursor(), which allows
+ * transactions to be hashed over the bytes they were read from.
+ */
+class CSpanReader {
+public:
+    /**
+     * @param[in]  nTypeIn Serialization Type
+     * @param[in]  nVersionIn Serialization Version (including any flags)
+     * @param[in]  pbeginIn, pendIn  The bytes to read, which must outlive the
+     * reader
+     */
+    CSpanReader(int nTypeIn, int nVersionIn, const uint8_t *pbeginIn,
+                const uint8_t *pendIn)
+        : nType(nTypeIn), nVersion(nVersionIn), pcursor(pbeginIn),
+          pend(pendIn) {}
+
+    void read(char *pch, size_t nSize) {
+        if (nSize > size()) {
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        }
+        memcpy(pch, pcursor, nSize);
+        pcursor += nSize;
+    }
+    template <typename T> CSpanReader &operator>>(T &obj) {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const { return nVersion; }
+    int GetType() const { return nType; }
+    size_t size() const { return pend - pcursor; }
+    bool empty() const { return pcursor == pend; }
+    const uint8_t *Cursor() const { return pcursor; }
+
+private:
+    const int nType;
+    const int nVersion;
+    const uint8_t *pcursor;
+    const uint8_t *const pend;
+};
+
+/**
+ * Reads values of any number of bits from a stream of bytes, most significant
+ * bit first.
+ */
+template <typename IStream> class BitStreamReader {
+public:
+    explicit BitStreamReader(IStream &istreamIn)
+        : istream(istreamIn), nBuffer(0), nOffset(8) {}
+
+    /**
+     * Read nBits bits, returned in the least significant bits of the result.
+     */
+    uint64_t Read(int nBits) {
+        if (nBits < 0 || nBits > 64) {
+            throw std::out_of_range("nBits must be between 0 and 64");
+        }
+
+        uint64_t nData = 0;
+        while (nBits > 0) {
+            if (nOffset == 8) {
+                istream >> nBuffer;
+                nOffset = 0;
+            }
+            int nChunk = std::min(8 - nOffset, nBits);
+            nData <<= nChunk;
+            nData |= uint8_t(nBuffer << nOffset) >> (8 - nChunk);
+            nOffset += nChunk;
+            nBits -= nChunk;
+        }
+        return nData;
+    }
+
+private:
+    IStream &istream;
+    //! Last byte read from the stream.
+    uint8_t nBuffer;
+    //! Bits of nBuffer already returned, starting from the most significant.
+    int nOffset;
+};
+
+/**
+ * Writes values of any number of bits to a stream of bytes, most significant
+ * bit first. The last byte is padded with zero bits on Flush().
+ */
+template <typename OStream> class BitStreamWriter {
+public:
+    explicit BitStreamWriter(OStream &ostreamIn)
+        : ostream(ostreamIn), nBuffer(0), nOffset(0) {}
+    ~BitStreamWriter() { Flush(); }
+
+    /** Write the nBits least significant bits of nData. */
+    void Write(uint64_t nData, int nBits) {
+        if (nBits < 0 || nBits > 64) {
+            throw std::out_of_range("nBits must be between 0 and 64");
+        }
+
+        while (nBits > 0) {
+            int nChunk = std::min(8 - nOffset, nBits);
+            // The next nChunk bits of nData, in place in nBuffer.
+            nBuffer |= uint8_t((nData << (64 - nBits)) >> (56 + nOffset));
+            nOffset += nChunk;
+            nBits -= nChunk;
+            if (nOffset == 8) {
+                Flush();
+            }
+        }
+    }
+
+    /** Write the bits pending in the buffer, padded with zeros. */
+    void Flush() {
+        if (nOffset == 0) {
+            return;
+        }
+        ostream << nBuffer;
+        nBuffer = 0;
+        nOffset = 0;
+    }
+
+private:
+    OStream &ostream;
+    //! Bits not written to the stream yet, starting from the most significant.
+    uint8_t nBuffer;
+    //! Number of bits in nBuffer.
+    int nOffset;
+};
+
 /**
  * Double ended buffer combining vector and stream-like interfaces.
  *
@@ -231,6 +362,35 @@ public:
     value_type *data() { return vch.data() + nReadPos; }
     const value_type *data() const { return vch.data() + nReadPos; }
 
+    /**
+     * Take the buffer out of the stream, which is left empty, so that its
+     * capacity can be reused.
+     */
+    vector_type ReleaseBuffer() {
+        vector_type vchOut;
+        vchOut.swap(vch);
+        nReadPos = 0;
+        return vchOut;
+    }
+
+    /** Replace the content of the stream with vchIn, reusing its storage. */
+    void SetBuffer(vector_type &&vchIn) {
+        vch = std::move(vchIn);
+        nReadPos = 0;
+    }
+
+    /**
+     * Deserialize obj straight from the buffer. Types with a deserializer
+     * specific to CSpanReader, like transactions, make use of the raw bytes.
+     */
+    template <typename T> CDataStream &ReadInPlace(T &obj) {
+        const uint8_t *pbegin = reinterpret_cast<const uint8_t *>(data());
+        CSpanReader reader(nType, nVersion, pbegin, pbegin + size());
+        reader >> obj;
+        ignore(reader.Cursor() - pbegin);
+        return (*this);
+    }
+
     void insert(iterator it, std::vector<char>::const_iterator first,
                 std::vector<char>::const_iterator last) {
         if (last == first) {
@@ -7,7 +7,14 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 
 #include <boost/thread.hpp>
 
@@ -18,6 +25,227 @@ void PrintLockContention(const char *pszName, const char *pszFile, int nLine) {
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+std::atomic<bool> fLockStats(DEFAULT_LOCKSTATS);
+
+int64_t LockStatsNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+namespace {
+
+//! A LOCK site. The strings are literals from the LOCK macros, so the
+//! pointers identify the site within a thread buffer.
+typedef std::tuple<const char *, const char *, int> LockSite;
+
+struct LockSiteHasher {
+    size_t operator()(const LockSite &site) const {
+        return std::hash<const void *>()(std::get<0>(site)) ^
+               (std::hash<const void *>()(std::get<1>(site)) << 1) ^
+               (size_t(std::get<2>(site)) << 2);
+    }
+};
+
+struct LockCounters {
+    uint64_t nAcquisitions = 0;
+    uint64_t nContended = 0;
+    int64_t nWaitNanos = 0;
+    int64_t nMaxWaitNanos = 0;
+    int64_t nHoldNanos = 0;
+    int64_t nMaxHoldNanos = 0;
+
+    void Merge(const LockCounters &other) {
+        nAcquisitions += other.nAcquisitions;
+        nContended += other.nContended;
+        nWaitNanos += other.nWaitNanos;
+        nMaxWaitNanos = std::max(nMaxWaitNanos, other.nMaxWaitNanos);
+        nHoldNanos += other.nHoldNanos;
+        nMaxHoldNanos = std::max(nMaxHoldNanos, other.nMaxHoldNanos);
+    }
+};
+
+typedef std::unordered_map<LockSite, LockCounters, LockSiteHasher>
+    LockCountersMap;
+
+/**
+ * Counters of a single thread. The mutex is only ever contended by
+ * GetLockStats, as no other thread records into this buffer.
+ */
+//! A lock held by the thread through LOCK while statistics are recorded.
+struct HeldLock {
+    //! Number of nested LOCKs of it.
+    int nDepth = 0;
+    //! When it was released by LEAVE_CRITICAL_SECTION, if it currently is.
+    int64_t nReleasedAt = 0;
+    //! Total time it was released by LEAVE_CRITICAL_SECTION.
+    int64_t nReleasedNanos = 0;
+};
+
+/**
+ * Counters of a single thread. The mutex is only ever contended by
+ * GetLockStats, as no other thread records into this buffer.
+ */
+struct LockStatsBuffer {
+    std::mutex mutex;
+    LockCountersMap counters;
+    //! Only used by the thread itself. Entries are removed once the lock is
+    //! released by its outermost LOCK, so this never outlives the locks.
+    std::unordered_map<const void *, HeldLock> mapHeld;
+};
+
+/** All live thread buffers, plus the counters of threads which exited. */
+struct LockStatsRegistry {
+    std::mutex mutex;
+    std::set<LockStatsBuffer *> buffers;
+    LockCountersMap retired;
+};
+
+// Neither of these is ever destroyed: locks are still taken while static
+// objects are torn down at shutdown.
+LockStatsRegistry &GetLockStatsRegistry() {
+    static LockStatsRegistry *registry = new LockStatsRegistry();
+    return *registry;
+}
+
+void RetireLockStatsBuffer(LockStatsBuffer *buffer) {
+    LockStatsRegistry &registry = GetLockStatsRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.buffers.erase(buffer);
+    for (const auto &entry : buffer->counters) {
+        registry.retired[entry.first].Merge(entry.second);
+    }
+    delete buffer;
+}
+
+boost::thread_specific_ptr<LockStatsBuffer> &GetLockStatsBufferPtr() {
+    static auto *ptr =
+        new boost::thread_specific_ptr<LockStatsBuffer>(RetireLockStatsBuffer);
+    return *ptr;
+}
+
+//! The buffer of the current thread, if it recorded anything yet.
+LockStatsBuffer *GetLockStatsBufferIfAny() {
+    return GetLockStatsBufferPtr().get();
+}
+
+LockStatsBuffer &GetLockStatsBuffer() {
+    boost::thread_specific_ptr<LockStatsBuffer> &ptr = GetLockStatsBufferPtr();
+    if (!ptr.get()) {
+        ptr.reset(new LockStatsBuffer());
+        LockStatsRegistry &registry = GetLockStatsRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.buffers.insert(ptr.get());
+    }
+    return *ptr;
+}
+
+//! Strip the build directory from __FILE__, keeping the path within src/.
+std::string LockSiteFile(const char *pszFile) {
+    std::string strFile(pszFile);
+    size_t pos = strFile.rfind("src/");
+    return pos == std::string::npos ? strFile : strFile.substr(pos + 4);
+}
+
+} // namespace
+
+void RecordLockStats(const char *pszName, const char *pszFile, int nLine,
+                     bool fContended, int64_t nWaitNanos, int64_t nHoldNanos) {
+    LockStatsBuffer &buffer = GetLockStatsBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    LockCounters &counters =
+        buffer.counters[LockSite(pszName, pszFile, nLine)];
+    counters.nAcquisitions++;
+    if (fContended) {
+        counters.nContended++;
+        counters.nWaitNanos += nWaitNanos;
+        counters.nMaxWaitNanos = std::max(counters.nMaxWaitNanos, nWaitNanos);
+    }
+    counters.nHoldNanos += nHoldNanos;
+    counters.nMaxHoldNanos = std::max(counters.nMaxHoldNanos, nHoldNanos);
+}
+
+int64_t LockStatsAcquired(void *cs) {
+    HeldLock &held = GetLockStatsBuffer().mapHeld[cs];
+    held.nDepth++;
+    return held.nReleasedNanos;
+}
+
+int64_t LockStatsReleased(void *cs) {
+    LockStatsBuffer *buffer = GetLockStatsBufferIfAny();
+    if (!buffer) {
+        return 0;
+    }
+    auto it = buffer->mapHeld.find(cs);
+    if (it == buffer->mapHeld.end()) {
+        return 0;
+    }
+    int64_t nReleasedNanos = it->second.nReleasedNanos;
+    if (--it->second.nDepth == 0) {
+        buffer->mapHeld.erase(it);
+    }
+    return nReleasedNanos;
+}
+
+void LockStatsLeave(void *cs) {
+    LockStatsBuffer *buffer = GetLockStatsBufferIfAny();
+    if (!buffer || buffer->mapHeld.empty()) {
+        return;
+    }
+    auto it = buffer->mapHeld.find(cs);
+    if (it != buffer->mapHeld.end()) {
+        it->second.nReleasedAt = LockStatsNow();
+    }
+}
+
+void LockStatsEnter(void *cs) {
+    LockStatsBuffer *buffer = GetLockStatsBufferIfAny();
+    if (!buffer || buffer->mapHeld.empty()) {
+        return;
+    }
+    auto it = buffer->mapHeld.find(cs);
+    if (it != buffer->mapHeld.end() && it->second.nReleasedAt) {
+        it->second.nReleasedNanos += LockStatsNow() - it->second.nReleasedAt;
+        it->second.nReleasedAt = 0;
+    }
+}
+
+std::vector<LockSiteStats> GetLockStats() {
+    // Different literals may name the same site when a header is included
+    // from several translation units, so aggregate by content.
+    std::map<std::tuple<std::string, std::string, int>, LockCounters> merged;
+    auto mergeCounters = [&merged](const LockCountersMap &counters) {
+        for (const auto &entry : counters) {
+            merged[std::make_tuple(std::string(std::get<0>(entry.first)),
+                                   LockSiteFile(std::get<1>(entry.first)),
+                                   std::get<2>(entry.first))]
+                .Merge(entry.second);
+        }
+    };
+
+    {
+        LockStatsRegistry &registry = GetLockStatsRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        mergeCounters(registry.retired);
+        for (LockStatsBuffer *buffer : registry.buffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            mergeCounters(buffer->counters);
+        }
+    }
+
+    std::vector<LockSiteStats> vStats;
+    vStats.reserve(merged.size());
+    for (const auto &entry : merged) {
+        const LockCounters &counters = entry.second;
+        vStats.push_back(LockSiteStats{
+            std::get<0>(entry.first), std::get<1>(entry.first),
+            std::get<2>(entry.first), counters.nAcquisitions,
+            counters.nContended, counters.nWaitNanos, counters.nMaxWaitNanos,
+            counters.nHoldNanos, counters.nMaxHoldNanos});
+    }
+    return vStats;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -156,6 +384,22 @@ void AssertLockHeldInternal(const char *pszName, const char *pszFile, int nLine,
     abort();
 }
 
+void AssertLockNotHeldInternal(const char *pszName, const char *pszFile,
+                               int nLine, void *cs) {
+    if (lockstack.get() == nullptr) {
+        return;
+    }
+
+    for (const std::pair<void *, CLockLocation> &i : *lockstack) {
+        if (i.first == cs) {
+            fprintf(stderr,
+                    "Assertion failed: lock %s held in %s:%i; locks held:\n%s",
+                    pszName, pszFile, nLine, LocksHeld().c_str());
+            abort();
+        }
+    }
+}
+
 void DeleteLock(void *cs) {
     if (!lockdata.available) {
         // We're already shutting down.
@@ -8,6 +8,11 @@
 
 #include "threadsafety.h"
 
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -69,6 +74,8 @@ void LeaveCritical();
 std::string LocksHeld();
 void AssertLockHeldInternal(const char *pszName, const char *pszFile, int nLine,
                             void *cs);
+void AssertLockNotHeldInternal(const char *pszName, const char *pszFile,
+                               int nLine, void *cs);
 void DeleteLock(void *cs);
 #else
 static inline void EnterCritical(const char *pszName, const char *pszFile,
@@ -77,9 +84,14 @@ static inline void LeaveCritical() {}
 static inline void AssertLockHeldInternal(const char *pszName,
                                           const char *pszFile, int nLine,
                                           void *cs) {}
+static inline void AssertLockNotHeldInternal(const char *pszName,
+                                             const char *pszFile, int nLine,
+                                             void *cs) {}
 static inline void DeleteLock(void *cs) {}
 #endif
 #define AssertLockHeld(cs) AssertLockHeldInternal(#cs, __FILE__, __LINE__, &cs)
+#define AssertLockNotHeld(cs)                                                  \
+    AssertLockNotHeldInternal(#cs, __FILE__, __LINE__, &cs)
 
 /**
  * Wrapped boost mutex: supports recursive locking, but no waiting
@@ -102,21 +114,90 @@ typedef boost::condition_variable CConditionVariable;
 void PrintLockContention(const char *pszName, const char *pszFile, int nLine);
 #endif
 
+/**
+ * Runtime lock contention statistics. Every LOCK site records how often its
+ * lock was taken, how often it had to wait for it, and for how long it waited
+ * and held it. The counters are kept in per-thread buffers, so recording does
+ * not contend, and are only aggregated when GetLockStats is called. They are
+ * recorded once the lock is released. Recording is off by default, as it
+ * still costs every LOCK a try_lock, clock reads and a counter lookup.
+ */
+static const bool DEFAULT_LOCKSTATS = false;
+extern std::atomic<bool> fLockStats;
+
+/** Aggregated statistics of a LOCK site, identified by lock name and line. */
+struct LockSiteStats {
+    std::string strName;
+    std::string strFile;
+    int nLine;
+    uint64_t nAcquisitions;
+    //! acquisitions which had to wait for another thread to release the lock
+    uint64_t nContended;
+    int64_t nWaitNanos;
+    int64_t nMaxWaitNanos;
+    int64_t nHoldNanos;
+    int64_t nMaxHoldNanos;
+};
+
+/** Monotonic clock used for lock statistics, in nanoseconds. */
+int64_t LockStatsNow();
+void RecordLockStats(const char *pszName, const char *pszFile, int nLine,
+                     bool fContended, int64_t nWaitNanos, int64_t nHoldNanos);
+/**
+ * Track the time the current thread keeps cs released with
+ * LEAVE_CRITICAL_SECTION while holding it with LOCK, which is not counted as
+ * held. LockStatsAcquired is called when a LOCK of cs is taken and
+ * LockStatsReleased when it is released. Both return the total released time
+ * so far.
+ */
+int64_t LockStatsAcquired(void *cs);
+int64_t LockStatsReleased(void *cs);
+void LockStatsLeave(void *cs);
+void LockStatsEnter(void *cs);
+/** Collect the statistics of all threads, including exited ones. */
+std::vector<LockSiteStats> GetLockStats();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex> class SCOPED_LOCKABLE CMutexLock {
 private:
     boost::unique_lock<Mutex> lock;
 
-    void Enter(const char *pszName, const char *pszFile, int nLine) {
-        EnterCritical(pszName, pszFile, nLine, (void *)(lock.mutex()));
+    //! Lock site and timings for the lock statistics. nLockedAt is 0 when
+    //! statistics are disabled.
+    const char *pszName = nullptr;
+    const char *pszFile = nullptr;
+    int nLine = 0;
+    bool fContended = false;
+    int64_t nWaitNanos = 0;
+    int64_t nLockedAt = 0;
+    int64_t nReleasedNanos = 0;
+
+    void Enter(const char *pszNameIn, const char *pszFileIn, int nLineIn) {
+        EnterCritical(pszNameIn, pszFileIn, nLineIn, (void *)(lock.mutex()));
+        if (lock.try_lock()) {
+            if (fLockStats) {
+                nLockedAt = LockStatsNow();
+            }
+        } else {
 #ifdef DEBUG_LOCKCONTENTION
-        if (!lock.try_lock()) {
-            PrintLockContention(pszName, pszFile, nLine);
+            PrintLockContention(pszNameIn, pszFileIn, nLineIn);
 #endif
-            lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            if (fLockStats) {
+                int64_t nWaitStart = LockStatsNow();
+                lock.lock();
+                nLockedAt = LockStatsNow();
+                fContended = true;
+                nWaitNanos = nLockedAt - nWaitStart;
+            } else {
+                lock.lock();
+            }
         }
-#endif
+        if (nLockedAt) {
+            nReleasedNanos = LockStatsAcquired((void *)(lock.mutex()));
+        }
+        pszName = pszNameIn;
+        pszFile = pszFileIn;
+        nLine = nLineIn;
     }
 
     bool TryEnter(const char *pszName, const char *pszFile, int nLine) {
@@ -148,7 +229,21 @@ public:
     }
 
     ~CMutexLock() UNLOCK_FUNCTION() {
-        if (lock.owns_lock()) LeaveCritical();
+        if (lock.owns_lock()) {
+            // The statistics are recorded once the lock is released, so as
+            // not to hold it any longer.
+            int64_t nUnlockedAt = nLockedAt ? LockStatsNow() : 0;
+            lock.unlock();
+            LeaveCritical();
+            if (nLockedAt) {
+                int64_t nHoldNanos =
+                    nUnlockedAt - nLockedAt -
+                    (LockStatsReleased((void *)(lock.mutex())) -
+                     nReleasedNanos);
+                RecordLockStats(pszName, pszFile, nLine, fContended,
+                                nWaitNanos, nHoldNanos);
+            }
+        }
     }
 
     operator bool() { return lock.owns_lock(); }
@@ -172,10 +267,12 @@ typedef CMutexLock<CCriticalSection> CCriticalBlock;
     {                                                                          \
         EnterCritical(#cs, __FILE__, __LINE__, (void *)(&cs));                 \
         (cs).lock();                                                           \
+        LockStatsEnter((void *)(&cs));                                         \
     }
 
 #define LEAVE_CRITICAL_SECTION(cs)                                             \
     {                                                                          \
+        LockStatsLeave((void *)(&cs));                                         \
         (cs).unlock();                                                         \
         LeaveCritical();                                                       \
     }
@@ -0,0 +1,216 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "config.h"
+#include "consensus/validation.h"
+#include "index/blockfilterindex.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "undo.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+BOOST_FIXTURE_TEST_CASE(gcsfilter_test, BasicTestingSetup) {
+    GCSFilter::ElementSet included;
+    GCSFilter::ElementSet excluded;
+    for (int i = 0; i < 100; i++) {
+        included.insert(InsecureRandBytes(32));
+        excluded.insert(InsecureRandBytes(32));
+    }
+
+    const GCSFilter::Params params(0, 0, BASIC_FILTER_P, BASIC_FILTER_M);
+    const GCSFilter filter(params, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100);
+    for (const GCSFilter::Element &element : included) {
+        BOOST_CHECK(filter.Match(element));
+
+        GCSFilter::ElementSet query = excluded;
+        query.insert(element);
+        BOOST_CHECK(filter.MatchAny(query));
+    }
+    // The false positive rate is about 1 / M: 100 random elements are
+    // expected to match with a probability of 1.3e-4.
+    BOOST_CHECK(!filter.MatchAny(excluded));
+
+    // A filter decoded from its encoding is the same.
+    const GCSFilter decoded(params, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100);
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    for (const GCSFilter::Element &element : included) {
+        BOOST_CHECK(decoded.Match(element));
+    }
+
+    // Encodings with missing or trailing data are rejected.
+    std::vector<uint8_t> vchTruncated = filter.GetEncoded();
+    vchTruncated.pop_back();
+    BOOST_CHECK_THROW(GCSFilter(params, vchTruncated), std::ios_base::failure);
+    std::vector<uint8_t> vchExtended = filter.GetEncoded();
+    vchExtended.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(params, vchExtended), std::ios_base::failure);
+
+    // An empty filter matches nothing.
+    const GCSFilter empty(params, GCSFilter::ElementSet());
+    BOOST_CHECK_EQUAL(empty.GetN(), 0);
+    BOOST_CHECK(empty.GetEncoded() == std::vector<uint8_t>(1, 0));
+    BOOST_CHECK(!empty.MatchAny(included));
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilter_basic_test, BasicTestingSetup) {
+    const CScript included1 = CScript() << std::vector<uint8_t>(65, 0)
+                                        << OP_CHECKSIG;
+    const CScript included2 = CScript() << OP_DUP << OP_HASH160
+                                        << std::vector<uint8_t>(20, 1)
+                                        << OP_EQUALVERIFY << OP_CHECKSIG;
+    const CScript included3 = CScript() << OP_3;
+    const CScript excludedOpReturn = CScript() << OP_RETURN << OP_4 << OP_ADD
+                                               << OP_8 << OP_EQUAL;
+    const CScript excludedSpent = CScript() << OP_5;
+
+    CMutableTransaction tx;
+    tx.vout.emplace_back(Amount(100), included1);
+    tx.vout.emplace_back(Amount(200), included2);
+    tx.vout.emplace_back(Amount(300), excludedOpReturn);
+    tx.vout.emplace_back(Amount(400), CScript());
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.emplace_back();
+    blockundo.vtxundo.back().vprevout.emplace_back(
+        CTxOut(Amount(500), included3), 1000, true);
+    blockundo.vtxundo.back().vprevout.emplace_back(
+        CTxOut(Amount(600), CScript()), 1000, true);
+
+    const BlockFilter filter(block, blockundo);
+    BOOST_CHECK(filter.GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(filter.GetFilter().GetN(), 3);
+
+    const GCSFilter &gcs = filter.GetFilter();
+    BOOST_CHECK(gcs.Match(GCSFilter::Element(included1.begin(),
+                                             included1.end())));
+    BOOST_CHECK(gcs.Match(GCSFilter::Element(included2.begin(),
+                                             included2.end())));
+    BOOST_CHECK(gcs.Match(GCSFilter::Element(included3.begin(),
+                                             included3.end())));
+    BOOST_CHECK(!gcs.Match(GCSFilter::Element(excludedOpReturn.begin(),
+                                              excludedOpReturn.end())));
+    BOOST_CHECK(!gcs.Match(GCSFilter::Element(excludedSpent.begin(),
+                                              excludedSpent.end())));
+
+    // The filter survives serialization, and is keyed on the block hash.
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << filter;
+    BlockFilter filterRead;
+    ss >> filterRead;
+    BOOST_CHECK(filterRead.GetBlockHash() == filter.GetBlockHash());
+    BOOST_CHECK(filterRead.GetEncodedFilter() == filter.GetEncodedFilter());
+    BOOST_CHECK(filterRead.GetFilter().Match(
+        GCSFilter::Element(included3.begin(), included3.end())));
+
+    // Headers commit to the previous header.
+    const uint256 hashHeader = filter.ComputeHeader(uint256());
+    BOOST_CHECK(hashHeader != filter.GetHash());
+    BOOST_CHECK(hashHeader != filter.ComputeHeader(hashHeader));
+}
+
+// Test vector of BIP 158: the basic filter of the testnet genesis block, which
+// has no undo data, and its header.
+BOOST_FIXTURE_TEST_CASE(blockfilter_bip158_vector_test, BasicTestingSetup) {
+    const std::unique_ptr<CChainParams> testnet =
+        CreateChainParams(CBaseChainParams::TESTNET);
+    const CBlock &genesis = testnet->GenesisBlock();
+    BOOST_CHECK_EQUAL(
+        genesis.GetHash().GetHex(),
+        "000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943");
+
+    const BlockFilter filter(genesis, CBlockUndo());
+    const std::vector<uint8_t> &vchFilter = filter.GetEncodedFilter();
+    BOOST_CHECK_EQUAL(HexStr(vchFilter.begin(), vchFilter.end()), "019dfca8");
+    BOOST_CHECK_EQUAL(
+        filter.ComputeHeader(uint256()).GetHex(),
+        "21584579b7eb08997773e5aeff3a7f932700042d0ed2a6129012b7d7ae81b750");
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_sync_test, TestChain100Setup) {
+    const Config &config = GetConfig();
+    g_blockfilterindex.reset(new BlockFilterIndex(config, 1 << 20, true));
+    BOOST_CHECK(!g_blockfilterindex->BlockUntilSyncedToCurrentChain());
+    BOOST_REQUIRE(g_blockfilterindex->Start());
+
+    // Allow the index to catch up with the block chain.
+    int64_t nTimeStart = GetTimeMillis();
+    while (!g_blockfilterindex->BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(nTimeStart + 10000 > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Every block of the chain has a filter matching its coinbase output,
+    // and its header commits to the previous one.
+    auto CheckChain = [&]() {
+        LOCK(cs_main);
+        uint256 hashPrevHeader;
+        for (const CBlockIndex *pindex = chainActive.Genesis(); pindex;
+             pindex = chainActive.Next(pindex)) {
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, config));
+
+            BlockFilter filter;
+            uint256 hashHeader;
+            BOOST_REQUIRE(
+                g_blockfilterindex->LookupFilter(pindex, filter, hashHeader));
+            BlockFilter filterOnly;
+            BOOST_REQUIRE(g_blockfilterindex->LookupFilter(pindex, filterOnly));
+            BOOST_CHECK(filterOnly.GetEncodedFilter() ==
+                        filter.GetEncodedFilter());
+            BOOST_CHECK(filter.GetBlockHash() == pindex->GetBlockHash());
+            BOOST_CHECK(hashHeader == filter.ComputeHeader(hashPrevHeader));
+
+            const CScript &script = block.vtx[0]->vout[0].scriptPubKey;
+            BOOST_CHECK(filter.GetFilter().Match(
+                GCSFilter::Element(script.begin(), script.end())));
+            hashPrevHeader = hashHeader;
+        }
+    };
+    CheckChain();
+
+    // Connected blocks are indexed from validation notifications.
+    CScript scriptPubKey =
+        GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    std::vector<CMutableTransaction> noTxns;
+    for (int i = 0; i < 5; i++) {
+        CreateAndProcessBlock(noTxns, scriptPubKey);
+    }
+    BOOST_CHECK(g_blockfilterindex->BlockUntilSyncedToCurrentChain());
+    CheckChain();
+
+    // After a reorg, the filters of the new blocks follow the headers of the
+    // blocks that stayed in the chain.
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(
+            config, state, chainActive[chainActive.Height() - 2]));
+    }
+    BOOST_CHECK(g_blockfilterindex->BlockUntilSyncedToCurrentChain());
+    const CScript scriptReorg = CScript() << OP_TRUE;
+    for (int i = 0; i < 4; i++) {
+        CreateAndProcessBlock(noTxns, scriptReorg);
+    }
+    BOOST_CHECK(g_blockfilterindex->BlockUntilSyncedToCurrentChain());
+    CheckChain();
+
+    g_blockfilterindex.reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,70 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockresponsecache.h"
+#include "protocol.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockresponsecache_tests, BasicTestingSetup)
+
+static CBlockResponseCache::Payload MakePayload(uint8_t n) {
+    return std::make_shared<const std::vector<uint8_t>>(10, n);
+}
+
+BOOST_AUTO_TEST_CASE(blockresponsecache_get_put) {
+    CBlockResponseCache cache(2);
+    const uint256 hash = InsecureRand256();
+    BOOST_CHECK(!cache.Get(hash, NetMsgType::BLOCK));
+
+    // Payloads are keyed by message type.
+    cache.Put(hash, NetMsgType::BLOCK, MakePayload(1));
+    cache.Put(hash, NetMsgType::CMPCTBLOCK, MakePayload(2));
+    BOOST_CHECK_EQUAL(cache.GetBlockCount(), 1);
+    BOOST_REQUIRE(cache.Get(hash, NetMsgType::BLOCK));
+    BOOST_CHECK_EQUAL(cache.Get(hash, NetMsgType::BLOCK)->front(), 1);
+    BOOST_CHECK_EQUAL(cache.Get(hash, NetMsgType::CMPCTBLOCK)->front(), 2);
+    BOOST_CHECK(!cache.Get(hash, NetMsgType::HEADERS));
+
+    // Putting a payload again replaces it.
+    cache.Put(hash, NetMsgType::BLOCK, MakePayload(3));
+    BOOST_CHECK_EQUAL(cache.Get(hash, NetMsgType::BLOCK)->front(), 3);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetBlockCount(), 0);
+    BOOST_CHECK(!cache.Get(hash, NetMsgType::BLOCK));
+}
+
+BOOST_AUTO_TEST_CASE(blockresponsecache_eviction) {
+    CBlockResponseCache cache(2);
+    const uint256 hash1 = InsecureRand256();
+    const uint256 hash2 = InsecureRand256();
+    const uint256 hash3 = InsecureRand256();
+
+    cache.Put(hash1, NetMsgType::BLOCK, MakePayload(1));
+    cache.Put(hash2, NetMsgType::BLOCK, MakePayload(2));
+
+    // Serving hash1 makes hash2 the least recently used block.
+    BOOST_CHECK(cache.Get(hash1, NetMsgType::BLOCK));
+    cache.Put(hash3, NetMsgType::BLOCK, MakePayload(3));
+    BOOST_CHECK_EQUAL(cache.GetBlockCount(), 2);
+    BOOST_CHECK(cache.Get(hash1, NetMsgType::BLOCK));
+    BOOST_CHECK(!cache.Get(hash2, NetMsgType::BLOCK));
+    BOOST_CHECK(cache.Get(hash3, NetMsgType::BLOCK));
+
+    // Payloads handed out stay valid after their block is evicted.
+    CBlockResponseCache::Payload payload = cache.Get(hash1, NetMsgType::BLOCK);
+    cache.Put(hash2, NetMsgType::BLOCK, MakePayload(2));
+    cache.Put(InsecureRand256(), NetMsgType::BLOCK, MakePayload(4));
+    BOOST_CHECK(!cache.Get(hash1, NetMsgType::BLOCK));
+    BOOST_CHECK_EQUAL(payload->front(), 1);
+
+    // A cache of size zero keeps nothing.
+    CBlockResponseCache disabled(0);
+    disabled.Put(hash1, NetMsgType::BLOCK, MakePayload(1));
+    BOOST_CHECK_EQUAL(disabled.GetBlockCount(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
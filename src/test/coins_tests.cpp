@@ -6,6 +6,7 @@
 #include "consensus/validation.h"
 #include "script/standard.h"
 #include "test/test_bitcoin.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -679,6 +680,71 @@ BOOST_AUTO_TEST_CASE(coin_access) {
     CheckAccessCoin(VALUE1, VALUE2, VALUE2, DIRTY | FRESH, DIRTY | FRESH);
 }
 
+void CheckAddFetchedCoin(const Amount fetched_value, const Amount cache_value,
+                         const Amount expected_value, char cache_flags,
+                         char expected_flags) {
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+    Coin coin;
+    SetCoinValue(fetched_value, coin);
+    test.cache.AddFetchedCoin(OUTPOINT, std::move(coin));
+    test.cache.SelfTest();
+
+    Amount result_value;
+    char result_flags;
+    GetCoinMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(coin_add_fetched) {
+    /* Check AddFetchedCoin behavior, adding a coin looked up outside of the
+     * cache, and checking the resulting entry in the cache. An existing entry
+     * is never replaced.
+     *
+     *                   Fetched Cache   Result  Cache        Result
+     *                   Value   Value   Value   Flags        Flags
+     */
+    CheckAddFetchedCoin(PRUNED, ABSENT, PRUNED, NO_ENTRY, FRESH);
+    CheckAddFetchedCoin(VALUE1, ABSENT, VALUE1, NO_ENTRY, 0);
+    CheckAddFetchedCoin(VALUE1, PRUNED, PRUNED, 0, 0);
+    CheckAddFetchedCoin(VALUE1, PRUNED, PRUNED, FRESH, FRESH);
+    CheckAddFetchedCoin(VALUE1, PRUNED, PRUNED, DIRTY, DIRTY);
+    CheckAddFetchedCoin(VALUE1, PRUNED, PRUNED, DIRTY | FRESH, DIRTY | FRESH);
+    CheckAddFetchedCoin(VALUE1, VALUE2, VALUE2, 0, 0);
+    CheckAddFetchedCoin(VALUE1, VALUE2, VALUE2, FRESH, FRESH);
+    CheckAddFetchedCoin(VALUE1, VALUE2, VALUE2, DIRTY, DIRTY);
+    CheckAddFetchedCoin(VALUE1, VALUE2, VALUE2, DIRTY | FRESH, DIRTY | FRESH);
+}
+
+BOOST_AUTO_TEST_CASE(coins_get_batch) {
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    const COutPoint outpoint1(InsecureRand256(), 0);
+    const COutPoint outpoint2(InsecureRand256(), 1);
+    const COutPoint missing(InsecureRand256(), 0);
+    cache.AddCoin(outpoint1, Coin(CTxOut(Amount(1), CScript()), 1, false),
+                  false);
+    cache.AddCoin(outpoint2, Coin(CTxOut(Amount(2), CScript()), 1, false),
+                  false);
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Flush());
+
+    // By default, coins are looked up one at a time, each in its place.
+    std::vector<Coin> vCoins;
+    std::vector<bool> found;
+    BOOST_CHECK_EQUAL(
+        base.GetCoins({outpoint2, missing, outpoint1}, vCoins, found), 2U);
+    BOOST_REQUIRE_EQUAL(vCoins.size(), 3U);
+    BOOST_CHECK(found[0] && !found[1] && found[2]);
+    BOOST_CHECK_EQUAL(vCoins[0].GetTxOut().nValue, Amount(2));
+    BOOST_CHECK_EQUAL(vCoins[2].GetTxOut().nValue, Amount(1));
+
+    // Only views known to be thread safe are read concurrently.
+    BOOST_CHECK(!base.SupportsConcurrentReads());
+    BOOST_CHECK(!cache.SupportsConcurrentReads());
+    BOOST_CHECK(CCoinsViewDB(1 << 20, true).SupportsConcurrentReads());
+}
+
 void CheckSpendCoin(Amount base_value, Amount cache_value,
                     Amount expected_value, char cache_flags,
                     char expected_flags) {
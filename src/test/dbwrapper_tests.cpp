@@ -321,4 +321,111 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_multiread) {
+    // Perform tests both obfuscated and non-obfuscated.
+    for (int i = 0; i < 2; i++) {
+        bool obfuscate = (bool)i;
+        fs::path ph = fs::temp_directory_path() / fs::unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        // Only even keys are present.
+        std::map<uint32_t, uint256> expected;
+        for (uint32_t x = 0; x < 100; x += 2) {
+            expected[x] = InsecureRand256();
+            BOOST_CHECK(dbw.Write(std::make_pair('m', x), expected[x]));
+        }
+
+        // Keys out of order, missing, duplicated, and past the last one.
+        std::vector<std::pair<char, uint32_t>> keys;
+        for (uint32_t x : {50, 3, 98, 0, 50, 7, 1000, 12}) {
+            keys.push_back(std::make_pair('m', x));
+        }
+        keys.push_back(std::make_pair('z', 0));
+
+        std::vector<uint256> values;
+        std::vector<bool> found;
+        BOOST_CHECK_EQUAL(dbw.MultiRead(keys, values, found), 5);
+        BOOST_REQUIRE_EQUAL(values.size(), keys.size());
+        BOOST_REQUIRE_EQUAL(found.size(), keys.size());
+        for (size_t j = 0; j < keys.size(); j++) {
+            auto it = expected.find(keys[j].second);
+            bool fPresent = keys[j].first == 'm' && it != expected.end();
+            BOOST_CHECK_EQUAL(found[j], fPresent);
+            if (fPresent) {
+                BOOST_CHECK(values[j] == it->second);
+            }
+        }
+
+        BOOST_CHECK_EQUAL(dbw.MultiRead(std::vector<char>(), values, found),
+                          0);
+        BOOST_CHECK(values.empty() && found.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_prefix) {
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, true);
+
+    for (uint32_t x = 0; x < 10; x++) {
+        BOOST_CHECK(dbw.Write(std::make_pair('a', x), x));
+        BOOST_CHECK(dbw.Write(std::make_pair('b', x), x * x));
+        BOOST_CHECK(dbw.Write(std::make_pair('c', x), x));
+    }
+
+    uint32_t nNext = 0;
+    size_t nCount = dbw.ForEachPrefix<std::pair<char, uint32_t>, uint32_t>(
+        'b', [&nNext](const std::pair<char, uint32_t> &key,
+                      const uint32_t &value) {
+            BOOST_CHECK_EQUAL(key.first, 'b');
+            BOOST_CHECK_EQUAL(key.second, nNext);
+            BOOST_CHECK_EQUAL(value, nNext * nNext);
+            nNext++;
+            return true;
+        });
+    BOOST_CHECK_EQUAL(nCount, 10);
+    BOOST_CHECK_EQUAL(nNext, 10);
+
+    // Stops as soon as the callback returns false.
+    nCount = dbw.ForEachPrefix<std::pair<char, uint32_t>, uint32_t>(
+        'a', [](const std::pair<char, uint32_t> &key, const uint32_t &value) {
+            return key.second < 4;
+        });
+    BOOST_CHECK_EQUAL(nCount, 5);
+
+    nCount = dbw.ForEachPrefix<std::pair<char, uint32_t>, uint32_t>(
+        'd', [](const std::pair<char, uint32_t> &key, const uint32_t &value) {
+            return true;
+        });
+    BOOST_CHECK_EQUAL(nCount, 0);
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_latency_histogram) {
+    CDBLatencyHistogram hist;
+    BOOST_CHECK_EQUAL(hist.GetCount(), 0);
+
+    hist.Add(0);
+    hist.Add(1);
+    hist.Add(3);
+    hist.Add(4);
+    hist.Add(int64_t(1) << 40);
+    BOOST_CHECK_EQUAL(hist.GetCount(), 5);
+    BOOST_CHECK_EQUAL(hist.GetBucket(0), 1);
+    BOOST_CHECK_EQUAL(hist.GetBucket(1), 1);
+    BOOST_CHECK_EQUAL(hist.GetBucket(2), 1);
+    BOOST_CHECK_EQUAL(hist.GetBucket(3), 1);
+    BOOST_CHECK_EQUAL(
+        hist.GetBucket(CDBLatencyHistogram::NUM_BUCKETS - 1), 1);
+
+    // Reads and writes of a database are recorded separately.
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, false);
+    uint256 res;
+    BOOST_CHECK(dbw.Write('k', InsecureRand256()));
+    BOOST_CHECK(dbw.Read('k', res));
+    BOOST_CHECK(!dbw.Exists('l'));
+    BOOST_CHECK_EQUAL(dbw.GetWriteLatency().GetCount(), 1);
+    // The constructor also reads the obfuscation key.
+    BOOST_CHECK_EQUAL(dbw.GetReadLatency().GetCount(), 3);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
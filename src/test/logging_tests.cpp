@@ -0,0 +1,173 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "logging.h"
+#include "test/test_bitcoin.h"
+#include "util.h"
+
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(logging_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(message_queue) {
+    BCLog::MessageQueue queue(3);
+    BOOST_CHECK_EQUAL(queue.Capacity(), 4U);
+
+    std::string msg;
+    BOOST_CHECK(!queue.Pop(msg));
+
+    // Messages come out in order, and the queue wraps around.
+    for (int lap = 0; lap < 3; lap++) {
+        for (int i = 0; i < 4; i++) {
+            BOOST_CHECK(queue.Push(strprintf("%d", i)));
+        }
+        BOOST_CHECK(!queue.Push("full"));
+        BOOST_CHECK_EQUAL(queue.Size(), 4U);
+        for (int i = 0; i < 4; i++) {
+            BOOST_CHECK(queue.Pop(msg));
+            BOOST_CHECK_EQUAL(msg, strprintf("%d", i));
+        }
+        BOOST_CHECK(!queue.Pop(msg));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(message_queue_producers) {
+    static const int PRODUCERS = 4;
+    static const int MESSAGES = 10000;
+    BCLog::MessageQueue queue(64);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PRODUCERS; p++) {
+        threads.emplace_back([&queue, p] {
+            for (int i = 0; i < MESSAGES; i++) {
+                while (!queue.Push(strprintf("%d %d", p, i))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // Every message is received once, in the order each producer sent them.
+    std::vector<int> vNext(PRODUCERS, 0);
+    int nReceived = 0;
+    std::string msg;
+    while (nReceived < PRODUCERS * MESSAGES) {
+        if (!queue.Pop(msg)) {
+            std::this_thread::yield();
+            continue;
+        }
+        int p, i;
+        BOOST_REQUIRE(sscanf(msg.c_str(), "%d %d", &p, &i) == 2);
+        BOOST_REQUIRE(p >= 0 && p < PRODUCERS);
+        BOOST_CHECK_EQUAL(i, vNext[p]);
+        vNext[p] = i + 1;
+        nReceived++;
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    BOOST_CHECK(!queue.Pop(msg));
+}
+
+static std::vector<std::string> ReadDebugLog() {
+    std::ifstream file((GetDataDir() / "debug.log").string());
+    std::vector<std::string> vLines;
+    std::string line;
+    while (std::getline(file, line)) {
+        vLines.push_back(line);
+    }
+    return vLines;
+}
+
+BOOST_AUTO_TEST_CASE(async_writer) {
+    BCLog::Logger logger;
+    logger.fLogTimestamps = false;
+
+    logger.LogPrintStr("before open\n");
+    logger.OpenDebugLog();
+    logger.StartAsyncWriter(1 << 10, 10);
+    for (int i = 0; i < 100; i++) {
+        logger.LogPrintStr(strprintf("async %d\n", i));
+    }
+    logger.Flush();
+    BOOST_CHECK_EQUAL(ReadDebugLog().size(), 101U);
+
+    logger.StopAsyncWriter();
+    logger.LogPrintStr("after stop\n");
+
+    std::vector<std::string> vLines = ReadDebugLog();
+    BOOST_REQUIRE_EQUAL(vLines.size(), 102U);
+    BOOST_CHECK_EQUAL(vLines.front(), "before open");
+    for (int i = 0; i < 100; i++) {
+        BOOST_CHECK_EQUAL(vLines[i + 1], strprintf("async %d", i));
+    }
+    BOOST_CHECK_EQUAL(vLines.back(), "after stop");
+    BOOST_CHECK_EQUAL(logger.GetDroppedMessages(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(async_writer_stop) {
+    static const int PRODUCERS = 4;
+    static const int MESSAGES = 2000;
+    BCLog::Logger logger;
+    logger.fLogTimestamps = false;
+    logger.OpenDebugLog();
+
+    // Messages logged while the writer stops are all written, without
+    // waiting for a later message.
+    logger.StartAsyncWriter(1 << 16, 60 * 1000);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PRODUCERS; p++) {
+        threads.emplace_back([&logger, p] {
+            for (int i = 0; i < MESSAGES; i++) {
+                logger.LogPrintStr(strprintf("msg %d %d\n", p, i));
+            }
+        });
+    }
+    logger.StopAsyncWriter();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(ReadDebugLog().size(), size_t(PRODUCERS * MESSAGES));
+    BOOST_CHECK_EQUAL(logger.GetDroppedMessages(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(async_writer_overflow) {
+    static const int MESSAGES = 100000;
+    BCLog::Logger logger;
+    logger.fLogTimestamps = false;
+    logger.OpenDebugLog();
+
+    // A tiny queue the writer thread cannot keep up with.
+    logger.StartAsyncWriter(16, 60 * 1000);
+    for (int i = 0; i < MESSAGES; i++) {
+        logger.LogPrintStr(strprintf("msg %d\n", i));
+    }
+    logger.StopAsyncWriter();
+
+    // Every message is either written, in order, or accounted for as dropped.
+    uint64_t nWritten = 0, nDropped = 0;
+    int nLast = -1;
+    for (const std::string &line : ReadDebugLog()) {
+        int i;
+        unsigned int n;
+        if (sscanf(line.c_str(), "msg %d", &i) == 1) {
+            BOOST_CHECK(i > nLast);
+            nLast = i;
+            nWritten++;
+        } else {
+            BOOST_REQUIRE(sscanf(line.c_str(),
+                                 "%u log messages were dropped", &n) == 1);
+            nDropped += n;
+        }
+    }
+    BOOST_CHECK_EQUAL(nDropped, logger.GetDroppedMessages());
+    BOOST_CHECK_EQUAL(nWritten + nDropped, uint64_t(MESSAGES));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,55 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "metrics.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(metrics_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(histogram) {
+    MetricsHistogram histogram({1000, 10000});
+    histogram.Observe(500);
+    histogram.Observe(1000);
+    histogram.Observe(5000);
+    histogram.Observe(20000);
+
+    std::string strOut;
+    histogram.Format(strOut, "test_seconds", "Test histogram.");
+    BOOST_CHECK_EQUAL(strOut, "# HELP test_seconds Test histogram.\n"
+                              "# TYPE test_seconds histogram\n"
+                              "test_seconds_bucket{le=\"0.001\"} 2\n"
+                              "test_seconds_bucket{le=\"0.01\"} 3\n"
+                              "test_seconds_bucket{le=\"+Inf\"} 4\n"
+                              "test_seconds_sum 0.0265\n"
+                              "test_seconds_count 4\n");
+}
+
+BOOST_AUTO_TEST_CASE(counter_map) {
+    MetricsCounterMap counters({"a", "b"}, "other");
+    counters.Add("a", 1);
+    counters.Add("a", 2);
+    counters.Add("c", 4);
+
+    std::map<std::string, uint64_t> expected = {
+        {"a", 3}, {"b", 0}, {"other", 4}};
+    BOOST_CHECK(counters.Get() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(format_metrics) {
+    std::string strOut = FormatMetrics();
+    BOOST_CHECK(strOut.find("# TYPE bitcoin_blocks gauge\n") !=
+                std::string::npos);
+    BOOST_CHECK(strOut.find("bitcoin_block_connect_seconds_count ") !=
+                std::string::npos);
+    BOOST_CHECK(strOut.find("\nbitcoin_mempool_transactions ") !=
+                std::string::npos);
+    BOOST_CHECK(strOut.find("bitcoin_net_received_bytes_total{command="
+                            "\"version\"} ") != std::string::npos);
+    BOOST_CHECK(strOut.find("bitcoin_net_sent_bytes_total{command="
+                            "\"*other*\"} ") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
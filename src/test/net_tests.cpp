@@ -7,6 +7,7 @@
 #include "hash.h"
 #include "net.h"
 #include "netbase.h"
+#include "netmessagemaker.h"
 #include "serialize.h"
 #include "streams.h"
 #include "test/test_bitcoin.h"
@@ -168,6 +169,133 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test) {
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(net_buffer_pool) {
+    CNetBufferPool<std::vector<uint8_t>> pool;
+    BOOST_CHECK(pool.Get().capacity() == 0);
+
+    // Buffers come back empty, with their capacity.
+    std::vector<uint8_t> buffer(MIN_POOLED_NET_BUFFER_SIZE, 0xab);
+    const uint8_t *pdata = buffer.data();
+    pool.Put(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+    std::vector<uint8_t> reused = pool.Get();
+    BOOST_CHECK(reused.empty());
+    BOOST_CHECK(reused.data() == pdata);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+
+    // Small and large buffers are not kept, and neither are buffers beyond
+    // the limit.
+    pool.Put(std::vector<uint8_t>(CMessageHeader::HEADER_SIZE));
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    pool.Put(std::vector<uint8_t>(MAX_POOLED_NET_BUFFER_SIZE + 1));
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    for (size_t i = 0; i < MAX_POOLED_NET_BUFFERS + 2; i++) {
+        pool.Put(std::vector<uint8_t>(MIN_POOLED_NET_BUFFER_SIZE));
+    }
+    BOOST_CHECK_EQUAL(pool.size(), MAX_POOLED_NET_BUFFERS);
+}
+
+BOOST_AUTO_TEST_CASE(cnetmessage_recycled_buffer) {
+    const Config &config = GetConfig();
+    const std::vector<uint8_t> payload(3000, 0x42);
+
+    CDataStream ssMsg(SER_NETWORK, INIT_PROTO_VERSION);
+    CMessageHeader hdr(config.GetChainParams().NetMagic(), "ping",
+                       payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    ssMsg << hdr;
+    ssMsg.write(reinterpret_cast<const char *>(payload.data()),
+                payload.size());
+
+    CNetBufferPool<CSerializeData> pool;
+    CSerializeData buffer;
+    buffer.reserve(4096);
+    const char *pdata = buffer.data();
+    pool.Put(std::move(buffer));
+
+    CNetMessage msg(config.GetChainParams().NetMagic(), SER_NETWORK,
+                    INIT_PROTO_VERSION);
+    msg.vRecv.SetBuffer(pool.Get());
+
+    // Feed the message in small pieces, as it could come off the socket.
+    const char *pch = &ssMsg[0];
+    uint32_t nBytes = ssMsg.size();
+    while (nBytes > 0) {
+        uint32_t nChunk = std::min<uint32_t>(nBytes, 700);
+        int handled = msg.in_data ? msg.readData(pch, nChunk)
+                                  : msg.readHeader(config, pch, nChunk);
+        BOOST_REQUIRE(handled > 0);
+        pch += handled;
+        nBytes -= handled;
+    }
+
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+    BOOST_CHECK(msg.vRecv.data() == pdata);
+    BOOST_CHECK(std::vector<uint8_t>(msg.vRecv.begin(), msg.vRecv.end()) ==
+                payload);
+
+    pool.Put(msg.vRecv.ReleaseBuffer());
+    BOOST_CHECK(msg.vRecv.empty());
+    BOOST_CHECK(pool.Get().data() == pdata);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(cnode_gathered_send) {
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    CConnman connman(GetConfig(), 0x1337, 0x1337);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode node(0, NODE_NETWORK, 0, fds[0], addr, 0, 0, "", false);
+
+    // The header and the payload of a message go out in a single call.
+    const CNetMsgMaker msgMaker(INIT_PROTO_VERSION);
+    const std::vector<uint8_t> payload(100, 0x42);
+    for (int i = 0; i < 10; i++) {
+        connman.PushMessage(&node, msgMaker.Make("test", payload));
+    }
+    const size_t nMsgSize = CMessageHeader::HEADER_SIZE + 1 + payload.size();
+    BOOST_CHECK_EQUAL(node.nSendCalls, 10);
+    BOOST_CHECK_EQUAL(node.nSendBytes, 10 * nMsgSize);
+
+    std::vector<char> received(10 * nMsgSize);
+    BOOST_CHECK_EQUAL(recv(fds[1], received.data(), received.size(), 0),
+                      ssize_t(received.size()));
+    BOOST_CHECK(std::equal(payload.begin(), payload.end(),
+                           received.begin() + CMessageHeader::HEADER_SIZE + 1));
+
+    // A message larger than the socket buffer is sent in part, and the rest
+    // is kept, starting in the middle of the payload.
+    int nSendBuffer = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &nSendBuffer,
+               sizeof(nSendBuffer));
+    connman.PushMessage(&node,
+                        msgMaker.Make("test", std::vector<uint8_t>(1000000)));
+    BOOST_CHECK_EQUAL(node.nSendCalls, 11);
+    BOOST_CHECK_EQUAL(node.vSendMsg.size(), 1);
+    BOOST_CHECK(node.nSendOffset > 0);
+    BOOST_CHECK_EQUAL(node.nSendBytes, 10 * nMsgSize +
+                                           CMessageHeader::HEADER_SIZE +
+                                           node.nSendOffset);
+
+    // A shared payload is queued as is, rather than copied.
+    CSerializedNetMsg sharedMsg;
+    sharedMsg.command = "test";
+    sharedMsg.sharedData =
+        std::make_shared<const std::vector<uint8_t>>(1000000);
+    const uint8_t *pshared = sharedMsg.sharedData->data();
+    connman.PushMessage(&node, std::move(sharedMsg));
+    BOOST_CHECK_EQUAL(node.vSendMsg.size(), 3);
+    BOOST_CHECK(node.vSendMsg.back().data() == pshared);
+
+    close(fds[1]);
+}
+#endif
+
 BOOST_AUTO_TEST_CASE(test_getSubVersionEB) {
     BOOST_CHECK_EQUAL(getSubVersionEB(13800000000), "13800.0");
     BOOST_CHECK_EQUAL(getSubVersionEB(3800000000), "3800.0");
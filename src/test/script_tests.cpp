@@ -1869,4 +1869,203 @@ BOOST_AUTO_TEST_CASE(script_FindAndDelete) {
     BOOST_CHECK(s == expect);
 }
 
+/**
+ * Accepts signatures depending on their first byte only, so that random
+ * scripts can get through signature checks.
+ */
+class FirstByteSignatureChecker : public BaseSignatureChecker {
+public:
+    bool CheckSig(const std::vector<uint8_t> &vchSig,
+                  const std::vector<uint8_t> &vchPubKey,
+                  const CScript &scriptCode, uint32_t flags) const override {
+        return vchSig.size() && (vchSig[0] & 1);
+    }
+};
+
+static uint32_t InsecureRandScriptFlags() {
+    static const uint32_t flagsToTest[] = {
+        SCRIPT_VERIFY_P2SH,
+        SCRIPT_VERIFY_STRICTENC,
+        SCRIPT_VERIFY_DERSIG,
+        SCRIPT_VERIFY_LOW_S,
+        SCRIPT_VERIFY_NULLDUMMY,
+        SCRIPT_VERIFY_SIGPUSHONLY,
+        SCRIPT_VERIFY_MINIMALDATA,
+        SCRIPT_VERIFY_CLEANSTACK,
+        SCRIPT_VERIFY_NULLFAIL,
+        SCRIPT_VERIFY_COMPRESSED_PUBKEYTYPE,
+        SCRIPT_ENABLE_SIGHASH_FORKID,
+    };
+    uint32_t flags = 0;
+    for (uint32_t flag : flagsToTest) {
+        if (InsecureRandBool()) {
+            flags |= flag;
+        }
+    }
+    if (flags & SCRIPT_VERIFY_CLEANSTACK) {
+        flags |= SCRIPT_VERIFY_P2SH;
+    }
+    return flags;
+}
+
+static void CheckSameAsGeneric(const CScript &scriptSig,
+                               const CScript &scriptPubKey, uint32_t flags,
+                               const BaseSignatureChecker &checker) {
+    ScriptError err, errGeneric;
+    bool fValid = VerifyScript(scriptSig, scriptPubKey, flags, checker, &err);
+    bool fValidGeneric = VerifyScriptGeneric(scriptSig, scriptPubKey, flags,
+                                             checker, &errGeneric);
+    BOOST_CHECK_EQUAL(fValid, fValidGeneric);
+    BOOST_CHECK_MESSAGE(err == errGeneric,
+                        std::string(FormatScriptError(err)) + " where " +
+                            FormatScriptError(errGeneric) + " expected: " +
+                            FormatScript(scriptSig) + " spending " +
+                            FormatScript(scriptPubKey));
+}
+
+static void PushData(CScript &script, const std::vector<uint8_t> &data,
+                     bool fMinimal) {
+    if (fMinimal || data.size() > 0xff) {
+        script << data;
+        return;
+    }
+    // Not minimal for any data size.
+    script.insert(script.end(), OP_PUSHDATA1);
+    script.insert(script.end(), uint8_t(data.size()));
+    script.insert(script.end(), data.begin(), data.end());
+}
+
+/**
+ * Randomly alter a scriptSig made of pushes, mostly keeping it push only so
+ * that the result still looks like one of the standard templates.
+ */
+static CScript MutateScriptSig(const CScript &scriptSig) {
+    std::vector<std::vector<uint8_t>> pushes;
+    CScript::const_iterator pc = scriptSig.begin();
+    opcodetype opcode;
+    std::vector<uint8_t> data;
+    while (scriptSig.GetOp(pc, opcode, data)) {
+        pushes.push_back(data);
+    }
+    if (pushes.empty()) {
+        return scriptSig;
+    }
+
+    std::vector<uint8_t> &push = pushes[InsecureRandRange(pushes.size())];
+    switch (InsecureRandRange(7)) {
+        case 0:
+            if (push.size()) {
+                push[InsecureRandRange(push.size())] ^=
+                    1 << InsecureRandRange(8);
+            }
+            break;
+        case 1:
+            // Hash type, or high S.
+            if (push.size()) {
+                push.back() = InsecureRandBits(8);
+            }
+            break;
+        case 2:
+            push.clear();
+            break;
+        case 3:
+            pushes.erase(pushes.begin() + InsecureRandRange(pushes.size()));
+            break;
+        case 4:
+            pushes.insert(pushes.begin() + InsecureRandRange(pushes.size()),
+                          pushes[InsecureRandRange(pushes.size())]);
+            break;
+        case 5:
+            std::swap(push, pushes[InsecureRandRange(pushes.size())]);
+            break;
+        case 6:
+            push = InsecureRandBytes(InsecureRandRange(80));
+            break;
+    }
+
+    CScript result;
+    for (const std::vector<uint8_t> &p : pushes) {
+        PushData(result, p, InsecureRandRange(16) != 0);
+    }
+    if (InsecureRandRange(32) == 0) {
+        result.resize(InsecureRandRange(result.size() + 1));
+    }
+    if (InsecureRandRange(32) == 0) {
+        result << OP_NOP;
+    }
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(script_standard_fast_paths) {
+    SeedInsecureRand(true);
+    std::vector<CKey> keys(16);
+    for (CKey &key : keys) {
+        key.MakeNewKey(InsecureRandBool());
+    }
+
+    for (int i = 0; i < 400; i++) {
+        // Either pay to pubkey hash, or pay to a multisig redeem script.
+        const bool fMultisig = InsecureRandBool();
+        const int nKeys = 1 + InsecureRandRange(fMultisig ? 16 : 1);
+        const int nSigs = 1 + InsecureRandRange(nKeys);
+        CScript redeemScript;
+        CScript scriptPubKey;
+        if (fMultisig) {
+            redeemScript << CScript::EncodeOP_N(nSigs);
+            for (int k = 0; k < nKeys; k++) {
+                PushData(redeemScript, ToByteVector(keys[k].GetPubKey()),
+                         InsecureRandRange(16) != 0);
+            }
+            redeemScript << CScript::EncodeOP_N(nKeys) << OP_CHECKMULTISIG;
+            scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+        } else {
+            scriptPubKey =
+                GetScriptForDestination(keys[0].GetPubKey().GetID());
+        }
+
+        const Amount amount(InsecureRandRange(1000));
+        CMutableTransaction txCredit =
+            BuildCreditingTransaction(scriptPubKey, amount);
+        CMutableTransaction tx = BuildSpendingTransaction(CScript(), txCredit);
+        const SigHashType sigHashType = InsecureRandBool()
+                                            ? SigHashType().withForkId()
+                                            : SigHashType();
+        const CScript &scriptCode = fMultisig ? redeemScript : scriptPubKey;
+        uint256 hash = SignatureHash(scriptCode, CTransaction(tx), 0,
+                                     sigHashType, amount);
+
+        // Sign with the first keys, possibly skipping one.
+        CScript scriptSig;
+        int nSkip = InsecureRandBool() ? InsecureRandRange(nKeys) : -1;
+        if (fMultisig) {
+            scriptSig << OP_0;
+        }
+        for (int k = 0, nSigned = 0; k < nKeys && nSigned < nSigs; k++) {
+            if (k == nSkip && nKeys - k > nSigs - nSigned) {
+                continue;
+            }
+            std::vector<uint8_t> vchSig;
+            BOOST_CHECK(keys[k].Sign(hash, vchSig));
+            vchSig.push_back(uint8_t(sigHashType.getRawSigHashType()));
+            scriptSig << vchSig;
+            nSigned++;
+        }
+        if (fMultisig) {
+            scriptSig << ToByteVector(redeemScript);
+        } else {
+            scriptSig << ToByteVector(keys[0].GetPubKey());
+        }
+
+        MutableTransactionSignatureChecker checker(&tx, 0, amount);
+        const uint32_t flags = InsecureRandScriptFlags();
+        CheckSameAsGeneric(scriptSig, scriptPubKey, flags, checker);
+        for (int j = 0; j < 8; j++) {
+            const CScript mutated = MutateScriptSig(scriptSig);
+            CheckSameAsGeneric(mutated, scriptPubKey, flags, checker);
+            CheckSameAsGeneric(mutated, scriptPubKey, InsecureRandScriptFlags(),
+                               FirstByteSignatureChecker());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
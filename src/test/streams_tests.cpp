@@ -73,6 +73,77 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer) {
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader) {
+    const uint8_t bytes[] = {1, 2, 3, 4, 5, 6};
+    CSpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, bytes, bytes + 6);
+    BOOST_CHECK_EQUAL(reader.size(), 6);
+
+    uint8_t a;
+    uint32_t b;
+    reader >> a >> b;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(b, 0x05040302);
+    BOOST_CHECK_EQUAL(reader.size(), 1);
+    BOOST_CHECK(reader.Cursor() == bytes + 5);
+
+    // Reading past the end throws, and nothing is consumed.
+    BOOST_CHECK_THROW(reader >> b, std::ios_base::failure);
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 6);
+    BOOST_CHECK(reader.empty());
+
+    // ReadInPlace consumes exactly the bytes that were read.
+    CDataStream ds(SER_NETWORK, INIT_PROTO_VERSION);
+    ds << uint16_t(0x1234) << uint8_t(7);
+    uint16_t c;
+    ds.ReadInPlace(c);
+    BOOST_CHECK_EQUAL(c, 0x1234);
+    BOOST_CHECK_EQUAL(ds.size(), 1);
+    BOOST_CHECK_THROW(ds.ReadInPlace(c), std::ios_base::failure);
+    ds >> a;
+    BOOST_CHECK_EQUAL(a, 7);
+    BOOST_CHECK(ds.empty());
+}
+
+BOOST_AUTO_TEST_CASE(streams_bitstream) {
+    std::vector<uint8_t> vch;
+    CVectorWriter writer(SER_NETWORK, INIT_PROTO_VERSION, vch, 0);
+    {
+        BitStreamWriter<CVectorWriter> bitwriter(writer);
+        bitwriter.Write(0, 1);
+        bitwriter.Write(2, 2);
+        bitwriter.Write(6, 3);
+        bitwriter.Write(11, 4);
+        bitwriter.Write(1, 5);
+        bitwriter.Write(32, 6);
+        bitwriter.Write(7, 7);
+        bitwriter.Write(30497, 16);
+        bitwriter.Write(0x0123456789ABCDEF, 64);
+        // The last byte is written, padded, when the writer goes away.
+    }
+    BOOST_CHECK_EQUAL(vch.size(), 14);
+    BOOST_CHECK_EQUAL(vch[0], 0x5A);
+    BOOST_CHECK_EQUAL(vch[1], 0xC3);
+
+    CSpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, vch.data(),
+                       vch.data() + vch.size());
+    BitStreamReader<CSpanReader> bitreader(reader);
+    BOOST_CHECK_EQUAL(bitreader.Read(1), 0);
+    BOOST_CHECK_EQUAL(bitreader.Read(2), 2);
+    BOOST_CHECK_EQUAL(bitreader.Read(3), 6);
+    BOOST_CHECK_EQUAL(bitreader.Read(4), 11);
+    BOOST_CHECK_EQUAL(bitreader.Read(5), 1);
+    BOOST_CHECK_EQUAL(bitreader.Read(6), 32);
+    BOOST_CHECK_EQUAL(bitreader.Read(7), 7);
+    BOOST_CHECK_EQUAL(bitreader.Read(16), 30497);
+    BOOST_CHECK_EQUAL(bitreader.Read(64), 0x0123456789ABCDEF);
+    // Padding bits.
+    BOOST_CHECK_EQUAL(bitreader.Read(4), 0);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(bitreader.Read(1), std::ios_base::failure);
+    BOOST_CHECK_THROW(bitreader.Read(65), std::out_of_range);
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor) {
     std::vector<char> in;
     std::vector<char> expected_xor;
@@ -0,0 +1,142 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sync.h"
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+static const LockSiteStats *FindLockStats(const std::vector<LockSiteStats> &v,
+                                          const std::string &strName) {
+    for (const LockSiteStats &stats : v) {
+        if (stats.strName == strName) {
+            return &stats;
+        }
+    }
+    return nullptr;
+}
+
+BOOST_AUTO_TEST_CASE(lockstats_contention) {
+    CCriticalSection csLockStatsTest;
+    std::atomic<bool> fLocked(false);
+    fLockStats = true;
+
+    // The other thread holds the lock for a while, so that we have to wait.
+    std::thread thread([&] {
+        LOCK(csLockStatsTest);
+        fLocked = true;
+        MilliSleep(50);
+    });
+    while (!fLocked) {
+        MilliSleep(1);
+    }
+    {
+        LOCK(csLockStatsTest);
+    }
+    thread.join();
+
+    // Counters of the exited thread are kept. Both sites share the name, but
+    // are on different lines.
+    std::vector<LockSiteStats> vStats = GetLockStats();
+    uint64_t nAcquisitions = 0, nContended = 0;
+    int64_t nMaxWaitNanos = 0, nMaxHoldNanos = 0;
+    for (const LockSiteStats &stats : vStats) {
+        if (stats.strName != "csLockStatsTest") {
+            continue;
+        }
+        BOOST_CHECK_EQUAL(stats.strFile, "test/sync_tests.cpp");
+        nAcquisitions += stats.nAcquisitions;
+        nContended += stats.nContended;
+        nMaxWaitNanos = std::max(nMaxWaitNanos, stats.nMaxWaitNanos);
+        nMaxHoldNanos = std::max(nMaxHoldNanos, stats.nMaxHoldNanos);
+    }
+    BOOST_CHECK_EQUAL(nAcquisitions, 2U);
+    BOOST_CHECK_EQUAL(nContended, 1U);
+    BOOST_CHECK(nMaxWaitNanos > 10 * 1000 * 1000);
+    BOOST_CHECK(nMaxHoldNanos >= 50 * 1000 * 1000);
+    fLockStats = DEFAULT_LOCKSTATS;
+}
+
+BOOST_AUTO_TEST_CASE(lockstats_released) {
+    CCriticalSection csLockStatsReleased;
+    fLockStats = true;
+
+    // The time the lock is released within the LOCK is not counted as held.
+    {
+        LOCK(csLockStatsReleased);
+        LEAVE_CRITICAL_SECTION(csLockStatsReleased);
+        MilliSleep(50);
+        ENTER_CRITICAL_SECTION(csLockStatsReleased);
+    }
+    fLockStats = DEFAULT_LOCKSTATS;
+
+    const std::vector<LockSiteStats> vStats = GetLockStats();
+    const LockSiteStats *stats = FindLockStats(vStats, "csLockStatsReleased");
+    BOOST_REQUIRE(stats);
+    BOOST_CHECK_EQUAL(stats->nAcquisitions, 1U);
+    BOOST_CHECK(stats->nMaxHoldNanos < 50 * 1000 * 1000);
+}
+
+BOOST_AUTO_TEST_CASE(lockstats_nested) {
+    CCriticalSection csLockStatsNested;
+    fLockStats = true;
+
+    // The time released is subtracted from both nested LOCKs, and is not
+    // counted again by the next LOCK.
+    {
+        LOCK(csLockStatsNested);
+        {
+            LOCK(csLockStatsNested);
+            LEAVE_CRITICAL_SECTION(csLockStatsNested);
+            LEAVE_CRITICAL_SECTION(csLockStatsNested);
+            MilliSleep(50);
+            ENTER_CRITICAL_SECTION(csLockStatsNested);
+            ENTER_CRITICAL_SECTION(csLockStatsNested);
+        }
+    }
+    {
+        LOCK(csLockStatsNested);
+        MilliSleep(20);
+    }
+    fLockStats = DEFAULT_LOCKSTATS;
+
+    int64_t nMaxHoldNanos = 0;
+    for (const LockSiteStats &stats : GetLockStats()) {
+        if (stats.strName == "csLockStatsNested") {
+            nMaxHoldNanos = std::max(nMaxHoldNanos, stats.nMaxHoldNanos);
+        }
+    }
+    BOOST_CHECK(nMaxHoldNanos >= 20 * 1000 * 1000);
+    BOOST_CHECK(nMaxHoldNanos < 50 * 1000 * 1000);
+}
+
+BOOST_AUTO_TEST_CASE(lockstats_disabled) {
+    CCriticalSection csLockStatsDisabled;
+    fLockStats = false;
+    {
+        LOCK(csLockStatsDisabled);
+    }
+    fLockStats = true;
+    BOOST_CHECK(!FindLockStats(GetLockStats(), "csLockStatsDisabled"));
+
+    {
+        LOCK(csLockStatsDisabled);
+    }
+    fLockStats = DEFAULT_LOCKSTATS;
+    const std::vector<LockSiteStats> vStats = GetLockStats();
+    const LockSiteStats *stats = FindLockStats(vStats, "csLockStatsDisabled");
+    BOOST_REQUIRE(stats);
+    BOOST_CHECK_EQUAL(stats->nAcquisitions, 1U);
+    BOOST_CHECK_EQUAL(stats->nContended, 0U);
+    BOOST_CHECK_EQUAL(stats->nWaitNanos, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -97,6 +97,10 @@ TestingSetup::TestingSetup(const std::string &chainName)
     for (int i = 0; i < nScriptCheckThreads - 1; i++) {
         threadGroup.create_thread(&ThreadScriptCheck);
     }
+    nPrefetchThreads = 2;
+    for (int i = 0; i < nPrefetchThreads; i++) {
+        threadGroup.create_thread(&ThreadInputPrefetch);
+    }
 
     // Deterministic randomness for tests.
     g_connman = std::unique_ptr<CConnman>(new CConnman(config, 0x1337, 0x1337));
@@ -15,11 +15,13 @@
 #include "primitives/block.h"
 #include "protocol.h"
 #include "pubkey.h"
+#include "script/interpreter.h"
 #include "script/script.h"
 #include "streams.h"
 #include "undo.h"
 #include "version.h"
 
+#include <cassert>
 #include <cstdint>
 #include <unistd.h>
 
@@ -45,9 +47,23 @@ enum TEST_ID {
     CBLOOMFILTER_DESERIALIZE,
     CDISKBLOCKINDEX_DESERIALIZE,
     CTXOUTCOMPRESSOR_DESERIALIZE,
+    SCRIPT_VERIFY_FAST_PATHS,
     TEST_ID_END
 };
 
+/**
+ * Accepts signatures depending on their first byte only, so that fuzzed
+ * scripts can get through signature checks.
+ */
+class FirstByteSignatureChecker : public BaseSignatureChecker {
+public:
+    bool CheckSig(const std::vector<uint8_t> &vchSig,
+                  const std::vector<uint8_t> &vchPubKey,
+                  const CScript &scriptCode, uint32_t flags) const override {
+        return vchSig.size() && (vchSig[0] & 1);
+    }
+};
+
 bool read_stdin(std::vector<char> &data) {
     char buffer[1024];
     ssize_t length = 0;
@@ -252,6 +268,29 @@ int main(int argc, char **argv) {
 
             break;
         }
+        case SCRIPT_VERIFY_FAST_PATHS: {
+            uint32_t flags;
+            CScript scriptSig, scriptPubKey;
+            try {
+                ds >> flags >> scriptSig >> scriptPubKey;
+            } catch (const std::ios_base::failure &e) {
+                return 0;
+            }
+            if (flags & SCRIPT_VERIFY_CLEANSTACK) {
+                flags |= SCRIPT_VERIFY_P2SH;
+            }
+
+            // The standard template fast paths must agree with the generic
+            // interpreter.
+            FirstByteSignatureChecker checker;
+            ScriptError err, errGeneric;
+            bool fValid =
+                VerifyScript(scriptSig, scriptPubKey, flags, checker, &err);
+            bool fValidGeneric = VerifyScriptGeneric(
+                scriptSig, scriptPubKey, flags, checker, &errGeneric);
+            assert(fValid == fValidGeneric && err == errGeneric);
+            break;
+        }
         default:
             return 0;
     }
@@ -0,0 +1,104 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "trace.h"
+#include "test/test_bitcoin.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include <univalue.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(trace_tests, TestingSetup)
+
+static UniValue DumpAndParse(bool fClear, size_t &nSpans) {
+    fs::path path = GetDataDir() / strprintf("trace-%d.json", GetTimeMicros());
+    BOOST_REQUIRE(DumpTrace(path, fClear, nSpans));
+
+    std::ifstream file(path.string());
+    std::string strJSON((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+    UniValue trace;
+    BOOST_REQUIRE(trace.read(strJSON));
+    return trace;
+}
+
+/** Spans of the trace in the given category. */
+static std::vector<UniValue> FindSpans(const UniValue &trace,
+                                       const std::string &strCategory) {
+    std::vector<UniValue> vSpans;
+    const UniValue &events = find_value(trace, "traceEvents");
+    for (size_t i = 0; i < events.size(); i++) {
+        if (find_value(events[i], "ph").get_str() == "X" &&
+            find_value(events[i], "cat").get_str() == strCategory) {
+            vSpans.push_back(events[i]);
+        }
+    }
+    return vSpans;
+}
+
+BOOST_AUTO_TEST_CASE(trace_spans) {
+    ClearTrace();
+
+    // Nothing is recorded while tracing is disabled.
+    {
+        TRACE_SPAN("test", "disabled");
+    }
+    size_t nSpans;
+    UniValue trace = DumpAndParse(true, nSpans);
+    BOOST_CHECK_EQUAL(nSpans, 0U);
+    BOOST_CHECK(FindSpans(trace, "test").empty());
+
+    fTracing = true;
+    {
+        TRACE_SPAN("test", "outer");
+        MilliSleep(2);
+        {
+            TRACE_SPAN("test", std::string("inner \"quoted\""));
+            MilliSleep(2);
+        }
+    }
+    TraceStage("test", "stage", 1000, 1500);
+    std::thread thread([] { TRACE_SPAN("test", "other thread"); });
+    thread.join();
+    fTracing = false;
+
+    trace = DumpAndParse(false, nSpans);
+    BOOST_CHECK_EQUAL(nSpans, 4U);
+    std::vector<UniValue> vSpans = FindSpans(trace, "test");
+    BOOST_REQUIRE_EQUAL(vSpans.size(), 4U);
+
+    // Spans are written in the order they end, per thread.
+    const UniValue &inner = vSpans[0];
+    const UniValue &outer = vSpans[1];
+    BOOST_CHECK_EQUAL(find_value(inner, "name").get_str(), "inner \"quoted\"");
+    BOOST_CHECK_EQUAL(find_value(outer, "name").get_str(), "outer");
+    BOOST_CHECK(find_value(inner, "ts").get_int64() >=
+                find_value(outer, "ts").get_int64());
+    BOOST_CHECK(find_value(inner, "ts").get_int64() +
+                    find_value(inner, "dur").get_int64() <=
+                find_value(outer, "ts").get_int64() +
+                    find_value(outer, "dur").get_int64());
+    BOOST_CHECK(find_value(outer, "dur").get_int64() >= 4000);
+    BOOST_CHECK_EQUAL(find_value(vSpans[2], "ts").get_int64(), 1000);
+    BOOST_CHECK_EQUAL(find_value(vSpans[2], "dur").get_int64(), 500);
+
+    // The span of the exited thread is kept, on a thread of its own.
+    BOOST_CHECK_EQUAL(find_value(vSpans[3], "name").get_str(), "other thread");
+    BOOST_CHECK(find_value(vSpans[3], "tid").get_int() !=
+                find_value(outer, "tid").get_int());
+
+    // Spans are kept until dumped with clear.
+    DumpAndParse(true, nSpans);
+    BOOST_CHECK_EQUAL(nSpans, 4U);
+    DumpAndParse(true, nSpans);
+    BOOST_CHECK_EQUAL(nSpans, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
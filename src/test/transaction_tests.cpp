@@ -291,6 +291,45 @@ SetupDummyInputs(CBasicKeyStore &keystoreRet, CCoinsViewCache &coinsRet) {
     return dummyTransactions;
 }
 
+BOOST_AUTO_TEST_CASE(tx_read_in_place) {
+    CMutableTransaction mtx;
+    mtx.nVersion = 1;
+    mtx.vin.resize(2);
+    mtx.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 3);
+    mtx.vin[0].scriptSig = CScript() << OP_1 << std::vector<uint8_t>(80, 0xab);
+    mtx.vin[1].prevout = COutPoint(TxId(InsecureRand256()), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = Amount(4321);
+    mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    mtx.nLockTime = 500;
+    const CTransaction tx(mtx);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx << tx << uint8_t(42);
+
+    // Transactions read in place are hashed over the bytes they were read
+    // from, which must match the hash computed from the serialized fields.
+    CTransactionRef ptx;
+    ss.ReadInPlace(ptx);
+    BOOST_CHECK(ptx->GetId() == tx.GetId());
+    BOOST_CHECK(*ptx == tx);
+    BOOST_CHECK(ptx->vin[0].scriptSig == mtx.vin[0].scriptSig);
+
+    CTransaction txDirect(deserialize, ss);
+    BOOST_CHECK(txDirect.GetId() == tx.GetId());
+
+    uint8_t nTrailing;
+    ss >> nTrailing;
+    BOOST_CHECK_EQUAL(nTrailing, 42);
+    BOOST_CHECK(ss.empty());
+
+    // A truncated transaction fails to deserialize.
+    ss << tx;
+    CDataStream ssTruncated(ss.begin(), ss.end() - 1, SER_NETWORK,
+                            PROTOCOL_VERSION);
+    BOOST_CHECK_THROW(ssTruncated.ReadInPlace(ptx), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(test_Get) {
     CBasicKeyStore keystore;
     CCoinsView coinsDummy;
@@ -474,6 +513,62 @@ BOOST_AUTO_TEST_CASE(test_big_transaction) {
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_produce_signatures) {
+    CBasicKeyStore keystore;
+    std::vector<CKey> keys(3);
+    for (CKey &key : keys) {
+        key.MakeNewKey(true);
+        keystore.AddKeyPubKey(key, key.GetPubKey());
+    }
+
+    CScript multisig = GetScriptForMultisig(
+        1, {keys[1].GetPubKey(), keys[2].GetPubKey()});
+    keystore.AddCScript(multisig);
+
+    CKey unknown;
+    unknown.MakeNewKey(true);
+
+    std::vector<CScript> scripts;
+    scripts.push_back(GetScriptForRawPubKey(keys[0].GetPubKey()));
+    scripts.push_back(GetScriptForDestination(keys[1].GetPubKey().GetID()));
+    scripts.push_back(multisig);
+    scripts.push_back(GetScriptForDestination(CScriptID(multisig)));
+
+    // Sign inputs of every kind, as signrawtransaction and the wallet do.
+    CMutableTransaction mtx;
+    std::vector<CTxOut> vSpent;
+    for (size_t i = 0; i < 200; i++) {
+        mtx.vin.emplace_back(COutPoint(InsecureRand256(), i));
+        vSpent.emplace_back(Amount(1000 + i), scripts[i % scripts.size()]);
+    }
+    mtx.vout.emplace_back(Amount(1000), CScript() << OP_1);
+
+    const SigHashType sigHashType = SigHashType().withForkId();
+    const CTransaction tx(mtx);
+    std::vector<SignatureData> vSigData;
+    BOOST_CHECK(ProduceSignatures(keystore, tx, PrecomputedTransactionData(tx),
+                                  vSpent, sigHashType, vSigData));
+    BOOST_CHECK_EQUAL(vSigData.size(), mtx.vin.size());
+
+    // The signatures are those of signing the inputs one at a time, in input
+    // order.
+    for (size_t i = 0; i < mtx.vin.size(); i++) {
+        BOOST_CHECK(SignSignature(keystore, vSpent[i].scriptPubKey, mtx, i,
+                                  vSpent[i].nValue, sigHashType));
+        BOOST_CHECK(vSigData[i].scriptSig == mtx.vin[i].scriptSig);
+    }
+
+    // Inputs spending a null output are skipped, and any input which can't be
+    // signed is reported.
+    vSpent[1].SetNull();
+    vSpent[2].scriptPubKey = GetScriptForRawPubKey(unknown.GetPubKey());
+    BOOST_CHECK(!ProduceSignatures(keystore, tx, PrecomputedTransactionData(tx),
+                                   vSpent, sigHashType, vSigData));
+    BOOST_CHECK(vSigData[0].scriptSig == mtx.vin[0].scriptSig);
+    BOOST_CHECK(vSigData[1].scriptSig.empty());
+    BOOST_CHECK(vSigData[3].scriptSig == mtx.vin[3].scriptSig);
+}
+
 BOOST_AUTO_TEST_CASE(test_witness) {
     CBasicKeyStore keystore, keystore2;
     CKey key1, key2, key3, key1L, key2L;
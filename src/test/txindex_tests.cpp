@@ -0,0 +1,60 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/txindex.h"
+#include "config.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(txindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup) {
+    const Config &config = GetConfig();
+    g_txindex.reset(new TxIndex(config, 1 << 20, true));
+
+    // Nothing is indexed, nor reported as synced, before the index is started.
+    CDiskTxPos pos;
+    for (const auto &txn : coinbaseTxns) {
+        BOOST_CHECK(!g_txindex->FindTx(txn.GetId(), pos));
+    }
+    BOOST_CHECK(!g_txindex->BlockUntilSyncedToCurrentChain());
+
+    BOOST_REQUIRE(g_txindex->Start());
+
+    // Allow the index to catch up with the block chain.
+    int64_t nTimeStart = GetTimeMillis();
+    while (!g_txindex->BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(nTimeStart + 10000 > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // All the transactions in the chain before the index was started are
+    // indexed, and the recorded positions point at them.
+    for (const auto &txn : coinbaseTxns) {
+        CTransactionRef tx;
+        uint256 hashBlock;
+        BOOST_CHECK(GetTransaction(config, txn.GetId(), tx, hashBlock));
+        BOOST_CHECK(tx && tx->GetId() == txn.GetId());
+    }
+
+    // Transactions in new blocks are indexed from validation notifications.
+    CScript scriptPubKey =
+        GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    for (int i = 0; i < 10; i++) {
+        std::vector<CMutableTransaction> noTxns;
+        const CBlock block = CreateAndProcessBlock(noTxns, scriptPubKey);
+        const CTransaction &txn = *block.vtx[0];
+
+        BOOST_CHECK(g_txindex->BlockUntilSyncedToCurrentChain());
+        BOOST_CHECK(g_txindex->FindTx(txn.GetId(), pos));
+    }
+
+    g_txindex.reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -92,6 +92,35 @@ BOOST_AUTO_TEST_CASE(connect_utxo_extblock) {
     BOOST_CHECK(!HasSpendableCoin(view, coinbaseTx.GetId()));
     BOOST_CHECK(!HasSpendableCoin(view, tx0.GetId()));
     BOOST_CHECK(HasSpendableCoin(view, prevTx0.GetId()));
+
+    // Do it again, streaming the undo data as it is read from disk.
+    blockundo = CBlockUndo();
+    UpdateUTXOSet(block, view, blockundo, chainparams, 123456);
+    BOOST_CHECK(!HasSpendableCoin(view, prevTx0.GetId()));
+
+    CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+    ssUndo << blockundo;
+
+    // Truncated undo data is rejected.
+    CDataStream ssTruncated(ssUndo.begin(), ssUndo.end() - 1, SER_DISK,
+                            CLIENT_VERSION);
+    {
+        CCoinsViewCache scratch(&view);
+        CBlockIndex pindex;
+        pindex.nHeight = 123456;
+        BOOST_CHECK_EQUAL(ApplyBlockUndo(ssTruncated, block, &pindex, scratch),
+                          DISCONNECT_FAILED);
+    }
+
+    CBlockIndex pindex;
+    pindex.nHeight = 123456;
+    BOOST_CHECK_EQUAL(ApplyBlockUndo(ssUndo, block, &pindex, view),
+                      DISCONNECT_OK);
+
+    BOOST_CHECK(view.GetBestBlock() == block.hashPrevBlock);
+    BOOST_CHECK(!HasSpendableCoin(view, coinbaseTx.GetId()));
+    BOOST_CHECK(!HasSpendableCoin(view, tx0.GetId()));
+    BOOST_CHECK(HasSpendableCoin(view, prevTx0.GetId()));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,12 +7,15 @@
 #include "config.h"
 #include "consensus/consensus.h"
 #include "primitives/transaction.h"
+#include "script/sighashtype.h"
+#include "script/standard.h"
 #include "test/test_bitcoin.h"
 #include "util.h"
 #include "validation.h"
 
 #include <cstdint>
 #include <cstdio>
+#include <limits>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -76,4 +79,51 @@ BOOST_AUTO_TEST_CASE(validation_load_external_block_file) {
     BOOST_CHECK_NO_THROW({ LoadExternalBlockFile(config, fp, 0); });
 }
 
+BOOST_FIXTURE_TEST_CASE(connect_block_with_flushed_inputs,
+                        TestChain100Setup) {
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+
+    // Keep replay protection off so the spends below can use plain forkid
+    // signatures whatever the current time is.
+    gArgs.ForceSetArg("-replayprotectionactivationtime",
+                      std::to_string(std::numeric_limits<int64_t>::max()));
+
+    for (size_t i = 0; i < 3; i++) {
+        // The coins spent by the block are only in the coins database, so
+        // they are read by the prefetch threads when the block arrives.
+        FlushStateToDisk();
+        const COutPoint prevout(coinbaseTxns[i].GetId(), 0);
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(!pcoinsTip->HaveCoinInCache(prevout));
+        }
+
+        CMutableTransaction spend;
+        spend.nVersion = 1;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = prevout;
+        spend.vout.resize(1);
+        spend.vout[0].nValue = 11 * CENT;
+        spend.vout[0].scriptPubKey = scriptPubKey;
+        std::vector<uint8_t> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, CTransaction(spend), 0,
+                                     SigHashType().withForkId(),
+                                     coinbaseTxns[i].vout[0].nValue);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        spend.vin[0].scriptSig << vchSig;
+
+        std::vector<CMutableTransaction> txns = {spend};
+        CBlock block = CreateAndProcessBlock(txns, scriptPubKey);
+
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+        BOOST_CHECK(!pcoinsTip->HaveCoin(prevout));
+        BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(spend.GetId(), 0)));
+    }
+
+    gArgs.ClearArg("-replayprotectionactivationtime");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,203 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "trace.h"
+
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <cstdio>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include <boost/thread/tss.hpp>
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
+std::atomic<bool> fTracing(DEFAULT_TRACING);
+
+namespace {
+
+struct TraceSpanRecord {
+    const char *pszCategory;
+    std::string strName;
+    int64_t nStart;
+    int64_t nDuration;
+};
+
+/**
+ * Spans of a single thread. The mutex is only ever contended while the trace
+ * is dumped. Buffers outlive their thread, so that its spans can still be
+ * dumped.
+ */
+struct TraceBuffer {
+    std::mutex mutex;
+    std::deque<TraceSpanRecord> spans;
+    int nThreadId;
+    std::string strThreadName;
+    bool fExited = false;
+};
+
+struct TraceRegistry {
+    std::mutex mutex;
+    std::list<std::unique_ptr<TraceBuffer>> buffers;
+    int nNextThreadId = 1;
+};
+
+// Never destroyed, spans may be recorded while static objects are torn down.
+TraceRegistry &GetTraceRegistry() {
+    static TraceRegistry *registry = new TraceRegistry();
+    return *registry;
+}
+
+void ReleaseTraceBuffer(TraceBuffer *buffer) {
+    // The registry owns the buffer.
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    buffer->fExited = true;
+}
+
+boost::thread_specific_ptr<TraceBuffer> &GetTraceBufferPtr() {
+    static auto *ptr =
+        new boost::thread_specific_ptr<TraceBuffer>(ReleaseTraceBuffer);
+    return *ptr;
+}
+
+std::string GetThreadName() {
+#if defined(PR_GET_NAME)
+    char name[16] = {0};
+    if (::prctl(PR_GET_NAME, name, 0, 0, 0) == 0) {
+        return name;
+    }
+#endif
+    return "";
+}
+
+TraceBuffer &GetTraceBuffer() {
+    boost::thread_specific_ptr<TraceBuffer> &ptr = GetTraceBufferPtr();
+    if (!ptr.get()) {
+        std::unique_ptr<TraceBuffer> buffer(new TraceBuffer());
+        buffer->strThreadName = GetThreadName();
+        ptr.reset(buffer.get());
+
+        TraceRegistry &registry = GetTraceRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        buffer->nThreadId = registry.nNextThreadId++;
+        registry.buffers.push_back(std::move(buffer));
+    }
+    return *ptr;
+}
+
+std::string JSONEscape(const std::string &str) {
+    std::string strEscaped;
+    strEscaped.reserve(str.size());
+    for (unsigned char c : str) {
+        if (c == '"' || c == '\\') {
+            strEscaped += '\\';
+            strEscaped += c;
+        } else if (c < 0x20) {
+            strEscaped += strprintf("\\u%04x", c);
+        } else {
+            strEscaped += c;
+        }
+    }
+    return strEscaped;
+}
+
+} // namespace
+
+void RecordTraceSpan(const char *pszCategory, std::string &&strName,
+                     int64_t nStartMicros, int64_t nEndMicros) {
+    TraceBuffer &buffer = GetTraceBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.spans.size() >= MAX_TRACE_SPANS_PER_THREAD) {
+        buffer.spans.pop_front();
+    }
+    buffer.spans.push_back(TraceSpanRecord{pszCategory, std::move(strName),
+                                           nStartMicros,
+                                           nEndMicros - nStartMicros});
+}
+
+void TraceSpan::Start() {
+    nStart = GetTimeMicros();
+}
+
+void TraceSpan::Finish() {
+    RecordTraceSpan(pszCategory,
+                    pszName ? std::string(pszName) : std::move(strName),
+                    nStart, GetTimeMicros());
+}
+
+bool DumpTrace(const fs::path &path, bool fClear, size_t &nSpans) {
+    FILE *file = fsbridge::fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    nSpans = 0;
+    bool fFirst = true;
+    auto writeEvent = [&file, &fFirst](const std::string &strEvent) {
+        fprintf(file, "%s\n%s", fFirst ? "" : ",", strEvent.c_str());
+        fFirst = false;
+    };
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    TraceRegistry &registry = GetTraceRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto it = registry.buffers.begin(); it != registry.buffers.end();) {
+        TraceBuffer &buffer = **it;
+        std::unique_lock<std::mutex> bufferLock(buffer.mutex);
+        if (!buffer.spans.empty()) {
+            writeEvent(strprintf("{\"name\":\"thread_name\",\"ph\":\"M\","
+                                 "\"pid\":1,\"tid\":%d,\"args\":{\"name\":"
+                                 "\"%s\"}}",
+                                 buffer.nThreadId,
+                                 JSONEscape(buffer.strThreadName)));
+        }
+        for (const TraceSpanRecord &span : buffer.spans) {
+            writeEvent(strprintf("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                                 "\"ts\":%d,\"dur\":%d,\"pid\":1,\"tid\":%d}",
+                                 JSONEscape(span.strName), span.pszCategory,
+                                 span.nStart, span.nDuration,
+                                 buffer.nThreadId));
+            nSpans++;
+        }
+
+        if (fClear) {
+            buffer.spans.clear();
+            if (buffer.fExited) {
+                bufferLock.unlock();
+                it = registry.buffers.erase(it);
+                continue;
+            }
+        }
+        ++it;
+    }
+    fprintf(file, "\n]}\n");
+
+    bool fOk = !ferror(file);
+    return fclose(file) == 0 && fOk;
+}
+
+void ClearTrace() {
+    TraceRegistry &registry = GetTraceRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto it = registry.buffers.begin(); it != registry.buffers.end();) {
+        std::unique_lock<std::mutex> bufferLock((*it)->mutex);
+        (*it)->spans.clear();
+        if ((*it)->fExited) {
+            bufferLock.unlock();
+            it = registry.buffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
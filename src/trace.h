@@ -0,0 +1,99 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TRACE_H
+#define BITCOIN_TRACE_H
+
+#include "fs.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * Tracing of the time spent in hot paths, such as block validation, message
+ * processing or RPC calls. While enabled, every thread records the spans it
+ * goes through in a buffer of its own. The spans of all threads can be dumped
+ * in the Chrome trace event format, to be loaded in chrome://tracing or
+ * Perfetto. When disabled, a span costs one relaxed atomic load.
+ */
+static const bool DEFAULT_TRACING = false;
+//! Spans kept per thread, older spans are discarded first.
+static const size_t MAX_TRACE_SPANS_PER_THREAD = 1 << 16;
+
+extern std::atomic<bool> fTracing;
+
+static inline bool TraceEnabled() {
+    return fTracing.load(std::memory_order_relaxed);
+}
+
+/**
+ * Record a span from nStartMicros to nEndMicros, as returned by
+ * GetTimeMicros. This allows existing timings to be traced.
+ */
+void RecordTraceSpan(const char *pszCategory, std::string &&strName,
+                     int64_t nStartMicros, int64_t nEndMicros);
+
+static inline void TraceStage(const char *pszCategory, const char *pszName,
+                              int64_t nStartMicros, int64_t nEndMicros) {
+    if (TraceEnabled()) {
+        RecordTraceSpan(pszCategory, pszName, nStartMicros, nEndMicros);
+    }
+}
+
+/** Span covering the lifetime of the object. */
+class TraceSpan {
+private:
+    const char *pszCategory;
+    const char *pszName;
+    std::string strName;
+    int64_t nStart = 0;
+
+    void Start();
+    void Finish();
+
+public:
+    TraceSpan(const char *pszCategoryIn, const char *pszNameIn)
+        : pszCategory(pszCategoryIn), pszName(pszNameIn) {
+        if (TraceEnabled()) {
+            Start();
+        }
+    }
+
+    /** For names only known at runtime, only copied while tracing. */
+    TraceSpan(const char *pszCategoryIn, const std::string &strNameIn)
+        : pszCategory(pszCategoryIn), pszName(nullptr) {
+        if (TraceEnabled()) {
+            strName = strNameIn;
+            Start();
+        }
+    }
+
+    ~TraceSpan() {
+        // Spans started before tracing was disabled are still recorded.
+        if (nStart) {
+            Finish();
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+};
+
+#define TRACE_PASTE(x, y) x##y
+#define TRACE_PASTE2(x, y) TRACE_PASTE(x, y)
+#define TRACE_SPAN(category, name)                                             \
+    TraceSpan TRACE_PASTE2(tracespan, __COUNTER__)(category, name)
+
+/**
+ * Write the recorded spans of all threads to a file in the Chrome trace event
+ * format, and optionally discard them. Return false if the file cannot be
+ * written.
+ */
+bool DumpTrace(const fs::path &path, bool fClear, size_t &nSpans);
+
+/** Discard all recorded spans. */
+void ClearTrace();
+
+#endif // BITCOIN_TRACE_H
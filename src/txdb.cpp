@@ -21,7 +21,8 @@
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
-static const char DB_TXINDEX = 't';
+// 't' is left over from the txindex, which now lives in indexes/txindex/.
+static const char DB_SPENTINDEX = 'p';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -66,6 +67,17 @@ bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
     return db.Exists(CoinEntry(&outpoint));
 }
 
+size_t CCoinsViewDB::GetCoins(const std::vector<COutPoint> &vOutPoints,
+                              std::vector<Coin> &vCoins,
+                              std::vector<bool> &found) const {
+    std::vector<CoinEntry> vEntries;
+    vEntries.reserve(vOutPoints.size());
+    for (const COutPoint &outpoint : vOutPoints) {
+        vEntries.emplace_back(&outpoint);
+    }
+    return db.MultiRead(vEntries, vCoins, found);
+}
+
 uint256 CCoinsViewDB::GetBestBlock() const {
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain)) return uint256();
@@ -248,17 +260,22 @@ bool CBlockTreeDB::WriteBatchSync(
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+bool CBlockTreeDB::ReadSpentIndex(const COutPoint &outpoint,
+                                  CSpentIndexValue &value) {
+    return Read(std::make_pair(DB_SPENTINDEX, outpoint), value);
 }
 
-bool CBlockTreeDB::WriteTxIndex(
-    const std::vector<std::pair<uint256, CDiskTxPos>> &vect) {
+bool CBlockTreeDB::UpdateSpentIndex(
+    const std::vector<std::pair<COutPoint, CSpentIndexValue>> &vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256, CDiskTxPos>>::const_iterator it =
-             vect.begin();
-         it != vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    for (const auto &entry : vect) {
+        if (entry.second.IsNull()) {
+            batch.Erase(std::make_pair(DB_SPENTINDEX, entry.first));
+        } else {
+            batch.Write(std::make_pair(DB_SPENTINDEX, entry.first),
+                        entry.second);
+        }
+    }
     return WriteBatch(batch);
 }
 
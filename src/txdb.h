@@ -30,13 +30,18 @@ static const int64_t nDefaultDbBatchSize = 16 << 20;
 static const int64_t nMaxDbCache = sizeof(void *) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
-//! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache, if no -spentindex
+//! (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
-// Unlike for the UTXO database, for the txindex scenario the leveldb cache make
+//! Max memory allocated to block tree DB specific cache, if -spentindex (MiB)
+// Unlike for the UTXO database, for the index scenario the leveldb cache make
 // a meaningful difference:
 // https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
-static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+static const int64_t nMaxBlockDBAndSpentIndexCache = 1024;
+//! Max memory allocated to tx index DB specific cache (MiB)
+static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to block filter index DB specific cache (MiB)
+static const int64_t nMaxFilterIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -62,6 +67,38 @@ struct CDiskTxPos : public CDiskBlockPos {
     }
 };
 
+/**
+ * Spent index entry: the transaction input that spent a given outpoint, and the
+ * height of the block containing it. A null entry is used to request erasure.
+ */
+struct CSpentIndexValue {
+    TxId txid;
+    uint32_t nInput;
+    int32_t nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(VARINT(nInput));
+        READWRITE(VARINT(nHeight));
+    }
+
+    CSpentIndexValue(const TxId &txidIn, uint32_t nInputIn, int32_t nHeightIn)
+        : txid(txidIn), nInput(nInputIn), nHeight(nHeightIn) {}
+
+    CSpentIndexValue() { SetNull(); }
+
+    void SetNull() {
+        txid = TxId();
+        nInput = 0;
+        nHeight = -1;
+    }
+
+    bool IsNull() const { return txid.IsNull(); }
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView {
 protected:
@@ -72,6 +109,13 @@ public:
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
+    //! Look up several coins at once, in key order. vCoins[i] and found[i]
+    //! are set for vOutPoints[i]. Returns the number of coins found.
+    size_t GetCoins(const std::vector<COutPoint> &vOutPoints,
+                    std::vector<Coin> &vCoins,
+                    std::vector<bool> &found) const override;
+    //! LevelDB reads are safe from several threads.
+    bool SupportsConcurrentReads() const override { return true; }
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
@@ -121,8 +165,10 @@ public:
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
-    bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>> &list);
+    bool ReadSpentIndex(const COutPoint &outpoint, CSpentIndexValue &value);
+    //! Write the given entries, erasing those whose value is null.
+    bool UpdateSpentIndex(
+        const std::vector<std::pair<COutPoint, CSpentIndexValue>> &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(
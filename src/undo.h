@@ -15,6 +15,7 @@
 class CBlock;
 class CBlockIndex;
 class CCoinsViewCache;
+class CDataStream;
 class CValidationState;
 
 /**
@@ -141,4 +142,14 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
                                 const CBlock &block, const CBlockIndex *pindex,
                                 CCoinsViewCache &coins);
 
+/**
+ * Undo a block from its serialized undo data, as stored in the rev files. The
+ * spent coins are deserialized and restored into the view one at a time, so
+ * the CBlockUndo is never materialized.
+ * See DisconnectBlock for more details.
+ */
+DisconnectResult ApplyBlockUndo(CDataStream &blockUndo, const CBlock &block,
+                                const CBlockIndex *pindex,
+                                CCoinsViewCache &coins);
+
 #endif // BITCOIN_UNDO_H
@@ -17,7 +17,9 @@
 #include "consensus/validation.h"
 #include "fs.h"
 #include "hash.h"
+#include "index/txindex.h"
 #include "init.h"
+#include "metrics.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "pow.h"
@@ -30,6 +32,7 @@
 #include "script/standard.h"
 #include "timedata.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -45,6 +48,7 @@
 
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/math/distributions/poisson.hpp>
 #include <boost/range/adaptor/reversed.hpp>
@@ -65,9 +69,10 @@ CBlockIndex *pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nPrefetchThreads = 0;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
-bool fTxIndex = false;
+bool fSpentIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -1079,6 +1084,7 @@ static bool AcceptToMemoryPoolWithTime(const Config &config, CTxMemPool &pool,
                                        int64_t nAcceptTime,
                                        bool fOverrideMempoolLimit = false,
                                        const Amount nAbsurdFee = Amount(0)) {
+    TRACE_SPAN("mempool", "AcceptToMemoryPool");
     std::vector<COutPoint> coins_to_uncache;
     bool res = AcceptToMemoryPoolWorker(
         config, pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime,
@@ -1114,6 +1120,12 @@ bool GetTransaction(const Config &config, const TxId &txid,
                     bool fAllowSlow) {
     CBlockIndex *pindexSlow = nullptr;
 
+    // Let the index catch up with the blocks connected so far. While its
+    // initial sync is still running, lookups fall back to the slow path.
+    if (g_txindex) {
+        g_txindex->BlockUntilSyncedToCurrentChain();
+    }
+
     LOCK(cs_main);
 
     CTransactionRef ptx = mempool.get(txid);
@@ -1122,9 +1134,9 @@ bool GetTransaction(const Config &config, const TxId &txid,
         return true;
     }
 
-    if (fTxIndex) {
+    if (g_txindex) {
         CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(txid, postx)) {
+        if (g_txindex->FindTx(txid, postx)) {
             CAutoFile file(OpenBlockFile(postx, true), SER_DISK,
                            CLIENT_VERSION);
             if (file.IsNull()) {
@@ -1174,6 +1186,16 @@ bool GetTransaction(const Config &config, const TxId &txid,
     return false;
 }
 
+bool GetSpentInfo(const COutPoint &outpoint, CSpentIndexValue &value) {
+    LOCK(cs_main);
+
+    if (!fSpentIndex) {
+        return false;
+    }
+
+    return pblocktree->ReadSpentIndex(outpoint, value);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CBlock and CBlockIndex
@@ -1566,8 +1588,10 @@ bool CheckInputs(const CTransaction &tx, CValidationState &state,
     // scriptPubKey in the inputs view of that transaction).
     uint256 hashCacheEntry = GetScriptCacheKey(tx, flags);
     if (IsKeyInScriptCache(hashCacheEntry, !scriptCacheStore)) {
+        GetMetrics().nScriptCacheHits++;
         return true;
     }
+    GetMetrics().nScriptCacheMisses++;
 
     for (size_t i = 0; i < tx.vin.size(); i++) {
         const COutPoint &prevout = tx.vin[i].prevout;
@@ -1667,6 +1691,8 @@ bool UndoWriteToDisk(const CBlockUndo &blockundo, CDiskBlockPos &pos,
     return true;
 }
 
+} // namespace
+
 bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos,
                       const uint256 &hashBlock) {
     // Open history file to read
@@ -1695,6 +1721,48 @@ bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos,
     return true;
 }
 
+/**
+ * Read the serialized undo data of a block into undo, and verify its checksum,
+ * without deserializing it.
+ */
+static bool UndoReadRawFromDisk(CDataStream &undo, const CDiskBlockPos &pos,
+                                const uint256 &hashBlock) {
+    // The size of the undo data is written just before it.
+    CDiskBlockPos posSize(pos.nFile, pos.nPos - sizeof(uint32_t));
+    CAutoFile filein(OpenUndoFile(posSize, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return error("%s: OpenUndoFile failed", __func__);
+    }
+
+    uint256 hashChecksum;
+    try {
+        uint32_t nSize;
+        filein >> nSize;
+        if (nSize > MAX_SIZE) {
+            return error("%s: Undo data too large (%u bytes)", __func__,
+                         nSize);
+        }
+        undo.clear();
+        undo.resize(nSize);
+        filein.read(undo.data(), nSize);
+        filein >> hashChecksum;
+    } catch (const std::exception &e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
+
+    // The checksum covers the serialized data, so it can be checked as is.
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher.write(undo.data(), undo.size());
+    if (hashChecksum != hasher.GetHash()) {
+        return error("%s: Checksum mismatch", __func__);
+    }
+
+    return true;
+}
+
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string &strMessage,
                const std::string &userMessage = "") {
@@ -1754,6 +1822,30 @@ DisconnectResult UndoCoinSpend(const Coin &undo, CCoinsViewCache &view,
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
+/**
+ * Record (fConnect) or erase (!fConnect) the spent index entries for all the
+ * inputs of a block at the given height.
+ */
+static bool UpdateSpentIndex(const CBlock &block, int nHeight, bool fConnect) {
+    std::vector<std::pair<COutPoint, CSpentIndexValue>> vSpentIndex;
+    for (const auto &ptx : block.vtx) {
+        const CTransaction &tx = *ptx;
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            CSpentIndexValue value;
+            if (fConnect) {
+                value = CSpentIndexValue(tx.GetId(), j, nHeight);
+            }
+            vSpentIndex.emplace_back(tx.vin[j].prevout, value);
+        }
+    }
+
+    return pblocktree->UpdateSpentIndex(vSpentIndex);
+}
+
 /**
  * Undo the effects of this block (with given index) on the UTXO set represented
  * by coins. When FAILED is returned, view is left in an indeterminate state.
@@ -1761,14 +1853,15 @@ DisconnectResult UndoCoinSpend(const Coin &undo, CCoinsViewCache &view,
 static DisconnectResult DisconnectBlock(const CBlock &block,
                                         const CBlockIndex *pindex,
                                         CCoinsViewCache &view) {
-    CBlockUndo blockUndo;
+    TRACE_SPAN("validation", "DisconnectBlock");
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         error("DisconnectBlock(): no undo data available");
         return DISCONNECT_FAILED;
     }
 
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash())) {
+    CDataStream blockUndo(SER_DISK, CLIENT_VERSION);
+    if (!UndoReadRawFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash())) {
         error("DisconnectBlock(): failure reading undo data");
         return DISCONNECT_FAILED;
     }
@@ -1776,6 +1869,40 @@ static DisconnectResult DisconnectBlock(const CBlock &block,
     return ApplyBlockUndo(blockUndo, block, pindex, view);
 }
 
+/**
+ * Second step of undoing a block, once the spent coins have been restored:
+ * remove the outputs it created and move the best block back.
+ */
+static DisconnectResult RevertBlockOutputs(const CBlock &block,
+                                           CCoinsViewCache &view,
+                                           bool fClean) {
+    for (const auto &ptx : block.vtx) {
+        const CTransaction &tx = *ptx;
+        uint256 txid = tx.GetId();
+
+        // Check that all outputs are available and match the outputs in the
+        // block itself exactly.
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (tx.vout[o].scriptPubKey.IsUnspendable()) {
+                continue;
+            }
+
+            COutPoint out(txid, o);
+            Coin coin;
+            bool is_spent = view.SpendCoin(out, &coin);
+            if (!is_spent || tx.vout[o] != coin.GetTxOut()) {
+                // transaction output mismatch
+                fClean = false;
+            }
+        }
+    }
+
+    // Move best block pointer to previous block.
+    view.SetBestBlock(block.hashPrevBlock);
+
+    return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
+}
+
 DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
                                 const CBlock &block, const CBlockIndex *pindex,
                                 CCoinsViewCache &view) {
@@ -1806,32 +1933,54 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
         }
     }
 
-    // Second, revert created outputs.
-    for (const auto &ptx : block.vtx) {
-        const CTransaction &tx = *ptx;
-        uint256 txid = tx.GetId();
+    return RevertBlockOutputs(block, view, fClean);
+}
 
-        // Check that all outputs are available and match the outputs in the
-        // block itself exactly.
-        for (size_t o = 0; o < tx.vout.size(); o++) {
-            if (tx.vout[o].scriptPubKey.IsUnspendable()) {
-                continue;
+DisconnectResult ApplyBlockUndo(CDataStream &blockUndo, const CBlock &block,
+                                const CBlockIndex *pindex,
+                                CCoinsViewCache &view) {
+    bool fClean = true;
+
+    // This mirrors the serialization of CBlockUndo and CTxUndo, restoring
+    // each coin as soon as it is read.
+    try {
+        if (ReadCompactSize(blockUndo) + 1 != block.vtx.size()) {
+            error("DisconnectBlock(): block and undo data inconsistent");
+            return DISCONNECT_FAILED;
+        }
+
+        // First, restore inputs.
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction &tx = *(block.vtx[i]);
+            if (ReadCompactSize(blockUndo) != tx.vin.size()) {
+                error("DisconnectBlock(): transaction and undo data "
+                      "inconsistent");
+                return DISCONNECT_FAILED;
             }
 
-            COutPoint out(txid, o);
-            Coin coin;
-            bool is_spent = view.SpendCoin(out, &coin);
-            if (!is_spent || tx.vout[o] != coin.GetTxOut()) {
-                // transaction output mismatch
-                fClean = false;
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                const COutPoint &out = tx.vin[j].prevout;
+                Coin undo;
+                blockUndo >> REF(TxInUndoDeserializer(&undo));
+                DisconnectResult res = UndoCoinSpend(undo, view, out);
+                if (res == DISCONNECT_FAILED) {
+                    return DISCONNECT_FAILED;
+                }
+                fClean = fClean && res != DISCONNECT_UNCLEAN;
             }
         }
+    } catch (const std::exception &e) {
+        error("DisconnectBlock(): deserialize error in undo data - %s",
+              e.what());
+        return DISCONNECT_FAILED;
     }
 
-    // Move best block pointer to previous block.
-    view.SetBestBlock(block.hashPrevBlock);
+    if (!blockUndo.empty()) {
+        error("DisconnectBlock(): block and undo data inconsistent");
+        return DISCONNECT_FAILED;
+    }
 
-    return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
+    return RevertBlockOutputs(block, view, fClean);
 }
 
 static void FlushBlockFile(bool fFinalize = false) {
@@ -1868,6 +2017,396 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Batched lookups of the inputs of a block in the backing view of the coins
+ * tip, on behalf of CInputPrefetcher.
+ */
+struct CInputPrefetchJob {
+    const Config *config = nullptr;
+    const CCoinsView *base = nullptr;
+    //! Flush count of the coins tip when the job was created.
+    uint64_t nEpoch = 0;
+    uint256 hashBlock;
+    //! Where to read the block from, when its inputs are not known yet.
+    CDiskBlockPos pos;
+    //! Sorted ranges of inputs, each read with a single GetCoins.
+    std::vector<std::vector<COutPoint>> vRanges;
+    std::vector<std::vector<Coin>> vCoins;
+    std::vector<std::vector<bool>> vFound;
+    //! Tasks not finished yet: reading the block, then reading each range.
+    size_t nPending = 0;
+};
+
+/**
+ * Load the coins spent by blocks into the coins tip ahead of their
+ * connection, on the -prefetchthreads threads.
+ *
+ * A block is scheduled when it arrives on top of the tip, or when the block
+ * before it starts being connected, so that its inputs are read while the
+ * previous block's scripts are checked. The inputs are sorted and split in
+ * one range per thread, each read from the coins database in key order by a
+ * single batched GetCoins.
+ *
+ * The reads are made without cs_main, so they are only used if the coins
+ * database was not written to since the job was created: every change made
+ * to the coins since then is then in the coins tip cache, which is never
+ * overwritten by a prefetched coin.
+ */
+class CInputPrefetcher {
+private:
+    typedef std::pair<std::shared_ptr<CInputPrefetchJob>, size_t> Task;
+    //! Task index standing for reading the block of a job from disk.
+    static const size_t READ_BLOCK = std::numeric_limits<size_t>::max();
+    //! Jobs kept ahead of the connection of their block.
+    static const size_t MAX_SCHEDULED_BLOCKS = 4;
+
+    boost::mutex mutex;
+    boost::condition_variable condTask;
+    boost::condition_variable condDone;
+    std::deque<Task> queue;
+    //! Jobs waiting for their block to be connected, oldest first.
+    std::vector<std::shared_ptr<CInputPrefetchJob>> vJobs;
+    //! Incremented, under cs_main, whenever the coins database is written.
+    uint64_t nEpoch = 0;
+    //! Tasks being run by the prefetch threads.
+    size_t nRunning = 0;
+
+    static void SplitRanges(CInputPrefetchJob &job,
+                            std::vector<COutPoint> &&vOutPoints,
+                            size_t nRanges) {
+        std::sort(vOutPoints.begin(), vOutPoints.end());
+        nRanges = std::max<size_t>(1, std::min(nRanges, vOutPoints.size()));
+        job.vRanges.resize(nRanges);
+        job.vCoins.resize(nRanges);
+        job.vFound.resize(nRanges);
+        for (size_t i = 0; i < nRanges; i++) {
+            job.vRanges[i].assign(
+                vOutPoints.begin() + i * vOutPoints.size() / nRanges,
+                vOutPoints.begin() + (i + 1) * vOutPoints.size() / nRanges);
+        }
+    }
+
+    /** Run a task of a job, without the lock. */
+    static void RunTask(CInputPrefetchJob &job, size_t nTask) {
+        if (nTask != READ_BLOCK) {
+            job.base->GetCoins(job.vRanges[nTask], job.vCoins[nTask],
+                               job.vFound[nTask]);
+            return;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, job.pos, *job.config) ||
+            block.GetHash() != job.hashBlock) {
+            return;
+        }
+        size_t nHits;
+        SplitRanges(job, GetPrefetchOutPoints(block, nullptr, nHits),
+                    nPrefetchThreads);
+    }
+
+    /** Account for a finished task, queueing the reads it led to. */
+    void FinishTask(const Task &task) {
+        CInputPrefetchJob &job = *task.first;
+        if (task.second == READ_BLOCK && !job.vRanges.empty()) {
+            for (size_t i = 0; i < job.vRanges.size(); i++) {
+                queue.emplace_back(task.first, i);
+            }
+            job.nPending += job.vRanges.size();
+            condTask.notify_all();
+        }
+        if (--job.nPending == 0) {
+            condDone.notify_all();
+        }
+    }
+
+    /** Wait for a job, running queued tasks meanwhile. */
+    void Wait(boost::unique_lock<boost::mutex> &lock,
+              const CInputPrefetchJob &job) {
+        // Tasks are never interrupted, so there is always one to run or to
+        // wait for, even once the prefetch threads are gone.
+        boost::this_thread::disable_interruption noInterrupt;
+        while (job.nPending) {
+            if (queue.empty()) {
+                condDone.wait(lock);
+                continue;
+            }
+            Task task = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            RunTask(*task.first, task.second);
+            lock.lock();
+            FinishTask(task);
+        }
+    }
+
+    /** Keep a job for its block, if there is room for it. */
+    bool Add(const std::shared_ptr<CInputPrefetchJob> &job) {
+        vJobs.erase(std::remove_if(vJobs.begin(), vJobs.end(),
+                                   [this](const std::shared_ptr<
+                                          CInputPrefetchJob> &other) {
+                                       return other->nEpoch != nEpoch;
+                                   }),
+                    vJobs.end());
+        for (const auto &other : vJobs) {
+            if (other->hashBlock == job->hashBlock) {
+                return false;
+            }
+        }
+        if (vJobs.size() >= MAX_SCHEDULED_BLOCKS) {
+            auto it = std::find_if(
+                vJobs.begin(), vJobs.end(),
+                [](const std::shared_ptr<CInputPrefetchJob> &other) {
+                    return other->nPending == 0;
+                });
+            if (it == vJobs.end()) {
+                return false;
+            }
+            vJobs.erase(it);
+        }
+        vJobs.push_back(job);
+        return true;
+    }
+
+    static size_t AddFetchedCoins(CInputPrefetchJob &job,
+                                  CCoinsViewCache &view) {
+        size_t nAdded = 0;
+        for (size_t i = 0; i < job.vRanges.size(); i++) {
+            for (size_t j = 0; j < job.vRanges[i].size(); j++) {
+                const COutPoint &outpoint = job.vRanges[i][j];
+                if (job.vFound[i][j] && !view.HaveCoinInCache(outpoint)) {
+                    view.AddFetchedCoin(outpoint,
+                                        std::move(job.vCoins[i][j]));
+                    nAdded++;
+                }
+            }
+        }
+        return nAdded;
+    }
+
+    //! Whether the backing view of the coins tip can be read by the threads.
+    static bool CanReadInBackground(const CCoinsViewCache &view) {
+        return nPrefetchThreads > 0 &&
+               view.GetBackend()->SupportsConcurrentReads();
+    }
+
+public:
+    /**
+     * The outpoints spent by block that it does not create, sorted. When
+     * pview is given, those cached in it are counted in nHits and left out.
+     */
+    static std::vector<COutPoint>
+    GetPrefetchOutPoints(const CBlock &block, const CCoinsViewCache *pview,
+                         size_t &nHits) {
+        std::set<TxId> setBlockTxIds;
+        for (const auto &ptx : block.vtx) {
+            setBlockTxIds.insert(ptx->GetId());
+        }
+
+        std::vector<COutPoint> vOutPoints;
+        nHits = 0;
+        for (const auto &ptx : block.vtx) {
+            if (ptx->IsCoinBase()) {
+                continue;
+            }
+            for (const CTxIn &txin : ptx->vin) {
+                if (setBlockTxIds.count(txin.prevout.GetTxId())) {
+                    continue;
+                }
+                if (pview && pview->HaveCoinInCache(txin.prevout)) {
+                    nHits++;
+                } else {
+                    vOutPoints.push_back(txin.prevout);
+                }
+            }
+        }
+        return vOutPoints;
+    }
+
+    void Thread() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (true) {
+            while (queue.empty()) {
+                condTask.wait(lock);
+            }
+            Task task = std::move(queue.front());
+            queue.pop_front();
+            nRunning++;
+            lock.unlock();
+            RunTask(*task.first, task.second);
+            lock.lock();
+            FinishTask(task);
+            if (--nRunning == 0) {
+                condDone.notify_all();
+            }
+        }
+    }
+
+    /** Start reading the inputs of a block received on top of the tip. */
+    void Schedule(const Config &config, const CBlock &block,
+                  const CCoinsViewCache &view) {
+        AssertLockHeld(cs_main);
+        if (!CanReadInBackground(view)) {
+            return;
+        }
+
+        auto job = std::make_shared<CInputPrefetchJob>();
+        job->config = &config;
+        job->base = view.GetBackend();
+        job->hashBlock = block.GetHash();
+        size_t nHits;
+        std::vector<COutPoint> vOutPoints =
+            GetPrefetchOutPoints(block, &view, nHits);
+        if (vOutPoints.empty()) {
+            return;
+        }
+        SplitRanges(*job, std::move(vOutPoints), nPrefetchThreads);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        job->nEpoch = nEpoch;
+        if (!Add(job)) {
+            return;
+        }
+        for (size_t i = 0; i < job->vRanges.size(); i++) {
+            queue.emplace_back(job, i);
+        }
+        job->nPending = job->vRanges.size();
+        condTask.notify_all();
+    }
+
+    /** Start reading a block from disk, then its inputs. */
+    void Schedule(const Config &config, const CBlockIndex *pindex,
+                  const CCoinsViewCache &view) {
+        AssertLockHeld(cs_main);
+        if (!CanReadInBackground(view) || !pindex->nStatus.hasData()) {
+            return;
+        }
+
+        auto job = std::make_shared<CInputPrefetchJob>();
+        job->config = &config;
+        job->base = view.GetBackend();
+        job->hashBlock = pindex->GetBlockHash();
+        job->pos = pindex->GetBlockPos();
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        job->nEpoch = nEpoch;
+        if (!Add(job)) {
+            return;
+        }
+        queue.emplace_back(job, READ_BLOCK);
+        job->nPending = 1;
+        condTask.notify_one();
+    }
+
+    /**
+     * Add the coins read for a block since it was scheduled to view, waiting
+     * for the reads still in progress. Returns the number of coins added.
+     */
+    size_t Apply(const uint256 &hashBlock, CCoinsViewCache &view) {
+        AssertLockHeld(cs_main);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        auto it = std::find_if(
+            vJobs.begin(), vJobs.end(),
+            [&hashBlock](const std::shared_ptr<CInputPrefetchJob> &job) {
+                return job->hashBlock == hashBlock;
+            });
+        if (it == vJobs.end()) {
+            return 0;
+        }
+        std::shared_ptr<CInputPrefetchJob> job = *it;
+        vJobs.erase(it);
+        if (job->nEpoch != nEpoch) {
+            return 0;
+        }
+        Wait(lock, *job);
+        return AddFetchedCoins(*job, view);
+    }
+
+    /**
+     * Read outpoints, sorted, from the backing view of view and add them to
+     * it, on the prefetch threads as well as this one when possible.
+     */
+    void Read(std::vector<COutPoint> &&vOutPoints, CCoinsViewCache &view) {
+        AssertLockHeld(cs_main);
+        CInputPrefetchJob job;
+        job.base = view.GetBackend();
+        if (!CanReadInBackground(view)) {
+            SplitRanges(job, std::move(vOutPoints), 1);
+            RunTask(job, 0);
+            AddFetchedCoins(job, view);
+            return;
+        }
+
+        auto pjob = std::make_shared<CInputPrefetchJob>(std::move(job));
+        SplitRanges(*pjob, std::move(vOutPoints), nPrefetchThreads);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (size_t i = 0; i < pjob->vRanges.size(); i++) {
+            queue.emplace_back(pjob, i);
+        }
+        pjob->nPending = pjob->vRanges.size();
+        condTask.notify_all();
+        Wait(lock, *pjob);
+        lock.unlock();
+        AddFetchedCoins(*pjob, view);
+    }
+
+    /** Discard the reads made so far, as the coins database changes. */
+    void Invalidate() {
+        AssertLockHeld(cs_main);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nEpoch++;
+        vJobs.clear();
+    }
+
+    /**
+     * Drop all jobs and wait for the reads in progress, before the coins
+     * views they read from are destroyed.
+     */
+    void Clear() {
+        AssertLockHeld(cs_main);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nEpoch++;
+        vJobs.clear();
+        queue.clear();
+        boost::this_thread::disable_interruption noInterrupt;
+        while (nRunning) {
+            condDone.wait(lock);
+        }
+    }
+};
+
+const size_t CInputPrefetcher::READ_BLOCK;
+const size_t CInputPrefetcher::MAX_SCHEDULED_BLOCKS;
+
+static CInputPrefetcher inputprefetcher;
+
+void ThreadInputPrefetch() {
+    RenameThread("bitcoin-prefetch");
+    inputprefetcher.Thread();
+}
+
+/**
+ * Load the coins spent by a block into view before the block is connected on
+ * top of it. The coins read in the background since the block was scheduled
+ * are added first. ConnectBlock needs all of them, so the other ones are read
+ * now rather than one at a time as ConnectBlock misses the cache.
+ *
+ * nHits is set to the number of inputs that were already cached, including
+ * nBackground read in the background, and nMisses to the number of inputs
+ * that had to be looked up.
+ */
+static void PrefetchInputs(const CBlock &block, CCoinsViewCache &view,
+                           size_t &nHits, size_t &nMisses,
+                           size_t &nBackground) {
+    AssertLockHeld(cs_main);
+    nBackground = inputprefetcher.Apply(block.GetHash(), view);
+    std::vector<COutPoint> vOutPoints =
+        CInputPrefetcher::GetPrefetchOutPoints(block, &view, nHits);
+    nMisses = vOutPoints.size();
+    if (!vOutPoints.empty()) {
+        inputprefetcher.Read(std::move(vOutPoints), view);
+    }
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1948,6 +2487,7 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
                          CValidationState &state, CBlockIndex *pindex,
                          CCoinsViewCache &view, bool fJustCheck = false) {
     AssertLockHeld(cs_main);
+    TRACE_SPAN("validation", "ConnectBlock");
 
     int64_t nTimeStart = GetTimeMicros();
 
@@ -2015,6 +2555,7 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
     nTimeCheck += nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs]\n",
              0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
+    TraceStage("validation", "Sanity checks", nTimeStart, nTime1);
 
     // Do not allow blocks that contain transactions which 'overwrite' older
     // transactions, unless those are already completely spent. If such
@@ -2086,6 +2627,7 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
     nTimeForks += nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs]\n",
              0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
+    TraceStage("validation", "Fork checks", nTime1, nTime2);
 
     CBlockUndo blockundo;
 
@@ -2102,10 +2644,6 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
         ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
     const uint64_t nMaxSigOpsCount = GetMaxBlockSigOpsCount(currentBlockSize);
 
-    CDiskTxPos pos(pindex->GetBlockPos(),
-                   GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
-    vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
 
     for (const auto &ptx : block.vtx) {
@@ -2113,9 +2651,6 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
 
         nInputs += tx.vin.size();
 
-        vPos.push_back(std::make_pair(tx.GetId(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
-
         if (tx.IsCoinBase()) {
             // We've already checked for sigops count before P2SH in CheckBlock.
             nSigOpsCount += GetSigOpCountWithoutP2SH(tx);
@@ -2200,6 +2735,7 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
              0.001 * (nTime3 - nTime2) / block.vtx.size(),
              nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs - 1),
              nTimeConnect * 0.000001);
+    TraceStage("validation", "Connect transactions", nTime2, nTime3);
 
     Amount blockReward =
         nFees + GetBlockSubsidy(pindex->nHeight, consensusParams);
@@ -2222,6 +2758,7 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
              nInputs - 1, 0.001 * (nTime4 - nTime2),
              nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs - 1),
              nTimeVerify * 0.000001);
+    TraceStage("validation", "Wait for script checks", nTime3, nTime4);
 
     if (fJustCheck) {
         return true;
@@ -2252,8 +2789,8 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex && !pblocktree->WriteTxIndex(vPos)) {
-        return AbortNode(state, "Failed to write transaction index");
+    if (fSpentIndex && !UpdateSpentIndex(block, pindex->nHeight, true)) {
+        return AbortNode(state, "Failed to write spent index");
     }
 
     // add this block to the view's block chain
@@ -2263,6 +2800,7 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
     nTimeIndex += nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs]\n",
              0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
+    TraceStage("validation", "Index writing", nTime4, nTime5);
 
     int64_t nTime6 = GetTimeMicros();
     nTimeCallbacks += nTime6 - nTime5;
@@ -2289,6 +2827,7 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
 static bool FlushStateToDisk(const CChainParams &chainparams,
                              CValidationState &state, FlushStateMode mode,
                              int nManualPruneHeight) {
+    TRACE_SPAN("validation", "FlushStateToDisk");
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
@@ -2414,6 +2953,7 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
 
                 // Flush the chainstate (which may refer to block index
                 // entries).
+                inputprefetcher.Invalidate();
                 if (!pcoinsTip->Flush()) {
                     return AbortNode(state, "Failed to write to coin database");
                 }
@@ -2429,6 +2969,8 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
             GetMainSignals().SetBestChain(chainActive.GetLocator());
             nLastSetChain = nNow;
         }
+
+        GetMetrics().nCoinsCacheBytes = pcoinsTip->DynamicMemoryUsage();
     } catch (const std::runtime_error &e) {
         return AbortNode(
             state, std::string("System error while flushing: ") + e.what());
@@ -2458,6 +3000,7 @@ static void UpdateTip(const Config &config, CBlockIndex *pindexNew) {
         config.GetChainParams().GetConsensus();
 
     chainActive.SetTip(pindexNew);
+    GetMetrics().nBlockHeight = pindexNew->nHeight;
 
     // New best block
     mempool.AddTransactionsUpdated(1);
@@ -2530,6 +3073,7 @@ static void UpdateTip(const Config &config, CBlockIndex *pindexNew) {
  */
 static bool DisconnectTip(const Config &config, CValidationState &state,
                           DisconnectedBlockTransactions *disconnectpool) {
+    TRACE_SPAN("validation", "DisconnectTip");
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
 
@@ -2554,6 +3098,11 @@ static bool DisconnectTip(const Config &config, CValidationState &state,
         assert(flushed);
     }
 
+    if (fSpentIndex &&
+        !UpdateSpentIndex(block, pindexDelete->nHeight, false)) {
+        return AbortNode(state, "Failed to write spent index");
+    }
+
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n",
              (GetTimeMicros() - nStart) * 0.001);
 
@@ -2604,6 +3153,9 @@ static bool DisconnectTip(const Config &config, CValidationState &state,
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
+static uint64_t nPrefetchHits = 0;
+static uint64_t nPrefetchMisses = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2695,6 +3247,7 @@ static bool ConnectTip(const Config &config, CValidationState &state,
                        ConnectTrace &connectTrace,
                        DisconnectedBlockTransactions &disconnectpool) {
     assert(pindexNew->pprev == chainActive.Tip());
+    TRACE_SPAN("validation", "ConnectTip");
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
@@ -2716,6 +3269,25 @@ static bool ConnectTip(const Config &config, CValidationState &state,
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n",
              (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    TraceStage("validation", "Load block from disk", nTime1, nTime2);
+
+    // Warm the coins cache with the inputs of the block.
+    size_t nHits, nMisses, nBackground;
+    PrefetchInputs(blockConnecting, *pcoinsTip, nHits, nMisses, nBackground);
+    int64_t nTimePrefetched = GetTimeMicros();
+    nTimePrefetch += nTimePrefetched - nTime2;
+    nPrefetchHits += nHits;
+    nPrefetchMisses += nMisses;
+    LogPrint(BCLog::BENCH,
+             "  - Prefetch inputs: %.2fms [%.2fs] (%u hits, %u of them read "
+             "in the background, %u misses, %.2f%% hit rate [%.2f%%])\n",
+             (nTimePrefetched - nTime2) * 0.001, nTimePrefetch * 0.000001,
+             nHits, nBackground, nMisses,
+             nHits + nMisses ? 100.0 * nHits / (nHits + nMisses) : 100.0,
+             nPrefetchHits + nPrefetchMisses
+                 ? 100.0 * nPrefetchHits / (nPrefetchHits + nPrefetchMisses)
+                 : 100.0);
+    TraceStage("validation", "Prefetch inputs", nTime2, nTimePrefetched);
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(config, blockConnecting, state, pindexNew, view);
@@ -2742,6 +3314,7 @@ static bool ConnectTip(const Config &config, CValidationState &state,
     nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs]\n",
              (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    TraceStage("validation", "Flush view", nTime3, nTime4);
 
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(config.GetChainParams(), state,
@@ -2765,8 +3338,10 @@ static bool ConnectTip(const Config &config, CValidationState &state,
     nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs]\n",
              (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
+    TraceStage("validation", "Connect postprocess", nTime5, nTime6);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs]\n",
              (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    GetMetrics().blockConnectTime.Observe(nTime6 - nTime1);
 
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
@@ -2874,6 +3449,7 @@ static bool ActivateBestChainStep(const Config &config, CValidationState &state,
                                   bool &fInvalidFound,
                                   ConnectTrace &connectTrace) {
     AssertLockHeld(cs_main);
+    TRACE_SPAN("validation", "ActivateBestChainStep");
     const CBlockIndex *pindexOldTip = chainActive.Tip();
     const CBlockIndex *pindexFork = chainActive.FindFork(pindexMostWork);
 
@@ -2909,9 +3485,13 @@ static bool ActivateBestChainStep(const Config &config, CValidationState &state,
 
         nHeight = nTargetHeight;
 
-        // Connect new blocks.
-        for (CBlockIndex *pindexConnect :
-             boost::adaptors::reverse(vpindexToConnect)) {
+        // Connect new blocks, reading the inputs of the next one meanwhile.
+        for (auto it = vpindexToConnect.rbegin(); it != vpindexToConnect.rend();
+             ++it) {
+            CBlockIndex *pindexConnect = *it;
+            if (std::next(it) != vpindexToConnect.rend()) {
+                inputprefetcher.Schedule(config, *std::next(it), *pcoinsTip);
+            }
             if (!ConnectTip(config, state, pindexConnect,
                             pindexConnect == pindexMostWork
                                 ? pblock
@@ -4016,6 +4596,11 @@ bool ProcessNewBlock(const Config &config,
                               nullptr, fNewBlock);
         }
 
+        // Start reading the inputs of a block which extends the tip.
+        if (ret && pindex->pprev == chainActive.Tip()) {
+            inputprefetcher.Schedule(config, *pblock, *pcoinsTip);
+        }
+
         CheckBlockIndex(chainparams.GetConsensus());
         if (!ret) {
             GetMainSignals().BlockChecked(*pblock, state);
@@ -4442,10 +5027,10 @@ static bool LoadBlockIndexDB(const Config &config) {
     pblocktree->ReadReindexing(fReindexing);
     fReindex |= fReindexing;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__,
-              fTxIndex ? "enabled" : "disabled");
+    // Check whether we have a spent index
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("%s: spent index %s\n", __func__,
+              fSpentIndex ? "enabled" : "disabled");
 
     return true;
 }
@@ -4667,6 +5252,11 @@ static bool RollforwardBlock(const CBlockIndex *pindex, CCoinsViewCache &view,
         }
     }
 
+    if (fSpentIndex && !UpdateSpentIndex(block, pindex->nHeight, true)) {
+        return error("ReplayBlock(): failed to write spent index at %d",
+                     pindex->nHeight);
+    }
+
     return true;
 }
 
@@ -4735,6 +5325,14 @@ bool ReplayBlocks(const Config &config, CCoinsView *view) {
                     pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
             }
 
+            if (fSpentIndex &&
+                !UpdateSpentIndex(block, pindexOld->nHeight, false)) {
+                return error("RollbackBlock(): failed to write spent index at "
+                             "%d, hash=%s",
+                             pindexOld->nHeight,
+                             pindexOld->GetBlockHash().ToString());
+            }
+
             // If DISCONNECT_UNCLEAN is returned, it means a non-existing UTXO
             // was deleted, or an existing UTXO was overwritten. It corresponds
             // to cases where the block-to-be-disconnect never had all its
@@ -4822,6 +5420,7 @@ bool RewindBlockIndex(const Config &config) {
 // logic assumes a consistent block index state
 void UnloadBlockIndex() {
     LOCK(cs_main);
+    inputprefetcher.Clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(nullptr);
     pindexBestInvalid = nullptr;
@@ -4860,9 +5459,9 @@ bool InitBlockIndex(const Config &config) {
         return true;
     }
 
-    // Use the provided setting for -txindex in the new database
-    fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-    pblocktree->WriteFlag("txindex", fTxIndex);
+    // Use the provided setting for -spentindex in the new database
+    fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the
@@ -33,6 +33,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CBloomFilter;
 class CChainParams;
 class CConnman;
@@ -44,6 +45,7 @@ class CTxUndo;
 class CValidationInterface;
 class CValidationState;
 struct ChainTxData;
+struct CSpentIndexValue;
 
 struct PrecomputedTransactionData;
 struct LockPoints;
@@ -93,6 +95,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of input prefetch threads allowed */
+static const int MAX_PREFETCH_THREADS = 16;
+/** -prefetchthreads default (number of threads reading block inputs ahead) */
+static const int DEFAULT_PREFETCH_THREADS = 4;
 /** Number of blocks that can be requested at any given time from a single peer.
  */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
@@ -171,6 +177,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -persistmempool */
@@ -203,7 +211,8 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
+extern int nPrefetchThreads;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -373,6 +382,11 @@ void UnloadBlockIndex();
  */
 void ThreadScriptCheck();
 
+/**
+ * Run an instance of the input prefetch thread.
+ */
+void ThreadInputPrefetch();
+
 /**
  * Check whether we are doing an initial block download (synchronizing from disk
  * or network)
@@ -394,10 +408,18 @@ std::string GetWarnings(const std::string &strFor);
 
 /**
  * Retrieve a transaction (from memory pool, or from disk, if possible).
+ * Waits for the transaction index to catch up with the chain, so must not be
+ * called with cs_main held.
  */
 bool GetTransaction(const Config &config, const TxId &txid, CTransactionRef &tx,
                     uint256 &hashBlock, bool fAllowSlow = false);
 
+/**
+ * Retrieve the input which spent the given outpoint in the active chain.
+ * Requires -spentindex.
+ */
+bool GetSpentInfo(const COutPoint &outpoint, CSpentIndexValue &value);
+
 /**
  * Find the best known block, and make it the active tip of the block chain.
  * If it fails, the tip is not updated.
@@ -620,6 +642,9 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
                        const Config &config);
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
                        const Config &config);
+/** Read the undo data of a block, hashBlock being the hash of its parent. */
+bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos,
+                      const uint256 &hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -5,6 +5,8 @@
 
 #include "validationinterface.h"
 
+#include <boost/bind.hpp>
+
 static CMainSignals g_signals;
 
 CMainSignals &GetMainSignals() {
@@ -104,16 +104,6 @@ UniValue importprivkey(const Config &config, const JSONRPCRequest &request) {
             "\nAs a JSON-RPC call\n" +
             HelpExampleRpc("importprivkey", "\"mykey\", \"testing\", false"));
 
-    LOCK2(cs_main, pwallet->cs_wallet);
-
-    EnsureWalletIsUnlocked(pwallet);
-
-    std::string strSecret = request.params[0].get_str();
-    std::string strLabel = "";
-    if (request.params.size() > 1) {
-        strLabel = request.params[1].get_str();
-    }
-
     // Whether to perform rescan after import
     bool fRescan = true;
     if (request.params.size() > 2) {
@@ -125,46 +115,72 @@ UniValue importprivkey(const Config &config, const JSONRPCRequest &request) {
                            "Rescan is disabled in pruned mode");
     }
 
-    CBitcoinSecret vchSecret;
-    bool fGood = vchSecret.SetString(strSecret);
-
-    if (!fGood) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
-                           "Invalid private key encoding");
-    }
-
-    CKey key = vchSecret.GetKey();
-    if (!key.IsValid()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
-                           "Private key outside allowed range");
+    WalletRescanReserver reserver(pwallet);
+    if (fRescan && !reserver.reserve()) {
+        throw JSONRPCError(RPC_WALLET_ERROR,
+                           "Wallet is currently rescanning. Wait for the "
+                           "rescan to finish.");
     }
 
-    CPubKey pubkey = key.GetPubKey();
-    assert(key.VerifyPubKey(pubkey));
-    CKeyID vchAddress = pubkey.GetID();
+    // The chain is rescanned once the locks are released.
+    CBlockIndex *pindexRescan = nullptr;
     {
-        pwallet->MarkDirty();
-        pwallet->SetAddressBook(vchAddress, strLabel, "receive");
+        LOCK2(cs_main, pwallet->cs_wallet);
+
+        EnsureWalletIsUnlocked(pwallet);
 
-        // Don't throw error in case a key is already there
-        if (pwallet->HaveKey(vchAddress)) {
-            return NullUniValue;
+        std::string strSecret = request.params[0].get_str();
+        std::string strLabel = "";
+        if (request.params.size() > 1) {
+            strLabel = request.params[1].get_str();
         }
 
-        pwallet->mapKeyMetadata[vchAddress].nCreateTime = 1;
+        CBitcoinSecret vchSecret;
+        bool fGood = vchSecret.SetString(strSecret);
 
-        if (!pwallet->AddKeyPubKey(key, pubkey)) {
-            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
+        if (!fGood) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                               "Invalid private key encoding");
         }
 
-        // whenever a key is imported, we need to scan the whole chain
-        pwallet->UpdateTimeFirstKey(1);
+        CKey key = vchSecret.GetKey();
+        if (!key.IsValid()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                               "Private key outside allowed range");
+        }
 
-        if (fRescan) {
-            pwallet->ScanForWalletTransactions(chainActive.Genesis(), true);
+        CPubKey pubkey = key.GetPubKey();
+        assert(key.VerifyPubKey(pubkey));
+        CKeyID vchAddress = pubkey.GetID();
+        {
+            pwallet->MarkDirty();
+            pwallet->SetAddressBook(vchAddress, strLabel, "receive");
+
+            // Don't throw error in case a key is already there
+            if (pwallet->HaveKey(vchAddress)) {
+                return NullUniValue;
+            }
+
+            pwallet->mapKeyMetadata[vchAddress].nCreateTime = 1;
+
+            if (!pwallet->AddKeyPubKey(key, pubkey)) {
+                throw JSONRPCError(RPC_WALLET_ERROR,
+                                   "Error adding key to wallet");
+            }
+
+            // whenever a key is imported, we need to scan the whole chain
+            pwallet->UpdateTimeFirstKey(1);
+
+            if (fRescan) {
+                pindexRescan = chainActive.Genesis();
+            }
         }
     }
 
+    if (pindexRescan) {
+        pwallet->ScanForWalletTransactions(pindexRescan, reserver, true);
+    }
+
     return NullUniValue;
 }
 
@@ -263,34 +279,49 @@ UniValue importaddress(const Config &config, const JSONRPCRequest &request) {
                            "Rescan is disabled in pruned mode");
     }
 
+    WalletRescanReserver reserver(pwallet);
+    if (fRescan && !reserver.reserve()) {
+        throw JSONRPCError(RPC_WALLET_ERROR,
+                           "Wallet is currently rescanning. Wait for the "
+                           "rescan to finish.");
+    }
+
     // Whether to import a p2sh version, too
     bool fP2SH = false;
     if (request.params.size() > 3) {
         fP2SH = request.params[3].get_bool();
     }
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    // The chain is rescanned once the locks are released.
+    CBlockIndex *pindexRescan = nullptr;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
 
-    CTxDestination dest =
-        DecodeDestination(request.params[0].get_str(), config.GetChainParams());
-    if (IsValidDestination(dest)) {
-        if (fP2SH) {
+        CTxDestination dest = DecodeDestination(request.params[0].get_str(),
+                                                config.GetChainParams());
+        if (IsValidDestination(dest)) {
+            if (fP2SH) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                                   "Cannot use the p2sh flag with an address - "
+                                   "use a script instead");
+            }
+            ImportAddress(pwallet, dest, strLabel);
+        } else if (IsHex(request.params[0].get_str())) {
+            std::vector<uint8_t> data(ParseHex(request.params[0].get_str()));
+            ImportScript(pwallet, CScript(data.begin(), data.end()), strLabel,
+                         fP2SH);
+        } else {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
-                               "Cannot use the p2sh flag with an address - use "
-                               "a script instead");
+                               "Invalid Bitcoin address or script");
+        }
+
+        if (fRescan) {
+            pindexRescan = chainActive.Genesis();
         }
-        ImportAddress(pwallet, dest, strLabel);
-    } else if (IsHex(request.params[0].get_str())) {
-        std::vector<uint8_t> data(ParseHex(request.params[0].get_str()));
-        ImportScript(pwallet, CScript(data.begin(), data.end()), strLabel,
-                     fP2SH);
-    } else {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
-                           "Invalid Bitcoin address or script");
     }
 
-    if (fRescan) {
-        pwallet->ScanForWalletTransactions(chainActive.Genesis(), true);
+    if (pindexRescan) {
+        pwallet->ScanForWalletTransactions(pindexRescan, reserver, true);
         pwallet->ReacceptWalletTransactions();
     }
 
@@ -470,6 +501,13 @@ UniValue importpubkey(const Config &config, const JSONRPCRequest &request) {
                            "Rescan is disabled in pruned mode");
     }
 
+    WalletRescanReserver reserver(pwallet);
+    if (fRescan && !reserver.reserve()) {
+        throw JSONRPCError(RPC_WALLET_ERROR,
+                           "Wallet is currently rescanning. Wait for the "
+                           "rescan to finish.");
+    }
+
     if (!IsHex(request.params[0].get_str())) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
                            "Pubkey must be a hex string");
@@ -482,13 +520,21 @@ UniValue importpubkey(const Config &config, const JSONRPCRequest &request) {
                            "Pubkey is not a valid public key");
     }
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    // The chain is rescanned once the locks are released.
+    CBlockIndex *pindexRescan = nullptr;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
 
-    ImportAddress(pwallet, pubKey.GetID(), strLabel);
-    ImportScript(pwallet, GetScriptForRawPubKey(pubKey), strLabel, false);
+        ImportAddress(pwallet, pubKey.GetID(), strLabel);
+        ImportScript(pwallet, GetScriptForRawPubKey(pubKey), strLabel, false);
 
-    if (fRescan) {
-        pwallet->ScanForWalletTransactions(chainActive.Genesis(), true);
+        if (fRescan) {
+            pindexRescan = chainActive.Genesis();
+        }
+    }
+
+    if (pindexRescan) {
+        pwallet->ScanForWalletTransactions(pindexRescan, reserver, true);
         pwallet->ReacceptWalletTransactions();
     }
 
@@ -520,97 +566,109 @@ UniValue importwallet(const Config &config, const JSONRPCRequest &request) {
                            "Importing wallets is disabled in pruned mode");
     }
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    WalletRescanReserver reserver(pwallet);
+    if (!reserver.reserve()) {
+        throw JSONRPCError(RPC_WALLET_ERROR,
+                           "Wallet is currently rescanning. Wait for the "
+                           "rescan to finish.");
+    }
 
-    EnsureWalletIsUnlocked(pwallet);
+    // The chain is rescanned once the locks are released.
+    CBlockIndex *pindex;
+    bool fGood;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
 
-    std::ifstream file;
-    file.open(request.params[0].get_str().c_str(),
-              std::ios::in | std::ios::ate);
-    if (!file.is_open()) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER,
-                           "Cannot open wallet dump file");
-    }
+        EnsureWalletIsUnlocked(pwallet);
 
-    int64_t nTimeBegin = chainActive.Tip()->GetBlockTime();
+        std::ifstream file;
+        file.open(request.params[0].get_str().c_str(),
+                  std::ios::in | std::ios::ate);
+        if (!file.is_open()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Cannot open wallet dump file");
+        }
 
-    bool fGood = true;
+        int64_t nTimeBegin = chainActive.Tip()->GetBlockTime();
 
-    int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
-    file.seekg(0, file.beg);
+        fGood = true;
 
-    // show progress dialog in GUI
-    pwallet->ShowProgress(_("Importing..."), 0);
-    while (file.good()) {
-        pwallet->ShowProgress(
-            "", std::max(1, std::min(99, (int)(((double)file.tellg() /
-                                                (double)nFilesize) *
-                                               100))));
-        std::string line;
-        std::getline(file, line);
-        if (line.empty() || line[0] == '#') {
-            continue;
-        }
+        int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
+        file.seekg(0, file.beg);
 
-        std::vector<std::string> vstr;
-        boost::split(vstr, line, boost::is_any_of(" "));
-        if (vstr.size() < 2) {
-            continue;
-        }
-        CBitcoinSecret vchSecret;
-        if (!vchSecret.SetString(vstr[0])) {
-            continue;
-        }
-        CKey key = vchSecret.GetKey();
-        CPubKey pubkey = key.GetPubKey();
-        assert(key.VerifyPubKey(pubkey));
-        CKeyID keyid = pubkey.GetID();
-        if (pwallet->HaveKey(keyid)) {
-            LogPrintf("Skipping import of %s (key already present)\n",
-                      EncodeDestination(keyid));
-            continue;
-        }
-        int64_t nTime = DecodeDumpTime(vstr[1]);
-        std::string strLabel;
-        bool fLabel = true;
-        for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
-            if (boost::algorithm::starts_with(vstr[nStr], "#")) {
-                break;
+        // show progress dialog in GUI
+        pwallet->ShowProgress(_("Importing..."), 0);
+        while (file.good()) {
+            pwallet->ShowProgress(
+                "", std::max(1, std::min(99, (int)(((double)file.tellg() /
+                                                    (double)nFilesize) *
+                                                   100))));
+            std::string line;
+            std::getline(file, line);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            std::vector<std::string> vstr;
+            boost::split(vstr, line, boost::is_any_of(" "));
+            if (vstr.size() < 2) {
+                continue;
             }
-            if (vstr[nStr] == "change=1") {
-                fLabel = false;
+            CBitcoinSecret vchSecret;
+            if (!vchSecret.SetString(vstr[0])) {
+                continue;
             }
-            if (vstr[nStr] == "reserve=1") {
-                fLabel = false;
+            CKey key = vchSecret.GetKey();
+            CPubKey pubkey = key.GetPubKey();
+            assert(key.VerifyPubKey(pubkey));
+            CKeyID keyid = pubkey.GetID();
+            if (pwallet->HaveKey(keyid)) {
+                LogPrintf("Skipping import of %s (key already present)\n",
+                          EncodeDestination(keyid));
+                continue;
             }
-            if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
-                strLabel = DecodeDumpString(vstr[nStr].substr(6));
-                fLabel = true;
+            int64_t nTime = DecodeDumpTime(vstr[1]);
+            std::string strLabel;
+            bool fLabel = true;
+            for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
+                if (boost::algorithm::starts_with(vstr[nStr], "#")) {
+                    break;
+                }
+                if (vstr[nStr] == "change=1") {
+                    fLabel = false;
+                }
+                if (vstr[nStr] == "reserve=1") {
+                    fLabel = false;
+                }
+                if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
+                    strLabel = DecodeDumpString(vstr[nStr].substr(6));
+                    fLabel = true;
+                }
             }
+            LogPrintf("Importing %s...\n", EncodeDestination(keyid));
+            if (!pwallet->AddKeyPubKey(key, pubkey)) {
+                fGood = false;
+                continue;
+            }
+            pwallet->mapKeyMetadata[keyid].nCreateTime = nTime;
+            if (fLabel) {
+                pwallet->SetAddressBook(keyid, strLabel, "receive");
+            }
+            nTimeBegin = std::min(nTimeBegin, nTime);
         }
-        LogPrintf("Importing %s...\n", EncodeDestination(keyid));
-        if (!pwallet->AddKeyPubKey(key, pubkey)) {
-            fGood = false;
-            continue;
-        }
-        pwallet->mapKeyMetadata[keyid].nCreateTime = nTime;
-        if (fLabel) {
-            pwallet->SetAddressBook(keyid, strLabel, "receive");
-        }
-        nTimeBegin = std::min(nTimeBegin, nTime);
-    }
-    file.close();
+        file.close();
+
+        // hide progress dialog in GUI
+        pwallet->ShowProgress("", 100);
+        pwallet->UpdateTimeFirstKey(nTimeBegin);
 
-    // hide progress dialog in GUI
-    pwallet->ShowProgress("", 100);
-    pwallet->UpdateTimeFirstKey(nTimeBegin);
+        pindex = chainActive.FindEarliestAtLeast(nTimeBegin - TIMESTAMP_WINDOW);
 
-    CBlockIndex *pindex =
-        chainActive.FindEarliestAtLeast(nTimeBegin - TIMESTAMP_WINDOW);
+        LogPrintf("Rescanning last %i blocks\n",
+                  chainActive.Height() - pindex->nHeight + 1);
+    }
 
-    LogPrintf("Rescanning last %i blocks\n",
-              chainActive.Height() - pindex->nHeight + 1);
-    pwallet->ScanForWalletTransactions(pindex);
+    pwallet->ScanForWalletTransactions(pindex, reserver);
     pwallet->MarkDirty();
 
     if (!fGood) {
@@ -798,7 +856,65 @@ UniValue dumpwallet(const Config &config, const JSONRPCRequest &request) {
     return reply;
 }
 
-UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
+/**
+ * The wallet calls of ProcessImport, which record the in-memory state they
+ * change in batch so that it can be restored if the import is not committed.
+ */
+static bool ImportWatchOnly(CWallet *const pwallet, CWalletDB &walletdb,
+                            CWallet::ImportBatch &batch, const CScript &script,
+                            const int64_t timestamp) {
+    if (!pwallet->HaveWatchOnly(script)) {
+        batch.vWatchOnly.push_back(script);
+    }
+    return pwallet->AddWatchOnlyWithDB(walletdb, script, timestamp);
+}
+
+static bool ImportRedeemScript(CWallet *const pwallet, CWalletDB &walletdb,
+                               CWallet::ImportBatch &batch,
+                               const CScript &redeemScript) {
+    if (!pwallet->HaveCScript(redeemScript)) {
+        batch.vScripts.push_back(redeemScript);
+    }
+    return pwallet->AddCScriptWithDB(walletdb, redeemScript);
+}
+
+static bool ImportKey(CWallet *const pwallet, CWalletDB &walletdb,
+                      CWallet::ImportBatch &batch, const CKey &key,
+                      const CPubKey &pubkey) {
+    // The key replaces the watch-only entries of its scripts, which stay
+    // removed if they were added by this import.
+    for (const CScript &script : {GetScriptForDestination(pubkey.GetID()),
+                                  GetScriptForRawPubKey(pubkey)}) {
+        if (!pwallet->HaveWatchOnly(script)) {
+            continue;
+        }
+        std::vector<CScript>::iterator it = std::find(
+            batch.vWatchOnly.begin(), batch.vWatchOnly.end(), script);
+        if (it != batch.vWatchOnly.end()) {
+            batch.vWatchOnly.erase(it);
+        } else {
+            batch.vWatchOnlyRemoved.push_back(script);
+        }
+    }
+    batch.vKeys.push_back(pubkey);
+    return pwallet->AddImportedKeyWithDB(walletdb, key, pubkey);
+}
+
+static void ImportAddressBook(CWallet *const pwallet, CWalletDB &walletdb,
+                              CWallet::ImportBatch &batch,
+                              const CTxDestination &dest,
+                              const std::string &label) {
+    std::map<CTxDestination, CAddressBookData>::const_iterator it =
+        pwallet->mapAddressBook.find(dest);
+    batch.vAddressBook.emplace_back(
+        dest, it == pwallet->mapAddressBook.end()
+                  ? nullptr
+                  : std::make_shared<CAddressBookData>(it->second));
+    pwallet->SetAddressBookWithDB(walletdb, dest, label, "receive");
+}
+
+UniValue ProcessImport(CWallet *const pwallet, CWalletDB &walletdb,
+                       CWallet::ImportBatch &batch, const UniValue &data,
                        const int64_t timestamp) {
     try {
         bool success = false;
@@ -903,13 +1019,14 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
 
             pwallet->MarkDirty();
 
-            if (!pwallet->AddWatchOnly(redeemScript, timestamp)) {
+            if (!ImportWatchOnly(pwallet, walletdb, batch, redeemScript,
+                                 timestamp)) {
                 throw JSONRPCError(RPC_WALLET_ERROR,
                                    "Error adding address to wallet");
             }
 
             if (!pwallet->HaveCScript(redeemScript) &&
-                !pwallet->AddCScript(redeemScript)) {
+                !ImportRedeemScript(pwallet, walletdb, batch, redeemScript)) {
                 throw JSONRPCError(RPC_WALLET_ERROR,
                                    "Error adding p2sh redeemScript to wallet");
             }
@@ -925,14 +1042,15 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
 
             pwallet->MarkDirty();
 
-            if (!pwallet->AddWatchOnly(redeemDestination, timestamp)) {
+            if (!ImportWatchOnly(pwallet, walletdb, batch, redeemDestination,
+                                 timestamp)) {
                 throw JSONRPCError(RPC_WALLET_ERROR,
                                    "Error adding address to wallet");
             }
 
             // add to address book or update label
             if (IsValidDestination(dest)) {
-                pwallet->SetAddressBook(dest, label, "receive");
+                ImportAddressBook(pwallet, walletdb, batch, dest, label);
             }
 
             // Import private keys.
@@ -960,7 +1078,8 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
 
                     CKeyID vchAddress = pubkey.GetID();
                     pwallet->MarkDirty();
-                    pwallet->SetAddressBook(vchAddress, label, "receive");
+                    ImportAddressBook(pwallet, walletdb, batch, vchAddress,
+                                      label);
 
                     if (pwallet->HaveKey(vchAddress)) {
                         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
@@ -969,7 +1088,7 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
 
                     pwallet->mapKeyMetadata[vchAddress].nCreateTime = timestamp;
 
-                    if (!pwallet->AddKeyPubKey(key, pubkey)) {
+                    if (!ImportKey(pwallet, walletdb, batch, key, pubkey)) {
                         throw JSONRPCError(RPC_WALLET_ERROR,
                                            "Error adding key to wallet");
                     }
@@ -1028,14 +1147,16 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
 
                 pwallet->MarkDirty();
 
-                if (!pwallet->AddWatchOnly(pubKeyScript, timestamp)) {
+                if (!ImportWatchOnly(pwallet, walletdb, batch, pubKeyScript,
+                                     timestamp)) {
                     throw JSONRPCError(RPC_WALLET_ERROR,
                                        "Error adding address to wallet");
                 }
 
                 // add to address book or update label
                 if (IsValidDestination(pubkey_dest)) {
-                    pwallet->SetAddressBook(pubkey_dest, label, "receive");
+                    ImportAddressBook(pwallet, walletdb, batch, pubkey_dest,
+                                      label);
                 }
 
                 // TODO Is this necessary?
@@ -1050,7 +1171,8 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
 
                 pwallet->MarkDirty();
 
-                if (!pwallet->AddWatchOnly(scriptRawPubKey, timestamp)) {
+                if (!ImportWatchOnly(pwallet, walletdb, batch,
+                                     scriptRawPubKey, timestamp)) {
                     throw JSONRPCError(RPC_WALLET_ERROR,
                                        "Error adding address to wallet");
                 }
@@ -1102,7 +1224,7 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
 
                 CKeyID vchAddress = pubKey.GetID();
                 pwallet->MarkDirty();
-                pwallet->SetAddressBook(vchAddress, label, "receive");
+                ImportAddressBook(pwallet, walletdb, batch, vchAddress, label);
 
                 if (pwallet->HaveKey(vchAddress)) {
                     throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already "
@@ -1113,7 +1235,7 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
 
                 pwallet->mapKeyMetadata[vchAddress].nCreateTime = timestamp;
 
-                if (!pwallet->AddKeyPubKey(key, pubKey)) {
+                if (!ImportKey(pwallet, walletdb, batch, key, pubKey)) {
                     throw JSONRPCError(RPC_WALLET_ERROR,
                                        "Error adding key to wallet");
                 }
@@ -1134,7 +1256,8 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
 
                 pwallet->MarkDirty();
 
-                if (!pwallet->AddWatchOnly(script, timestamp)) {
+                if (!ImportWatchOnly(pwallet, walletdb, batch, script,
+                                     timestamp)) {
                     throw JSONRPCError(RPC_WALLET_ERROR,
                                        "Error adding address to wallet");
                 }
@@ -1142,7 +1265,8 @@ UniValue ProcessImport(CWallet *const pwallet, const UniValue &data,
                 if (scriptPubKey.getType() == UniValue::VOBJ) {
                     // add to address book or update label
                     if (IsValidDestination(dest)) {
-                        pwallet->SetAddressBook(dest, label, "receive");
+                        ImportAddressBook(pwallet, walletdb, batch, dest,
+                                          label);
                     }
                 }
 
@@ -1245,60 +1369,91 @@ UniValue importmulti(const Config &config, const JSONRPCRequest &mainRequest) {
         }
     }
 
-    LOCK2(cs_main, pwallet->cs_wallet);
-    EnsureWalletIsUnlocked(pwallet);
-
-    // Verify all timestamps are present before importing any keys.
-    const int64_t now =
-        chainActive.Tip() ? chainActive.Tip()->GetMedianTimePast() : 0;
-    for (const UniValue &data : requests.getValues()) {
-        GetImportTimestamp(data, now);
-    }
-
-    bool fRunScan = false;
-    const int64_t minimumTimestamp = 1;
-    int64_t nLowestTimestamp = 0;
-
-    if (fRescan && chainActive.Tip()) {
-        nLowestTimestamp = chainActive.Tip()->GetBlockTime();
-    } else {
-        fRescan = false;
+    WalletRescanReserver reserver(pwallet);
+    if (fRescan && !reserver.reserve()) {
+        throw JSONRPCError(RPC_WALLET_ERROR,
+                           "Wallet is currently rescanning. Wait for the "
+                           "rescan to finish.");
     }
 
+    // The chain is rescanned once the locks are released.
+    CBlockIndex *pindex = nullptr;
+    int64_t now;
     UniValue response(UniValue::VARR);
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        EnsureWalletIsUnlocked(pwallet);
+
+        // Verify all timestamps are present before importing any keys.
+        now = chainActive.Tip() ? chainActive.Tip()->GetMedianTimePast() : 0;
+        for (const UniValue &data : requests.getValues()) {
+            GetImportTimestamp(data, now);
+        }
 
-    for (const UniValue &data : requests.getValues()) {
-        const int64_t timestamp =
-            std::max(GetImportTimestamp(data, now), minimumTimestamp);
-        const UniValue result = ProcessImport(pwallet, data, timestamp);
-        response.push_back(result);
+        bool fRunScan = false;
+        const int64_t minimumTimestamp = 1;
+        int64_t nLowestTimestamp = 0;
 
-        if (!fRescan) {
-            continue;
+        if (fRescan && chainActive.Tip()) {
+            nLowestTimestamp = chainActive.Tip()->GetBlockTime();
+        } else {
+            fRescan = false;
         }
 
-        // If at least one request was successful then allow rescan.
-        if (result["success"].get_bool()) {
-            fRunScan = true;
+        // All the requests are written through one database handle, and
+        // each in one transaction, rather than opening and flushing the
+        // database for every record.
+        CWalletDB walletdb(pwallet->GetDBHandle());
+        for (const UniValue &data : requests.getValues()) {
+            const int64_t timestamp =
+                std::max(GetImportTimestamp(data, now), minimumTimestamp);
+            CWalletDBTxn txn(walletdb);
+            CWallet::ImportBatch batch;
+            UniValue result =
+                ProcessImport(pwallet, walletdb, batch, data, timestamp);
+            if (!result["success"].get_bool()) {
+                // Nothing of a failed request is kept, in the database nor in
+                // memory.
+                txn.Abort();
+                pwallet->UndoImportBatch(batch);
+            } else if (!txn.Commit()) {
+                pwallet->UndoImportBatch(batch);
+                result = UniValue(UniValue::VOBJ);
+                result.pushKV("success", UniValue(false));
+                result.pushKV("error",
+                              JSONRPCError(RPC_WALLET_ERROR,
+                                           "Error committing the imported "
+                                           "data to the wallet database"));
+            }
+            response.push_back(result);
+
+            if (!fRescan) {
+                continue;
+            }
+
+            // If at least one request was successful then allow rescan.
+            if (result["success"].get_bool()) {
+                fRunScan = true;
+            }
+
+            // Get the lowest timestamp.
+            if (timestamp < nLowestTimestamp) {
+                nLowestTimestamp = timestamp;
+            }
         }
 
-        // Get the lowest timestamp.
-        if (timestamp < nLowestTimestamp) {
-            nLowestTimestamp = timestamp;
+        if (fRescan && fRunScan && requests.size()) {
+            pindex = nLowestTimestamp > minimumTimestamp
+                         ? chainActive.FindEarliestAtLeast(std::max<int64_t>(
+                               nLowestTimestamp - TIMESTAMP_WINDOW, 0))
+                         : chainActive.Genesis();
         }
     }
 
-    if (fRescan && fRunScan && requests.size()) {
-        CBlockIndex *pindex =
-            nLowestTimestamp > minimumTimestamp
-                ? chainActive.FindEarliestAtLeast(
-                      std::max<int64_t>(nLowestTimestamp - TIMESTAMP_WINDOW, 0))
-                : chainActive.Genesis();
-        CBlockIndex *scannedRange = nullptr;
-        if (pindex) {
-            scannedRange = pwallet->ScanForWalletTransactions(pindex, true);
-            pwallet->ReacceptWalletTransactions();
-        }
+    if (pindex) {
+        CBlockIndex *scannedRange =
+            pwallet->ScanForWalletTransactions(pindex, reserver, true);
+        pwallet->ReacceptWalletTransactions();
 
         if (!scannedRange || scannedRange->nHeight > pindex->nHeight) {
             std::vector<UniValue> results = response.getValues();
@@ -28,6 +28,9 @@
 
 #include <event2/http.h>
 
+#include <cstdint>
+#include <limits>
+
 static const std::string WALLET_ENDPOINT_BASE = "/wallet/";
 
 static std::string urlDecode(const std::string &urlEncoded) {
@@ -1711,6 +1714,22 @@ void AcentryToJSON(const CAccountingEntry &acentry,
     }
 }
 
+/**
+ * A listtransactions cursor: the order position of the last entry of a page,
+ * and the number of entries listed at that position up to and including it.
+ */
+static std::string EncodeListCursor(int64_t nOrderPos, uint32_t nEntries) {
+    return strprintf("%d:%u", nOrderPos, nEntries);
+}
+
+static bool DecodeListCursor(const std::string &strCursor, int64_t &nOrderPos,
+                             uint32_t &nEntries) {
+    size_t nSep = strCursor.find(':');
+    return nSep != std::string::npos &&
+           ParseInt64(strCursor.substr(0, nSep), &nOrderPos) &&
+           ParseUInt32(strCursor.substr(nSep + 1), &nEntries);
+}
+
 static UniValue listtransactions(const Config &config,
                                  const JSONRPCRequest &request) {
     CWallet *const pwallet = GetWalletForJSONRPCRequest(request);
@@ -1718,9 +1737,10 @@ static UniValue listtransactions(const Config &config,
         return NullUniValue;
     }
 
-    if (request.fHelp || request.params.size() > 4) {
+    if (request.fHelp || request.params.size() > 5) {
         throw std::runtime_error(
-            "listtransactions ( \"account\" count skip include_watchonly)\n"
+            "listtransactions ( \"account\" count skip include_watchonly "
+            "\"cursor\" )\n"
             "\nReturns up to 'count' most recent transactions skipping the "
             "first 'from' transactions for account 'account'.\n"
             "\nArguments:\n"
@@ -1732,6 +1752,14 @@ static UniValue listtransactions(const Config &config,
             "transactions to skip\n"
             "4. include_watchonly (bool, optional, default=false) Include "
             "transactions to watch-only addresses (see 'importaddress')\n"
+            "5. \"cursor\"     (string, optional) Page through the "
+            "transactions from the most recent one: \"\" for the first page, "
+            "then the cursor returned with the previous page. Unlike 'skip', "
+            "the cost of a page does not grow with the number of "
+            "transactions before it. 'count' must be positive. When given, "
+            "the result is an object\n"
+            "                 with the transactions and the cursor of the next "
+            "page.\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -1808,12 +1836,23 @@ static UniValue listtransactions(const Config &config,
             "transactions.\n"
             "  }\n"
             "]\n"
+            "\nResult (with a cursor):\n"
+            "{\n"
+            "  \"transactions\": [ ... ], (array) As above\n"
+            "  \"cursor\": \"cursor\"     (string) The cursor of the next "
+            "page. Missing when the oldest transaction was reached\n"
+            "}\n"
 
             "\nExamples:\n"
             "\nList the most recent 10 transactions in the systems\n" +
             HelpExampleCli("listtransactions", "") +
             "\nList transactions 100 to 120\n" +
             HelpExampleCli("listtransactions", "\"*\" 20 100") +
+            "\nList the most recent 1000 transactions, then the next 1000 "
+            "with the cursor returned\n" +
+            HelpExampleCli("listtransactions", "\"*\" 1000 0 false \"\"") +
+            HelpExampleCli("listtransactions",
+                           "\"*\" 1000 0 false \"cursor\"") +
             "\nAs a json rpc call\n" +
             HelpExampleRpc("listtransactions", "\"*\", 20, 100"));
     }
@@ -1840,33 +1879,81 @@ static UniValue listtransactions(const Config &config,
         filter = filter | ISMINE_WATCH_ONLY;
     }
 
+    // The entries at or after the cursor were listed by previous pages.
+    bool fCursor = false;
+    std::string strCursor;
+    int64_t nCursorPos = std::numeric_limits<int64_t>::max();
+    uint32_t nCursorEntries = 0;
+    if (request.params.size() > 4 && !request.params[4].isNull()) {
+        fCursor = true;
+        strCursor = request.params[4].get_str();
+        if (!strCursor.empty() &&
+            !DecodeListCursor(strCursor, nCursorPos, nCursorEntries)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+    }
+
     if (nCount < 0) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
     }
     if (nFrom < 0) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
     }
+    // An empty page has no last entry to resume after.
+    if (fCursor && nCount == 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Count must be positive with a cursor");
+    }
     UniValue ret(UniValue::VARR);
+    // The order position of each entry of ret, and the number of entries at
+    // that position up to and including it.
+    std::vector<std::pair<int64_t, uint32_t>> vEntryPos;
+    bool fFull = false;
 
     const CWallet::TxItems &txOrdered = pwallet->wtxOrdered;
 
     // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin();
+    int64_t nPos = nCursorPos;
+    uint32_t nEntriesAtPos = 0;
+    for (CWallet::TxItems::const_reverse_iterator it(
+             txOrdered.upper_bound(nCursorPos));
          it != txOrdered.rend(); ++it) {
+        UniValue entries(UniValue::VARR);
         CWalletTx *const pwtx = (*it).second.first;
         if (pwtx != 0) {
-            ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter);
+            ListTransactions(pwallet, *pwtx, strAccount, 0, true, entries,
+                             filter);
         }
         CAccountingEntry *const pacentry = (*it).second.second;
         if (pacentry != 0) {
-            AcentryToJSON(*pacentry, strAccount, ret);
+            AcentryToJSON(*pacentry, strAccount, entries);
+        }
+
+        if ((*it).first != nPos) {
+            nPos = (*it).first;
+            nEntriesAtPos = 0;
+        }
+        for (const UniValue &entry : entries.getValues()) {
+            if (++nEntriesAtPos <= nCursorEntries && nPos == nCursorPos) {
+                continue;
+            }
+            ret.push_back(entry);
+            vEntryPos.push_back(std::make_pair(nPos, nEntriesAtPos));
         }
 
         if ((int)ret.size() >= (nCount + nFrom)) {
+            fFull = true;
             break;
         }
     }
 
+    // The next page starts after the last entry of this one.
+    if (fFull && fCursor) {
+        const std::pair<int64_t, uint32_t> &last =
+            vEntryPos[nFrom + nCount - 1];
+        strCursor = EncodeListCursor(last.first, last.second);
+    }
+
     // ret is newest to oldest
 
     if (nFrom > (int)ret.size()) {
@@ -1897,7 +1984,16 @@ static UniValue listtransactions(const Config &config,
     ret.setArray();
     ret.push_backV(arrTmp);
 
-    return ret;
+    if (!fCursor) {
+        return ret;
+    }
+
+    UniValue page(UniValue::VOBJ);
+    page.push_back(Pair("transactions", ret));
+    if (fFull) {
+        page.push_back(Pair("cursor", strCursor));
+    }
+    return page;
 }
 
 static UniValue listaccounts(const Config &config,
@@ -2124,11 +2220,10 @@ static UniValue listsinceblock(const Config &config,
 
     UniValue transactions(UniValue::VARR);
 
-    for (const std::pair<uint256, CWalletTx> &pairWtx : pwallet->mapWallet) {
-        CWalletTx tx = pairWtx.second;
-
-        if (depth == -1 || tx.GetDepthInMainChain() < depth) {
-            ListTransactions(pwallet, tx, "*", 0, true, transactions, filter);
+    for (const CWalletTx *pwtx : pwallet->GetTransactionsSince(pindex)) {
+        if (depth == -1 || pwtx->GetDepthInMainChain() < depth) {
+            ListTransactions(pwallet, *pwtx, "*", 0, true, transactions,
+                             filter);
         }
     }
 
@@ -2933,13 +3028,14 @@ static UniValue getwalletinfo(const Config &config,
     UniValue obj(UniValue::VOBJ);
 
     size_t kpExternalSize = pwallet->KeypoolCountExternalKeys();
+    const CWalletBalances balances = pwallet->GetBalances();
     obj.push_back(Pair("walletname", pwallet->GetName()));
     obj.push_back(Pair("walletversion", pwallet->GetVersion()));
-    obj.push_back(Pair("balance", ValueFromAmount(pwallet->GetBalance())));
+    obj.push_back(Pair("balance", ValueFromAmount(balances.nTrusted)));
     obj.push_back(Pair("unconfirmed_balance",
-                       ValueFromAmount(pwallet->GetUnconfirmedBalance())));
-    obj.push_back(Pair("immature_balance",
-                       ValueFromAmount(pwallet->GetImmatureBalance())));
+                       ValueFromAmount(balances.nUntrustedPending)));
+    obj.push_back(
+        Pair("immature_balance", ValueFromAmount(balances.nImmature)));
     obj.push_back(Pair("txcount", (int)pwallet->mapWallet.size()));
     obj.push_back(Pair("keypoololdest", pwallet->GetOldestKeyPoolTime()));
     obj.push_back(Pair("keypoolsize", (int64_t)kpExternalSize));
@@ -3501,7 +3597,7 @@ static const ContextFreeRPCCommand commands[] = {
     { "wallet",             "listreceivedbyaccount",    listreceivedbyaccount,    false,  {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listreceivedbyaddress",    listreceivedbyaddress,    false,  {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listsinceblock",           listsinceblock,           false,  {"blockhash","target_confirmations","include_watchonly"} },
-    { "wallet",             "listtransactions",         listtransactions,         false,  {"account","count","skip","include_watchonly"} },
+    { "wallet",             "listtransactions",         listtransactions,         false,  {"account","count","skip","include_watchonly","cursor"} },
     { "wallet",             "listunspent",              listunspent,              false,  {"minconf","maxconf","addresses","include_unsafe"} },
     { "wallet",             "listwallets",              listwallets,              true,   {} },
     { "wallet",             "lockunspent",              lockunspent,              true,   {"unlock","transactions"} },
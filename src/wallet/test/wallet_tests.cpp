@@ -6,7 +6,9 @@
 
 #include "chainparams.h"
 #include "config.h"
+#include "consensus/validation.h"
 #include "rpc/server.h"
+#include "script/standard.h"
 #include "test/test_bitcoin.h"
 #include "validation.h"
 #include "wallet/rpcdump.h"
@@ -448,6 +450,82 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset) {
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_bnb) {
+    CoinSet setCoinsRet;
+    Amount nValueRet;
+
+    const CWallet wallet(Params());
+    LOCK(walletCriticalSection);
+
+    empty_wallet();
+    add_coin(wallet, 5 * CENT);
+    add_coin(wallet, 3 * CENT + Amount(200));
+    add_coin(wallet, 20 * CENT);
+
+    // Without an exact match, the bigger coin is taken to avoid small
+    // change...
+    BOOST_CHECK(wallet.SelectCoinsMinConf(8 * CENT, 1, 6, 0, vCoins,
+                                          setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 20 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    // ... unless some excess is allowed, in which case no change is needed.
+    BOOST_CHECK(wallet.SelectCoinsMinConf(8 * CENT, 1, 6, 0, vCoins,
+                                          setCoinsRet, nValueRet, Amount(200)));
+    BOOST_CHECK_EQUAL(nValueRet, 8 * CENT + Amount(200));
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    BOOST_CHECK(wallet.SelectCoinsMinConf(8 * CENT, 1, 6, 0, vCoins,
+                                          setCoinsRet, nValueRet, Amount(199)));
+    BOOST_CHECK_EQUAL(nValueRet, 20 * CENT);
+
+    // The subset with the least excess is taken, with the larger coins first.
+    add_coin(wallet, 3 * CENT + Amount(100));
+    add_coin(wallet, 4 * CENT);
+    add_coin(wallet, 4 * CENT);
+    BOOST_CHECK(wallet.SelectCoinsMinConf(8 * CENT, 1, 6, 0, vCoins,
+                                          setCoinsRet, nValueRet, Amount(500)));
+    BOOST_CHECK_EQUAL(nValueRet, 8 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    BOOST_CHECK(wallet.SelectCoinsMinConf(8 * CENT + Amount(50), 1, 6, 0,
+                                          vCoins, setCoinsRet, nValueRet,
+                                          Amount(500)));
+    BOOST_CHECK_EQUAL(nValueRet, 8 * CENT + Amount(100));
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // Of two subsets with the same excess, the one with fewer coins is taken.
+    add_coin(wallet, 8 * CENT + Amount(100));
+    BOOST_CHECK(wallet.SelectCoinsMinConf(8 * CENT + Amount(50), 1, 6, 0,
+                                          vCoins, setCoinsRet, nValueRet,
+                                          Amount(500)));
+    BOOST_CHECK_EQUAL(nValueRet, 8 * CENT + Amount(100));
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    // The fee each coin costs to spend counts along with the excess.
+    BOOST_CHECK(wallet.SelectCoinsMinConf(8 * CENT, 1, 6, 0, vCoins,
+                                          setCoinsRet, nValueRet, Amount(500),
+                                          Amount(0)));
+    BOOST_CHECK_EQUAL(nValueRet, 8 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    BOOST_CHECK(wallet.SelectCoinsMinConf(8 * CENT, 1, 6, 0, vCoins,
+                                          setCoinsRet, nValueRet, Amount(500),
+                                          Amount(200)));
+    BOOST_CHECK_EQUAL(nValueRet, 8 * CENT + Amount(100));
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    // Coins of the same value are only tried once, so large sets of them are
+    // searched quickly, here finding no subset needing no change.
+    empty_wallet();
+    for (int i = 0; i < 20000; i++) {
+        add_coin(wallet, 2 * CENT);
+    }
+    add_coin(wallet, 1 * CENT - Amount(1));
+    BOOST_CHECK(wallet.SelectCoinsMinConf(5 * CENT, 1, 6, 0, vCoins,
+                                          setCoinsRet, nValueRet, Amount(500)));
+    BOOST_CHECK(nValueRet >= 5 * CENT + MIN_CHANGE);
+
+    empty_wallet();
+}
+
 BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup) {
     LOCK(cs_main);
 
@@ -463,7 +541,10 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup) {
         CWallet wallet(Params());
         LOCK(wallet.cs_wallet);
         wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
-        BOOST_CHECK_EQUAL(oldTip, wallet.ScanForWalletTransactions(oldTip));
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        BOOST_CHECK_EQUAL(oldTip,
+                          wallet.ScanForWalletTransactions(oldTip, reserver));
         BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 100 * COIN);
     }
 
@@ -477,7 +558,10 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup) {
         CWallet wallet(Params());
         LOCK(wallet.cs_wallet);
         wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
-        BOOST_CHECK_EQUAL(newTip, wallet.ScanForWalletTransactions(oldTip));
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        BOOST_CHECK_EQUAL(newTip,
+                          wallet.ScanForWalletTransactions(oldTip, reserver));
         BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 50 * COIN);
     }
 
@@ -527,7 +611,10 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup) {
             LOCK(wallet.cs_wallet);
             wallet.UpdateTimeFirstKey(newTip->GetBlockTime() + 7200 + 1);
         }
-        BOOST_CHECK_EQUAL(newTip, wallet.ScanForWalletTransactions(newTip));
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        BOOST_CHECK_EQUAL(newTip,
+                          wallet.ScanForWalletTransactions(newTip, reserver));
     }
 }
 
@@ -623,6 +710,349 @@ BOOST_FIXTURE_TEST_CASE(coin_mark_dirty_immature_credit, TestChain100Setup) {
     BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(), 50 * COIN);
 }
 
+static size_t CountAvailableCoins(const CWallet &wallet) {
+    std::vector<COutput> vAvailable;
+    wallet.AvailableCoins(vAvailable, false);
+    return vAvailable.size();
+}
+
+// Check that AvailableCoins follows the wallet's own unspent outputs as
+// transactions and keys are added, and transactions are abandoned.
+BOOST_FIXTURE_TEST_CASE(available_coins_utxo_index, TestChain100Setup) {
+    // Make the first coinbase mature.
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+
+    CWallet wallet(Params());
+    LOCK2(cs_main, wallet.cs_wallet);
+
+    // A transaction added before its key is known only shows up once the key
+    // is imported.
+    CWalletTx wtxCoinbase(&wallet, MakeTransactionRef(coinbaseTxns.front()));
+    wtxCoinbase.SetMerkleBranch(chainActive[1], 0);
+    BOOST_CHECK(wallet.AddToWallet(wtxCoinbase));
+    BOOST_CHECK_EQUAL(CountAvailableCoins(wallet), 0U);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    BOOST_CHECK_EQUAL(CountAvailableCoins(wallet), 1U);
+
+    // Immature coinbases are never available.
+    WalletRescanReserver reserver(&wallet);
+    reserver.reserve();
+    wallet.ScanForWalletTransactions(chainActive.Genesis(), reserver);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 101U);
+    BOOST_CHECK_EQUAL(CountAvailableCoins(wallet), 1U);
+
+    // An unconfirmed spend, which is not in the mempool, makes the coin spent
+    // until it gets abandoned.
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns.front().GetId(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 20 * COIN;
+    spend.vout[0].scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    spend.vout[1].nValue = 29 * COIN;
+    spend.vout[1].scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CWalletTx wtxSpend(&wallet, MakeTransactionRef(spend));
+    BOOST_CHECK(wallet.AddToWallet(wtxSpend));
+    BOOST_CHECK(wallet.IsSpent(spend.vin[0].prevout.GetTxId(), 0));
+    BOOST_CHECK_EQUAL(CountAvailableCoins(wallet), 0U);
+
+    BOOST_CHECK(wallet.AbandonTransaction(wtxSpend.GetId()));
+    BOOST_CHECK(!wallet.IsSpent(spend.vin[0].prevout.GetTxId(), 0));
+    BOOST_CHECK_EQUAL(CountAvailableCoins(wallet), 1U);
+
+    // Adding it again brings it back from abandoned.
+    BOOST_CHECK(wallet.AddToWallet(wtxSpend));
+    BOOST_CHECK_EQUAL(CountAvailableCoins(wallet), 0U);
+}
+
+// Check that a key generated by the wallet brings the outputs already paying
+// to it up to date, as when the keypool is derived again after a restore.
+BOOST_FIXTURE_TEST_CASE(generated_key_foreign_outputs, TestChain100Setup) {
+    // Make the first coinbase mature.
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+
+    CWallet wallet(Params());
+    LOCK2(cs_main, wallet.cs_wallet);
+    CWalletTx wtxCoinbase(&wallet, MakeTransactionRef(coinbaseTxns.front()));
+    wtxCoinbase.SetMerkleBranch(chainActive[1], 0);
+    BOOST_CHECK(wallet.AddToWallet(wtxCoinbase));
+    BOOST_CHECK_EQUAL(CountAvailableCoins(wallet), 0U);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), Amount(0));
+
+    // The key is not written to the dummy database, but is still added.
+    CWalletDB walletdb(wallet.GetDBHandle());
+    wallet.AddKeyPubKeyWithDB(walletdb, coinbaseKey, coinbaseKey.GetPubKey());
+    BOOST_CHECK_EQUAL(CountAvailableCoins(wallet), 1U);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 50 * COIN);
+}
+
+// Check that the running totals of the balances follow transactions as they
+// are added and abandoned, coinbases as they mature, and blocks as they are
+// disconnected.
+BOOST_FIXTURE_TEST_CASE(cached_balances, TestChain100Setup) {
+    // Make the first coinbase mature.
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+
+    CWallet wallet(Params());
+    {
+        LOCK2(cs_main, wallet.cs_wallet);
+        wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        wallet.ScanForWalletTransactions(chainActive.Genesis(), reserver);
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), 50 * COIN);
+        BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 100 * 50 * COIN);
+        BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), Amount(0));
+
+        // An unconfirmed spend, which is not in the mempool, is neither
+        // trusted nor pending, but spends the coinbase until it is abandoned.
+        CMutableTransaction spend;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = COutPoint(coinbaseTxns.front().GetId(), 0);
+        spend.vout.resize(1);
+        spend.vout[0].nValue = 49 * COIN;
+        spend.vout[0].scriptPubKey =
+            GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+        CWalletTx wtxSpend(&wallet, MakeTransactionRef(spend));
+        BOOST_CHECK(wallet.AddToWallet(wtxSpend));
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), Amount(0));
+        BOOST_CHECK(wallet.AbandonTransaction(wtxSpend.GetId()));
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), 50 * COIN);
+    }
+
+    // The next coinbase matures as a block is connected, which the wallet is
+    // not told about.
+    const CBlock block = CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    {
+        LOCK2(cs_main, wallet.cs_wallet);
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), 2 * 50 * COIN);
+        BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 99 * 50 * COIN);
+
+        // And becomes immature again as it is disconnected.
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(GetConfig(), state, chainActive.Tip()));
+        wallet.BlockDisconnected(std::make_shared<const CBlock>(block));
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), 50 * COIN);
+        BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 100 * 50 * COIN);
+    }
+}
+
+// Check that the script filter used by rescans matches every script IsMine
+// considers ours.
+BOOST_AUTO_TEST_CASE(script_filter_matches_ismine) {
+    CWallet wallet(Params());
+    LOCK(wallet.cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CKey watchedKey;
+    watchedKey.MakeNewKey(true);
+    wallet.AddKeyPubKey(key, key.GetPubKey());
+
+    const CScript multisig =
+        GetScriptForMultisig(1, {key.GetPubKey(), otherKey.GetPubKey()});
+    const CScript multisigMine = GetScriptForMultisig(1, {key.GetPubKey()});
+    const CScript watched =
+        GetScriptForDestination(watchedKey.GetPubKey().GetID());
+    wallet.AddCScript(multisig);
+    wallet.AddCScript(multisigMine);
+    wallet.AddWatchOnly(watched, 0);
+
+    CWalletScriptFilter filter;
+    wallet.GetScriptFilter(filter);
+
+    const std::vector<CScript> scripts = {
+        GetScriptForRawPubKey(key.GetPubKey()),
+        GetScriptForDestination(key.GetPubKey().GetID()),
+        GetScriptForDestination(CScriptID(multisigMine)),
+        multisigMine,
+        watched,
+        GetScriptForDestination(CScriptID(multisig)),
+        multisig,
+        GetScriptForRawPubKey(otherKey.GetPubKey()),
+        GetScriptForDestination(otherKey.GetPubKey().GetID()),
+        CScript() << OP_RETURN,
+        CScript() << OP_TRUE,
+    };
+    size_t nMine = 0;
+    for (const CScript &script : scripts) {
+        if (IsMine(wallet, script) != ISMINE_NO) {
+            BOOST_CHECK(filter.Matches(script));
+            nMine++;
+        }
+    }
+    BOOST_CHECK_EQUAL(nMine, 5U);
+
+    BOOST_CHECK(!filter.Matches(
+        GetScriptForDestination(otherKey.GetPubKey().GetID())));
+    BOOST_CHECK(!filter.Matches(CScript() << OP_TRUE));
+}
+
+BOOST_AUTO_TEST_CASE(ismine_script_map) {
+    CWallet wallet(Params());
+    LOCK(wallet.cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    CKey otherKey;
+    otherKey.MakeNewKey(false);
+    CKey watchedKey;
+    watchedKey.MakeNewKey(true);
+
+    const CScript multisig =
+        GetScriptForMultisig(2, {key.GetPubKey(), otherKey.GetPubKey()});
+    const CScript watched =
+        GetScriptForDestination(watchedKey.GetPubKey().GetID());
+    // Scripts ::IsMine solves, with non-minimal pushes of the key and its ID.
+    const CPubKey pubkey = key.GetPubKey();
+    const CKeyID keyid = pubkey.GetID();
+    std::vector<uint8_t> vchP2PKH = {OP_DUP, OP_HASH160, OP_PUSHDATA1, 20};
+    vchP2PKH.insert(vchP2PKH.end(), keyid.begin(), keyid.end());
+    vchP2PKH.push_back(OP_EQUALVERIFY);
+    vchP2PKH.push_back(OP_CHECKSIG);
+    const CScript nonMinimalP2PKH(vchP2PKH.begin(), vchP2PKH.end());
+    std::vector<uint8_t> vchP2PK = {OP_PUSHDATA1, 33};
+    vchP2PK.insert(vchP2PK.end(), pubkey.begin(), pubkey.end());
+    vchP2PK.push_back(OP_CHECKSIG);
+    const CScript nonMinimalP2PK(vchP2PK.begin(), vchP2PK.end());
+    const std::vector<CScript> scripts = {
+        GetScriptForRawPubKey(key.GetPubKey()),
+        GetScriptForDestination(key.GetPubKey().GetID()),
+        GetScriptForRawPubKey(otherKey.GetPubKey()),
+        GetScriptForDestination(otherKey.GetPubKey().GetID()),
+        GetScriptForDestination(CScriptID(multisig)),
+        multisig,
+        GetScriptForMultisig(1, {key.GetPubKey()}),
+        watched,
+        nonMinimalP2PKH,
+        nonMinimalP2PK,
+        CScript() << OP_RETURN,
+        CScript() << OP_TRUE,
+    };
+
+    // The wallet's answers match the keystore's as keys, scripts and
+    // watch-only scripts come and go.
+    auto CheckScripts = [&]() {
+        for (const CScript &script : scripts) {
+            CTxOut txout(Amount(1), script);
+            BOOST_CHECK_EQUAL(wallet.IsMine(txout), IsMine(wallet, script));
+        }
+    };
+
+    CheckScripts();
+    wallet.AddKeyPubKey(key, key.GetPubKey());
+    BOOST_CHECK(wallet.IsMine(CTxOut(Amount(1), scripts[1])) ==
+                ISMINE_SPENDABLE);
+    BOOST_CHECK(wallet.IsMine(CTxOut(Amount(1), nonMinimalP2PKH)) ==
+                ISMINE_SPENDABLE);
+    BOOST_CHECK(wallet.IsMine(CTxOut(Amount(1), nonMinimalP2PK)) ==
+                ISMINE_SPENDABLE);
+    CheckScripts();
+    wallet.AddCScript(multisig);
+    CheckScripts();
+    wallet.AddWatchOnly(watched, 0);
+    BOOST_CHECK(wallet.IsMine(CTxOut(Amount(1), watched)) != ISMINE_NO);
+    CheckScripts();
+    wallet.AddKeyPubKey(otherKey, otherKey.GetPubKey());
+    BOOST_CHECK(wallet.IsMine(CTxOut(Amount(1), multisig)) ==
+                ISMINE_SPENDABLE);
+    CheckScripts();
+    wallet.RemoveWatchOnly(watched);
+    BOOST_CHECK(wallet.IsMine(CTxOut(Amount(1), watched)) == ISMINE_NO);
+    CheckScripts();
+
+    // A new key makes the watch-only P2SH script of a redeem script paying to
+    // it spendable, without the whole map being rebuilt.
+    CKey redeemKey;
+    redeemKey.MakeNewKey(true);
+    const CScript redeemScript =
+        GetScriptForMultisig(1, {redeemKey.GetPubKey()});
+    const CScript watchedP2SH =
+        GetScriptForDestination(CScriptID(redeemScript));
+    wallet.AddCScript(redeemScript);
+    wallet.AddWatchOnly(watchedP2SH, 0);
+    BOOST_CHECK(wallet.IsMine(CTxOut(Amount(1), watchedP2SH)) &
+                ISMINE_WATCH_ONLY);
+    wallet.AddKeyPubKey(redeemKey, redeemKey.GetPubKey());
+    BOOST_CHECK(wallet.IsMine(CTxOut(Amount(1), watchedP2SH)) ==
+                ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(Amount(1), watchedP2SH)),
+                      IsMine(wallet, watchedP2SH));
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup_batch) {
+    const unsigned int nKeys = KEYPOOL_TOPUP_BATCH_SIZE + 10;
+    CKey masterKey;
+    {
+        LOCK(pwalletMain->cs_wallet);
+        pwalletMain->SetMinVersion(FEATURE_HD_SPLIT);
+        BOOST_REQUIRE(pwalletMain->SetHDMasterKey(
+            pwalletMain->GenerateNewHDMasterKey()));
+        BOOST_REQUIRE(pwalletMain->GetKey(
+            pwalletMain->GetHDChain().masterKeyID, masterKey));
+    }
+
+    // Derive the keys of the external and internal chains one at a time.
+    const uint32_t HARDENED = 0x80000000;
+    CExtKey extMasterKey;
+    extMasterKey.SetMaster(masterKey.begin(), masterKey.size());
+    CExtKey accountKey;
+    extMasterKey.Derive(accountKey, HARDENED);
+    std::vector<CExtKey> chainKeys(2);
+    std::vector<std::vector<CKey>> vChildKeys(2);
+    for (int internal = 0; internal < 2; internal++) {
+        accountKey.Derive(chainKeys[internal], HARDENED + internal);
+        for (unsigned int i = 0; i <= nKeys; i++) {
+            CExtKey childKey;
+            chainKeys[internal].Derive(childKey, i | HARDENED);
+            vChildKeys[internal].push_back(childKey.key);
+        }
+    }
+
+    // A key of the external chain the wallet already has is skipped.
+    const CKey &knownKey = vChildKeys[0][5];
+    BOOST_CHECK(pwalletMain->AddKeyPubKey(knownKey, knownKey.GetPubKey()));
+
+    BOOST_CHECK(pwalletMain->TopUpKeyPool(nKeys));
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK_EQUAL(pwalletMain->KeypoolCountExternalKeys(), nKeys);
+        BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), 2 * nKeys);
+        BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nExternalChainCounter,
+                          nKeys + 1);
+        BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nInternalChainCounter,
+                          nKeys);
+        for (int internal = 0; internal < 2; internal++) {
+            for (unsigned int i = 0; i < nKeys + 1 - internal; i++) {
+                const CKeyID keyid =
+                    vChildKeys[internal][i].GetPubKey().GetID();
+                BOOST_CHECK(pwalletMain->HaveKey(keyid));
+                if (internal == 0 && i == 5) {
+                    continue;
+                }
+                BOOST_CHECK_EQUAL(pwalletMain->mapKeyMetadata[keyid].hdKeypath,
+                                  std::string(internal ? "m/0'/1'/"
+                                                       : "m/0'/0'/") +
+                                      std::to_string(i) + "'");
+            }
+        }
+    }
+
+    // The keys, the pool and the chain counters were all committed.
+    bool fFirstRun;
+    std::unique_ptr<CWalletDBWrapper> dbw(
+        new CWalletDBWrapper(&bitdb, "wallet_test.dat"));
+    CWallet wallet(Params(), std::move(dbw));
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), 2 * nKeys);
+    BOOST_CHECK_EQUAL(wallet.GetHDChain().nExternalChainCounter, nKeys + 1);
+    BOOST_CHECK_EQUAL(wallet.GetHDChain().nInternalChainCounter, nKeys);
+    BOOST_CHECK(wallet.HaveKey(vChildKeys[1][nKeys - 1].GetPubKey().GetID()));
+}
+
 static int64_t AddTx(CWallet &wallet, uint32_t lockTime, int64_t mockTime,
                      int64_t blockTime) {
     CMutableTransaction tx;
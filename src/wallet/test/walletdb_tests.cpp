@@ -130,6 +130,69 @@ BOOST_AUTO_TEST_CASE(write_erase_destdata) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(load_batches) {
+    auto walletdbwrapper = TmpDB(pathTemp, "load_batches");
+    CWalletDB walletdb(*walletdbwrapper, "cr+");
+
+    // Enough records for several batches, decoded on other threads.
+    const int nTxs = 2 * WALLET_LOAD_BATCH_SIZE;
+    std::vector<uint256> vTxIds;
+    for (int i = 0; i < nTxs; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 0);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = Amount(1000 + i);
+        CWalletTx wtx(nullptr, MakeTransactionRef(std::move(mtx)));
+        wtx.nOrderPos = i;
+        BOOST_CHECK(walletdb.WriteTx(wtx));
+        vTxIds.push_back(wtx.GetId());
+    }
+
+    std::vector<CPubKey> vPubKeys;
+    for (int i = 0; i < 100; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        CPubKey pubkey = key.GetPubKey();
+        BOOST_CHECK(walletdb.WriteKey(pubkey, key.GetPrivKey(),
+                                      CKeyMetadata(GetTime())));
+        vPubKeys.push_back(pubkey);
+    }
+
+    for (int i = 0; i < 10; i++) {
+        CAccountingEntry entry;
+        entry.strAccount = i % 2 ? "odd" : "even";
+        entry.nCreditDebit = Amount(i);
+        entry.nOrderPos = nTxs + i;
+        BOOST_CHECK(walletdb.WriteAccountingEntry(i + 1, entry));
+    }
+
+    auto w = LoadWallet(&walletdb);
+    LOCK(w->cs_wallet);
+    BOOST_CHECK_EQUAL(w->mapWallet.size(), vTxIds.size());
+    for (const uint256 &txid : vTxIds) {
+        BOOST_CHECK(w->mapWallet.count(txid));
+    }
+    for (const CPubKey &pubkey : vPubKeys) {
+        BOOST_CHECK(w->HaveKey(pubkey.GetID()));
+    }
+
+    // The accounting entries are those ListAccountCreditDebit lists.
+    std::list<CAccountingEntry> entries;
+    walletdb.ListAccountCreditDebit("*", entries);
+    BOOST_CHECK_EQUAL(w->nAccountingEntryNumber, 10U);
+    BOOST_REQUIRE_EQUAL(w->laccentries.size(), entries.size());
+    auto it = w->laccentries.begin();
+    for (const CAccountingEntry &entry : entries) {
+        BOOST_CHECK_EQUAL(it->strAccount, entry.strAccount);
+        BOOST_CHECK_EQUAL(it->nEntryNo, entry.nEntryNo);
+        BOOST_CHECK_EQUAL(it->nOrderPos, entry.nOrderPos);
+        BOOST_CHECK(it->nCreditDebit == entry.nCreditDebit);
+        ++it;
+    }
+    BOOST_CHECK_EQUAL(w->wtxOrdered.size(), vTxIds.size() + 10);
+}
+
 BOOST_AUTO_TEST_CASE(no_dest_fails) {
     auto walletdbwrapper = TmpDB(pathTemp, "no_dest_fails");
     CWalletDB walletdb(*walletdbwrapper, "cr+");
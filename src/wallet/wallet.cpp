@@ -12,6 +12,7 @@
 #include "consensus/validation.h"
 #include "dstencode.h"
 #include "fs.h"
+#include "index/blockfilterindex.h"
 #include "init.h"
 #include "key.h"
 #include "keystore.h"
@@ -19,10 +20,12 @@
 #include "policy/policy.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "random.h"
 #include "scheduler.h"
 #include "script/script.h"
 #include "script/sighashtype.h"
 #include "script/sign.h"
+#include "script/standard.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -36,6 +39,10 @@
 #include <boost/thread.hpp>
 
 #include <cassert>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
 
 std::vector<CWalletRef> vpwallets;
 
@@ -169,8 +176,7 @@ CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, bool internal) {
     return pubkey;
 }
 
-void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata &metadata,
-                                CKey &secret, bool internal) {
+void CWallet::DeriveChainKey(CExtKey &chainChildKey, bool internal) {
     // for now we use a fixed keypath scheme of m/0'/0'/k
     // master key seed (256bit)
     CKey key;
@@ -178,10 +184,6 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata &metadata,
     CExtKey masterKey;
     // key at m/0'
     CExtKey accountKey;
-    // key at m/0'/0' (external) or m/0'/1' (internal)
-    CExtKey chainChildKey;
-    // key at m/0'/0'/<n>'
-    CExtKey childKey;
 
     // try to get the master key
     if (!GetKey(hdChain.masterKeyID, key)) {
@@ -200,6 +202,16 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata &metadata,
     assert(internal ? CanSupportFeature(FEATURE_HD_SPLIT) : true);
     accountKey.Derive(chainChildKey,
                       BIP32_HARDENED_KEY_LIMIT + (internal ? 1 : 0));
+}
+
+void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata &metadata,
+                                CKey &secret, bool internal) {
+    // key at m/0'/0' (external) or m/0'/1' (internal)
+    CExtKey chainChildKey;
+    // key at m/0'/0'/<n>'
+    CExtKey childKey;
+
+    DeriveChainKey(chainChildKey, internal);
 
     // derive child key at next index, skip keys already known to the wallet
     do {
@@ -234,6 +246,139 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata &metadata,
     }
 }
 
+void CWallet::GenerateNewKeys(CWalletDB &walletdb, bool internal,
+                              size_t nKeys, KeypoolBatch &batch) {
+    // mapKeyMetadata
+    AssertLockHeld(cs_wallet);
+    bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY);
+    bool fHD = IsHDEnabled();
+    internal = fHD && CanSupportFeature(FEATURE_HD_SPLIT) && internal;
+
+    CExtKey chainChildKey;
+    if (fHD) {
+        DeriveChainKey(chainChildKey, internal);
+    }
+    uint32_t &nChainCounter = internal ? hdChain.nInternalChainCounter
+                                       : hdChain.nExternalChainCounter;
+
+    // Compressed public keys were introduced in version 0.6.0
+    if (fCompressed) {
+        SetMinVersion(FEATURE_COMPRPUBKEY, &walletdb);
+    }
+
+    int64_t nCreationTime = GetTime();
+    UpdateTimeFirstKey(nCreationTime);
+
+    size_t nAdded = 0;
+    while (nAdded < nKeys) {
+        // Generate the missing keys on a few threads. With HD, candidate i is
+        // the child at index nFirstChild + i of the chain key; deriving it from
+        // the chain key directly spares computing the chain key's fingerprint
+        // for each child.
+        const uint32_t nFirstChild = nChainCounter;
+        std::vector<CKey> vSecrets(nKeys - nAdded);
+        std::vector<CPubKey> vCandidates(vSecrets.size());
+        std::atomic<size_t> nNext(0);
+        auto generate = [&]() {
+            for (size_t i = nNext++; i < vSecrets.size(); i = nNext++) {
+                if (fHD) {
+                    ChainCode ccChild;
+                    chainChildKey.key.Derive(
+                        vSecrets[i], ccChild,
+                        (nFirstChild + i) | BIP32_HARDENED_KEY_LIMIT,
+                        chainChildKey.chaincode);
+                } else {
+                    vSecrets[i].MakeNewKey(fCompressed);
+                }
+                vCandidates[i] = vSecrets[i].GetPubKey();
+                assert(vSecrets[i].VerifyPubKey(vCandidates[i]));
+            }
+        };
+
+        int nThreads = std::max(
+            1, std::min<int>(std::min(GetNumCores(), MAX_KEYPOOL_THREADS),
+                             vSecrets.size()));
+        std::vector<std::thread> threads;
+        for (int i = 1; i < nThreads; i++) {
+            threads.emplace_back(generate);
+        }
+        generate();
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+
+        for (size_t i = 0; i < vSecrets.size(); i++) {
+            CKeyMetadata metadata(nCreationTime);
+            if (fHD) {
+                metadata.hdKeypath = std::string(internal ? "m/0'/1'/"
+                                                          : "m/0'/0'/") +
+                                     std::to_string(nChainCounter) + "'";
+                metadata.hdMasterKeyID = hdChain.masterKeyID;
+                nChainCounter++;
+                // skip keys already known to the wallet
+                if (HaveKey(vCandidates[i].GetID())) {
+                    continue;
+                }
+            }
+
+            // The key replaces the watch-only entries of its scripts.
+            for (const CScript &script :
+                 {GetScriptForDestination(vCandidates[i].GetID()),
+                  GetScriptForRawPubKey(vCandidates[i])}) {
+                if (HaveWatchOnly(script)) {
+                    batch.vWatchOnlyRemoved.push_back(script);
+                }
+            }
+            mapKeyMetadata[vCandidates[i].GetID()] = metadata;
+            batch.vKeys.push_back(vCandidates[i]);
+            if (!AddKeyPubKeyWithDB(walletdb, vSecrets[i], vCandidates[i])) {
+                throw std::runtime_error(std::string(__func__) +
+                                         ": AddKey failed");
+            }
+            nAdded++;
+        }
+    }
+
+    // update the chain model in the database
+    if (fHD && !walletdb.WriteHDChain(hdChain)) {
+        throw std::runtime_error(std::string(__func__) +
+                                 ": Writing HD chain model failed");
+    }
+}
+
+void CWallet::UndoKeypoolBatch(const KeypoolBatch &batch) {
+    AssertLockHeld(cs_wallet);
+    {
+        LOCK(cs_KeyStore);
+        for (const CPubKey &pubkey : batch.vKeys) {
+            mapKeys.erase(pubkey.GetID());
+            mapCryptedKeys.erase(pubkey.GetID());
+        }
+        for (const CScript &script : batch.vWatchOnlyRemoved) {
+            CCryptoKeyStore::AddWatchOnly(script);
+        }
+    }
+
+    for (const CPubKey &pubkey : batch.vKeys) {
+        mapKeyMetadata.erase(pubkey.GetID());
+        auto it = m_pool_key_to_index.find(pubkey.GetID());
+        if (it != m_pool_key_to_index.end()) {
+            setInternalKeyPool.erase(it->second);
+            setExternalKeyPool.erase(it->second);
+            m_pool_key_to_index.erase(it);
+        }
+    }
+
+    hdChain = batch.hdChain;
+    m_max_keypool_index = batch.nMaxKeypoolIndex;
+    MarkMineScriptsDirty();
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
+    if (!batch.vWatchOnlyRemoved.empty()) {
+        NotifyWatchonlyChanged(true);
+    }
+}
+
 bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey &secret,
                                  const CPubKey &pubkey) {
     // mapKeyMetadata
@@ -262,14 +407,18 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey &secret,
     CScript script;
     script = GetScriptForDestination(pubkey.GetID());
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     }
 
     script = GetScriptForRawPubKey(pubkey);
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     }
 
+    // Outputs already in the wallet may pay to the key, if it is derived again
+    // after a restore.
+    SyncForeignOutputs(AddMineScripts(pubkey));
+
     if (IsCrypted()) {
         return true;
     }
@@ -280,7 +429,67 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey &secret,
 
 bool CWallet::AddKeyPubKey(const CKey &secret, const CPubKey &pubkey) {
     CWalletDB walletdb(*dbw);
-    return CWallet::AddKeyPubKeyWithDB(walletdb, secret, pubkey);
+    return AddImportedKeyWithDB(walletdb, secret, pubkey);
+}
+
+bool CWallet::AddImportedKeyWithDB(CWalletDB &walletdb, const CKey &secret,
+                                   const CPubKey &pubkey) {
+    AssertLockHeld(cs_wallet);
+    bool fAdded = CWallet::AddKeyPubKeyWithDB(walletdb, secret, pubkey);
+
+    // Imported keys may come with any number of outputs, which are all looked
+    // at again.
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
+    return fAdded;
+}
+
+void CWallet::UndoImportBatch(const ImportBatch &batch) {
+    AssertLockHeld(cs_wallet);
+    {
+        LOCK(cs_KeyStore);
+        for (const CPubKey &pubkey : batch.vKeys) {
+            mapKeys.erase(pubkey.GetID());
+            mapCryptedKeys.erase(pubkey.GetID());
+        }
+        for (const CScript &script : batch.vScripts) {
+            mapScripts.erase(CScriptID(script));
+        }
+        for (const CScript &script : batch.vWatchOnly) {
+            CCryptoKeyStore::RemoveWatchOnly(script);
+        }
+        for (const CScript &script : batch.vWatchOnlyRemoved) {
+            CCryptoKeyStore::AddWatchOnly(script);
+        }
+    }
+
+    for (const CPubKey &pubkey : batch.vKeys) {
+        mapKeyMetadata.erase(pubkey.GetID());
+    }
+
+    // Restore the entries in the reverse order they were changed in.
+    for (auto it = batch.vAddressBook.rbegin(); it != batch.vAddressBook.rend();
+         ++it) {
+        if (it->second) {
+            mapAddressBook[it->first] = *it->second;
+            NotifyAddressBookChanged(
+                this, it->first, it->second->name,
+                ::IsMine(*this, it->first) != ISMINE_NO, it->second->purpose,
+                CT_UPDATED);
+        } else {
+            mapAddressBook.erase(it->first);
+            NotifyAddressBookChanged(this, it->first, "",
+                                     ::IsMine(*this, it->first) != ISMINE_NO,
+                                     "", CT_DELETED);
+        }
+    }
+
+    MarkMineScriptsDirty();
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
+    if (!batch.vWatchOnly.empty() || !batch.vWatchOnlyRemoved.empty()) {
+        NotifyWatchonlyChanged(HaveWatchOnly());
+    }
 }
 
 bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
@@ -310,6 +519,7 @@ bool CWallet::LoadKeyMetadata(const CTxDestination &keyID,
 
 bool CWallet::LoadCryptedKey(const CPubKey &vchPubKey,
                              const std::vector<uint8_t> &vchCryptedSecret) {
+    MarkMineScriptsDirty();
     return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
 }
 
@@ -325,11 +535,22 @@ void CWallet::UpdateTimeFirstKey(int64_t nCreateTime) {
 }
 
 bool CWallet::AddCScript(const CScript &redeemScript) {
+    CWalletDB walletdb(*dbw);
+    return AddCScriptWithDB(walletdb, redeemScript);
+}
+
+bool CWallet::AddCScriptWithDB(CWalletDB &walletdb,
+                               const CScript &redeemScript) {
+    AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::AddCScript(redeemScript)) {
         return false;
     }
 
-    return CWalletDB(*dbw).WriteCScript(Hash160(redeemScript), redeemScript);
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
+    MarkMineScriptsDirty();
+
+    return walletdb.WriteCScript(Hash160(redeemScript), redeemScript);
 }
 
 bool CWallet::LoadCScript(const CScript &redeemScript) {
@@ -348,18 +569,29 @@ bool CWallet::LoadCScript(const CScript &redeemScript) {
         return true;
     }
 
+    MarkMineScriptsDirty();
     return CCryptoKeyStore::AddCScript(redeemScript);
 }
 
 bool CWallet::AddWatchOnly(const CScript &dest) {
+    CWalletDB walletdb(*dbw);
+    return AddWatchOnlyWithDB(walletdb, dest);
+}
+
+bool CWallet::AddWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest) {
+    AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::AddWatchOnly(dest)) {
         return false;
     }
 
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
+    MarkMineScriptsDirty();
+
     const CKeyMetadata &meta = mapKeyMetadata[CScriptID(dest)];
     UpdateTimeFirstKey(meta.nCreateTime);
     NotifyWatchonlyChanged(true);
-    return CWalletDB(*dbw).WriteWatchOnly(dest, meta);
+    return walletdb.WriteWatchOnly(dest, meta);
 }
 
 bool CWallet::AddWatchOnly(const CScript &dest, int64_t nCreateTime) {
@@ -367,20 +599,36 @@ bool CWallet::AddWatchOnly(const CScript &dest, int64_t nCreateTime) {
     return AddWatchOnly(dest);
 }
 
+bool CWallet::AddWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest,
+                                 int64_t nCreateTime) {
+    mapKeyMetadata[CScriptID(dest)].nCreateTime = nCreateTime;
+    return AddWatchOnlyWithDB(walletdb, dest);
+}
+
 bool CWallet::RemoveWatchOnly(const CScript &dest) {
+    CWalletDB walletdb(*dbw);
+    return RemoveWatchOnlyWithDB(walletdb, dest);
+}
+
+bool CWallet::RemoveWatchOnlyWithDB(CWalletDB &walletdb,
+                                    const CScript &dest) {
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest)) {
         return false;
     }
 
+    fWalletUTXODirty = true;
+    MarkMineScriptsDirty();
+
     if (!HaveWatchOnly()) {
         NotifyWatchonlyChanged(false);
     }
 
-    return CWalletDB(*dbw).EraseWatchOnly(dest);
+    return walletdb.EraseWatchOnly(dest);
 }
 
 bool CWallet::LoadWatchOnly(const CScript &dest) {
+    MarkMineScriptsDirty();
     return CCryptoKeyStore::AddWatchOnly(dest);
 }
 
@@ -730,6 +978,346 @@ void CWallet::AddToSpends(const uint256 &wtxid) {
     }
 }
 
+/**
+ * Whether a wallet transaction spends its inputs for IsSpent whatever the state
+ * of the chain, that is as long as it is neither abandoned nor conflicted.
+ */
+static bool SpendsInputs(const CWalletTx &wtx) {
+    return !wtx.isAbandoned() && (wtx.hashBlock.IsNull() || wtx.nIndex != -1);
+}
+
+bool CWallet::IsWalletUTXO(const CWalletTx &wtx, unsigned int n) const {
+    AssertLockHeld(cs_wallet);
+    if (IsMine(wtx.tx->vout[n]) == ISMINE_NO) {
+        return false;
+    }
+
+    std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range =
+        mapTxSpends.equal_range(COutPoint(wtx.GetId(), n));
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit =
+            mapWallet.find(it->second);
+        if (mit != mapWallet.end() && SpendsInputs(mit->second)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CWallet::SyncWalletUTXO(const COutPoint &outpoint) {
+    AssertLockHeld(cs_wallet);
+    if (fWalletUTXODirty) {
+        return;
+    }
+
+    std::map<uint256, CWalletTx>::const_iterator it =
+        mapWallet.find(outpoint.GetTxId());
+    if (it == mapWallet.end() ||
+        outpoint.GetN() >= it->second.tx->vout.size()) {
+        return;
+    }
+
+    if (IsWalletUTXO(it->second, outpoint.GetN())) {
+        setWalletUTXO.insert(outpoint);
+    } else {
+        setWalletUTXO.erase(outpoint);
+    }
+}
+
+void CWallet::SyncWalletUTXO(const CWalletTx &wtx) {
+    // The transaction's own outputs, and the ones it spends, whose state
+    // depends on whether it is abandoned or conflicted.
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        SyncWalletUTXO(COutPoint(wtx.GetId(), i));
+    }
+
+    if (!wtx.IsCoinBase()) {
+        for (const CTxIn &txin : wtx.tx->vin) {
+            SyncWalletUTXO(txin.prevout);
+        }
+    }
+}
+
+const std::set<COutPoint> &CWallet::GetWalletUTXO() const {
+    AssertLockHeld(cs_wallet);
+    if (fWalletUTXODirty) {
+        setWalletUTXO.clear();
+        mapForeignOutputs.clear();
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet) {
+            const CWalletTx &wtx = item.second;
+            for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+                if (IsWalletUTXO(wtx, i)) {
+                    setWalletUTXO.insert(COutPoint(wtx.GetId(), i));
+                }
+            }
+            AddToForeignOutputs(wtx);
+        }
+        fWalletUTXODirty = false;
+    }
+
+    return setWalletUTXO;
+}
+
+void CWallet::AddToForeignOutputs(const CWalletTx &wtx) const {
+    AssertLockHeld(cs_wallet);
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        const CTxOut &txout = wtx.tx->vout[i];
+        if (IsMine(txout) != ISMINE_SPENDABLE) {
+            mapForeignOutputs[txout.scriptPubKey].emplace_back(wtx.GetId(), i);
+        }
+    }
+}
+
+void CWallet::SyncForeignOutputs(const std::vector<CScript> &vScripts) {
+    AssertLockHeld(cs_wallet);
+    if (fWalletUTXODirty) {
+        fBalancesDirty = true;
+        return;
+    }
+
+    // The transactions paying to the scripts have more credit, and the ones
+    // spending their outputs more debit.
+    auto markDirty = [this](const uint256 &txid) {
+        std::map<uint256, CWalletTx>::iterator it = mapWallet.find(txid);
+        if (it != mapWallet.end()) {
+            it->second.MarkDirty();
+            MarkBalancesDirty(txid);
+        }
+    };
+    for (const CScript &script : vScripts) {
+        auto it = mapForeignOutputs.find(script);
+        if (it == mapForeignOutputs.end()) {
+            continue;
+        }
+
+        for (const COutPoint &outpoint : it->second) {
+            SyncWalletUTXO(outpoint);
+            markDirty(outpoint.GetTxId());
+            std::pair<TxSpends::const_iterator, TxSpends::const_iterator>
+                range = mapTxSpends.equal_range(outpoint);
+            for (TxSpends::const_iterator sit = range.first;
+                 sit != range.second; ++sit) {
+                markDirty(sit->second);
+            }
+        }
+
+        // Spendable outputs stay ours until keys or scripts are removed,
+        // which rebuilds the index.
+        if (IsMine(CTxOut(Amount(0), script)) == ISMINE_SPENDABLE) {
+            mapForeignOutputs.erase(it);
+        }
+    }
+}
+
+/**
+ * The block a transaction is indexed under in mapTxsByBlock: the one it is
+ * confirmed in, or the null hash.
+ */
+static uint256 GetTxsByBlockKey(const CWalletTx &wtx) {
+    // Abandoned and conflicted transactions have nIndex == -1.
+    return wtx.hashUnset() || wtx.nIndex == -1 ? uint256() : wtx.hashBlock;
+}
+
+void CWallet::AddToTxsByBlock(const CWalletTx &wtx) const {
+    AssertLockHeld(cs_wallet);
+    if (fTxsByBlockDirty) {
+        return;
+    }
+
+    const uint256 hashBlock = GetTxsByBlockKey(wtx);
+    std::set<uint256> &setTxs = mapTxsByBlock[hashBlock];
+    if (setTxs.empty() && !hashBlock.IsNull()) {
+        setTxsBlocksUnsorted.insert(hashBlock);
+    }
+    setTxs.insert(wtx.GetId());
+}
+
+void CWallet::RemoveFromTxsByBlock(const CWalletTx &wtx) {
+    AssertLockHeld(cs_wallet);
+    if (fTxsByBlockDirty) {
+        return;
+    }
+
+    std::map<uint256, std::set<uint256>>::iterator it =
+        mapTxsByBlock.find(GetTxsByBlockKey(wtx));
+    if (it != mapTxsByBlock.end()) {
+        it->second.erase(wtx.GetId());
+        if (it->second.empty()) {
+            mapTxsByBlock.erase(it);
+        }
+    }
+}
+
+std::vector<const CWalletTx *>
+CWallet::GetTransactionsSince(const CBlockIndex *pindex) const {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    std::vector<const CWalletTx *> vTxs;
+    if (pindex == nullptr) {
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet) {
+            vTxs.push_back(&item.second);
+        }
+        return vTxs;
+    }
+
+    if (fTxsByBlockDirty) {
+        mapTxsByBlock.clear();
+        mapTxsBlocksByHeight.clear();
+        setTxsBlocksUnsorted.clear();
+        setTxsBlocksDisconnected.clear();
+        fTxsByBlockDirty = false;
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet) {
+            AddToTxsByBlock(item.second);
+        }
+    }
+
+    // Sort the blocks indexed since the last lookup. Those not in the active
+    // chain were on a fork when their transactions were loaded, or have been
+    // disconnected since they were added.
+    for (std::set<uint256>::iterator it = setTxsBlocksUnsorted.begin();
+         it != setTxsBlocksUnsorted.end();) {
+        BlockMap::const_iterator mi = mapBlockIndex.find(*it);
+        if (mi == mapBlockIndex.end()) {
+            ++it;
+            continue;
+        }
+
+        mapTxsBlocksByHeight[mi->second->nHeight].insert(*it);
+        if (!chainActive.Contains(mi->second)) {
+            setTxsBlocksDisconnected.insert(*it);
+        }
+        it = setTxsBlocksUnsorted.erase(it);
+    }
+
+    // Returns false if the block has no transactions left in the index.
+    auto AddBlockTxs = [&](const uint256 &hashBlock) {
+        std::map<uint256, std::set<uint256>>::const_iterator itBlock =
+            mapTxsByBlock.find(hashBlock);
+        if (itBlock == mapTxsByBlock.end()) {
+            return false;
+        }
+
+        for (const uint256 &txid : itBlock->second) {
+            std::map<uint256, CWalletTx>::const_iterator it =
+                mapWallet.find(txid);
+            if (it != mapWallet.end()) {
+                vTxs.push_back(&it->second);
+            }
+        }
+        return true;
+    };
+
+    // Transactions of blocks that are not in the active chain, because they
+    // were disconnected or are unknown, are unconfirmed.
+    AddBlockTxs(uint256());
+    for (const uint256 &hashBlock : setTxsBlocksUnsorted) {
+        AddBlockTxs(hashBlock);
+    }
+
+    for (std::set<uint256>::iterator it = setTxsBlocksDisconnected.begin();
+         it != setTxsBlocksDisconnected.end();) {
+        const CBlockIndex *pindexBlock = mapBlockIndex.at(*it);
+        if (chainActive.Contains(pindexBlock) || !mapTxsByBlock.count(*it)) {
+            it = setTxsBlocksDisconnected.erase(it);
+            continue;
+        }
+
+        // The blocks above pindex are visited below.
+        if (pindexBlock->nHeight <= pindex->nHeight) {
+            AddBlockTxs(*it);
+        }
+        ++it;
+    }
+
+    for (std::map<int, std::set<uint256>>::iterator it =
+             mapTxsBlocksByHeight.upper_bound(pindex->nHeight);
+         it != mapTxsBlocksByHeight.end();) {
+        for (std::set<uint256>::iterator itHash = it->second.begin();
+             itHash != it->second.end();) {
+            if (AddBlockTxs(*itHash)) {
+                ++itHash;
+            } else {
+                itHash = it->second.erase(itHash);
+            }
+        }
+
+        if (it->second.empty()) {
+            it = mapTxsBlocksByHeight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    return vTxs;
+}
+
+/**
+ * Counts the balances of a transaction in the running totals again. Returns
+ * whether they may change without the wallet being notified, so that the
+ * transaction must be counted again the next time the balances are read.
+ */
+bool CWallet::CountBalances(const uint256 &txid) const {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    std::map<uint256, CWalletBalances>::iterator itCounted =
+        mapBalancesCounted.find(txid);
+    if (itCounted != mapBalancesCounted.end()) {
+        balancesCounted -= itCounted->second;
+        mapBalancesCounted.erase(itCounted);
+    }
+
+    std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(txid);
+    if (it == mapWallet.end()) {
+        return false;
+    }
+
+    // The credit caches of the transaction may not have been invalidated yet
+    // when it was marked, so they are not used.
+    const CWalletTx &wtx = it->second;
+    const int nDepth = wtx.GetDepthInMainChain();
+    CWalletBalances balances;
+    if (wtx.IsTrusted()) {
+        balances.nTrusted = wtx.GetAvailableCredit(false);
+        balances.nWatchOnlyTrusted = wtx.GetAvailableWatchOnlyCredit(false);
+    } else if (nDepth == 0 && wtx.InMempool()) {
+        balances.nUntrustedPending = wtx.GetAvailableCredit(false);
+        balances.nWatchOnlyUntrustedPending =
+            wtx.GetAvailableWatchOnlyCredit(false);
+    }
+    balances.nImmature = wtx.GetImmatureCredit(false);
+    balances.nWatchOnlyImmature = wtx.GetImmatureWatchOnlyCredit(false);
+
+    if (!balances.IsNull()) {
+        balancesCounted += balances;
+        mapBalancesCounted[txid] = balances;
+    }
+
+    // Unconfirmed transactions enter and leave the mempool and get confirmed,
+    // and coinbases mature, as blocks are connected.
+    return nDepth == 0 || (nDepth > 0 && wtx.GetBlocksToMaturity() > 0);
+}
+
+void CWallet::MarkBalancesDirty(const uint256 &txid) {
+    AssertLockHeld(cs_wallet);
+    if (!fBalancesDirty) {
+        setBalancesRecount.insert(txid);
+    }
+}
+
+void CWallet::MarkBalancesDirty(const CWalletTx &wtx) {
+    // The transaction itself, and the ones whose outputs it spends, which are
+    // spent or not depending on whether it is abandoned or conflicted.
+    MarkBalancesDirty(wtx.GetId());
+    if (!wtx.IsCoinBase()) {
+        for (const CTxIn &txin : wtx.tx->vin) {
+            if (mapWallet.count(txin.prevout.GetTxId())) {
+                MarkBalancesDirty(txin.prevout.GetTxId());
+            }
+        }
+    }
+}
+
 bool CWallet::EncryptWallet(const SecureString &strWalletPassphrase) {
     if (IsCrypted()) {
         return false;
@@ -1006,6 +1594,7 @@ bool CWallet::GetAccountPubkey(CPubKey &pubKey, std::string strAccount,
 
 void CWallet::MarkDirty() {
     LOCK(cs_wallet);
+    fBalancesDirty = true;
     for (std::pair<const uint256, CWalletTx> &item : mapWallet) {
         item.second.MarkDirty();
     }
@@ -1030,10 +1619,15 @@ bool CWallet::AddToWallet(const CWalletTx &wtxIn, bool fFlushOnClose) {
         wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
         wtx.nTimeSmart = ComputeTimeSmart(wtx);
         AddToSpends(hash);
+        if (!fWalletUTXODirty) {
+            AddToForeignOutputs(wtx);
+        }
     }
 
     bool fUpdated = false;
     if (!fInsertedNew) {
+        RemoveFromTxsByBlock(wtx);
+
         // Merge
         if (!wtxIn.hashUnset() && wtxIn.hashBlock != wtx.hashBlock) {
             wtx.hashBlock = wtxIn.hashBlock;
@@ -1056,11 +1650,18 @@ bool CWallet::AddToWallet(const CWalletTx &wtxIn, bool fFlushOnClose) {
             fUpdated = true;
         }
     }
+    AddToTxsByBlock(wtx);
 
     //// debug print
     LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetId().ToString(),
               (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
+    // Follow mapWallet, whether or not writing to disk succeeds.
+    if (fInsertedNew || fUpdated) {
+        SyncWalletUTXO(wtx);
+        MarkBalancesDirty(wtx);
+    }
+
     // Write to disk
     if ((fInsertedNew || fUpdated) && !walletdb.WriteTx(wtx)) {
         return false;
@@ -1086,6 +1687,7 @@ bool CWallet::AddToWallet(const CWalletTx &wtxIn, bool fFlushOnClose) {
 }
 
 bool CWallet::LoadToWallet(const CWalletTx &wtxIn) {
+    AssertLockHeld(cs_wallet);
     uint256 txid = wtxIn.GetId();
 
     mapWallet[txid] = wtxIn;
@@ -1093,6 +1695,9 @@ bool CWallet::LoadToWallet(const CWalletTx &wtxIn) {
     wtx.BindWallet(this);
     wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
     AddToSpends(txid);
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
+    fTxsByBlockDirty = true;
     for (const CTxIn &txin : wtx.tx->vin) {
         if (mapWallet.count(txin.prevout.GetTxId())) {
             CWalletTx &prevtx = mapWallet[txin.prevout.GetTxId()];
@@ -1226,9 +1831,13 @@ bool CWallet::AbandonTransaction(const uint256 &hashTx) {
             // If the orig tx was not in block/mempool, none of its spends can
             // be in mempool.
             assert(!wtx.InMempool());
+            RemoveFromTxsByBlock(wtx);
             wtx.nIndex = -1;
             wtx.setAbandoned();
+            AddToTxsByBlock(wtx);
             wtx.MarkDirty();
+            SyncWalletUTXO(wtx);
+            MarkBalancesDirty(wtx);
             walletdb.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetId(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet
@@ -1292,9 +1901,13 @@ void CWallet::MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx) {
         if (conflictconfirms < currentconfirm) {
             // Block is 'more conflicted' than current confirm; update.
             // Mark transaction as conflicted with this block.
+            RemoveFromTxsByBlock(wtx);
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
+            AddToTxsByBlock(wtx);
             wtx.MarkDirty();
+            SyncWalletUTXO(wtx);
+            MarkBalancesDirty(wtx);
             walletdb.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet
             // that spend them conflicted too.
@@ -1334,6 +1947,7 @@ void CWallet::SyncTransaction(const CTransactionRef &ptx,
     for (const CTxIn &txin : tx.vin) {
         if (mapWallet.count(txin.prevout.GetTxId())) {
             mapWallet[txin.prevout.GetTxId()].MarkDirty();
+            MarkBalancesDirty(txin.prevout.GetTxId());
         }
     }
 }
@@ -1366,6 +1980,12 @@ void CWallet::BlockConnected(
 
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock) {
     LOCK2(cs_main, cs_wallet);
+    // Every transaction is one block shallower: coinbases may become immature
+    // again and conflicts may be lifted.
+    fBalancesDirty = true;
+    if (!fTxsByBlockDirty && mapTxsByBlock.count(pblock->GetHash())) {
+        setTxsBlocksDisconnected.insert(pblock->GetHash());
+    }
 
     for (const CTransactionRef &ptx : pblock->vtx) {
         SyncTransaction(ptx);
@@ -1383,29 +2003,177 @@ isminetype CWallet::IsMine(const CTxIn &txin) const {
         }
     }
 
-    return ISMINE_NO;
+    return ISMINE_NO;
+}
+
+// Note that this function doesn't distinguish between a 0-valued input, and a
+// not-"is mine" (according to the filter) input.
+Amount CWallet::GetDebit(const CTxIn &txin, const isminefilter &filter) const {
+    LOCK(cs_wallet);
+    std::map<uint256, CWalletTx>::const_iterator mi =
+        mapWallet.find(txin.prevout.GetTxId());
+    if (mi != mapWallet.end()) {
+        const CWalletTx &prev = (*mi).second;
+        if (txin.prevout.GetN() < prev.tx->vout.size()) {
+            if (IsMine(prev.tx->vout[txin.prevout.GetN()]) & filter) {
+                return prev.tx->vout[txin.prevout.GetN()].nValue;
+            }
+        }
+    }
+
+    return Amount(0);
+}
+
+SaltedScriptHasher::SaltedScriptHasher()
+    : k0(GetRand(std::numeric_limits<uint64_t>::max())),
+      k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+void CWallet::ForEachWalletScript(
+    const std::function<void(const CScript &)> &f) const {
+    LOCK(cs_KeyStore);
+    std::set<CKeyID> setKeyIDs;
+    GetKeys(setKeyIDs);
+    for (const CKeyID &keyid : setKeyIDs) {
+        f(GetScriptForDestination(keyid));
+        CPubKey pubkey;
+        if (GetPubKey(keyid, pubkey)) {
+            f(GetScriptForRawPubKey(pubkey));
+        }
+    }
+    for (const std::pair<const CScriptID, CScript> &item : mapScripts) {
+        f(GetScriptForDestination(item.first));
+        f(item.second);
+    }
+    for (const CScript &script : setWatchOnly) {
+        f(script);
+    }
+}
+
+void CWallet::MarkMineScriptsDirty() {
+    LOCK(cs_KeyStore);
+    fMineScriptsDirty = true;
+    mapMineScripts.clear();
+    mapKeyScripts.clear();
+}
+
+/** The keys a script references, by the pushes of their IDs or pubkeys. */
+static std::set<CKeyID> GetScriptKeys(const CScript &script) {
+    std::set<CKeyID> setKeyIDs;
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    std::vector<uint8_t> vch;
+    while (script.GetOp(pc, opcode, vch)) {
+        CPubKey pubkey(vch);
+        if (vch.size() == CKeyID().size()) {
+            setKeyIDs.insert(CKeyID(uint160(vch)));
+        } else if (pubkey.IsValid()) {
+            setKeyIDs.insert(pubkey.GetID());
+        }
+    }
+    return setKeyIDs;
+}
+
+void CWallet::BuildMineScripts() const {
+    AssertLockHeld(cs_KeyStore);
+    mapMineScripts.clear();
+    ForEachWalletScript([this](const CScript &script) {
+        isminetype mine = ::IsMine(*this, script);
+        if (mine != ISMINE_NO) {
+            mapMineScripts[script] = mine;
+        }
+    });
+
+    // A watch-only P2SH script references the keys of its redeem script.
+    mapKeyScripts.clear();
+    for (const std::pair<const CScriptID, CScript> &item : mapScripts) {
+        const CScript script = GetScriptForDestination(item.first);
+        for (const CKeyID &keyid : GetScriptKeys(item.second)) {
+            mapKeyScripts[keyid].push_back(script);
+            mapKeyScripts[keyid].push_back(item.second);
+        }
+    }
+    for (const CScript &script : setWatchOnly) {
+        std::vector<std::vector<uint8_t>> vSolutions;
+        txnouttype whichType;
+        CScript redeemScript;
+        bool fP2SH =
+            Solver(script, whichType, vSolutions) &&
+            whichType == TX_SCRIPTHASH &&
+            GetCScript(CScriptID(uint160(vSolutions[0])), redeemScript);
+        for (const CKeyID &keyid :
+             GetScriptKeys(fP2SH ? redeemScript : script)) {
+            mapKeyScripts[keyid].push_back(script);
+        }
+    }
+
+    fMineScriptsDirty = false;
+}
+
+std::vector<CScript> CWallet::AddMineScripts(const CPubKey &pubkey) {
+    LOCK(cs_KeyStore);
+    if (fMineScriptsDirty) {
+        BuildMineScripts();
+    }
+
+    // The new key may make scripts and watch-only scripts we already know
+    // spendable or solvable, if they pay to it or to a redeem script that
+    // does. Only those are evaluated again: a new key only makes more scripts
+    // ours, so the entries of the other keys' scripts stay as they are.
+    std::vector<CScript> vScripts;
+    vScripts.push_back(GetScriptForDestination(pubkey.GetID()));
+    vScripts.push_back(GetScriptForRawPubKey(pubkey));
+    auto it = mapKeyScripts.find(pubkey.GetID());
+    if (it != mapKeyScripts.end()) {
+        vScripts.insert(vScripts.end(), it->second.begin(), it->second.end());
+    }
+    for (const CScript &script : vScripts) {
+        isminetype mine = ::IsMine(*this, script);
+        if (mine != ISMINE_NO) {
+            mapMineScripts[script] = mine;
+        }
+    }
+
+    return vScripts;
+}
+
+/**
+ * Whether a script is in the standard form of a P2PK, P2PKH or P2SH script,
+ * in which mapMineScripts lists them if they are ours.
+ */
+static bool IsListedScriptForm(const CScript &script) {
+    if (script.IsPayToScriptHash()) {
+        return true;
+    }
+
+    if (script.size() == 25) {
+        return script[0] == OP_DUP && script[1] == OP_HASH160 &&
+               script[2] == 20 && script[23] == OP_EQUALVERIFY &&
+               script[24] == OP_CHECKSIG;
+    }
+
+    return (script.size() == 35 || script.size() == 67) &&
+           script[0] == script.size() - 2 && script.back() == OP_CHECKSIG;
 }
 
-// Note that this function doesn't distinguish between a 0-valued input, and a
-// not-"is mine" (according to the filter) input.
-Amount CWallet::GetDebit(const CTxIn &txin, const isminefilter &filter) const {
-    LOCK(cs_wallet);
-    std::map<uint256, CWalletTx>::const_iterator mi =
-        mapWallet.find(txin.prevout.GetTxId());
-    if (mi != mapWallet.end()) {
-        const CWalletTx &prev = (*mi).second;
-        if (txin.prevout.GetN() < prev.tx->vout.size()) {
-            if (IsMine(prev.tx->vout[txin.prevout.GetN()]) & filter) {
-                return prev.tx->vout[txin.prevout.GetN()].nValue;
-            }
-        }
+isminetype CWallet::IsMine(const CTxOut &txout) const {
+    const CScript &scriptPubKey = txout.scriptPubKey;
+
+    LOCK(cs_KeyStore);
+    if (fMineScriptsDirty) {
+        BuildMineScripts();
     }
 
-    return Amount(0);
-}
+    auto it = mapMineScripts.find(scriptPubKey);
+    if (it != mapMineScripts.end()) {
+        return it->second;
+    }
 
-isminetype CWallet::IsMine(const CTxOut &txout) const {
-    return ::IsMine(*this, txout.scriptPubKey);
+    // Scripts in other forms, bare multisig among them, are not listed.
+    if (IsListedScriptForm(scriptPubKey) || scriptPubKey.IsUnspendable()) {
+        return ISMINE_NO;
+    }
+
+    return ::IsMine(*this, scriptPubKey);
 }
 
 Amount CWallet::GetCredit(const CTxOut &txout,
@@ -1427,7 +2195,7 @@ bool CWallet::IsChange(const CTxOut &txout) const {
     // outputs are 'the send' and which are 'the change' will need to be
     // implemented (maybe extend CWalletTx to remember which output, if any, was
     // change).
-    if (::IsMine(*this, txout.scriptPubKey)) {
+    if (IsMine(txout)) {
         CTxDestination address;
         if (!ExtractDestination(txout.scriptPubKey, address)) {
             return true;
@@ -1696,72 +2464,442 @@ void CWalletTx::GetAmounts(std::list<COutputEntry> &listReceived,
     }
 }
 
+bool CWalletScriptFilter::Matches(const CScript &scriptPubKey) const {
+    if (setWatchOnly.count(scriptPubKey)) {
+        return true;
+    }
+
+    std::vector<std::vector<uint8_t>> vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions)) {
+        return false;
+    }
+
+    switch (whichType) {
+        case TX_PUBKEY:
+            return setKeyIDs.count(CPubKey(vSolutions[0]).GetID()) != 0;
+        case TX_PUBKEYHASH:
+            return setKeyIDs.count(CKeyID(uint160(vSolutions[0]))) != 0;
+        case TX_SCRIPTHASH:
+            return setScriptIDs.count(CScriptID(uint160(vSolutions[0]))) != 0;
+        case TX_MULTISIG:
+            // IsMine requires all the keys, any one of them is enough here.
+            for (size_t i = 1; i + 1 < vSolutions.size(); i++) {
+                if (setKeyIDs.count(CPubKey(vSolutions[i]).GetID())) {
+                    return true;
+                }
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+bool CWalletScriptFilter::MatchesAnyOutput(const CTransaction &tx) const {
+    for (const CTxOut &txout : tx.vout) {
+        if (Matches(txout.scriptPubKey)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CWallet::GetScriptFilter(CWalletScriptFilter &filter) const {
+    LOCK(cs_KeyStore);
+    GetKeys(filter.setKeyIDs);
+    filter.setScriptIDs.clear();
+    for (const std::pair<const CScriptID, CScript> &item : mapScripts) {
+        filter.setScriptIDs.insert(item.first);
+    }
+    filter.setWatchOnly = setWatchOnly;
+
+    filter.setElements.clear();
+    ForEachWalletScript([&filter](const CScript &script) {
+        filter.setElements.emplace(script.begin(), script.end());
+    });
+}
+
+namespace {
+
+/**
+ * Reads the blocks of a rescan on a few threads, up to
+ * WALLET_RESCAN_READ_AHEAD blocks ahead of the one being scanned, and no
+ * further once the blocks waiting to be scanned add up to
+ * WALLET_RESCAN_READ_AHEAD_BYTES. The threads only read and deserialize
+ * blocks, and take no lock.
+ *
+ * If the block filter index is enabled, blocks whose filter matches none of
+ * the given scripts are not read at all, and are returned empty. No block is
+ * skipped if no scripts are given.
+ */
+class BlockReadAhead {
+public:
+    typedef std::shared_ptr<const GCSFilter::ElementSet> ElementsRef;
+
+    BlockReadAhead(const std::vector<CBlockIndex *> &vIndexIn,
+                   const Config &configIn, ElementsRef elementsIn)
+        : vIndex(vIndexIn), config(configIn), elements(std::move(elementsIn)),
+          nNextRead(0), nNextScan(0), nBytesAhead(0), fStop(false) {
+        int nThreads =
+            std::max(1, std::min(GetNumCores(), MAX_WALLET_RESCAN_THREADS));
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back(&BlockReadAhead::ThreadRead, this);
+        }
+    }
+
+    ~BlockReadAhead() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_all();
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * Wait for the n-th block, blocks being taken in order. Returns false if
+     * it could not be read.
+     */
+    bool Get(size_t n, CBlock &block) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return mapRead.count(n) != 0; });
+        std::map<size_t, Entry>::iterator it = mapRead.find(n);
+        Entry entry = std::move(it->second);
+        mapRead.erase(it);
+        nNextScan = n + 1;
+        nBytesAhead -= entry.nBytes;
+        const ElementsRef elementsNow = elements;
+        lock.unlock();
+        cond.notify_all();
+
+        // A block skipped before the wallet's scripts changed may pay to the
+        // new ones.
+        if (entry.elementsSkipped && entry.elementsSkipped != elementsNow &&
+            !SkipBlock(vIndex[n], elementsNow)) {
+            return ReadBlockFromDisk(block, vIndex[n], config);
+        }
+
+        block = std::move(entry.block);
+        return entry.fRead;
+    }
+
+    /** Match the next block filters against a new set of scripts. */
+    void SetElements(ElementsRef elementsIn) {
+        std::lock_guard<std::mutex> lock(mutex);
+        elements = std::move(elementsIn);
+    }
+
+private:
+    struct Entry {
+        bool fRead;
+        size_t nBytes;
+        //! The scripts the block filter was matched against, if it was
+        //! skipped.
+        ElementsRef elementsSkipped;
+        CBlock block;
+    };
+
+    const std::vector<CBlockIndex *> &vIndex;
+    const Config &config;
+    std::mutex mutex;
+    std::condition_variable cond;
+    ElementsRef elements;
+    size_t nNextRead;
+    size_t nNextScan;
+    //! Serialized size of the blocks in mapRead
+    size_t nBytesAhead;
+    bool fStop;
+    std::map<size_t, Entry> mapRead;
+    std::vector<std::thread> threads;
+
+    /** Whether the filter of the block shows it does not involve us. */
+    static bool SkipBlock(const CBlockIndex *pindex,
+                          const ElementsRef &elementsIn) {
+        if (!g_blockfilterindex || !elementsIn) {
+            return false;
+        }
+        BlockFilter filter;
+        return g_blockfilterindex->LookupFilter(pindex, filter) &&
+               !filter.GetFilter().MatchAny(*elementsIn);
+    }
+
+    void ThreadRead() {
+        while (true) {
+            size_t n;
+            ElementsRef elementsNow;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&] {
+                    // The blocks in mapRead are all ahead of the one being
+                    // scanned, which is being read or is the next one to be.
+                    return fStop || nNextRead >= vIndex.size() ||
+                           (nNextRead < nNextScan + WALLET_RESCAN_READ_AHEAD &&
+                            nBytesAhead < WALLET_RESCAN_READ_AHEAD_BYTES);
+                });
+                if (fStop || nNextRead >= vIndex.size()) {
+                    return;
+                }
+                n = nNextRead++;
+                elementsNow = elements;
+            }
+
+            Entry entry;
+            entry.nBytes = 0;
+            if (SkipBlock(vIndex[n], elementsNow)) {
+                entry.fRead = true;
+                entry.elementsSkipped = elementsNow;
+            } else {
+                entry.fRead = ReadBlockFromDisk(entry.block, vIndex[n], config);
+                if (entry.fRead) {
+                    entry.nBytes = ::GetSerializeSize(entry.block, SER_DISK,
+                                                      CLIENT_VERSION);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                nBytesAhead += entry.nBytes;
+                mapRead.emplace(n, std::move(entry));
+            }
+            cond.notify_all();
+        }
+    }
+};
+
+} // namespace
+
+/**
+ * Whether AddToWalletIfInvolvingMe may do anything with a transaction: it pays
+ * to a script of the wallet, is a wallet transaction already, spends from one,
+ * or spends the same output as one.
+ */
+static bool MayInvolveWallet(const CTransaction &tx,
+                             const CWalletScriptFilter &filter,
+                             const std::set<uint256> &setWalletTxIds,
+                             const std::set<COutPoint> &setWalletSpent) {
+    if (setWalletTxIds.count(tx.GetId())) {
+        return true;
+    }
+    if (!tx.IsCoinBase()) {
+        for (const CTxIn &txin : tx.vin) {
+            if (setWalletTxIds.count(txin.prevout.GetTxId()) ||
+                setWalletSpent.count(txin.prevout)) {
+                return true;
+            }
+        }
+    }
+    return filter.MatchesAnyOutput(tx);
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions from or to
  * us. If fUpdate is true, found transactions that already exist in the wallet
  * will be updated.
  *
+ * Blocks are read ahead on a few threads and matched against a copy of the
+ * wallet's scripts without holding any lock. cs_main and cs_wallet are only
+ * taken to list the blocks up to the tip, and to add the transactions that
+ * matched to the wallet. With -blockfilterindex, blocks whose filter matches
+ * none of the wallet's scripts, nor those of the outputs spent by wallet
+ * transactions that are not in the chain, are skipped without being read,
+ * unless the wallet has bare multisig outputs, whose scripts cannot be
+ * listed.
+ *
  * Returns pointer to the first block in the last contiguous range that was
  * successfully scanned or elided (elided if pIndexStart points at a block
  * before CWallet::nTimeFirstKey). Returns null if there is no such range, or
  * the range doesn't include chainActive.Tip().
  */
-CBlockIndex *CWallet::ScanForWalletTransactions(CBlockIndex *pindexStart,
-                                                bool fUpdate) {
-    LOCK2(cs_main, cs_wallet);
-
+CBlockIndex *
+CWallet::ScanForWalletTransactions(CBlockIndex *pindexStart,
+                                  const WalletRescanReserver &reserver,
+                                  bool fUpdate) {
+    assert(reserver.isReserved());
     int64_t nNow = GetTime();
 
     CBlockIndex *pindex = pindexStart;
     CBlockIndex *ret = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
+
+    // What the transactions of the blocks are matched against. The
+    // transactions of the wallet and the outputs they spend are updated as
+    // transactions are found.
+    CWalletScriptFilter filter;
+    int64_t nFilterKeypoolIndex;
+    std::set<uint256> setWalletTxIds;
+    std::set<COutPoint> setWalletSpent;
+    // A block may conflict with a wallet transaction that is not in the chain
+    // by spending one of the same outputs, which need not be ours. Block
+    // filters also list the scripts of the outputs a block spends, so these
+    // scripts are matched as well, and no block is skipped if the wallet does
+    // not know them all, nor if it has bare multisig outputs.
+    GCSFilter::ElementSet setSpentElements;
+    bool fSkipBlocks = true;
+    // Bare multisig scripts paying to our keys cannot all be listed, so no
+    // block is skipped once the wallet has received any.
+    auto PaysToBareMultisig = [this](const CTransaction &tx) {
+        for (const CTxOut &txout : tx.vout) {
+            const CScript &script = txout.scriptPubKey;
+            if (!script.empty() && script.back() == OP_CHECKMULTISIG &&
+                IsMine(txout) != ISMINE_NO) {
+                return true;
+            }
+        }
+        return false;
+    };
+    {
+        LOCK2(cs_main, cs_wallet);
 
-    // No need to read and scan block, if block was created before our wallet
-    // birthday (as adjusted for block time variability)
-    while (pindex && nTimeFirstKey &&
-           (pindex->GetBlockTime() < (nTimeFirstKey - 7200))) {
-        pindex = chainActive.Next(pindex);
+        // No need to read and scan block, if block was created before our
+        // wallet birthday (as adjusted for block time variability)
+        while (pindex && nTimeFirstKey &&
+               (pindex->GetBlockTime() < (nTimeFirstKey - 7200))) {
+            pindex = chainActive.Next(pindex);
+        }
+
+        // Show rescan progress in GUI as dialog or on splashscreen, if -rescan
+        // on startup.
+        ShowProgress(_("Rescanning..."), 0);
+        dProgressStart =
+            GuessVerificationProgress(chainParams.TxData(), pindex);
+        dProgressTip =
+            GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
+
+        GetScriptFilter(filter);
+        nFilterKeypoolIndex = m_max_keypool_index;
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet) {
+            setWalletTxIds.insert(item.first);
+
+            const CWalletTx &wtx = item.second;
+            if (fSkipBlocks && PaysToBareMultisig(*wtx.tx)) {
+                fSkipBlocks = false;
+            }
+            if (wtx.IsCoinBase() || wtx.GetDepthInMainChain() > 0) {
+                continue;
+            }
+            for (const CTxIn &txin : wtx.tx->vin) {
+                std::map<uint256, CWalletTx>::const_iterator mi =
+                    mapWallet.find(txin.prevout.GetTxId());
+                if (mi == mapWallet.end() ||
+                    txin.prevout.GetN() >= mi->second.tx->vout.size()) {
+                    fSkipBlocks = false;
+                    continue;
+                }
+                const CScript &script =
+                    mi->second.tx->vout[txin.prevout.GetN()].scriptPubKey;
+                setSpentElements.emplace(script.begin(), script.end());
+            }
+        }
+        for (const std::pair<const COutPoint, uint256> &item : mapTxSpends) {
+            setWalletSpent.insert(item.first);
+        }
     }
 
-    // Show rescan progress in GUI as dialog or on splashscreen, if -rescan on
-    // startup.
-    ShowProgress(_("Rescanning..."), 0);
-    double dProgressStart =
-        GuessVerificationProgress(chainParams.TxData(), pindex);
-    double dProgressTip =
-        GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
+    // What the block filters are matched against, if blocks may be skipped.
+    auto GetFilterElements =
+        [&]() -> std::shared_ptr<const GCSFilter::ElementSet> {
+        if (!fSkipBlocks) {
+            return nullptr;
+        }
+        std::shared_ptr<GCSFilter::ElementSet> elements =
+            std::make_shared<GCSFilter::ElementSet>(filter.setElements);
+        elements->insert(setSpentElements.begin(), setSpentElements.end());
+        return elements;
+    };
+
+    std::vector<CBlockIndex *> vIndex;
     while (pindex) {
-        if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
-            ShowProgress(
-                _("Rescanning..."),
-                std::max(1,
-                         std::min(99, (int)((GuessVerificationProgress(
-                                                 chainParams.TxData(), pindex) -
-                                             dProgressStart) /
-                                            (dProgressTip - dProgressStart) *
-                                            100))));
+        // Blocks up to the tip are listed under cs_main, and then scanned
+        // without it. Blocks connected in the meantime are scanned in the next
+        // round.
+        vIndex.clear();
+        {
+            LOCK(cs_main);
+            for (; pindex; pindex = chainActive.Next(pindex)) {
+                vIndex.push_back(pindex);
+            }
         }
 
-        CBlock block;
-        if (ReadBlockFromDisk(block, pindex, GetConfig())) {
-            for (size_t posInBlock = 0; posInBlock < block.vtx.size();
-                 ++posInBlock) {
-                AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex,
-                                         posInBlock, fUpdate);
+        BlockReadAhead reader(vIndex, GetConfig(), GetFilterElements());
+        for (size_t i = 0; i < vIndex.size(); i++) {
+            pindex = vIndex[i];
+            if (pindex->nHeight % 100 == 0 &&
+                dProgressTip - dProgressStart > 0.0) {
+                ShowProgress(
+                    _("Rescanning..."),
+                    std::max(1, std::min(99, (int)((GuessVerificationProgress(
+                                                        chainParams.TxData(),
+                                                        pindex) -
+                                                    dProgressStart) /
+                                                   (dProgressTip -
+                                                    dProgressStart) *
+                                                   100))));
+            }
+
+            CBlock block;
+            if (reader.Get(i, block)) {
+                std::vector<size_t> vMatches;
+                for (size_t posInBlock = 0; posInBlock < block.vtx.size();
+                     ++posInBlock) {
+                    if (MayInvolveWallet(*block.vtx[posInBlock], filter,
+                                         setWalletTxIds, setWalletSpent)) {
+                        vMatches.push_back(posInBlock);
+                    }
+                }
+
+                if (!vMatches.empty()) {
+                    LOCK2(cs_main, cs_wallet);
+                    // The block was read without cs_main, and may have been
+                    // disconnected since. The scan then resumes from the
+                    // fork point.
+                    if (!chainActive.Contains(pindex)) {
+                        break;
+                    }
+                    for (size_t posInBlock : vMatches) {
+                        const CTransactionRef &ptx = block.vtx[posInBlock];
+                        AddToWalletIfInvolvingMe(ptx, pindex, posInBlock,
+                                                 fUpdate);
+                        if (mapWallet.count(ptx->GetId())) {
+                            setWalletTxIds.insert(ptx->GetId());
+                            for (const CTxIn &txin : ptx->vin) {
+                                setWalletSpent.insert(txin.prevout);
+                            }
+                            if (fSkipBlocks && PaysToBareMultisig(*ptx)) {
+                                fSkipBlocks = false;
+                                reader.SetElements(GetFilterElements());
+                            }
+                        }
+                    }
+
+                    // Used keypool keys get replaced by new ones, which the
+                    // next blocks may pay to.
+                    if (m_max_keypool_index != nFilterKeypoolIndex) {
+                        GetScriptFilter(filter);
+                        nFilterKeypoolIndex = m_max_keypool_index;
+                        reader.SetElements(GetFilterElements());
+                    }
+                }
+
+                if (!ret) {
+                    ret = pindex;
+                }
+            } else {
+                ret = nullptr;
             }
-            if (!ret) {
-                ret = pindex;
+
+            if (GetTime() >= nNow + 60) {
+                nNow = GetTime();
+                LogPrintf("Still rescanning. At block %d. Progress=%f\n",
+                          pindex->nHeight,
+                          GuessVerificationProgress(chainParams.TxData(),
+                                                    pindex));
             }
-        } else {
-            ret = nullptr;
         }
 
-        pindex = chainActive.Next(pindex);
-        if (GetTime() >= nNow + 60) {
-            nNow = GetTime();
-            LogPrintf("Still rescanning. At block %d. Progress=%f\n",
-                      pindex->nHeight,
-                      GuessVerificationProgress(chainParams.TxData(), pindex));
-        }
+        LOCK(cs_main);
+        pindex = chainActive.Next(chainActive.FindFork(pindex));
     }
 
     // Hide progress dialog in GUI.
@@ -2133,86 +3271,55 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime,
  *
  * @{
  */
-Amount CWallet::GetBalance() const {
+CWalletBalances CWallet::GetBalances() const {
     LOCK2(cs_main, cs_wallet);
 
-    Amount nTotal(0);
-    for (const std::pair<uint256, CWalletTx> &p : mapWallet) {
-        const CWalletTx *pcoin = &p.second;
-        if (pcoin->IsTrusted()) {
-            nTotal += pcoin->GetAvailableCredit();
+    if (fBalancesDirty) {
+        balancesCounted = CWalletBalances();
+        mapBalancesCounted.clear();
+        setBalancesRecount.clear();
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet) {
+            if (CountBalances(item.first)) {
+                setBalancesRecount.insert(item.first);
+            }
+        }
+        fBalancesDirty = false;
+    } else {
+        std::set<uint256>::iterator it = setBalancesRecount.begin();
+        while (it != setBalancesRecount.end()) {
+            if (CountBalances(*it)) {
+                ++it;
+            } else {
+                it = setBalancesRecount.erase(it);
+            }
         }
     }
 
-    return nTotal;
+    return balancesCounted;
 }
 
-Amount CWallet::GetUnconfirmedBalance() const {
-    LOCK2(cs_main, cs_wallet);
-
-    Amount nTotal(0);
-    for (const std::pair<uint256, CWalletTx> &p : mapWallet) {
-        const CWalletTx *pcoin = &p.second;
-        if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 &&
-            pcoin->InMempool()) {
-            nTotal += pcoin->GetAvailableCredit();
-        }
-    }
+Amount CWallet::GetBalance() const {
+    return GetBalances().nTrusted;
+}
 
-    return nTotal;
+Amount CWallet::GetUnconfirmedBalance() const {
+    return GetBalances().nUntrustedPending;
 }
 
 Amount CWallet::GetImmatureBalance() const {
-    LOCK2(cs_main, cs_wallet);
-
-    Amount nTotal(0);
-    for (const std::pair<uint256, CWalletTx> &p : mapWallet) {
-        const CWalletTx *pcoin = &p.second;
-        nTotal += pcoin->GetImmatureCredit();
-    }
-
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 Amount CWallet::GetWatchOnlyBalance() const {
-    LOCK2(cs_main, cs_wallet);
-
-    Amount nTotal(0);
-    for (const std::pair<uint256, CWalletTx> &p : mapWallet) {
-        const CWalletTx *pcoin = &p.second;
-        if (pcoin->IsTrusted()) {
-            nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnlyTrusted;
 }
 
 Amount CWallet::GetUnconfirmedWatchOnlyBalance() const {
-    LOCK2(cs_main, cs_wallet);
-
-    Amount nTotal(0);
-    for (const std::pair<uint256, CWalletTx> &p : mapWallet) {
-        const CWalletTx *pcoin = &p.second;
-        if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 &&
-            pcoin->InMempool()) {
-            nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnlyUntrustedPending;
 }
 
 Amount CWallet::GetImmatureWatchOnlyBalance() const {
-    LOCK2(cs_main, cs_wallet);
-
-    Amount nTotal(0);
-    for (const std::pair<uint256, CWalletTx> &p : mapWallet) {
-        const CWalletTx *pcoin = &p.second;
-        nTotal += pcoin->GetImmatureWatchOnlyCredit();
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnlyImmature;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2267,9 +3374,22 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe,
     vCoins.clear();
 
     LOCK2(cs_main, cs_wallet);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end(); ++it) {
-        const uint256 &wtxid = it->first;
+    // Walk the wallet's own outputs rather than every wallet transaction. The
+    // outputs of a transaction are next to each other in the set, so they are
+    // checked a transaction at a time.
+    const std::set<COutPoint> &setUTXO = GetWalletUTXO();
+    std::set<COutPoint>::const_iterator itOut = setUTXO.begin();
+    while (itOut != setUTXO.end()) {
+        const uint256 wtxid = itOut->GetTxId();
+        const std::set<COutPoint>::const_iterator itFirst = itOut;
+        while (itOut != setUTXO.end() && itOut->GetTxId() == wtxid) {
+            ++itOut;
+        }
+
+        std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+        if (it == mapWallet.end()) {
+            continue;
+        }
         const CWalletTx *pcoin = &(*it).second;
 
         if (!CheckFinalTx(*pcoin)) {
@@ -2318,7 +3438,9 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe,
             continue;
         }
 
-        for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
+        for (std::set<COutPoint>::const_iterator itCoin = itFirst;
+             itCoin != itOut; ++itCoin) {
+            const unsigned int i = itCoin->GetN();
             isminetype mine = IsMine(pcoin->tx->vout[i]);
             if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
                 !IsLockedCoin((*it).first, i) &&
@@ -2340,8 +3462,8 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe,
 }
 
 static void ApproximateBestSubset(
-    std::vector<std::pair<Amount, std::pair<const CWalletTx *, unsigned int>>>
-        vValue,
+    const std::vector<
+        std::pair<Amount, std::pair<const CWalletTx *, unsigned int>>> &vValue,
     const Amount nTotalLower, const Amount nTargetValue,
     std::vector<char> &vfBest, Amount &nBest, int iterations = 1000) {
     std::vector<char> vfIncluded;
@@ -2381,11 +3503,123 @@ static void ApproximateBestSubset(
     }
 }
 
+/**
+ * Search, by branch and bound, for the subset of vValue exceeding nTargetValue
+ * by at most nMaxExcess which wastes the least: its excess plus the fee its
+ * inputs cost, at nInputFee each. Of two subsets wasting as much, the one with
+ * fewer inputs is taken. vValue must be sorted by decreasing value. Larger
+ * coins are tried first and the search gives up after BNB_MAX_TRIES steps,
+ * keeping the best subset found so far. Each step is a binary search, so the
+ * work is bounded whatever the number of coins.
+ */
+static bool SelectCoinsBnB(
+    const std::vector<
+        std::pair<Amount, std::pair<const CWalletTx *, unsigned int>>> &vValue,
+    const Amount nTargetValue, const Amount nMaxExcess, const Amount nInputFee,
+    std::vector<char> &vfBest, Amount &nBest) {
+    typedef std::pair<Amount, std::pair<const CWalletTx *, unsigned int>>
+        CoinValue;
+
+    // Total value of the coins from each position on.
+    std::vector<Amount> vRemaining(vValue.size() + 1, Amount(0));
+    for (size_t i = vValue.size(); i > 0; i--) {
+        vRemaining[i - 1] = vRemaining[i] + vValue[i - 1].first;
+    }
+
+    if (vRemaining[0] < nTargetValue) {
+        return false;
+    }
+
+    std::vector<size_t> vIncluded;
+    std::vector<size_t> vBestIncluded;
+    bool fFound = false;
+    Amount nBestWaste(0);
+    Amount nValue(0);
+    size_t nNext = 0;
+    for (size_t nTries = 0; nTries < BNB_MAX_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nValue >= nTargetValue) {
+            // Coins which would not improve on the best subset are never
+            // included, so this one is better.
+            vBestIncluded = vIncluded;
+            nBestWaste = nValue - nTargetValue +
+                         int64_t(vIncluded.size()) * nInputFee;
+            fFound = true;
+            fBacktrack = true;
+        } else {
+            // The excess the next coin may bring, for the subset it would
+            // complete to improve on the best one. Adding more coins after it
+            // only costs more, so larger coins can be skipped.
+            const size_t nInputs = vIncluded.size() + 1;
+            Amount nExcessAllowed = nMaxExcess;
+            if (fFound) {
+                nExcessAllowed = std::min(
+                    nExcessAllowed,
+                    nBestWaste - int64_t(nInputs) * nInputFee -
+                        Amount(nInputs < vBestIncluded.size() ? 0 : 1));
+            }
+
+            if (nExcessAllowed < Amount(0)) {
+                fBacktrack = true;
+            } else {
+                const Amount nMaxCoin = nTargetValue + nExcessAllowed - nValue;
+                nNext = std::lower_bound(vValue.begin() + nNext, vValue.end(),
+                                         nMaxCoin,
+                                         [](const CoinValue &coin, Amount n) {
+                                             return coin.first > n;
+                                         }) -
+                        vValue.begin();
+                if (nValue + vRemaining[nNext] < nTargetValue) {
+                    fBacktrack = true;
+                } else {
+                    vIncluded.push_back(nNext);
+                    nValue += vValue[nNext].first;
+                    nNext++;
+                }
+            }
+        }
+
+        if (fBacktrack) {
+            if (vIncluded.empty()) {
+                // Every subset was tried.
+                break;
+            }
+
+            // Leave the last coin included out. Including one of the same
+            // value after it instead would only lead to subsets already
+            // tried, so skip those as well.
+            const size_t nLast = vIncluded.back();
+            vIncluded.pop_back();
+            nValue -= vValue[nLast].first;
+            nNext = std::upper_bound(vValue.begin() + nLast, vValue.end(),
+                                     vValue[nLast].first,
+                                     [](Amount n, const CoinValue &coin) {
+                                         return n > coin.first;
+                                     }) -
+                    vValue.begin();
+        }
+    }
+
+    if (!fFound) {
+        return false;
+    }
+
+    vfBest.assign(vValue.size(), false);
+    nBest = Amount(0);
+    for (size_t i : vBestIncluded) {
+        vfBest[i] = true;
+        nBest += vValue[i].first;
+    }
+
+    return true;
+}
+
 bool CWallet::SelectCoinsMinConf(
     const Amount nTargetValue, const int nConfMine, const int nConfTheirs,
     const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
     std::set<std::pair<const CWalletTx *, unsigned int>> &setCoinsRet,
-    Amount &nValueRet) const {
+    Amount &nValueRet, const Amount nMaxExcess,
+    const Amount nInputFee) const {
     setCoinsRet.clear();
     nValueRet = Amount(0);
 
@@ -2412,7 +3646,9 @@ bool CWallet::SelectCoinsMinConf(
             continue;
         }
 
-        if (!mempool.TransactionWithinChainLimit(pcoin->GetId(),
+        // Transactions in a block are no longer in the mempool.
+        if (output.nDepth == 0 &&
+            !mempool.TransactionWithinChainLimit(pcoin->GetId(),
                                                  nMaxAncestors)) {
             continue;
         }
@@ -2454,16 +3690,36 @@ bool CWallet::SelectCoinsMinConf(
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
     std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
     std::reverse(vValue.begin(), vValue.end());
     std::vector<char> vfBest;
     Amount nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
+    // Look for a subset needing no change first.
+    if (SelectCoinsBnB(vValue, nTargetValue, nMaxExcess, nInputFee, vfBest,
+                       nBest)) {
+        for (size_t i = 0; i < vValue.size(); i++) {
+            if (vfBest[i]) {
+                setCoinsRet.insert(vValue[i].second);
+            }
+        }
+
+        nValueRet += nBest;
+        LogPrint(BCLog::SELECTCOINS,
+                 "SelectCoins() branch and bound: %u coins, total %s\n",
+                 setCoinsRet.size(), FormatMoney(nBest));
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation, with fewer iterations
+    // over large sets of coins.
+    const int nIterations = std::max<size_t>(
+        1, std::min<size_t>(1000, KNAPSACK_MAX_STEPS / vValue.size()));
+    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest,
+                          nIterations);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE) {
         ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE,
-                              vfBest, nBest);
+                              vfBest, nBest, nIterations);
     }
 
     // If we have a bigger coin and (either the stochastic approximation didn't
@@ -2500,7 +3756,8 @@ bool CWallet::SelectCoinsMinConf(
 bool CWallet::SelectCoins(
     const std::vector<COutput> &vAvailableCoins, const Amount nTargetValue,
     std::set<std::pair<const CWalletTx *, unsigned int>> &setCoinsRet,
-    Amount &nValueRet, const CCoinControl *coinControl) const {
+    Amount &nValueRet, const Amount nMaxExcess, const Amount nInputFee,
+    const CCoinControl *coinControl) const {
     std::vector<COutput> vCoins(vAvailableCoins);
 
     // coin control -> return all selected outputs (we want all selected to go
@@ -2562,30 +3819,30 @@ bool CWallet::SelectCoins(
     bool fRejectLongChains = gArgs.GetBoolArg(
         "-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
+    const Amount nTarget = nTargetValue - nValueFromPresetInputs;
     bool res =
         nTargetValue <= nValueFromPresetInputs ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0,
-                           vCoins, setCoinsRet, nValueRet) ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0,
-                           vCoins, setCoinsRet, nValueRet) ||
+        SelectCoinsMinConf(nTarget, 1, 6, 0, vCoins, setCoinsRet, nValueRet,
+                           nMaxExcess, nInputFee) ||
+        SelectCoinsMinConf(nTarget, 1, 1, 0, vCoins, setCoinsRet, nValueRet,
+                           nMaxExcess, nInputFee) ||
         (bSpendZeroConfChange &&
-         SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2,
-                            vCoins, setCoinsRet, nValueRet)) ||
+         SelectCoinsMinConf(nTarget, 0, 1, 2, vCoins, setCoinsRet, nValueRet,
+                            nMaxExcess, nInputFee)) ||
         (bSpendZeroConfChange &&
-         SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1,
+         SelectCoinsMinConf(nTarget, 0, 1,
                             std::min((size_t)4, nMaxChainLength / 3), vCoins,
-                            setCoinsRet, nValueRet)) ||
+                            setCoinsRet, nValueRet, nMaxExcess, nInputFee)) ||
         (bSpendZeroConfChange &&
-         SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1,
-                            nMaxChainLength / 2, vCoins, setCoinsRet,
-                            nValueRet)) ||
+         SelectCoinsMinConf(nTarget, 0, 1, nMaxChainLength / 2, vCoins,
+                            setCoinsRet, nValueRet, nMaxExcess, nInputFee)) ||
         (bSpendZeroConfChange &&
-         SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1,
-                            nMaxChainLength, vCoins, setCoinsRet, nValueRet)) ||
+         SelectCoinsMinConf(nTarget, 0, 1, nMaxChainLength, vCoins,
+                            setCoinsRet, nValueRet, nMaxExcess, nInputFee)) ||
         (bSpendZeroConfChange && !fRejectLongChains &&
-         SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1,
+         SelectCoinsMinConf(nTarget, 0, 1,
                             std::numeric_limits<uint64_t>::max(), vCoins,
-                            setCoinsRet, nValueRet));
+                            setCoinsRet, nValueRet, nMaxExcess, nInputFee));
 
     // Because SelectCoinsMinConf clears the setCoinsRet, we now add the
     // possible inputs to the coinset.
@@ -2734,6 +3991,35 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
         std::vector<COutput> vAvailableCoins;
         AvailableCoins(vAvailableCoins, true, coinControl);
 
+        // Dust change is added to the fee rather than paid to an output, so
+        // coins exceeding the amount by less than the dust threshold need no
+        // change. Not when the fee is subtracted from the recipients, as dust
+        // change is then raised at their expense.
+        Amount nMaxExcess(0);
+        const Amount nDustChange =
+            CTxOut(Amount(0), GetScriptForDestination(CKeyID()))
+                .GetDustThreshold(dustRelayFee);
+        if (nSubtractFeeFromAmount == 0 && nDustChange > Amount(0)) {
+            nMaxExcess = nDustChange - Amount(1);
+        }
+
+        // Allow to override the default confirmation target over the
+        // CoinControl instance.
+        int currentConfirmationTarget = nTxConfirmTarget;
+        if (coinControl && coinControl->nConfirmTarget > 0) {
+            currentConfirmationTarget = coinControl->nConfirmTarget;
+        }
+
+        // The fee of spending a typical P2PKH input, sized as in
+        // CTxOut::GetDustThreshold. Coin selection counts it as waste, so it
+        // prefers sets of fewer coins.
+        const unsigned int nInputBytes = 32 + 4 + 1 + 107 + 4;
+        Amount nInputFee =
+            GetMinimumFee(nInputBytes, currentConfirmationTarget, mempool);
+        if (coinControl && coinControl->fOverrideFeeRate) {
+            nInputFee = coinControl->nFeeRate.GetFee(nInputBytes);
+        }
+
         nFeeRet = Amount(0);
         // Start with no fee and loop until there is enough fee.
         while (true) {
@@ -2790,7 +4076,7 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
             Amount nValueIn(0);
             setCoins.clear();
             if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins,
-                             nValueIn, coinControl)) {
+                             nValueIn, nMaxExcess, nInputFee, coinControl)) {
                 strFailReason = _("Insufficient funds");
                 return false;
             }
@@ -2927,13 +4213,6 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
                 vin.scriptSig = CScript();
             }
 
-            // Allow to override the default confirmation target over the
-            // CoinControl instance.
-            int currentConfirmationTarget = nTxConfirmTarget;
-            if (coinControl && coinControl->nConfirmTarget > 0) {
-                currentConfirmationTarget = coinControl->nConfirmTarget;
-            }
-
             Amount nFeeNeeded =
                 GetMinimumFee(nBytes, currentConfirmationTarget, mempool);
             if (coinControl && nFeeNeeded > Amount(0) &&
@@ -3002,24 +4281,22 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
             SigHashType sigHashType = SigHashType().withForkId();
 
             CTransaction txNewConst(txNew);
-            int nIn = 0;
+            std::vector<CTxOut> vSpent;
+            vSpent.reserve(setCoins.size());
             for (const auto &coin : setCoins) {
-                const CScript &scriptPubKey =
-                    coin.first->tx->vout[coin.second].scriptPubKey;
-                SignatureData sigdata;
-
-                if (!ProduceSignature(
-                        TransactionSignatureCreator(
-                            this, &txNewConst, nIn,
-                            coin.first->tx->vout[coin.second].nValue,
-                            sigHashType),
-                        scriptPubKey, sigdata)) {
-                    strFailReason = _("Signing transaction failed");
-                    return false;
-                }
+                vSpent.push_back(coin.first->tx->vout[coin.second]);
+            }
 
-                UpdateTransaction(txNew, nIn, sigdata);
-                nIn++;
+            std::vector<SignatureData> vSigData;
+            if (!ProduceSignatures(*this, txNewConst,
+                                   PrecomputedTransactionData(txNewConst),
+                                   vSpent, sigHashType, vSigData)) {
+                strFailReason = _("Signing transaction failed");
+                return false;
+            }
+
+            for (size_t nIn = 0; nIn < vSigData.size(); nIn++) {
+                UpdateTransaction(txNew, nIn, vSigData[nIn]);
             }
         }
 
@@ -3205,6 +4482,9 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256> &vHashIn,
     for (uint256 hash : vHashOut) {
         mapWallet.erase(hash);
     }
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
+    fTxsByBlockDirty = true;
 
     if (nZapSelectTxRet == DB_NEED_REWRITE) {
         if (dbw->Rewrite("\x04pool")) {
@@ -3250,6 +4530,14 @@ DBErrors CWallet::ZapWalletTx(std::vector<CWalletTx> &vWtx) {
 bool CWallet::SetAddressBook(const CTxDestination &address,
                              const std::string &strName,
                              const std::string &strPurpose) {
+    CWalletDB walletdb(*dbw);
+    return SetAddressBookWithDB(walletdb, address, strName, strPurpose);
+}
+
+bool CWallet::SetAddressBookWithDB(CWalletDB &walletdb,
+                                   const CTxDestination &address,
+                                   const std::string &strName,
+                                   const std::string &strPurpose) {
     bool fUpdated = false;
     {
         // mapAddressBook
@@ -3268,12 +4556,11 @@ bool CWallet::SetAddressBook(const CTxDestination &address,
                              ::IsMine(*this, address) != ISMINE_NO, strPurpose,
                              (fUpdated ? CT_UPDATED : CT_NEW));
 
-    if (!strPurpose.empty() &&
-        !CWalletDB(*dbw).WritePurpose(address, strPurpose)) {
+    if (!strPurpose.empty() && !walletdb.WritePurpose(address, strPurpose)) {
         return false;
     }
 
-    return CWalletDB(*dbw).WriteName(address, strName);
+    return walletdb.WriteName(address, strName);
 }
 
 bool CWallet::DelAddressBook(const CTxDestination &address) {
@@ -3393,29 +4680,54 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize) {
         // don't create extra internal keys
         missingInternal = 0;
     }
-    bool internal = false;
+    // The keys, their pool entries and the HD chain counter are written in
+    // batches, each committed as one database transaction.
     CWalletDB walletdb(*dbw);
-    for (int64_t i = missingInternal + missingExternal; i--;) {
-        if (i < missingInternal) {
-            internal = true;
-        }
-
-        // How in the hell did you use so many keys?
-        assert(m_max_keypool_index < std::numeric_limits<int64_t>::max());
-        int64_t index = ++m_max_keypool_index;
-
-        CPubKey pubkey(GenerateNewKey(walletdb, internal));
-        if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
-            throw std::runtime_error(std::string(__func__) +
-                                     ": writing generated key failed");
-        }
+    for (bool internal : {false, true}) {
+        int64_t nMissing = internal ? missingInternal : missingExternal;
+        while (nMissing > 0) {
+            int64_t nBatch = std::min(nMissing, KEYPOOL_TOPUP_BATCH_SIZE);
+            CWalletDBTxn txn(walletdb);
+            // Keys handed out must be on disk, so the batch's changes in
+            // memory are undone unless it is committed.
+            KeypoolBatch batch;
+            batch.hdChain = hdChain;
+            batch.nMaxKeypoolIndex = m_max_keypool_index;
+            bool fCommitted = false;
+            try {
+                GenerateNewKeys(walletdb, internal, nBatch, batch);
+                for (const CPubKey &pubkey : batch.vKeys) {
+                    // How in the hell did you use so many keys?
+                    assert(m_max_keypool_index <
+                           std::numeric_limits<int64_t>::max());
+                    int64_t index = ++m_max_keypool_index;
+
+                    if (!walletdb.WritePool(index,
+                                            CKeyPool(pubkey, internal))) {
+                        throw std::runtime_error(
+                            std::string(__func__) +
+                            ": writing generated key failed");
+                    }
 
-        if (internal) {
-            setInternalKeyPool.insert(index);
-        } else {
-            setExternalKeyPool.insert(index);
+                    if (internal) {
+                        setInternalKeyPool.insert(index);
+                    } else {
+                        setExternalKeyPool.insert(index);
+                    }
+                    m_pool_key_to_index[pubkey.GetID()] = index;
+                }
+                fCommitted = txn.Commit();
+            } catch (...) {
+                UndoKeypoolBatch(batch);
+                throw;
+            }
+            if (!fCommitted) {
+                UndoKeypoolBatch(batch);
+                throw std::runtime_error(std::string(__func__) +
+                                         ": committing generated keys failed");
+            }
+            nMissing -= nBatch;
         }
-        m_pool_key_to_index[pubkey.GetID()] = index;
     }
     if (missingInternal + missingExternal > 0) {
         LogPrintf(
@@ -4257,7 +5569,16 @@ CWallet *CWallet::CreateWalletFromFile(const CChainParams &chainParams,
                   chainActive.Height() - pindexRescan->nHeight,
                   pindexRescan->nHeight);
         nStart = GetTimeMillis();
-        walletInstance->ScanForWalletTransactions(pindexRescan, true);
+        {
+            WalletRescanReserver reserver(walletInstance);
+            if (!reserver.reserve()) {
+                InitError(
+                    _("Failed to rescan the wallet during initialization"));
+                return nullptr;
+            }
+            walletInstance->ScanForWalletTransactions(pindexRescan, reserver,
+                                                      true);
+        }
         LogPrintf(" rescan      %15dms\n", GetTimeMillis() - nStart);
         walletInstance->SetBestChain(chainActive.GetLocator());
         walletInstance->dbw->IncrementUpdateCounter();
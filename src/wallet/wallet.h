@@ -7,6 +7,8 @@
 #define BITCOIN_WALLET_WALLET_H
 
 #include "amount.h"
+#include "blockfilter.h"
+#include "hash.h"
 #include "script/ismine.h"
 #include "script/sign.h"
 #include "streams.h"
@@ -23,10 +25,14 @@
 #include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -65,6 +71,23 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! Number of blocks read ahead of the one being scanned during a rescan
+static const size_t WALLET_RESCAN_READ_AHEAD = 32;
+//! Maximum size of the blocks read ahead of the one being scanned during a
+//! rescan
+static const size_t WALLET_RESCAN_READ_AHEAD_BYTES = 64 * 1024 * 1024;
+//! Maximum number of threads reading blocks ahead during a rescan
+static const int MAX_WALLET_RESCAN_THREADS = 4;
+//! Number of keys written in one database transaction by TopUpKeyPool
+static const int64_t KEYPOOL_TOPUP_BATCH_SIZE = 1000;
+//! Maximum number of threads generating keys for the keypool
+static const int MAX_KEYPOOL_THREADS = 8;
+//! Maximum number of steps of the branch and bound search for coins needing no
+//! change
+static const size_t BNB_MAX_TRIES = 100000;
+//! Maximum number of coins added up by the stochastic coin selection, over all
+//! its iterations
+static const size_t KNAPSACK_MAX_STEPS = 10000000;
 
 extern const char *DEFAULT_WALLET_DAT;
 
@@ -585,24 +608,111 @@ private:
     std::vector<char> _ssExtra;
 };
 
+/**
+ * Keys, scripts and watch-only scripts of a wallet, copied so that scripts can
+ * be matched against them without holding any lock. Anything IsMine considers
+ * ours matches, but a match does not imply the script is ours.
+ */
+class CWalletScriptFilter {
+public:
+    std::set<CKeyID> setKeyIDs;
+    std::set<CScriptID> setScriptIDs;
+    WatchOnlySet setWatchOnly;
+    /**
+     * The scriptPubKeys the wallet's keys and scripts are paid to, to match
+     * block filters against: P2PK and P2PKH scripts of the keys, P2SH scripts
+     * and redeem scripts, and watch-only scripts. Unlike Matches, bare
+     * multisig scripts paying to the keys are not included, unless they are
+     * redeem scripts or watch-only scripts, so rescans do not skip blocks for
+     * wallets that have bare multisig outputs.
+     */
+    GCSFilter::ElementSet setElements;
+
+    bool Matches(const CScript &scriptPubKey) const;
+    bool MatchesAnyOutput(const CTransaction &tx) const;
+};
+
+class SaltedScriptHasher {
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedScriptHasher();
+
+    size_t operator()(const CScript &script) const {
+        return CSipHasher(k0, k1)
+            .Write(script.data(), script.size())
+            .Finalize();
+    }
+};
+
+/** Balances of a wallet, by confirmation state. */
+struct CWalletBalances {
+    //! Trusted: confirmed, or unconfirmed and sent by us
+    Amount nTrusted;
+    //! Untrusted but in the mempool
+    Amount nUntrustedPending;
+    //! Coinbases in the main chain that have not matured yet
+    Amount nImmature;
+    Amount nWatchOnlyTrusted;
+    Amount nWatchOnlyUntrustedPending;
+    Amount nWatchOnlyImmature;
+
+    bool IsNull() const {
+        return nTrusted == Amount(0) && nUntrustedPending == Amount(0) &&
+               nImmature == Amount(0) && nWatchOnlyTrusted == Amount(0) &&
+               nWatchOnlyUntrustedPending == Amount(0) &&
+               nWatchOnlyImmature == Amount(0);
+    }
+
+    CWalletBalances &operator+=(const CWalletBalances &b) {
+        nTrusted += b.nTrusted;
+        nUntrustedPending += b.nUntrustedPending;
+        nImmature += b.nImmature;
+        nWatchOnlyTrusted += b.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending += b.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature += b.nWatchOnlyImmature;
+        return *this;
+    }
+
+    CWalletBalances &operator-=(const CWalletBalances &b) {
+        nTrusted -= b.nTrusted;
+        nUntrustedPending -= b.nUntrustedPending;
+        nImmature -= b.nImmature;
+        nWatchOnlyTrusted -= b.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending -= b.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature -= b.nWatchOnlyImmature;
+        return *this;
+    }
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of
  * transactions and balances, and provides the ability to create new
  * transactions.
  */
+class WalletRescanReserver;
+
 class CWallet final : public CCryptoKeyStore, public CValidationInterface {
 private:
     static std::atomic<bool> fFlushScheduled;
+    //! Set while a rescan is reserved by a WalletRescanReserver.
+    std::atomic<bool> fScanningWallet;
+    std::mutex mutexScanning;
+    friend class WalletRescanReserver;
 
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
      * all coins from coinControl are selected; Never select unconfirmed coins
-     * if they are not ours.
+     * if they are not ours. See SelectCoinsMinConf for nMaxExcess and
+     * nInputFee.
      */
     bool SelectCoins(
         const std::vector<COutput> &vAvailableCoins, const Amount nTargetValue,
         std::set<std::pair<const CWalletTx *, unsigned int>> &setCoinsRet,
-        Amount &nValueRet, const CCoinControl *coinControl = nullptr) const;
+        Amount &nValueRet, const Amount nMaxExcess, const Amount nInputFee,
+        const CCoinControl *coinControl = nullptr) const;
 
     CWalletDB *pwalletdbEncryption;
 
@@ -633,6 +743,108 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Outputs of wallet transactions that are ours and not spent by a wallet
+     * transaction that is neither abandoned nor conflicted. This is a superset
+     * of the wallet's unspent outputs, which AvailableCoins walks instead of
+     * the whole of mapWallet. It is kept up to date as transactions are added
+     * or change state, and rebuilt from scratch when fWalletUTXODirty is set,
+     * after keys or scripts are imported or removed, or transactions are
+     * removed. Guarded by cs_wallet.
+     */
+    mutable std::set<COutPoint> setWalletUTXO;
+    mutable bool fWalletUTXODirty;
+    bool IsWalletUTXO(const CWalletTx &wtx, unsigned int n) const;
+    void SyncWalletUTXO(const COutPoint &outpoint);
+    void SyncWalletUTXO(const CWalletTx &wtx);
+    const std::set<COutPoint> &GetWalletUTXO() const;
+
+    /**
+     * Outputs of wallet transactions that we cannot spend, by scriptPubKey,
+     * so that a key generated by the wallet only brings the outputs paying to
+     * its scripts, and the balances of the transactions paying to or spending
+     * them, up to date. Outputs that became ours since they were listed
+     * may still be. It is rebuilt along with setWalletUTXO, and kept up to
+     * date as transactions are added. Guarded by cs_wallet.
+     */
+    mutable std::unordered_map<CScript, std::vector<COutPoint>,
+                               SaltedScriptHasher>
+        mapForeignOutputs;
+    void AddToForeignOutputs(const CWalletTx &wtx) const;
+    void SyncForeignOutputs(const std::vector<CScript> &vScripts);
+
+    /**
+     * Running totals of the balances, which are the sum of the balances of
+     * the transactions in mapBalancesCounted. Transactions are counted again
+     * when they are in setBalancesRecount: the ones that were added or changed
+     * state, and the ones whose balances may change as blocks are connected
+     * or the mempool changes, that is unconfirmed transactions and immature
+     * coinbases. Everything is counted again when fBalancesDirty is set, after
+     * loading, importing, zapping or a block is disconnected.
+     */
+    mutable CWalletBalances balancesCounted;
+    mutable std::map<uint256, CWalletBalances> mapBalancesCounted;
+    mutable std::set<uint256> setBalancesRecount;
+    mutable bool fBalancesDirty;
+    bool CountBalances(const uint256 &txid) const;
+    void MarkBalancesDirty(const uint256 &txid);
+    void MarkBalancesDirty(const CWalletTx &wtx);
+
+    /**
+     * Wallet transactions by the block they are confirmed in, and under the
+     * null hash the ones that are not confirmed in any block: unconfirmed,
+     * abandoned and conflicted transactions. GetTransactionsSince looks up
+     * the blocks instead of walking mapWallet. The index is kept up to date as
+     * transactions are added or change state, and rebuilt from scratch when
+     * fTxsByBlockDirty is set, after loading or removing transactions.
+     */
+    mutable std::map<uint256, std::set<uint256>> mapTxsByBlock;
+    mutable bool fTxsByBlockDirty;
+    /**
+     * The blocks of mapTxsByBlock by height, so that GetTransactionsSince only
+     * visits the blocks above the one it is given. Heights are looked up with
+     * cs_main held, which is not the case when transactions are added: blocks
+     * are queued in setTxsBlocksUnsorted until the next lookup, and blocks
+     * which are not in mapBlockIndex stay there. Blocks no longer in
+     * mapTxsByBlock are dropped as they are visited.
+     */
+    mutable std::map<int, std::set<uint256>> mapTxsBlocksByHeight;
+    mutable std::set<uint256> setTxsBlocksUnsorted;
+    /**
+     * The blocks of mapTxsByBlock which were disconnected from the active
+     * chain. Their transactions are unconfirmed whatever their height, so they
+     * are visited on every lookup until they are connected again.
+     */
+    mutable std::set<uint256> setTxsBlocksDisconnected;
+    void AddToTxsByBlock(const CWalletTx &wtx) const;
+    void RemoveFromTxsByBlock(const CWalletTx &wtx);
+
+    /**
+     * The scriptPubKeys that are ours, with what IsMine returns for them, so
+     * that IsMine(const CTxOut &) is a single hash lookup. They are the P2PK
+     * and P2PKH scripts of the keys, keypool included, the P2SH scripts and
+     * redeem scripts, and the watch-only scripts. Scripts that are not in the
+     * standard form of their type, like bare multisig scripts, which are ours
+     * only when we have all of their keys, or P2PKH scripts with non-minimal
+     * pushes, are not listed and are checked by ::IsMine. New keys are added
+     * as they are generated or imported, and the redeem scripts and
+     * watch-only scripts that reference them, found in mapKeyScripts, are
+     * evaluated again with them. Both maps are rebuilt from scratch when
+     * fMineScriptsDirty is set, after scripts or watch-only scripts change.
+     * Guarded by cs_KeyStore.
+     */
+    mutable std::unordered_map<CScript, isminetype, SaltedScriptHasher>
+        mapMineScripts;
+    mutable std::map<CKeyID, std::vector<CScript>> mapKeyScripts;
+    mutable bool fMineScriptsDirty;
+    void BuildMineScripts() const;
+    /** Returns the scripts that a new key may have made ours. */
+    std::vector<CScript> AddMineScripts(const CPubKey &pubkey);
+    void MarkMineScriptsDirty();
+    /** Call f on each scriptPubKey that may be ours, but bare multisig. */
+    void ForEachWalletScript(
+        const std::function<void(const CScript &)> &f) const;
+
     /**
      * Used by TransactionAddedToMemorypool/BlockConnected/Disconnected.
      * Should be called with pindexBlock and posInBlock if this is for a
@@ -648,6 +860,28 @@ private:
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata &metadata,
                            CKey &secret, bool internal = false);
+    /* HD derive the key of the external (m/0'/0') or internal (m/0'/1')
+     * chain */
+    void DeriveChainKey(CExtKey &chainChildKey, bool internal);
+    /**
+     * The in-memory state a keypool top-up batch changes, so that it can be
+     * restored by UndoKeypoolBatch when the batch's database transaction is
+     * not committed.
+     */
+    struct KeypoolBatch {
+        CHDChain hdChain;
+        int64_t nMaxKeypoolIndex;
+        std::vector<CPubKey> vKeys;
+        std::vector<CScript> vWatchOnlyRemoved;
+    };
+    /**
+     * Generate nKeys new keys at once, as GenerateNewKey would one at a time,
+     * and append them to batch.vKeys as they are added. The keys are generated
+     * on several threads, and the HD chain counter is written once.
+     */
+    void GenerateNewKeys(CWalletDB &walletdb, bool internal, size_t nKeys,
+                         KeypoolBatch &batch);
+    void UndoKeypoolBatch(const KeypoolBatch &batch);
 
     std::set<int64_t> setInternalKeyPool;
     std::set<int64_t> setExternalKeyPool;
@@ -666,6 +900,8 @@ private:
      * intelligently for more efficient rescans.
      */
     bool AddWatchOnly(const CScript &dest) override;
+    bool AddWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest);
+    bool RemoveWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest);
 
     std::unique_ptr<CWalletDBWrapper> dbw;
 
@@ -738,6 +974,11 @@ public:
         m_max_keypool_index = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        fWalletUTXODirty = true;
+        fBalancesDirty = true;
+        fTxsByBlockDirty = true;
+        fMineScriptsDirty = true;
+        fScanningWallet = false;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -776,12 +1017,18 @@ public:
      * small change; This method is stochastic for some inputs and upon
      * completion the coin set and corresponding actual target value is
      * assembled.
+     *
+     * A set of coins exceeding nTargetValue by at most nMaxExcess, which
+     * needs no change output, is looked for first by a bounded branch and
+     * bound search. It minimises the excess plus nInputFee per coin, the fee
+     * each input costs.
      */
     bool SelectCoinsMinConf(
         const Amount nTargetValue, int nConfMine, int nConfTheirs,
         uint64_t nMaxAncestors, std::vector<COutput> vCoins,
         std::set<std::pair<const CWalletTx *, unsigned int>> &setCoinsRet,
-        Amount &nValueRet) const;
+        Amount &nValueRet, const Amount nMaxExcess = Amount(0),
+        const Amount nInputFee = Amount(0)) const;
 
     bool IsSpent(const uint256 &hash, unsigned int n) const;
 
@@ -800,8 +1047,29 @@ public:
     bool AddKeyPubKey(const CKey &key, const CPubKey &pubkey) override;
     bool AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey &key,
                             const CPubKey &pubkey);
+    //! Adds a key from outside the wallet, which outputs already in the
+    //! wallet may pay to, and saves it through walletdb.
+    bool AddImportedKeyWithDB(CWalletDB &walletdb, const CKey &key,
+                              const CPubKey &pubkey);
+    /**
+     * The in-memory state an import written in one database transaction
+     * changes, so that it can be restored by UndoImportBatch when the
+     * transaction is aborted or not committed.
+     */
+    struct ImportBatch {
+        std::vector<CPubKey> vKeys;
+        std::vector<CScript> vScripts;
+        std::vector<CScript> vWatchOnly;
+        std::vector<CScript> vWatchOnlyRemoved;
+        //! Address book entries as they were, or null if they were not there.
+        std::vector<
+            std::pair<CTxDestination, std::shared_ptr<CAddressBookData>>>
+            vAddressBook;
+    };
+    void UndoImportBatch(const ImportBatch &batch);
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
     bool LoadKey(const CKey &key, const CPubKey &pubkey) {
+        MarkMineScriptsDirty();
         return CCryptoKeyStore::AddKeyPubKey(key, pubkey);
     }
 
@@ -825,6 +1093,7 @@ public:
     bool LoadCryptedKey(const CPubKey &vchPubKey,
                         const std::vector<uint8_t> &vchCryptedSecret);
     bool AddCScript(const CScript &redeemScript) override;
+    bool AddCScriptWithDB(CWalletDB &walletdb, const CScript &redeemScript);
     bool LoadCScript(const CScript &redeemScript);
 
     //! Adds a destination data tuple to the store, and saves it to disk
@@ -842,6 +1111,8 @@ public:
 
     //! Adds a watch-only address to the store, and saves it to disk.
     bool AddWatchOnly(const CScript &dest, int64_t nCreateTime);
+    bool AddWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest,
+                            int64_t nCreateTime);
     bool RemoveWatchOnly(const CScript &dest) override;
     //! Adds a watch-only address to the store, without saving it to disk (used
     //! by LoadWallet)
@@ -884,8 +1155,11 @@ public:
     bool AddToWalletIfInvolvingMe(const CTransactionRef &tx,
                                   const CBlockIndex *pIndex, int posInBlock,
                                   bool fUpdate);
-    CBlockIndex *ScanForWalletTransactions(CBlockIndex *pindexStart,
-                                           bool fUpdate = false);
+    void GetScriptFilter(CWalletScriptFilter &filter) const;
+    CBlockIndex *
+    ScanForWalletTransactions(CBlockIndex *pindexStart,
+                              const WalletRescanReserver &reserver,
+                              bool fUpdate = false);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime,
                                   CConnman *connman) override;
@@ -893,6 +1167,14 @@ public:
     // fBroadcastTransactions!
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime,
                                                         CConnman *connman);
+    /**
+     * The transactions that are not confirmed in pindex or one of its
+     * ancestors, or all of them if pindex is null: the ones listsinceblock
+     * lists.
+     */
+    std::vector<const CWalletTx *>
+    GetTransactionsSince(const CBlockIndex *pindex) const;
+    CWalletBalances GetBalances() const;
     Amount GetBalance() const;
     Amount GetUnconfirmedBalance() const;
     Amount GetImmatureBalance() const;
@@ -1011,6 +1293,10 @@ public:
 
     bool SetAddressBook(const CTxDestination &address,
                         const std::string &strName, const std::string &purpose);
+    bool SetAddressBookWithDB(CWalletDB &walletdb,
+                              const CTxDestination &address,
+                              const std::string &strName,
+                              const std::string &purpose);
 
     bool DelAddressBook(const CTxDestination &address);
 
@@ -1193,6 +1479,42 @@ public:
     }
 };
 
+/**
+ * RAII object reserving the wallet for a rescan, so that no two rescans of a
+ * wallet run at once now that they do not hold cs_wallet throughout.
+ */
+class WalletRescanReserver {
+private:
+    CWallet *const m_wallet;
+    bool m_could_reserve;
+
+public:
+    explicit WalletRescanReserver(CWallet *w)
+        : m_wallet(w), m_could_reserve(false) {}
+
+    bool reserve() {
+        assert(!m_could_reserve);
+        std::lock_guard<std::mutex> lock(m_wallet->mutexScanning);
+        if (m_wallet->fScanningWallet) {
+            return false;
+        }
+        m_wallet->fScanningWallet = true;
+        m_could_reserve = true;
+        return true;
+    }
+
+    bool isReserved() const {
+        return m_could_reserve && m_wallet->fScanningWallet;
+    }
+
+    ~WalletRescanReserver() {
+        std::lock_guard<std::mutex> lock(m_wallet->mutexScanning);
+        if (m_could_reserve) {
+            m_wallet->fScanningWallet = false;
+        }
+    }
+};
+
 // Helper for producing a bunch of max-sized low-S signatures (eg 72 bytes)
 // ContainerType is meant to hold pair<CWalletTx *, int>, and be iterable so
 // that each entry corresponds to each vIn, in order.
@@ -21,7 +21,11 @@
 #include <boost/thread.hpp>
 #include <boost/version.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 //
 // CWalletDB
@@ -264,6 +268,8 @@ public:
     bool fAnyUnordered;
     int nFileVersion;
     std::vector<uint256> vWalletUpgrade;
+    //! The accounting entries, in the order of the database.
+    std::list<CAccountingEntry> laccentries;
 
     CWalletScanState() {
         nKeys = nCKeys = nWatchKeys = nKeyMeta = 0;
@@ -273,32 +279,49 @@ public:
     }
 };
 
-bool ReadKeyValue(CWallet *pwallet, CDataStream &ssKey, CDataStream &ssValue,
-                  CWalletScanState &wss, std::string &strType,
-                  std::string &strErr) {
+/**
+ * A record read from the wallet database. The records that are expensive to
+ * decode, transactions and unencrypted keys, are decoded and checked by
+ * DecodeRecord, which does not touch the wallet and may run on any thread,
+ * before LoadRecord loads them into the wallet.
+ */
+class CWalletRecord {
+public:
+    CDataStream ssKey;
+    CDataStream ssValue;
+    std::string strType;
+    std::string strErr;
+    //! Whether DecodeRecord succeeded.
+    bool fDecoded;
+
+    // "tx" records
+    uint256 hash;
+    CWalletTx wtx;
+    bool fUpgraded;
+
+    // "key" and "wkey" records
+    CPubKey vchPubKey;
+    CKey key;
+
+    CWalletRecord()
+        : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION),
+          fDecoded(false), fUpgraded(false) {}
+};
+
+static bool DecodeRecord(CWalletRecord &rec) {
+    CDataStream &ssKey = rec.ssKey;
+    CDataStream &ssValue = rec.ssValue;
+    const std::string &strType = rec.strType;
+    std::string &strErr = rec.strErr;
     try {
         // Unserialize
         // Taking advantage of the fact that pair serialization is just the two
         // items serialized one after the other.
-        ssKey >> strType;
-        if (strType == "name") {
-            std::string strAddress;
-            ssKey >> strAddress;
-            ssValue >> pwallet
-                           ->mapAddressBook[DecodeDestination(
-                               strAddress, pwallet->chainParams)]
-                           .name;
-        } else if (strType == "purpose") {
-            std::string strAddress;
-            ssKey >> strAddress;
-            ssValue >> pwallet
-                           ->mapAddressBook[DecodeDestination(
-                               strAddress, pwallet->chainParams)]
-                           .purpose;
-        } else if (strType == "tx") {
-            uint256 hash;
+        ssKey >> rec.strType;
+        if (strType == "tx") {
+            uint256 &hash = rec.hash;
             ssKey >> hash;
-            CWalletTx wtx;
+            CWalletTx &wtx = rec.wtx;
             ssValue >> wtx;
             CValidationState state;
             bool isValid = wtx.IsCoinBase()
@@ -326,52 +349,19 @@ bool ReadKeyValue(CWallet *pwallet, CDataStream &ssKey, CDataStream &ssValue,
                                   wtx.fTimeReceivedIsTxTime, hash.ToString());
                     wtx.fTimeReceivedIsTxTime = 0;
                 }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1) {
-                wss.fAnyUnordered = true;
-            }
-
-            pwallet->LoadToWallet(wtx);
-        } else if (strType == "acentry") {
-            std::string strAccount;
-            ssKey >> strAccount;
-            uint64_t nNumber;
-            ssKey >> nNumber;
-            if (nNumber > pwallet->nAccountingEntryNumber) {
-                pwallet->nAccountingEntryNumber = nNumber;
-            }
-
-            if (!wss.fAnyUnordered) {
-                CAccountingEntry acentry;
-                ssValue >> acentry;
-                if (acentry.nOrderPos == -1) {
-                    wss.fAnyUnordered = true;
-                }
-            }
-        } else if (strType == "watchs") {
-            wss.nWatchKeys++;
-            CScript script;
-            ssKey >> script;
-            char fYes;
-            ssValue >> fYes;
-            if (fYes == '1') {
-                pwallet->LoadWatchOnly(script);
+                rec.fUpgraded = true;
             }
         } else if (strType == "key" || strType == "wkey") {
-            CPubKey vchPubKey;
+            CPubKey &vchPubKey = rec.vchPubKey;
             ssKey >> vchPubKey;
             if (!vchPubKey.IsValid()) {
                 strErr = "Error reading wallet database: CPubKey corrupt";
                 return false;
             }
-            CKey key;
             CPrivKey pkey;
             uint256 hash;
 
             if (strType == "key") {
-                wss.nKeys++;
                 ssValue >> pkey;
             } else {
                 CWalletKey wkey;
@@ -408,11 +398,79 @@ bool ReadKeyValue(CWallet *pwallet, CDataStream &ssKey, CDataStream &ssValue,
                 fSkipCheck = true;
             }
 
-            if (!key.Load(pkey, vchPubKey, fSkipCheck)) {
+            if (!rec.key.Load(pkey, vchPubKey, fSkipCheck)) {
                 strErr = "Error reading wallet database: CPrivKey corrupt";
                 return false;
             }
-            if (!pwallet->LoadKey(key, vchPubKey)) {
+        }
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+static bool LoadRecord(CWallet *pwallet, CWalletRecord &rec,
+                       CWalletScanState &wss) {
+    CDataStream &ssKey = rec.ssKey;
+    CDataStream &ssValue = rec.ssValue;
+    const std::string &strType = rec.strType;
+    std::string &strErr = rec.strErr;
+    try {
+        if (strType == "name") {
+            std::string strAddress;
+            ssKey >> strAddress;
+            ssValue >> pwallet
+                           ->mapAddressBook[DecodeDestination(
+                               strAddress, pwallet->chainParams)]
+                           .name;
+        } else if (strType == "purpose") {
+            std::string strAddress;
+            ssKey >> strAddress;
+            ssValue >> pwallet
+                           ->mapAddressBook[DecodeDestination(
+                               strAddress, pwallet->chainParams)]
+                           .purpose;
+        } else if (strType == "tx") {
+            if (rec.fUpgraded) {
+                wss.vWalletUpgrade.push_back(rec.hash);
+            }
+
+            if (rec.wtx.nOrderPos == -1) {
+                wss.fAnyUnordered = true;
+            }
+
+            pwallet->LoadToWallet(rec.wtx);
+        } else if (strType == "acentry") {
+            std::string strAccount;
+            ssKey >> strAccount;
+            uint64_t nNumber;
+            ssKey >> nNumber;
+            if (nNumber > pwallet->nAccountingEntryNumber) {
+                pwallet->nAccountingEntryNumber = nNumber;
+            }
+
+            CAccountingEntry acentry;
+            ssValue >> acentry;
+            acentry.strAccount = strAccount;
+            acentry.nEntryNo = nNumber;
+            if (acentry.nOrderPos == -1) {
+                wss.fAnyUnordered = true;
+            }
+            wss.laccentries.push_back(acentry);
+        } else if (strType == "watchs") {
+            wss.nWatchKeys++;
+            CScript script;
+            ssKey >> script;
+            char fYes;
+            ssValue >> fYes;
+            if (fYes == '1') {
+                pwallet->LoadWatchOnly(script);
+            }
+        } else if (strType == "key" || strType == "wkey") {
+            if (strType == "key") {
+                wss.nKeys++;
+            }
+            if (!pwallet->LoadKey(rec.key, rec.vchPubKey)) {
                 strErr = "Error reading wallet database: LoadKey failed";
                 return false;
             }
@@ -522,6 +580,104 @@ bool ReadKeyValue(CWallet *pwallet, CDataStream &ssKey, CDataStream &ssValue,
     return true;
 }
 
+bool ReadKeyValue(CWallet *pwallet, CDataStream &ssKey, CDataStream &ssValue,
+                  CWalletScanState &wss, std::string &strType,
+                  std::string &strErr) {
+    CWalletRecord rec;
+    rec.ssKey = ssKey;
+    rec.ssValue = ssValue;
+    bool fRead = DecodeRecord(rec) && LoadRecord(pwallet, rec, wss);
+    strType = rec.strType;
+    strErr = rec.strErr;
+    return fRead;
+}
+
+/**
+ * Decodes batches of records on a few threads, while the caller goes on
+ * reading the database. The threads are started once and wait for the next
+ * batch in between.
+ */
+class CWalletRecordDecoder {
+public:
+    CWalletRecordDecoder()
+        : pRecords(nullptr), nNext(0), nBatch(0), nBusy(0), fStop(false) {
+        int nThreads =
+            std::max(1, std::min(GetNumCores(), MAX_WALLET_LOAD_THREADS));
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back(&CWalletRecordDecoder::ThreadDecode, this);
+        }
+    }
+
+    ~CWalletRecordDecoder() {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+        }
+        condBatch.notify_all();
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * Start decoding vRecordsIn, which must not be touched until Wait
+     * returns.
+     */
+    void Decode(std::vector<CWalletRecord> &vRecordsIn) {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            pRecords = &vRecordsIn;
+            nNext = 0;
+            nBatch++;
+            nBusy = threads.size();
+        }
+        condBatch.notify_all();
+    }
+
+    /** Wait until every thread is done with the current batch. */
+    void Wait() {
+        std::unique_lock<std::mutex> lock(cs);
+        condDone.wait(lock, [this] { return nBusy == 0; });
+    }
+
+private:
+    std::mutex cs;
+    std::condition_variable condBatch;
+    std::condition_variable condDone;
+    std::vector<CWalletRecord> *pRecords;
+    std::atomic<size_t> nNext;
+    //! The number of batches started, so that each thread takes part in each
+    //! batch once.
+    uint64_t nBatch;
+    //! The number of threads which are not done with the current batch yet.
+    size_t nBusy;
+    bool fStop;
+    std::vector<std::thread> threads;
+
+    void ThreadDecode() {
+        uint64_t nDone = 0;
+        std::unique_lock<std::mutex> lock(cs);
+        while (true) {
+            condBatch.wait(lock, [&] { return fStop || nBatch != nDone; });
+            if (fStop) {
+                return;
+            }
+
+            nDone = nBatch;
+            std::vector<CWalletRecord> &vRecords = *pRecords;
+            lock.unlock();
+            for (size_t i = nNext++; i < vRecords.size(); i = nNext++) {
+                vRecords[i].fDecoded = DecodeRecord(vRecords[i]);
+            }
+            lock.lock();
+
+            if (--nBusy == 0) {
+                condDone.notify_all();
+            }
+        }
+    }
+};
+
 bool CWalletDB::IsKeyType(const std::string &strType) {
     return (strType == "key" || strType == "wkey" || strType == "mkey" ||
             strType == "ckey");
@@ -531,6 +687,8 @@ DBErrors CWalletDB::LoadWallet(CWallet *pwallet) {
     CWalletScanState wss;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
+    int64_t nTimeStart = GetTimeMillis();
+    size_t nRecords = 0;
 
     LOCK(pwallet->cs_wallet);
     try {
@@ -549,41 +707,68 @@ DBErrors CWalletDB::LoadWallet(CWallet *pwallet) {
             return DB_CORRUPT;
         }
 
-        while (true) {
-            // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = batch.ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND) {
-                break;
+        // Records are read in batches. Each batch is decoded on other threads
+        // while the next one is read, and is then loaded into the wallet in
+        // the order of the database.
+        bool fEnd = false;
+        auto ReadBatch = [&](std::vector<CWalletRecord> &vBatch) {
+            vBatch.clear();
+            while (!fEnd && vBatch.size() < WALLET_LOAD_BATCH_SIZE) {
+                vBatch.emplace_back();
+                CWalletRecord &rec = vBatch.back();
+                int ret = batch.ReadAtCursor(pcursor, rec.ssKey, rec.ssValue);
+                if (ret == DB_NOTFOUND) {
+                    vBatch.pop_back();
+                    fEnd = true;
+                } else if (ret != 0) {
+                    LogPrintf(
+                        "Error reading next record from wallet database\n");
+                    return false;
+                }
             }
+            return true;
+        };
 
-            if (ret != 0) {
-                LogPrintf("Error reading next record from wallet database\n");
+        std::vector<CWalletRecord> vRecords;
+        std::vector<CWalletRecord> vNextRecords;
+        if (!ReadBatch(vRecords)) {
+            return DB_CORRUPT;
+        }
+        // Destroyed first, as it may still be decoding vRecords.
+        CWalletRecordDecoder decoder;
+        while (!vRecords.empty()) {
+            decoder.Decode(vRecords);
+            bool fReadNext = ReadBatch(vNextRecords);
+            decoder.Wait();
+            if (!fReadNext) {
                 return DB_CORRUPT;
             }
 
-            // Try to be tolerant of single corrupt records:
-            std::string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr)) {
-                // losing keys is considered a catastrophic error, anything else
-                // we assume the user can live with:
-                if (IsKeyType(strType) || strType == "defaultkey") {
-                    result = DB_CORRUPT;
-                } else {
-                    // Leave other errors alone, if we try to fix them we might
-                    // make things worse. But do warn the user there is
-                    // something wrong.
-                    fNoncriticalErrors = true;
-                    if (strType == "tx") {
-                        // Rescan if there is a bad transaction record:
-                        gArgs.SoftSetBoolArg("-rescan", true);
+            for (CWalletRecord &rec : vRecords) {
+                const std::string &strType = rec.strType;
+                // Try to be tolerant of single corrupt records:
+                if (!rec.fDecoded || !LoadRecord(pwallet, rec, wss)) {
+                    // losing keys is considered a catastrophic error, anything
+                    // else we assume the user can live with:
+                    if (IsKeyType(strType) || strType == "defaultkey") {
+                        result = DB_CORRUPT;
+                    } else {
+                        // Leave other errors alone, if we try to fix them we
+                        // might make things worse. But do warn the user there
+                        // is something wrong.
+                        fNoncriticalErrors = true;
+                        if (strType == "tx") {
+                            // Rescan if there is a bad transaction record:
+                            gArgs.SoftSetBoolArg("-rescan", true);
+                        }
                     }
                 }
+                if (!rec.strErr.empty()) {
+                    LogPrintf("%s\n", rec.strErr);
+                }
             }
-            if (!strErr.empty()) {
-                LogPrintf("%s\n", strErr);
-            }
+            nRecords += vRecords.size();
+            std::swap(vRecords, vNextRecords);
         }
         pcursor->close();
     } catch (const boost::thread_interrupted &) {
@@ -602,6 +787,7 @@ DBErrors CWalletDB::LoadWallet(CWallet *pwallet) {
         return result;
     }
 
+    int64_t nTimeRecords = GetTimeMillis();
     LogPrintf("nFileVersion = %d\n", wss.nFileVersion);
 
     LogPrintf("Keys: %u plaintext, %u encrypted, %u w/ metadata, %u total\n",
@@ -627,17 +813,26 @@ DBErrors CWalletDB::LoadWallet(CWallet *pwallet) {
         WriteVersion(CLIENT_VERSION);
     }
 
+    int64_t nTimeUpgrade = GetTimeMillis();
     if (wss.fAnyUnordered) {
         result = pwallet->ReorderTransactions();
+        // Reordering rewrites the accounting entries: read them again.
+        wss.laccentries.clear();
+        ListAccountCreditDebit("*", wss.laccentries);
     }
 
-    pwallet->laccentries.clear();
-    ListAccountCreditDebit("*", pwallet->laccentries);
+    int64_t nTimeReorder = GetTimeMillis();
+    pwallet->laccentries = std::move(wss.laccentries);
     for (CAccountingEntry &entry : pwallet->laccentries) {
         pwallet->wtxOrdered.insert(std::make_pair(
             entry.nOrderPos, CWallet::TxPair((CWalletTx *)0, &entry)));
     }
 
+    LogPrintf("Wallet load: %u records read and loaded in %dms, upgrades "
+              "%dms, reordering %dms, accounting entries %dms\n",
+              nRecords, nTimeRecords - nTimeStart, nTimeUpgrade - nTimeRecords,
+              nTimeReorder - nTimeUpgrade, GetTimeMillis() - nTimeReorder);
+
     return result;
 }
 
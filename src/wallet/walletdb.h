@@ -38,6 +38,10 @@
  */
 
 static const bool DEFAULT_FLUSHWALLET = true;
+//! Number of records read from the database at a time by LoadWallet
+static const size_t WALLET_LOAD_BATCH_SIZE = 1000;
+//! Maximum number of threads decoding records during LoadWallet
+static const int MAX_WALLET_LOAD_THREADS = 4;
 
 class CAccount;
 class CAccountingEntry;
@@ -270,6 +274,49 @@ private:
     void operator=(const CWalletDB &);
 };
 
+/**
+ * Groups the writes made through a CWalletDB into one database transaction,
+ * which is aborted unless Commit() is called. Committing once for a batch of
+ * records avoids committing each record on its own.
+ *
+ * If no transaction can be begun, as with a dummy database or when one is
+ * already in progress on the handle, the writes go through as they would
+ * without it.
+ */
+class CWalletDBTxn {
+public:
+    explicit CWalletDBTxn(CWalletDB &walletdbIn)
+        : walletdb(walletdbIn), fActive(walletdb.TxnBegin()) {}
+
+    ~CWalletDBTxn() {
+        if (fActive) {
+            walletdb.TxnAbort();
+        }
+    }
+
+    bool Commit() {
+        if (!fActive) {
+            return true;
+        }
+        fActive = false;
+        return walletdb.TxnCommit();
+    }
+
+    void Abort() {
+        if (fActive) {
+            fActive = false;
+            walletdb.TxnAbort();
+        }
+    }
+
+private:
+    CWalletDB &walletdb;
+    bool fActive;
+
+    CWalletDBTxn(const CWalletDBTxn &);
+    void operator=(const CWalletDBTxn &);
+};
+
 //! Compacts BDB state so that wallet.dat is self-contained (if there are
 //! changes)
 void MaybeCompactWalletDB();
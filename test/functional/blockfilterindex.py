@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test -blockfilterindex through RPC, including reorgs and wallet rescans
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+import time
+
+
+class BlockFilterIndexTest(BitcoinTestFramework):
+
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-blockfilterindex"], []]
+
+    def wait_for_filter(self, node, blockhash):
+        timeout = time.time() + 30
+        while True:
+            try:
+                return node.getblockfilter(blockhash)
+            except JSONRPCException:
+                assert time.time() < timeout
+                time.sleep(0.1)
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(101)
+        self.sync_all()
+
+        # The index is only available where it was enabled.
+        assert_raises_rpc_error(-1, "Block filter index not enabled",
+                                self.nodes[1].getblockfilter, "00" * 32)
+        assert_raises_rpc_error(-5, "Block not found",
+                                node.getblockfilter, "00" * 32)
+
+        # Filter headers chain up from the genesis block.
+        tip = node.getbestblockhash()
+        tipfilter = self.wait_for_filter(node, tip)
+        assert_equal(len(tipfilter["header"]), 64)
+        assert len(tipfilter["filter"]) > 2
+
+        # Blocks of a reorg get their own filters, and those of the blocks
+        # that were disconnected are still available.
+        node.invalidateblock(tip)
+        newtip = node.generate(1)[0]
+        newfilter = self.wait_for_filter(node, newtip)
+        assert newfilter["header"] != tipfilter["header"]
+        assert_equal(node.getblockfilter(tip), tipfilter)
+
+        # Rescanning with the filters finds the same transactions.
+        address = self.nodes[1].getnewaddress()
+        privkey = self.nodes[1].dumpprivkey(address)
+        node.sendtoaddress(address, 10)
+        node.generate(10)
+        self.wait_for_filter(node, node.getbestblockhash())
+        node.importprivkey(privkey)
+        assert_equal(node.getreceivedbyaddress(address), 10)
+
+
+if __name__ == '__main__':
+    BlockFilterIndexTest().main()
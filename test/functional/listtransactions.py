@@ -97,6 +97,27 @@ class ListTransactionsTest(BitcoinTestFramework):
             {"category": "receive", "amount": Decimal("0.1")},
             {"txid": txid, "account": "watchonly"})
 
+        # Paging with a cursor lists the same entries as a single call.
+        everything = self.nodes[0].listtransactions("*", 1000, 0, True)
+        pages = []
+        page = self.nodes[0].listtransactions("*", 3, 0, True, "")
+        while "cursor" in page:
+            pages.insert(0, page["transactions"])
+            page = self.nodes[0].listtransactions(
+                "*", 3, 0, True, page["cursor"])
+        pages.insert(0, page["transactions"])
+        assert_equal(sum(pages, []), everything)
+        assert_equal(
+            self.nodes[0].listtransactions("*", 2, 1, True, "")[
+                "transactions"],
+            everything[-3:-1])
+        assert_raises_rpc_error(-8, "Invalid cursor",
+                                self.nodes[0].listtransactions, "*", 3, 0,
+                                True, "cursor")
+        assert_raises_rpc_error(-8, "Count must be positive with a cursor",
+                                self.nodes[0].listtransactions, "*", 0, 0,
+                                True, "")
+
 
 if __name__ == '__main__':
     ListTransactionsTest().main()
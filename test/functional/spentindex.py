@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test -spentindex through RPC and REST, including rollback on reorg
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+import http.client
+import json
+import urllib.parse
+
+
+class SpentIndexTest(BitcoinTestFramework):
+
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-spentindex", "-rest"], []]
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(101)
+        self.sync_all()
+
+        # The index is only available where it was enabled.
+        assert_raises_rpc_error(-1, "Spent index not enabled",
+                                self.nodes[1].getspentinfo, "00" * 32, 0)
+
+        txid = node.sendtoaddress(node.getnewaddress(), 10)
+        tx = node.getrawtransaction(txid, 1)
+        prevout = tx["vin"][0]
+
+        # Not spent in a block yet.
+        assert_raises_rpc_error(-5, "Unable to get spent info",
+                                node.getspentinfo, prevout["txid"],
+                                prevout["vout"])
+
+        blockhash = node.generate(1)[0]
+        self.sync_all()
+        height = node.getblockcount()
+
+        info = node.getspentinfo(prevout["txid"], prevout["vout"])
+        assert_equal(info, {"txid": txid, "index": 0, "height": height})
+
+        url = urllib.parse.urlparse(node.url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request("GET", "/rest/spentinfo/%s-%d.json" %
+                     (prevout["txid"], prevout["vout"]))
+        assert_equal(json.loads(conn.getresponse().read().decode("utf-8")),
+                     info)
+
+        # Disconnecting the block erases the entries again.
+        node.invalidateblock(blockhash)
+        assert_raises_rpc_error(-5, "Unable to get spent info",
+                                node.getspentinfo, prevout["txid"],
+                                prevout["vout"])
+
+        node.reconsiderblock(blockhash)
+        assert_equal(node.getspentinfo(
+            prevout["txid"], prevout["vout"]), info)
+
+
+if __name__ == '__main__':
+    SpentIndexTest().main()